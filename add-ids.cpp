@@ -23,6 +23,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "htn_task_head.hpp"
 #include "htn_method.hpp"
@@ -1,5 +1,7 @@
 #include <vector>
 #include <string>
+#include <sstream>
+#include <cstdlib>
 #include <cassert>
 #include <set>
 #include <tr1/memory>
@@ -19,6 +21,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_domain.hpp"
 #include "strips_problem.hpp"
@@ -275,9 +279,9 @@ void AnnotatedPlan::AddMethodInst( const HtnMethod * p_pMethod,
     TermP l_pConst = l_iIter->second;
     TermVariableP l_pNewTerm;
     if( l_pOld->HasTyping() )
-      l_pNewTerm = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeOldId(), l_pOld->GetTyping() ) );
+      l_pNewTerm = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeOldId(), l_pOld->GetTyping() ) );
     else
-      l_pNewTerm = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeOldId() ) );
+      l_pNewTerm = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeOldId() ) );
     l_ChangeOfVars.AddPair( l_pOld, l_pNewTerm );
     l_pNewSub->AddPair( l_pNewTerm, l_pConst );
   }
@@ -291,3 +295,232 @@ void AnnotatedPlan::AddMethodInst( const HtnMethod * p_pMethod,
   m_vMethodCosts.push_back( p_fMethodCost );
 }
 
+
+/**
+ *  Retrieve every variable that appears in one of the method instantiations,
+ *   each only once, in order of first appearance.
+ *  \param p_iIndex IN The 0-based index of the method instantiation.
+ *  \return The variables of its method, substitution, task, and effects.
+ */
+std::vector< TermVariableP > AnnotatedPlan::GetInstVariables( unsigned int p_iIndex ) const
+{
+  std::vector< TermVariableP > l_vAll = m_vMethods[p_iIndex]->GetVariables();
+  for( SubMap::const_iterator i = m_vMethodSubs[p_iIndex]->Begin();
+       i != m_vMethodSubs[p_iIndex]->End();
+       i++ )
+    l_vAll.push_back( i->first );
+  std::vector< TermVariableP > l_vTemp = m_vTaskDescrs[p_iIndex]->GetCHead()->GetVariables();
+  l_vAll.insert( l_vAll.end(), l_vTemp.begin(), l_vTemp.end() );
+  l_vTemp = m_vTaskDescrs[p_iIndex]->GetCPreconditions()->GetVariables();
+  l_vAll.insert( l_vAll.end(), l_vTemp.begin(), l_vTemp.end() );
+  l_vTemp = m_vTaskDescrs[p_iIndex]->GetCEffects()->GetVariables();
+  l_vAll.insert( l_vAll.end(), l_vTemp.begin(), l_vTemp.end() );
+  l_vTemp = m_vMethodEffects[p_iIndex]->GetVariables();
+  l_vAll.insert( l_vAll.end(), l_vTemp.begin(), l_vTemp.end() );
+
+  std::vector< TermVariableP > l_vRet;
+  for( unsigned int i = 0; i < l_vAll.size(); i++ )
+  {
+    bool l_bFound = false;
+    for( unsigned int j = 0; j < l_vRet.size() && !l_bFound; j++ )
+    {
+      if( l_vRet[j] == l_vAll[i] )
+	l_bFound = true;
+    }
+    if( !l_bFound )
+      l_vRet.push_back( l_vAll[i] );
+  }
+  return l_vRet;
+}
+
+/**
+ *  Retrieve a PDDL-like representation of the method instantiations that have
+ *   been added to this plan, so that learning from it may be resumed later.
+ *  The variables are renamed "?saved_[number]" so that they cannot clash with
+ *   those of the process that reads them back.
+ *  \param p_iRequirements IN The requirements of the domain of the methods.
+ *  \return A representation that MethodInstsFromPddl() can read.
+ */
+std::string AnnotatedPlan::MethodInstsToPddl( long p_iRequirements ) const
+{
+  std::stringstream l_sRet;
+  l_sRet.precision( 17 );
+  unsigned int l_iNextSaved = 0;
+
+  l_sRet << "(\n";
+  for( unsigned int i = 0; i < m_vMethods.size(); i++ )
+  {
+    std::vector< TermVariableP > l_vVars = GetInstVariables( i );
+    Substitution l_Rename;
+    for( unsigned int j = 0; j < l_vVars.size(); j++ )
+    {
+      std::stringstream l_sName;
+      l_sName << "?saved_" << l_iNextSaved++;
+      if( l_vVars[j]->HasTyping() )
+	l_Rename.AddPair( l_vVars[j], g_TermTable.LookupTemp( l_sName.str(), l_vVars[j]->GetTyping() ) );
+      else
+	l_Rename.AddPair( l_vVars[j], g_TermTable.LookupTemp( l_sName.str() ) );
+    }
+
+    l_sRet << " ( :instance\n";
+    l_sRet << "  :states ( " << m_vBeforeStates[i] << " " << m_vAfterStates[i] << " )\n";
+    l_sRet << "  :cost ( " << m_vMethodCosts[i] << " )\n";
+    l_sRet << "  :vars\n";
+    l_sRet << "  (\n";
+    for( unsigned int j = 0; j < l_vVars.size(); j++ )
+      l_sRet << "    " << l_Rename.FindIndexByVar( l_vVars[j] )->second->ToStr() << "\n";
+    l_sRet << "  )\n";
+
+    HtnMethod * l_pMethod = m_vMethods[i]->AfterSubstitution( l_Rename, 0 );
+    l_sRet << "  :method\n";
+    l_sRet << l_pMethod->ToPddl( p_iRequirements );
+    delete l_pMethod;
+
+    l_sRet << "  :substitution\n";
+    l_sRet << "  (\n";
+    for( SubMap::const_iterator j = m_vMethodSubs[i]->Begin();
+	 j != m_vMethodSubs[i]->End();
+	 j++ )
+      l_sRet << "    ( " << l_Rename.FindIndexByVar( j->first )->second->ToStrNoTyping() << " " << j->second->ToStrNoTyping() << " )\n";
+    l_sRet << "  )\n";
+
+    l_sRet << "  :task\n";
+    l_sRet << m_vTaskDescrs[i]->AfterSubstitution( l_Rename, 0 )->ToPddl();
+    l_sRet << "  :effect\n";
+    l_sRet << "  " << m_vMethodEffects[i]->AfterSubstitution( l_Rename, 0 )->ToStrNoTyping() << "\n";
+    l_sRet << " )\n";
+  }
+  l_sRet << ")\n";
+
+  return l_sRet.str();
+}
+
+/**
+ *  Add the method instantiations in a representation from
+ *   MethodInstsToPddl() to this plan.
+ *  Each variable is renamed, exactly as AddMethodInst() does.
+ *  \param p_sInput INOUT A stream containing the representation.  It is
+ *   advanced beyond it.
+ *  \param p_sTypes IN The allowable types of the domain of the methods.
+ *  \param p_vAllowablePredicates IN The allowable predicates of the domain.
+ *  \param p_iRequirements IN The requirements of the domain.
+ */
+void AnnotatedPlan::MethodInstsFromPddl( std::stringstream & p_sInput,
+					 const std::set< std::string, StrLessNoCase > & p_sTypes,
+					 const std::vector< FormulaPred > & p_vAllowablePredicates,
+					 long p_iRequirements )
+{
+  EatWhitespace( p_sInput );
+  EatString( p_sInput, "(" );
+  EatWhitespace( p_sInput );
+
+  while( p_sInput.peek() != ')' )
+  {
+    EatString( p_sInput, "(" );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, ":instance" );
+    EatWhitespace( p_sInput );
+
+    EatString( p_sInput, ":states" );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, "(" );
+    EatWhitespace( p_sInput );
+    unsigned int l_iBefore = atoi( ReadString( p_sInput ).c_str() );
+    EatWhitespace( p_sInput );
+    unsigned int l_iAfter = atoi( ReadString( p_sInput ).c_str() );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, ")" );
+    EatWhitespace( p_sInput );
+
+    EatString( p_sInput, ":cost" );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, "(" );
+    EatWhitespace( p_sInput );
+    double l_fCost = strtod( ReadString( p_sInput ).c_str(), NULL );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, ")" );
+    EatWhitespace( p_sInput );
+
+    // The variables are declared first, with their types, so that the rest
+    //  may refer to them by name alone.
+    EatString( p_sInput, ":vars" );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, "(" );
+    EatWhitespace( p_sInput );
+    std::vector< TermVariableP > l_vVars;
+    while( p_sInput.peek() != ')' )
+    {
+      std::string l_sName = ReadString( p_sInput );
+      EatWhitespace( p_sInput );
+      if( p_sInput.peek() == '-' )
+      {
+	EatString( p_sInput, "-" );
+	EatWhitespace( p_sInput );
+	l_vVars.push_back( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( l_sName, ReadString( p_sInput ) ) ) );
+	EatWhitespace( p_sInput );
+      }
+      else
+	l_vVars.push_back( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( l_sName ) ) );
+    }
+    EatString( p_sInput, ")" );
+    EatWhitespace( p_sInput );
+
+    EatString( p_sInput, ":method" );
+    std::stringstream l_sMethodStream( ReadParenthetical( p_sInput ) );
+    HtnMethod * l_pMethod = HtnMethod::FromPddl( l_sMethodStream, p_sTypes, p_vAllowablePredicates, p_iRequirements );
+    EatWhitespace( p_sInput );
+
+    EatString( p_sInput, ":substitution" );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, "(" );
+    EatWhitespace( p_sInput );
+    Substitution l_Sub;
+    while( p_sInput.peek() != ')' )
+    {
+      EatString( p_sInput, "(" );
+      EatWhitespace( p_sInput );
+      TermVariableP l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( ReadString( p_sInput ) ) );
+      EatWhitespace( p_sInput );
+      TermP l_pConst = g_TermTable.Lookup( ReadString( p_sInput ) );
+      EatWhitespace( p_sInput );
+      EatString( p_sInput, ")" );
+      EatWhitespace( p_sInput );
+      l_Sub.AddPair( l_pVar, l_pConst );
+    }
+    EatString( p_sInput, ")" );
+    EatWhitespace( p_sInput );
+
+    EatString( p_sInput, ":task" );
+    HtnTaskDescr l_TaskDescr( p_sInput, p_sTypes, p_vAllowablePredicates );
+    EatWhitespace( p_sInput );
+
+    EatString( p_sInput, ":effect" );
+    FormulaConj l_Effects( p_sInput, TypeTable(), p_vAllowablePredicates );
+    EatWhitespace( p_sInput );
+    EatString( p_sInput, ")" );
+    EatWhitespace( p_sInput );
+
+    Substitution l_ChangeOfVars;
+    for( unsigned int i = 0; i < l_vVars.size(); i++ )
+    {
+      if( l_vVars[i]->HasTyping() )
+	l_ChangeOfVars.AddPair( l_vVars[i], g_TermTable.LookupTemp( MakeOldId(), l_vVars[i]->GetTyping() ) );
+      else
+	l_ChangeOfVars.AddPair( l_vVars[i], g_TermTable.LookupTemp( MakeOldId() ) );
+    }
+    Substitution * l_pNewSub = new Substitution;
+    for( SubMap::const_iterator i = l_Sub.Begin(); i != l_Sub.End(); i++ )
+      l_pNewSub->AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( l_ChangeOfVars.FindIndexByVar( i->first )->second ), i->second );
+
+    m_vMethods.push_back( l_pMethod->AfterSubstitution( l_ChangeOfVars, 0 ) );
+    m_vMethodSubs.push_back( l_pNewSub );
+    m_vBeforeStates.push_back( l_iBefore );
+    m_vAfterStates.push_back( l_iAfter );
+    m_vTaskDescrs.push_back( l_TaskDescr.AfterSubstitution( l_ChangeOfVars, 0 ) );
+    m_vMethodEffects.push_back( std::tr1::dynamic_pointer_cast< FormulaConj >( l_Effects.AfterSubstitution( l_ChangeOfVars, 0 ) ) );
+    m_vMethodCosts.push_back( l_fCost );
+    delete l_pMethod;
+  }
+
+  EatString( p_sInput, ")" );
+}
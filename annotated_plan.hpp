@@ -30,7 +30,15 @@ public:
 		      FormulaConjP p_pMethodEffects,
 		      double p_fMethodCost );
 
+  std::string MethodInstsToPddl( long p_iRequirements ) const;
+  void MethodInstsFromPddl( std::stringstream & p_sInput,
+			    const std::set< std::string, StrLessNoCase > & p_sTypes,
+			    const std::vector< FormulaPred > & p_vAllowablePredicates,
+			    long p_iRequirements );
+
 private:
+  std::vector< TermVariableP > GetInstVariables( unsigned int p_iIndex ) const;
+
   std::vector< Substitution * > m_vMethodSubs;
   std::vector< HtnMethod * > m_vMethods;
   std::vector< unsigned int > m_vBeforeStates;
@@ -0,0 +1,86 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <iostream>
+#include <cassert>
+#include <fstream>
+#include <set>
+#include <tr1/memory>
+
+#include <tclap/CmdLine.h>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_constant.hpp"
+#include "term_variable.hpp"
+#include "type_table.hpp"
+#include "substitution.hpp"
+#include "formula.hpp"
+#include "formula_pred.hpp"
+#include "formula_equ.hpp"
+#include "formula_neg.hpp"
+#include "formula_conj.hpp"
+#include "operator.hpp"
+#include "htn_task_head.hpp"
+#include "htn_method.hpp"
+#include "compiled_domain.hpp"
+#include "htn_domain.hpp"
+
+int main( int argc, char * argv[] )
+{
+#ifdef CATCH_EXCEPTS
+  try{
+#endif//CATCH_EXCEPTS
+
+  std::string l_sDomainFile;
+  std::string l_sOutputFile;
+  try
+  {
+    TCLAP::CmdLine l_cCmd( "Compile an HTN domain into a binary form that htn-solver2 can load without parsing.", ' ', "1.1" );
+
+    TCLAP::UnlabeledValueArg<std::string> l_aDomainFile( "domain_file", "Path to the PDDL domain file.", true, "not_spec", "domain_file", l_cCmd );
+    TCLAP::UnlabeledValueArg<std::string> l_aOutputFile( "output_file", "Path to which to write the compiled domain.", true, "not_spec", "output_file", l_cCmd );
+
+    l_cCmd.parse( argc, argv );
+
+    l_sDomainFile = l_aDomainFile.getValue();
+    l_sOutputFile = l_aOutputFile.getValue();
+  }
+  catch( TCLAP::ArgException &e )
+  {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 1;
+  }
+
+  std::tr1::shared_ptr< HtnDomain > l_pDomain;
+  try
+  {
+    MappedFile l_DomainFile( l_sDomainFile );
+    PddlTokenizer l_DomainTokens( l_DomainFile.GetData(), l_DomainFile.GetSize() );
+    l_pDomain = std::tr1::shared_ptr< HtnDomain >( HtnDomain::FromPddl( l_DomainTokens ) );
+  }
+  catch( FileReadException & e )
+  {
+    e.SetFileName( l_sDomainFile );
+    throw e;
+  }
+
+  std::string l_sCompiled = l_pDomain->ToCompiled();
+  std::ofstream l_sOutput( l_sOutputFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+  l_sOutput.write( l_sCompiled.data(), l_sCompiled.size() );
+  l_sOutput.close();
+  if( l_sOutput.fail() )
+  {
+    std::cerr << "error: could not write " << l_sOutputFile << std::endl;
+    return 1;
+  }
+
+  return 0;
+
+#ifdef CATCH_EXCEPTS
+  }catch( Exception & e ){ std::cerr << "\n" << e.ToStr() << "\n"; return 1; }
+#endif//CATCH_EXCEPTS
+}
@@ -0,0 +1,584 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <tr1/memory>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "string_table.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_variable.hpp"
+#include "term_constant.hpp"
+#include "term_table.hpp"
+#include "type_table.hpp"
+#include "formula.hpp"
+#include "formula_pred.hpp"
+#include "formula_equ.hpp"
+#include "formula_neg.hpp"
+#include "formula_conj.hpp"
+#include "compiled_domain.hpp"
+
+/** \file compiled_domain.hpp
+ *  Declaration of the CompiledDomainWriter and CompiledDomainReader classes.
+ */
+
+/** \file compiled_domain.cpp
+ *  Definition of the CompiledDomainWriter and CompiledDomainReader classes.
+ */
+
+extern StringTable g_StrTable;
+extern TermTable g_TermTable;
+
+/*
+ *  A compiled domain is a sequence of 32-bit words in the byte order of the
+ *   machine that wrote it:
+ *
+ *   magic        8 bytes, COMPILED_DOMAIN_MAGIC with its terminating null
+ *   version      COMPILED_DOMAIN_VERSION
+ *   byte order   COMPILED_DOMAIN_BYTE_ORDER
+ *   strings      count, then for each its length and its bytes, padded to a
+ *                 whole number of words
+ *   symbols      count, then the index of each relation and type name, in
+ *                 the order in which the writer's StringTable numbered them
+ *   terms        count, then the name and type (or COMPILED_DOMAIN_NONE) of
+ *                 each, then the order in which to look them up, which puts
+ *                 constants in the order in which the writer's TermTable
+ *                 numbered them
+ *   body         everything else, as written by HtnDomain::ToCompiled()
+ *
+ *  Interning the symbols and terms in the writer's order means that a
+ *   compiled domain loaded into a fresh process numbers its relations and
+ *   constants exactly as parsing the PDDL would have.
+ */
+
+/**
+ *  Determine whether a buffer holds a compiled domain, rather than text.
+ *  \param p_pData IN A pointer to the buffer.
+ *  \param p_iSize IN The number of bytes in the buffer.
+ *  \return Whether the buffer starts with the compiled domain magic number.
+ */
+bool IsCompiledDomain( const char * p_pData, size_t p_iSize )
+{
+  return p_iSize >= sizeof( COMPILED_DOMAIN_MAGIC ) &&
+    memcmp( p_pData, COMPILED_DOMAIN_MAGIC, sizeof( COMPILED_DOMAIN_MAGIC ) ) == 0;
+}
+
+/** \class CompiledDomainWriter
+ *  Builds the binary form of an HtnDomain.
+ *  Strings and Terms are interned as they are written, so the body refers to
+ *   each by its index.
+ */
+
+/** \var CompiledDomainWriter::m_vBody
+ *  The words of the body, in order.
+ */
+
+/** \var CompiledDomainWriter::m_vStrings
+ *  The interned strings, by index.
+ */
+
+/** \var CompiledDomainWriter::m_mStrings
+ *  The index of each interned string.
+ *  This is case-sensitive, so that names are written exactly as they were
+ *   read.
+ */
+
+/** \var CompiledDomainWriter::m_mSymbols
+ *  For each relation or type name that has been written, its index in the
+ *   global StringTable mapped to its index in m_vStrings.
+ */
+
+/** \var CompiledDomainWriter::m_vTerms
+ *  The interned Terms, by index.
+ */
+
+/** \var CompiledDomainWriter::m_mTerms
+ *  The index of each interned Term.
+ */
+
+/**
+ *  Construct an empty CompiledDomainWriter.
+ */
+CompiledDomainWriter::CompiledDomainWriter()
+{
+}
+
+/**
+ *  Destruct a CompiledDomainWriter.
+ */
+CompiledDomainWriter::~CompiledDomainWriter()
+{
+}
+
+/**
+ *  Append a word to the body.
+ *  \param p_iWord IN The word to append.
+ */
+void CompiledDomainWriter::WriteWord( uint32_t p_iWord )
+{
+  m_vBody.push_back( p_iWord );
+}
+
+/**
+ *  Append a double to the body, as two words.
+ *  \param p_fValue IN The value to append.
+ */
+void CompiledDomainWriter::WriteDouble( double p_fValue )
+{
+  uint32_t l_aWords[2];
+  memcpy( l_aWords, &p_fValue, sizeof( l_aWords ) );
+  WriteWord( l_aWords[0] );
+  WriteWord( l_aWords[1] );
+}
+
+/**
+ *  Append a reference to a string to the body.
+ *  \param p_sString IN The string, which is interned if it is new.
+ */
+void CompiledDomainWriter::WriteString( const std::string & p_sString )
+{
+  WriteWord( InternString( p_sString ) );
+}
+
+/**
+ *  Append the reference that stands for a missing string to the body.
+ */
+void CompiledDomainWriter::WriteNoString()
+{
+  WriteWord( COMPILED_DOMAIN_NONE );
+}
+
+/**
+ *  Append a reference to a Term to the body.
+ *  \param p_pTerm IN A smart pointer to the Term, which is interned if it
+ *   is new.
+ */
+void CompiledDomainWriter::WriteTerm( const TermP & p_pTerm )
+{
+  std::tr1::unordered_map< const Term *, unsigned int >::const_iterator l_Found = m_mTerms.find( p_pTerm.get() );
+  if( l_Found != m_mTerms.end() )
+  {
+    WriteWord( l_Found->second );
+    return;
+  }
+
+  InternString( p_pTerm->ToStrNoTyping() );
+  if( p_pTerm->HasTyping() )
+    NoteSymbol( p_pTerm->GetTypingStrTableIndex(), p_pTerm->GetTyping() );
+
+  unsigned int l_iIndex = m_vTerms.size();
+  m_vTerms.push_back( p_pTerm );
+  m_mTerms[p_pTerm.get()] = l_iIndex;
+  WriteWord( l_iIndex );
+}
+
+/**
+ *  Append a predicate to the body: its relation, its valence, and a
+ *   reference to each of its parameters.
+ *  \param p_Pred IN The predicate.
+ */
+void CompiledDomainWriter::WritePred( const FormulaPred & p_Pred )
+{
+  NoteSymbol( p_Pred.GetRelationIndex(), p_Pred.GetRelation() );
+  WriteString( p_Pred.GetRelation() );
+  WriteWord( p_Pred.GetValence() );
+  for( unsigned int i = 0; i < p_Pred.GetValence(); i++ )
+    WriteTerm( p_Pred.GetCParam( i ) );
+}
+
+/**
+ *  Append a Formula to the body: its FormulaType, followed by its contents.
+ *  \param p_pFormula IN A smart pointer to the Formula.
+ */
+void CompiledDomainWriter::WriteFormula( const FormulaP & p_pFormula )
+{
+  WriteWord( p_pFormula->GetType() );
+  switch( p_pFormula->GetType() )
+  {
+  case FT_PRED:
+    WritePred( *std::tr1::dynamic_pointer_cast< FormulaPred >( p_pFormula ) );
+    break;
+  case FT_EQU:
+  {
+    FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( p_pFormula );
+    WriteTerm( l_pEqu->GetCFirst() );
+    WriteTerm( l_pEqu->GetCSecond() );
+    break;
+  }
+  case FT_NEG:
+    WriteFormula( std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pFormula )->GetCNegForm() );
+    break;
+  case FT_CONJ:
+  {
+    FormulaConjP l_pConj = std::tr1::dynamic_pointer_cast< FormulaConj >( p_pFormula );
+    WriteWord( l_pConj->GetNumConjs() );
+    for( FormulaPVecCI i = l_pConj->GetBeginConj(); i != l_pConj->GetEndConj(); i++ )
+      WriteFormula( *i );
+    break;
+  }
+  default:
+    throw Exception( E_NOT_IMPLEMENTED,
+		     "This type of formula cannot be compiled.",
+		     __FILE__,
+		     __LINE__ );
+  }
+}
+
+/**
+ *  Retrieve the index of a string, interning it if it is new.
+ *  \param p_sString IN The string.
+ *  \return The index of the string.
+ */
+unsigned int CompiledDomainWriter::InternString( const std::string & p_sString )
+{
+  std::map< std::string, unsigned int >::const_iterator l_Found = m_mStrings.find( p_sString );
+  if( l_Found != m_mStrings.end() )
+    return l_Found->second;
+
+  unsigned int l_iIndex = m_vStrings.size();
+  m_vStrings.push_back( p_sString );
+  m_mStrings[p_sString] = l_iIndex;
+  return l_iIndex;
+}
+
+/**
+ *  Record that a relation or type name must be interned when the domain is
+ *   loaded.
+ *  \param p_iSymbol IN The index of the name in the global StringTable.
+ *  \param p_sString IN The name.
+ */
+void CompiledDomainWriter::NoteSymbol( unsigned int p_iSymbol, const std::string & p_sString )
+{
+  if( m_mSymbols.find( p_iSymbol ) == m_mSymbols.end() )
+    m_mSymbols[p_iSymbol] = InternString( p_sString );
+}
+
+/**
+ *  A functor that orders Term indices so that constants come first, in the
+ *   order of their ids, and everything else follows in its original order.
+ */
+struct TermInternLess
+{
+  const std::vector< TermP > * m_pTerms;
+
+  bool operator()( unsigned int p_iFirst, unsigned int p_iSecond ) const
+  {
+    return (*m_pTerms)[p_iFirst]->GetId() < (*m_pTerms)[p_iSecond]->GetId();
+  }
+};
+
+/**
+ *  Retrieve the complete compiled domain.
+ *  \return A string containing the header, the tables, and the body.
+ */
+std::string CompiledDomainWriter::Finish() const
+{
+  std::vector< uint32_t > l_vWords;
+
+  uint32_t l_aMagic[2];
+  memcpy( l_aMagic, COMPILED_DOMAIN_MAGIC, sizeof( l_aMagic ) );
+  l_vWords.push_back( l_aMagic[0] );
+  l_vWords.push_back( l_aMagic[1] );
+  l_vWords.push_back( COMPILED_DOMAIN_VERSION );
+  l_vWords.push_back( COMPILED_DOMAIN_BYTE_ORDER );
+
+  l_vWords.push_back( m_vStrings.size() );
+  for( unsigned int i = 0; i < m_vStrings.size(); i++ )
+  {
+    l_vWords.push_back( m_vStrings[i].size() );
+    unsigned int l_iFirst = l_vWords.size();
+    l_vWords.resize( l_iFirst + ( m_vStrings[i].size() + 3 ) / 4, 0 );
+    if( !m_vStrings[i].empty() )
+      memcpy( &l_vWords[l_iFirst], m_vStrings[i].data(), m_vStrings[i].size() );
+  }
+
+  l_vWords.push_back( m_mSymbols.size() );
+  for( std::map< unsigned int, unsigned int >::const_iterator i = m_mSymbols.begin();
+       i != m_mSymbols.end();
+       i++ )
+    l_vWords.push_back( i->second );
+
+  l_vWords.push_back( m_vTerms.size() );
+  for( unsigned int i = 0; i < m_vTerms.size(); i++ )
+  {
+    l_vWords.push_back( m_mStrings.find( m_vTerms[i]->ToStrNoTyping() )->second );
+    if( m_vTerms[i]->HasTyping() )
+      l_vWords.push_back( m_mStrings.find( m_vTerms[i]->GetTyping() )->second );
+    else
+      l_vWords.push_back( COMPILED_DOMAIN_NONE );
+  }
+  std::vector< unsigned int > l_vOrder;
+  for( unsigned int i = 0; i < m_vTerms.size(); i++ )
+    l_vOrder.push_back( i );
+  TermInternLess l_Less;
+  l_Less.m_pTerms = &m_vTerms;
+  std::stable_sort( l_vOrder.begin(), l_vOrder.end(), l_Less );
+  for( unsigned int i = 0; i < l_vOrder.size(); i++ )
+    l_vWords.push_back( l_vOrder[i] );
+
+  l_vWords.insert( l_vWords.end(), m_vBody.begin(), m_vBody.end() );
+
+  return std::string( (const char *)&l_vWords[0], l_vWords.size() * sizeof( uint32_t ) );
+}
+
+/** \class CompiledDomainReader
+ *  Reads the binary form of an HtnDomain from a buffer, which is usually a
+ *   MappedFile.
+ *  The header and tables are read when it is constructed, so that the body
+ *   can refer to strings and Terms by index.
+ */
+
+/** \var CompiledDomainReader::m_pData
+ *  A pointer to the buffer, which is not owned by this reader.
+ */
+
+/** \var CompiledDomainReader::m_iSize
+ *  The number of bytes in the buffer.
+ */
+
+/** \var CompiledDomainReader::m_iPos
+ *  The offset of the next word to read.
+ */
+
+/** \var CompiledDomainReader::m_vStrings
+ *  The interned strings, by index.
+ */
+
+/** \var CompiledDomainReader::m_vTerms
+ *  The interned Terms, by index.
+ */
+
+/**
+ *  Construct a CompiledDomainReader over a buffer, reading its header,
+ *   interning its symbols, and looking up its Terms.
+ *  \param p_pData IN A pointer to the buffer, which must outlive this.
+ *  \param p_iSize IN The number of bytes in the buffer.
+ */
+CompiledDomainReader::CompiledDomainReader( const char * p_pData, size_t p_iSize ) throw ( UnexpectedStringException )
+  : m_pData( p_pData ),
+    m_iSize( p_iSize ),
+    m_iPos( 0 )
+{
+  if( !IsCompiledDomain( p_pData, p_iSize ) )
+    throw UnexpectedStringException( "This is not a compiled domain.",
+				     __FILE__,
+				     __LINE__ );
+  m_iPos = sizeof( COMPILED_DOMAIN_MAGIC );
+
+  uint32_t l_iVersion = ReadWord();
+  if( l_iVersion != COMPILED_DOMAIN_VERSION )
+  {
+    std::stringstream l_sMessage;
+    l_sMessage << "The compiled domain has version " << l_iVersion << ", but only version " << COMPILED_DOMAIN_VERSION << " can be read.  Compile it again.";
+    throw UnexpectedStringException( l_sMessage.str(),
+				     __FILE__,
+				     __LINE__ );
+  }
+  if( ReadWord() != COMPILED_DOMAIN_BYTE_ORDER )
+    throw UnexpectedStringException( "The compiled domain was written on a machine with a different byte order.",
+				     __FILE__,
+				     __LINE__ );
+
+  uint32_t l_iNumStrings = ReadWord();
+  m_vStrings.reserve( l_iNumStrings );
+  for( uint32_t i = 0; i < l_iNumStrings; i++ )
+  {
+    uint32_t l_iLength = ReadWord();
+    // The string is padded to a whole number of words, which must be there.
+    size_t l_iPadded = ( ( (size_t)l_iLength + 3 ) / 4 ) * 4;
+    if( m_iPos > m_iSize || m_iSize - m_iPos < l_iPadded )
+      throw UnexpectedStringException( "The compiled domain is truncated.",
+				       __FILE__,
+				       __LINE__ );
+    m_vStrings.push_back( std::string( m_pData + m_iPos, l_iLength ) );
+    m_iPos += l_iPadded;
+  }
+
+  uint32_t l_iNumSymbols = ReadWord();
+  for( uint32_t i = 0; i < l_iNumSymbols; i++ )
+    g_StrTable.Lookup( GetString( ReadWord() ) );
+
+  uint32_t l_iNumTerms = ReadWord();
+  std::vector< uint32_t > l_vNames, l_vTypes;
+  for( uint32_t i = 0; i < l_iNumTerms; i++ )
+  {
+    l_vNames.push_back( ReadWord() );
+    l_vTypes.push_back( ReadWord() );
+  }
+  m_vTerms.resize( l_iNumTerms );
+  for( uint32_t i = 0; i < l_iNumTerms; i++ )
+  {
+    uint32_t l_iIndex = ReadWord();
+    if( l_iIndex >= l_iNumTerms || m_vTerms[l_iIndex] )
+      throw UnexpectedStringException( "The compiled domain has a bad term table.",
+				       __FILE__,
+				       __LINE__ );
+    if( l_vTypes[l_iIndex] == COMPILED_DOMAIN_NONE )
+      m_vTerms[l_iIndex] = g_TermTable.Lookup( GetString( l_vNames[l_iIndex] ) );
+    else
+      m_vTerms[l_iIndex] = g_TermTable.Lookup( GetString( l_vNames[l_iIndex] ),
+					       GetString( l_vTypes[l_iIndex] ) );
+  }
+}
+
+/**
+ *  Destruct a CompiledDomainReader.
+ */
+CompiledDomainReader::~CompiledDomainReader()
+{
+}
+
+/**
+ *  Read the next word.
+ *  \return The next word.
+ */
+uint32_t CompiledDomainReader::ReadWord() throw ( UnexpectedStringException )
+{
+  if( m_iPos > m_iSize || m_iSize - m_iPos < sizeof( uint32_t ) )
+    throw UnexpectedStringException( "The compiled domain is truncated.",
+				     __FILE__,
+				     __LINE__ );
+  uint32_t l_iRet;
+  memcpy( &l_iRet, m_pData + m_iPos, sizeof( uint32_t ) );
+  m_iPos += sizeof( uint32_t );
+  return l_iRet;
+}
+
+/**
+ *  Read a double from the next two words.
+ *  \return The double.
+ */
+double CompiledDomainReader::ReadDouble() throw ( UnexpectedStringException )
+{
+  uint32_t l_aWords[2];
+  l_aWords[0] = ReadWord();
+  l_aWords[1] = ReadWord();
+  double l_fRet;
+  memcpy( &l_fRet, l_aWords, sizeof( l_fRet ) );
+  return l_fRet;
+}
+
+/**
+ *  Retrieve an interned string by index.
+ *  \param p_iIndex IN The index of the string.
+ *  \return A reference to the string, which has the same lifetime as this.
+ */
+const std::string & CompiledDomainReader::GetString( uint32_t p_iIndex ) const throw ( UnexpectedStringException )
+{
+  if( p_iIndex >= m_vStrings.size() )
+    throw UnexpectedStringException( "The compiled domain refers to a string that it does not contain.",
+				     __FILE__,
+				     __LINE__ );
+  return m_vStrings[p_iIndex];
+}
+
+/**
+ *  Read a reference to a string.
+ *  \return A reference to the string, which has the same lifetime as this.
+ */
+const std::string & CompiledDomainReader::ReadString() throw ( UnexpectedStringException )
+{
+  return GetString( ReadWord() );
+}
+
+/**
+ *  Read a reference to a string that may be missing.
+ *  \param p_sString OUT The string, if it is present.
+ *  \return Whether the string is present.
+ */
+bool CompiledDomainReader::ReadOptionalString( std::string & p_sString ) throw ( UnexpectedStringException )
+{
+  uint32_t l_iIndex = ReadWord();
+  if( l_iIndex == COMPILED_DOMAIN_NONE )
+    return false;
+  p_sString = GetString( l_iIndex );
+  return true;
+}
+
+/**
+ *  Read a reference to a Term.
+ *  \return A smart pointer to the Term.
+ */
+TermP CompiledDomainReader::ReadTerm() throw ( UnexpectedStringException )
+{
+  uint32_t l_iIndex = ReadWord();
+  if( l_iIndex >= m_vTerms.size() )
+    throw UnexpectedStringException( "The compiled domain refers to a term that it does not contain.",
+				     __FILE__,
+				     __LINE__ );
+  return m_vTerms[l_iIndex];
+}
+
+/**
+ *  Read a predicate, as written by CompiledDomainWriter::WritePred().
+ *  \return A smart pointer to a new FormulaPred.
+ */
+FormulaPredP CompiledDomainReader::ReadPred() throw ( UnexpectedStringException )
+{
+  std::string l_sRelation = ReadString();
+  uint32_t l_iValence = ReadWord();
+  std::vector< TermP > l_vParams;
+  for( uint32_t i = 0; i < l_iValence; i++ )
+    l_vParams.push_back( ReadTerm() );
+  return FormulaPredP( new FormulaPred( l_sRelation, l_vParams ) );
+}
+
+/**
+ *  Read a Formula, as written by CompiledDomainWriter::WriteFormula().
+ *  \return A smart pointer to a new Formula.
+ */
+FormulaP CompiledDomainReader::ReadFormula() throw ( UnexpectedStringException )
+{
+  switch( ReadWord() )
+  {
+  case FT_PRED:
+    return ReadPred();
+  case FT_EQU:
+  {
+    TermP l_pFirst = ReadTerm();
+    TermP l_pSecond = ReadTerm();
+    return FormulaP( new FormulaEqu( l_pFirst, l_pSecond ) );
+  }
+  case FT_NEG:
+    return FormulaP( new FormulaNeg( ReadFormula() ) );
+  case FT_CONJ:
+  {
+    uint32_t l_iNumConjs = ReadWord();
+    FormulaPVec l_vConjs;
+    for( uint32_t i = 0; i < l_iNumConjs; i++ )
+      l_vConjs.push_back( ReadFormula() );
+    return FormulaP( new FormulaConj( l_vConjs ) );
+  }
+  default:
+    throw UnexpectedStringException( "The compiled domain contains an unknown type of formula.",
+				     __FILE__,
+				     __LINE__ );
+  }
+}
+
+/**
+ *  Read a Formula that must be a conjunction.
+ *  \return A smart pointer to a new FormulaConj.
+ */
+FormulaConjP CompiledDomainReader::ReadConj() throw ( UnexpectedStringException )
+{
+  FormulaConjP l_pRet = std::tr1::dynamic_pointer_cast< FormulaConj >( ReadFormula() );
+  if( !l_pRet )
+    throw UnexpectedStringException( "The compiled domain contains a formula that should be a conjunction but is not.",
+				     __FILE__,
+				     __LINE__ );
+  return l_pRet;
+}
+
+/**
+ *  Determine whether every word has been read.
+ *  \return Whether every word has been read.
+ */
+bool CompiledDomainReader::AtEnd() const
+{
+  return m_iPos == m_iSize;
+}
@@ -0,0 +1,76 @@
+#ifndef COMPILED_DOMAIN_HPP__
+#define COMPILED_DOMAIN_HPP__
+
+#include <stdint.h>
+#include <map>
+#include <tr1/unordered_map>
+
+#define COMPILED_DOMAIN_MAGIC "HTNCDOM"
+#define COMPILED_DOMAIN_VERSION 1
+#define COMPILED_DOMAIN_BYTE_ORDER 0x01020304
+#define COMPILED_DOMAIN_NONE 0xFFFFFFFF
+
+bool IsCompiledDomain( const char * p_pData, size_t p_iSize );
+
+class CompiledDomainWriter
+{
+public:
+  CompiledDomainWriter();
+  virtual ~CompiledDomainWriter();
+
+  void WriteWord( uint32_t p_iWord );
+  void WriteDouble( double p_fValue );
+  void WriteString( const std::string & p_sString );
+  void WriteNoString();
+  void WriteTerm( const TermP & p_pTerm );
+  void WritePred( const FormulaPred & p_Pred );
+  void WriteFormula( const FormulaP & p_pFormula );
+
+  std::string Finish() const;
+
+private:
+  CompiledDomainWriter( const CompiledDomainWriter & p_Other );
+  CompiledDomainWriter & operator=( const CompiledDomainWriter & p_Other );
+
+  unsigned int InternString( const std::string & p_sString );
+  void NoteSymbol( unsigned int p_iSymbol, const std::string & p_sString );
+
+  std::vector< uint32_t > m_vBody;
+  std::vector< std::string > m_vStrings;
+  std::map< std::string, unsigned int > m_mStrings;
+  std::map< unsigned int, unsigned int > m_mSymbols;
+  std::vector< TermP > m_vTerms;
+  std::tr1::unordered_map< const Term *, unsigned int > m_mTerms;
+};
+
+class CompiledDomainReader
+{
+public:
+  CompiledDomainReader( const char * p_pData, size_t p_iSize ) throw ( UnexpectedStringException );
+  virtual ~CompiledDomainReader();
+
+  uint32_t ReadWord() throw ( UnexpectedStringException );
+  double ReadDouble() throw ( UnexpectedStringException );
+  const std::string & ReadString() throw ( UnexpectedStringException );
+  bool ReadOptionalString( std::string & p_sString ) throw ( UnexpectedStringException );
+  TermP ReadTerm() throw ( UnexpectedStringException );
+  FormulaPredP ReadPred() throw ( UnexpectedStringException );
+  FormulaP ReadFormula() throw ( UnexpectedStringException );
+  FormulaConjP ReadConj() throw ( UnexpectedStringException );
+
+  bool AtEnd() const;
+
+private:
+  CompiledDomainReader( const CompiledDomainReader & p_Other );
+  CompiledDomainReader & operator=( const CompiledDomainReader & p_Other );
+
+  const std::string & GetString( uint32_t p_iIndex ) const throw ( UnexpectedStringException );
+
+  const char * m_pData;
+  size_t m_iSize;
+  size_t m_iPos;
+  std::vector< std::string > m_vStrings;
+  std::vector< TermP > m_vTerms;
+};
+
+#endif//COMPILED_DOMAIN_HPP__
@@ -0,0 +1,236 @@
+#include <list>
+#include <tr1/unordered_map>
+
+#include "failure_cache.hpp"
+
+/** \file failure_cache.hpp
+ *  Declaration of the FailureCache class.
+ */
+
+/** \file failure_cache.cpp
+ *  Definition of the FailureCache class.
+ */
+
+/** \enum FailureEviction
+ *  Which entry a full FailureCache gives up to make room for a new one.
+ */
+
+/** \var FE_LRU
+ *  Evict the entry that was least recently added or found.
+ */
+
+/** \var FE_FIFO
+ *  Evict the entry that was added first, no matter how often it is found.
+ */
+
+/** \class FailureCache
+ *  A bounded record of search nodes from which no plan could be found.
+ *  Each node is known by a hash of its state and outstanding tasks, which is
+ *   the key, and by a second hash computed independently, which must also
+ *   match before a node is taken to have failed.  Thus a node with a plan is
+ *   only pruned if both hashes collide at once.
+ *  Along with each node is kept the shallowest depth at which its search
+ *   failed.  Since a search that starts deeper has less room before the
+ *   depth limit, it cannot succeed where a shallower one failed, but a
+ *   shallower one might.
+ */
+
+/** \var FailureCache::m_iCapacity
+ *  The greatest number of entries to keep.
+ */
+
+/** \var FailureCache::m_iEviction
+ *  Which entry to evict when the cache is full.
+ */
+
+/** \var FailureCache::m_lOrder
+ *  The keys of the entries, with the next to be evicted at the front.
+ */
+
+/** \struct FailureCache::FailureEntry
+ *  What is known about one node that failed.
+ */
+
+/** \var FailureCache::FailureEntry::m_iCheck
+ *  The second hash of the node, which confirms that a key refers to it.
+ */
+
+/** \var FailureCache::FailureEntry::m_iDepth
+ *  The shallowest depth at which the search of the node failed.
+ */
+
+/** \var FailureCache::FailureEntry::m_iPlace
+ *  The place of the key of the node in FailureCache::m_lOrder.
+ */
+
+/** \var FailureCache::m_mFailures
+ *  A map from the key of each entry to what is known about its node.
+ */
+
+/** \var FailureCache::m_iNumHits
+ *  The number of lookups that found a failure.
+ */
+
+/** \var FailureCache::m_iNumMisses
+ *  The number of lookups that did not find a failure.
+ */
+
+/** \var FailureCache::m_iNumEvictions
+ *  The number of entries that were given up to make room for others.
+ */
+
+/** \var FailureCache::m_iNumCollisions
+ *  The number of lookups and additions that found the key of another node.
+ */
+
+/**
+ *  Construct an empty FailureCache.
+ *  \param p_iCapacity IN The greatest number of entries to keep.  If this is
+ *   0, nothing is ever kept.
+ *  \param p_iEviction IN Which entry to evict when the cache is full.
+ */
+FailureCache::FailureCache( unsigned int p_iCapacity,
+			    FailureEviction p_iEviction )
+  : m_iCapacity( p_iCapacity ),
+    m_iEviction( p_iEviction ),
+    m_iNumHits( 0 ),
+    m_iNumMisses( 0 ),
+    m_iNumEvictions( 0 ),
+    m_iNumCollisions( 0 )
+{
+}
+
+/**
+ *  Destruct a FailureCache.
+ */
+FailureCache::~FailureCache()
+{
+}
+
+/**
+ *  Determine whether a search node is known to fail.
+ *  This counts as a hit or a miss and, with FE_LRU, makes a found entry the
+ *   last to be evicted.  An entry with the same key but a different check is
+ *   for another node, and counts as a miss and a collision.
+ *  \param p_iKey IN The hash of the search node.
+ *  \param p_iCheck IN The second hash of the search node.
+ *  \param p_iDepth IN The depth at which the node is about to be searched.
+ *  \return Whether the node failed before at this depth or a shallower one.
+ */
+bool FailureCache::IsFailure( uint64_t p_iKey, uint64_t p_iCheck, unsigned int p_iDepth )
+{
+  FailureMap::iterator l_iEntry = m_mFailures.find( p_iKey );
+  if( l_iEntry != m_mFailures.end() && l_iEntry->second.m_iCheck != p_iCheck )
+  {
+    m_iNumCollisions++;
+    l_iEntry = m_mFailures.end();
+  }
+  if( l_iEntry == m_mFailures.end() || l_iEntry->second.m_iDepth > p_iDepth )
+  {
+    m_iNumMisses++;
+    return false;
+  }
+
+  m_iNumHits++;
+  if( m_iEviction == FE_LRU )
+    m_lOrder.splice( m_lOrder.end(), m_lOrder, l_iEntry->second.m_iPlace );
+  return true;
+}
+
+/**
+ *  Record that no plan could be found from a search node.
+ *  If the cache is full, another entry is evicted to make room.  An entry
+ *   for another node with the same key is replaced.
+ *  \param p_iKey IN The hash of the search node.
+ *  \param p_iCheck IN The second hash of the search node.
+ *  \param p_iDepth IN The depth at which the search of the node failed.
+ */
+void FailureCache::AddFailure( uint64_t p_iKey, uint64_t p_iCheck, unsigned int p_iDepth )
+{
+  if( m_iCapacity == 0 )
+    return;
+
+  FailureMap::iterator l_iEntry = m_mFailures.find( p_iKey );
+  if( l_iEntry != m_mFailures.end() )
+  {
+    if( l_iEntry->second.m_iCheck != p_iCheck )
+    {
+      m_iNumCollisions++;
+      l_iEntry->second.m_iCheck = p_iCheck;
+      l_iEntry->second.m_iDepth = p_iDepth;
+    }
+    else if( p_iDepth < l_iEntry->second.m_iDepth )
+      l_iEntry->second.m_iDepth = p_iDepth;
+    if( m_iEviction == FE_LRU )
+      m_lOrder.splice( m_lOrder.end(), m_lOrder, l_iEntry->second.m_iPlace );
+    return;
+  }
+
+  if( m_mFailures.size() >= m_iCapacity )
+  {
+    m_mFailures.erase( m_lOrder.front() );
+    m_lOrder.pop_front();
+    m_iNumEvictions++;
+  }
+
+  m_lOrder.push_back( p_iKey );
+  FailureEntry & l_Entry = m_mFailures[p_iKey];
+  l_Entry.m_iCheck = p_iCheck;
+  l_Entry.m_iDepth = p_iDepth;
+  l_Entry.m_iPlace = --m_lOrder.end();
+}
+
+/**
+ *  Retrieve the greatest number of entries this cache will keep.
+ *  \return The capacity of this cache.
+ */
+unsigned int FailureCache::GetCapacity() const
+{
+  return m_iCapacity;
+}
+
+/**
+ *  Retrieve the number of entries in this cache.
+ *  \return The number of entries in this cache.
+ */
+unsigned int FailureCache::GetSize() const
+{
+  return m_mFailures.size();
+}
+
+/**
+ *  Retrieve the number of lookups that found a failure.
+ *  \return The number of hits.
+ */
+unsigned long FailureCache::GetNumHits() const
+{
+  return m_iNumHits;
+}
+
+/**
+ *  Retrieve the number of lookups that did not find a failure.
+ *  \return The number of misses.
+ */
+unsigned long FailureCache::GetNumMisses() const
+{
+  return m_iNumMisses;
+}
+
+/**
+ *  Retrieve the number of entries given up to make room for others.
+ *  \return The number of evictions.
+ */
+unsigned long FailureCache::GetNumEvictions() const
+{
+  return m_iNumEvictions;
+}
+
+/**
+ *  Retrieve the number of lookups and additions that found the key of
+ *   another node.
+ *  \return The number of collisions.
+ */
+unsigned long FailureCache::GetNumCollisions() const
+{
+  return m_iNumCollisions;
+}
@@ -0,0 +1,54 @@
+#ifndef FAILURE_CACHE_HPP__
+#define FAILURE_CACHE_HPP__
+
+#include <stdint.h>
+#include <list>
+#include <tr1/unordered_map>
+
+enum FailureEviction
+{
+  FE_LRU,
+  FE_FIFO,
+};
+
+class FailureCache
+{
+public:
+  FailureCache( unsigned int p_iCapacity,
+		FailureEviction p_iEviction );
+  virtual ~FailureCache();
+
+  bool IsFailure( uint64_t p_iKey, uint64_t p_iCheck, unsigned int p_iDepth );
+  void AddFailure( uint64_t p_iKey, uint64_t p_iCheck, unsigned int p_iDepth );
+
+  unsigned int GetCapacity() const;
+  unsigned int GetSize() const;
+  unsigned long GetNumHits() const;
+  unsigned long GetNumMisses() const;
+  unsigned long GetNumEvictions() const;
+  unsigned long GetNumCollisions() const;
+
+private:
+  FailureCache( const FailureCache & p_Other );
+  FailureCache & operator=( const FailureCache & p_Other );
+
+  typedef std::list< uint64_t > KeyList;
+  struct FailureEntry
+  {
+    uint64_t m_iCheck;
+    unsigned int m_iDepth;
+    KeyList::iterator m_iPlace;
+  };
+  typedef std::tr1::unordered_map< uint64_t, FailureEntry > FailureMap;
+
+  unsigned int m_iCapacity;
+  FailureEviction m_iEviction;
+  KeyList m_lOrder;
+  FailureMap m_mFailures;
+  unsigned long m_iNumHits;
+  unsigned long m_iNumMisses;
+  unsigned long m_iNumEvictions;
+  unsigned long m_iNumCollisions;
+};
+
+#endif//FAILURE_CACHE_HPP__
@@ -85,6 +85,18 @@ FormulaEqu::FormulaEqu( const FormulaEqu & p_Other )
   m_pSecondTerm = p_Other.GetCSecond();
 }
 
+/**
+ *  Construct an equality formula between two existing Terms.
+ *  \param p_pFirst IN A smart pointer to the first Term.
+ *  \param p_pSecond IN A smart pointer to the second Term.
+ */
+FormulaEqu::FormulaEqu( const TermP & p_pFirst,
+			const TermP & p_pSecond )
+  : m_pFirstTerm( p_pFirst ),
+    m_pSecondTerm( p_pSecond )
+{
+}
+
 /**
  *  Construct a default equality formula.
  *  This exists only as a convenience for FormulaEqu::AfterSubstitution.
@@ -15,6 +15,8 @@ public:
 	      const TypeTable & p_TypeTable );
 
   FormulaEqu( const FormulaEqu & p_Other );
+  FormulaEqu( const TermP & p_pFirst,
+	      const TermP & p_pSecond );
 
   virtual ~FormulaEqu();
 
@@ -64,6 +64,15 @@ FormulaNeg::FormulaNeg( const FormulaNeg & p_Other )
 {
 }
 
+/**
+ *  Construct a FormulaNeg of an existing Formula.
+ *  \param p_pNegForm IN A smart pointer to the Formula to negate.
+ */
+FormulaNeg::FormulaNeg( const FormulaP & p_pNegForm )
+  : m_pNegForm( p_pNegForm )
+{
+}
+
 /**
  *  Construct a FormulaNeg from its string representation, a table of 
  *   allowable Terms with their types, and a list of allowable predicate 
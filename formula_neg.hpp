@@ -17,6 +17,7 @@ public:
 	      const std::vector< FormulaPred > & p_vAllowablePredicates );
 
   FormulaNeg( const FormulaNeg & p_Other );
+  FormulaNeg( const FormulaP & p_pNegForm );
 
   virtual ~FormulaNeg();
 
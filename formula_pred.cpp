@@ -165,6 +165,19 @@ FormulaPred::FormulaPred()
 {
 }
 
+/**
+ *  Construct a FormulaPred from its relation and parameters, which have
+ *   already been checked against the declared predicates.
+ *  \param p_sRelation IN The name of the relation.
+ *  \param p_vParams IN A list of smart pointers to the parameters.
+ */
+FormulaPred::FormulaPred( const std::string & p_sRelation,
+			  const std::vector< TermP > & p_vParams )
+  : m_vParams( p_vParams )
+{
+  m_iRelation = g_StrTable.Lookup( p_sRelation );
+}
+
 /**
  *  Construct a FormulaPred from a stream with a string representation, 
  *   requiring that it satisfy some constraints.
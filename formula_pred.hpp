@@ -17,6 +17,8 @@ public:
   FormulaPred( std::string p_sString,
 	       const TypeTable & p_TypeTable,
 	       const std::vector< FormulaPred > & p_vAllowablePredicates );
+  FormulaPred( const std::string & p_sRelation,
+	       const std::vector< TermP > & p_vParams );
 
   virtual ~FormulaPred();
 
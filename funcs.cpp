@@ -2,10 +2,11 @@
 #include <sstream>
 #include <cassert>
 #include <iostream>
-#include <fstream>
+#include <cstdio>
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 
 /** \file funcs.hpp
  *  Declarations of various useful global functions.
@@ -526,26 +527,20 @@ std::string PrintRequirements( long l_iReqs )
 
 /**
  *  Read the contents of a file into a string.
+ *  The file is mapped into memory and copied in one piece.  As before, an EOF
+ *   character is appended to the contents.
  *  \param p_sFileName IN The path to a file.
  *  \return The contents of that file.
- *  \todo This could probably be optimized by reading more than one char
- *   at a time.
  */
 std::string ReadFile( std::string p_sFileName ) throw ( StreamFailException )
 {
-  std::ifstream fin( p_sFileName.c_str() );
+  MappedFile l_File( p_sFileName );
 
-  if( !fin.is_open() || !fin.good() )
-    throw StreamFailException( "Reading file " + p_sFileName + " failed.",
-			       __FILE__,
-			       __LINE__ );
-
-  std::string l_sRet = "";
-
-  while( !fin.eof() )
-    l_sRet += (char)fin.get();
+  std::string l_sRet;
+  l_sRet.reserve( l_File.GetSize() + 1 );
+  l_sRet.append( l_File.GetData(), l_File.GetSize() );
+  l_sRet += (char)EOF;
 
-  fin.close();
   return l_sRet;
 }
 
@@ -567,15 +562,87 @@ void IncreaseNextVarId( unsigned int p_iNewMinimum )
     g_iNextVarIdSuffix = p_iNewMinimum + 1;
 }
 
+/**
+ *  Retrieve the suffix for the next automatic variable ID to be created.
+ *  \return The current value of g_iNextVarIdSuffix.
+ */
+unsigned int GetNextVarId()
+{
+  return g_iNextVarIdSuffix;
+}
+
+/**
+ *  Skip over some automatic variable IDs, as though MakeVarId() had been
+ *   called that many times.
+ *  \param p_iNum IN The number of IDs to skip.
+ */
+void SkipVarIds( unsigned int p_iNum )
+{
+  g_iNextVarIdSuffix += p_iNum;
+}
+
+/**
+ *  The scope of the automatic variables created by the current thread, or 0
+ *   if they are taken from g_iNextVarIdSuffix.
+ */
+__thread unsigned int g_iThreadVarIdScope = 0;
+
+/**
+ *  The suffix for the next automatic variable to be created by the current
+ *   thread within its scope.
+ */
+__thread unsigned int g_iThreadVarIdSuffix = 0;
+
+/**
+ *  The number of automatic variables created by the current thread within its
+ *   scope since the last call to TakeThreadVarIdCount().
+ */
+__thread unsigned int g_iThreadVarIdCount = 0;
+
+/**
+ *  Give the automatic variables created by the current thread names of their
+ *   own, of the form "?spec_[scope]_[number]", rather than taking them from
+ *   the shared sequence.
+ *  This allows several threads to create variables at once, and lets a thread
+ *   that is only trying something out leave the shared sequence as it was.
+ *  \param p_iScope IN A number that no other thread is using as its scope, or
+ *   0 to return to the shared sequence.
+ */
+void SetThreadVarIdScope( unsigned int p_iScope )
+{
+  g_iThreadVarIdScope = p_iScope;
+  g_iThreadVarIdCount = 0;
+}
+
+/**
+ *  Retrieve the number of automatic variables that the current thread has
+ *   created within its scope since this was last called.
+ *  \return The number of variables created.
+ */
+unsigned int TakeThreadVarIdCount()
+{
+  unsigned int l_iRet = g_iThreadVarIdCount;
+  g_iThreadVarIdCount = 0;
+  return l_iRet;
+}
+
 /**
  *  Create a new, unique variable name of the form "?auto_[number]".
  *  The [number] part is the current value of g_iNextVarIdSuffix, which is
  *   incremented.
+ *  If the current thread has a scope from SetThreadVarIdScope(), the name is
+ *   instead taken from that scope.
  *  \return A string containing a new unique variable name.
  */
 std::string MakeVarId()
 {
-  char l_cArray[32];
+  char l_cArray[48];
+  if( g_iThreadVarIdScope != 0 )
+  {
+    sprintf( l_cArray, "?spec_%u_%u", g_iThreadVarIdScope, g_iThreadVarIdSuffix++ );
+    g_iThreadVarIdCount++;
+    return l_cArray;
+  }
   sprintf( l_cArray, "?auto_%d", g_iNextVarIdSuffix++ );
   return l_cArray;
 }
@@ -636,3 +703,19 @@ size_t HashStr::operator() ( const std::string & x ) const
 
   return l_iHash;
 }
+
+/**
+ *  Scramble a hash value so that every bit of the input affects every bit of
+ *   the output.
+ *  Hashes that are combined by adding them up, which does not depend on
+ *   their order, need this to keep distinct sets from colliding.
+ *  \param p_iHash IN The hash value to scramble.
+ *  \return The scrambled hash value.
+ */
+uint64_t MixHash( uint64_t p_iHash )
+{
+  p_iHash += 0x9E3779B97F4A7C15ULL;
+  p_iHash = ( p_iHash ^ ( p_iHash >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+  p_iHash = ( p_iHash ^ ( p_iHash >> 27 ) ) * 0x94D049BB133111EBULL;
+  return p_iHash ^ ( p_iHash >> 31 );
+}
@@ -1,6 +1,8 @@
 #ifndef FUNCS_HPP__
 #define FUNCS_HPP__
 
+#include <stdint.h>
+
 int CompareNoCase( const std::string & p_sFirst, const std::string & p_sSecond );
 
 struct StrLessNoCase
@@ -54,6 +56,10 @@ std::string PrintRequirements( long l_iReqs );
 std::string ReadFile( std::string p_sFileName ) throw ( StreamFailException );
 
 void IncreaseNextVarId( unsigned int p_iNewMinimum );
+unsigned int GetNextVarId();
+void SkipVarIds( unsigned int p_iNum );
+void SetThreadVarIdScope( unsigned int p_iScope );
+unsigned int TakeThreadVarIdCount();
 std::string MakeVarId();
 std::string MakeTempOldId();
 std::string MakeTempNewId();
@@ -64,5 +70,7 @@ struct HashStr
   size_t operator() ( const std::string & x ) const;
 };
 
+uint64_t MixHash( uint64_t p_iHash );
+
 
 #endif//FUNCS_HPP__
@@ -0,0 +1,232 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <map>
+#include <tr1/memory>
+#include <pthread.h>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "string_table.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_variable.hpp"
+#include "term_constant.hpp"
+#include "term_table.hpp"
+#include "type_table.hpp"
+#include "formula.hpp"
+#include "formula_pred.hpp"
+#include "ground_atom.hpp"
+
+/** \file ground_atom.hpp
+ *  Declaration of the GroundAtom class.
+ */
+
+/** \file ground_atom.cpp
+ *  Definition of the GroundAtom class.
+ */
+
+/** \def GROUND_ATOM_MAX_ARGS
+ *  The number of parameters that a GroundAtom holds in place.
+ *  Any more are kept in g_vWideArgs, and a precondition that mentions such
+ *   a predicate is not compiled into a UnifyPlan.
+ */
+
+/** \class GroundAtom
+ *  A compact representation of a ground predicate, which is how a State
+ *   stores the atoms that hold in it.
+ *  Rather than smart pointers, it holds the index of its relation in the
+ *   global StringTable and the ids of its parameters in the global TermTable,
+ *   in a fixed-size array.  Thus it needs no allocation of its own, and may be
+ *   copied, hashed and compared without touching any Term.
+ *  The rare atom with more than GROUND_ATOM_MAX_ARGS parameters keeps the
+ *   rest in g_vWideArgs, which interns them so that an index can stand for
+ *   them.
+ */
+
+/** \var GroundAtom::m_iRelation
+ *  The index of the relation (predicate symbol) of this atom in the global
+ *   StringTable.
+ */
+
+/** \var GroundAtom::m_iValence
+ *  The number of parameters of this atom.
+ */
+
+/** \var GroundAtom::m_aArgs
+ *  The ids of the parameters of this atom in the global TermTable.
+ *  Slots beyond the valence are always zero.
+ */
+
+/** \var GroundAtom::m_iWideArgs
+ *  For an atom with more than GROUND_ATOM_MAX_ARGS parameters, the index in
+ *   g_vWideArgs of the ids of the rest.  Otherwise, zero.
+ */
+
+/** \class HashGroundAtom
+ *  A functor to hash GroundAtoms.
+ */
+
+/** \class EqualGroundAtom
+ *  A functor to determine whether or not two GroundAtoms are equal.
+ */
+
+/**
+ *  The one and only StringTable, defined in string_table.cpp.
+ */
+extern StringTable g_StrTable;
+
+/**
+ *  The one and only TermTable, defined in term_table.cpp.
+ */
+extern TermTable g_TermTable;
+
+/**
+ *  The ids of the parameters beyond GROUND_ATOM_MAX_ARGS of every wide atom
+ *   made so far, each list stored once.
+ */
+std::vector< std::vector< unsigned int > > g_vWideArgs;
+
+/**
+ *  A map from each list in g_vWideArgs to its index.
+ */
+std::map< std::vector< unsigned int >, unsigned int > g_mWideArgs;
+
+/**
+ *  A lock on g_vWideArgs and g_mWideArgs, which search threads may share.
+ */
+pthread_mutex_t g_WideArgsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ *  Construct an empty GroundAtom.
+ *  This is only meaningful as a placeholder to be assigned over.
+ */
+GroundAtom::GroundAtom()
+  : m_iRelation( 0 ),
+    m_iValence( 0 ),
+    m_iWideArgs( 0 )
+{
+  for( unsigned int i = 0; i < GROUND_ATOM_MAX_ARGS; i++ )
+    m_aArgs[i] = 0;
+}
+
+/**
+ *  Construct the GroundAtom for a ground predicate.
+ *  Throws E_STATE_NOT_ATOM if the predicate is not ground.
+ *  \param p_Pred IN The predicate, all of whose parameters must be constants.
+ */
+GroundAtom::GroundAtom( const FormulaPred & p_Pred )
+  : m_iRelation( p_Pred.GetRelationIndex() ),
+    m_iValence( p_Pred.GetValence() ),
+    m_iWideArgs( 0 )
+{
+  std::vector< unsigned int > l_vArgs( m_iValence );
+  for( unsigned int i = 0; i < m_iValence; i++ )
+  {
+    l_vArgs[i] = p_Pred.GetCParam( i )->GetId();
+    if( l_vArgs[i] == TERM_NO_ID )
+      throw Exception( E_STATE_NOT_ATOM,
+		       "\"" + p_Pred.ToStr() + "\" is not an atom.",
+		       __FILE__,
+		       __LINE__ );
+  }
+
+  for( unsigned int i = 0; i < GROUND_ATOM_MAX_ARGS; i++ )
+    m_aArgs[i] = i < m_iValence ? l_vArgs[i] : 0;
+  if( m_iValence > GROUND_ATOM_MAX_ARGS )
+    SetWideArgs( &l_vArgs[0] );
+}
+
+/**
+ *  Construct a GroundAtom from the ids of its parameters.
+ *  \param p_iRelation IN The index of the relation in the global StringTable.
+ *  \param p_iValence IN The number of parameters.
+ *  \param p_aArgs IN The ids of the constants that are its parameters.
+ */
+GroundAtom::GroundAtom( unsigned int p_iRelation,
+			unsigned int p_iValence,
+			const unsigned int * p_aArgs )
+  : m_iRelation( p_iRelation ),
+    m_iValence( p_iValence ),
+    m_iWideArgs( 0 )
+{
+  for( unsigned int i = 0; i < GROUND_ATOM_MAX_ARGS; i++ )
+    m_aArgs[i] = i < m_iValence ? p_aArgs[i] : 0;
+  if( m_iValence > GROUND_ATOM_MAX_ARGS )
+    SetWideArgs( p_aArgs );
+}
+
+/**
+ *  Intern the parameters of a wide atom beyond GROUND_ATOM_MAX_ARGS.
+ *  \param p_aArgs IN The ids of all of the parameters of this atom.
+ */
+void GroundAtom::SetWideArgs( const unsigned int * p_aArgs )
+{
+  std::vector< unsigned int > l_vWide( p_aArgs + GROUND_ATOM_MAX_ARGS, p_aArgs + m_iValence );
+
+  pthread_mutex_lock( &g_WideArgsMutex );
+  std::map< std::vector< unsigned int >, unsigned int >::iterator l_iFound = g_mWideArgs.find( l_vWide );
+  if( l_iFound == g_mWideArgs.end() )
+  {
+    l_iFound = g_mWideArgs.insert( std::make_pair( l_vWide, (unsigned int)g_vWideArgs.size() ) ).first;
+    g_vWideArgs.push_back( l_vWide );
+  }
+  m_iWideArgs = l_iFound->second;
+  pthread_mutex_unlock( &g_WideArgsMutex );
+}
+
+/**
+ *  Retrieve the id of a parameter of a wide atom beyond GROUND_ATOM_MAX_ARGS.
+ *  \param p_iIndex IN The position of the parameter.
+ *  \return The id of the constant in that position.
+ */
+unsigned int GroundAtom::GetWideArgId( unsigned int p_iIndex ) const
+{
+  pthread_mutex_lock( &g_WideArgsMutex );
+  unsigned int l_iRet = g_vWideArgs[m_iWideArgs][p_iIndex - GROUND_ATOM_MAX_ARGS];
+  pthread_mutex_unlock( &g_WideArgsMutex );
+  return l_iRet;
+}
+
+/**
+ *  Retrieve one parameter of this atom.
+ *  \param p_iIndex IN The position of the parameter.
+ *  \return A smart pointer to the constant in that position.
+ */
+const TermP & GroundAtom::GetCParam( unsigned int p_iIndex ) const
+{
+  return g_TermTable.LookupId( GetArgId( p_iIndex ) );
+}
+
+/**
+ *  Retrieve a string representation of this atom.
+ *  This is the same as that of the FormulaPred it was made from.
+ *  \return A string representation of this atom.
+ */
+std::string GroundAtom::ToStr() const
+{
+  std::string l_sRet;
+  l_sRet += "( ";
+
+  l_sRet += g_StrTable.Lookup( m_iRelation );
+
+  for( unsigned int i = 0; i < m_iValence; i++ )
+  {
+    l_sRet += " ";
+    l_sRet += GetCParam( i )->ToStr();
+  }
+
+  l_sRet += " )";
+  return l_sRet;
+}
+
+/**
+ *  Determine whether or not two GroundAtoms are equal.
+ *  \param p_First IN The first GroundAtom.
+ *  \param p_Second IN The second GroundAtom.
+ *  \return Whether or not the two are equal.
+ */
+bool operator==( const GroundAtom & p_First, const GroundAtom & p_Second )
+{
+  return p_First.Equal( p_Second );
+}
@@ -0,0 +1,107 @@
+#ifndef GROUND_ATOM_HPP__
+#define GROUND_ATOM_HPP__
+
+#define GROUND_ATOM_MAX_ARGS 6
+
+class GroundAtom
+{
+public:
+  GroundAtom();
+  GroundAtom( const FormulaPred & p_Pred );
+  GroundAtom( unsigned int p_iRelation,
+	      unsigned int p_iValence,
+	      const unsigned int * p_aArgs );
+
+  /**
+   *  Retrieve the index of the relation (predicate symbol) of this atom in
+   *   the global StringTable.
+   *  \return The index of the relation of this atom.
+   */
+  unsigned int GetRelationIndex() const
+  {
+    return m_iRelation;
+  }
+
+  /**
+   *  Retrieve the number of parameters of this atom.
+   *  \return The number of parameters of this atom.
+   */
+  unsigned int GetValence() const
+  {
+    return m_iValence;
+  }
+
+  /**
+   *  Retrieve the id in the global TermTable of one parameter of this atom.
+   *  \param p_iIndex IN The position of the parameter.
+   *  \return The id of the constant in that position.
+   */
+  unsigned int GetArgId( unsigned int p_iIndex ) const
+  {
+    if( p_iIndex < GROUND_ATOM_MAX_ARGS )
+      return m_aArgs[p_iIndex];
+    return GetWideArgId( p_iIndex );
+  }
+
+  const TermP & GetCParam( unsigned int p_iIndex ) const;
+
+  std::string ToStr() const;
+
+  /**
+   *  Hash this atom.
+   *  Every argument slot takes part, used or not, so that there is no branch
+   *   on the valence.  The parameters of a wide atom beyond the slots are
+   *   interned, so their index stands in for them.
+   *  \return A hash value for this atom.
+   */
+  size_t Hash() const
+  {
+    size_t l_iHash = m_iRelation * 31 + m_iValence;
+    for( unsigned int i = 0; i < GROUND_ATOM_MAX_ARGS; i++ )
+      l_iHash = l_iHash * 31 + m_aArgs[i];
+    return l_iHash * 31 + m_iWideArgs;
+  }
+
+  /**
+   *  Determine whether or not this atom is equal to another.
+   *  As with GroundAtom::Hash(), every slot is compared without branching.
+   *  \param p_Other IN The atom that might be equal.
+   *  \return Whether or not the two atoms are equal.
+   */
+  bool Equal( const GroundAtom & p_Other ) const
+  {
+    unsigned int l_iDiff = ( m_iRelation ^ p_Other.m_iRelation ) | ( m_iValence ^ p_Other.m_iValence ) | ( m_iWideArgs ^ p_Other.m_iWideArgs );
+    for( unsigned int i = 0; i < GROUND_ATOM_MAX_ARGS; i++ )
+      l_iDiff |= m_aArgs[i] ^ p_Other.m_aArgs[i];
+    return l_iDiff == 0;
+  }
+
+private:
+  void SetWideArgs( const unsigned int * p_aArgs );
+  unsigned int GetWideArgId( unsigned int p_iIndex ) const;
+
+  unsigned int m_iRelation;
+  unsigned int m_iValence;
+  unsigned int m_aArgs[GROUND_ATOM_MAX_ARGS];
+  unsigned int m_iWideArgs;
+};
+
+struct HashGroundAtom
+{
+  size_t operator() ( const GroundAtom & x ) const
+  {
+    return x.Hash();
+  }
+};
+
+struct EqualGroundAtom
+{
+  bool operator() ( const GroundAtom & x, const GroundAtom & y ) const
+  {
+    return x.Equal( y );
+  }
+};
+
+bool operator==( const GroundAtom & p_First, const GroundAtom & p_Second );
+
+#endif//GROUND_ATOM_HPP__
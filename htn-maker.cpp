@@ -2,18 +2,23 @@
 #include <sstream>
 #include <vector>
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <set>
+#include <utility>
 #include <tr1/memory>
+#include <pthread.h>
 
 #include <tclap/CmdLine.h>
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_constant.hpp"
 #include "term_variable.hpp"
+#include "term_table.hpp"
 #include "type_table.hpp"
 #include "substitution.hpp"
 #include "formula.hpp"
@@ -22,6 +27,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_domain.hpp"
 #include "strips_problem.hpp"
@@ -46,9 +53,69 @@
 #define FLAG_ND_CHECKERS                0x00000200
 #define FLAG_QVALUES                    0x00000400
 
+/**
+ *  The number of jobs that each worker is given at once to try out, when
+ *   learning with more than one thread.
+ */
+#define LEARN_JOBS_PER_THREAD 2
+
+/**
+ *  Learning from one partial method over one subsequence of the plan, which a
+ *   worker tries out without changing the plan or the domain.
+ */
+struct LearnJob
+{
+  unsigned int m_iInitState;
+  const PartialHtnMethod * m_pPartial;
+  bool m_bChanges;
+  unsigned int m_iNumVarIds;
+};
+
+/**
+ *  Everything shared among the workers that try out jobs in parallel.
+ *  The main thread hands out a batch of jobs and waits until all of them have
+ *   been tried before it changes the plan or the domain, so the workers only
+ *   ever see them unchanged.
+ */
+struct LearnPool
+{
+  pthread_mutex_t m_Mutex;
+  pthread_cond_t m_WorkCond;
+  pthread_cond_t m_DoneCond;
+  std::vector< pthread_t > m_vThreads;
+  std::vector< LearnJob > m_vJobs;
+  unsigned int m_iNextJob;
+  unsigned int m_iNumDone;
+  unsigned int m_iFinalState;
+  AnnotatedPlan * m_pPlan;
+  HtnDomain * m_pDomain;
+  bool m_bQuit;
+};
+
+std::vector< std::pair< std::string, std::string > > ReadManifest( const std::string & p_sManifestFile );
+
+AnnotatedPlan * ReadTrace( const std::string & p_sProblemFile,
+			   const std::string & p_sSolutionFile,
+			   const std::tr1::shared_ptr< StripsDomain > & p_pStripsDomain );
+
+uint64_t HashPlanSteps( const AnnotatedPlan * p_pPlan,
+			unsigned int p_iNumSteps );
+
+unsigned int ResumeLearning( const std::string & p_sStateFile,
+			     const std::pair< std::string, std::string > & p_Trace,
+			     AnnotatedPlan * p_pPlan,
+			     const HtnDomain * p_pDomain );
+
+void SaveLearningState( const std::string & p_sStateFile,
+			const std::pair< std::string, std::string > & p_Trace,
+			const AnnotatedPlan * p_pPlan,
+			const HtnDomain * p_pDomain );
+
 void LearnMethods( AnnotatedPlan * p_pPlan,
 		   HtnTaskList * p_pTasks,
-		   HtnDomain * p_pHtnDomain );
+		   HtnDomain * p_pHtnDomain,
+		   const std::tr1::shared_ptr< const HtnDomain > & p_pSnapshot,
+		   unsigned int p_iFirstState );
 
 void DoSubsumption( HtnDomain * p_pHtnDomain,
 		    HtnMethod * p_pNewMethod );
@@ -56,11 +123,19 @@ void DoSubsumption( HtnDomain * p_pHtnDomain,
 void DoQValueUpdate( HtnDomain * p_pHtnDomain,
 		     HtnMethod * p_pNewMethod );
 
-void LearnFromExactSequence( unsigned int p_iInitState,
+bool LearnFromExactSequence( unsigned int p_iInitState,
 			     unsigned int p_iFinalState,
 			     AnnotatedPlan * p_pPlan,
 			     HtnDomain * p_pDomain,
-			     const PartialHtnMethod * p_pPartial );
+			     const PartialHtnMethod * p_pPartial,
+			     bool p_bDryRun );
+
+bool LearnFromPartial( unsigned int p_iInitState,
+		       unsigned int p_iFinalState,
+		       AnnotatedPlan * p_pPlan,
+		       HtnDomain * p_pDomain,
+		       const PartialHtnMethod * p_pPartial,
+		       bool p_bDryRun );
 
 void LearnFromSubsequences( unsigned int p_iInitState,
 			    unsigned int p_iFinalState,
@@ -68,13 +143,25 @@ void LearnFromSubsequences( unsigned int p_iInitState,
 			    HtnDomain * p_pDomain,
 			    const std::vector< PartialHtnMethod * > & p_vPartials );
 
+void LearnFromSubsequencesParallel( unsigned int p_iFinalState,
+				    AnnotatedPlan * p_pPlan,
+				    HtnDomain * p_pDomain,
+				    const std::vector< PartialHtnMethod * > & p_vPartials );
+
+void StartLearnPool( AnnotatedPlan * p_pPlan,
+		     HtnDomain * p_pDomain );
+void StopLearnPool();
+
+HtnMethod * NameVarsInOrder( HtnMethod * p_pMethod );
+
 bool TrySolving( AnnotatedPlan * p_pPlan, 
 		 unsigned int p_iInitState,
 		 unsigned int p_iForState,
 		 const std::tr1::shared_ptr< HtnTaskDescr > & p_pTask,
 		 const Substitution * p_pTaskSubs,
 		 const Substitution * p_pMasterSubs,
-		 const HtnDomain * p_pDomain );
+		 const HtnDomain * p_pDomain,
+		 bool p_bDryRun );
 
 void MakeSoundnessCheckMethods( const HtnTaskList * p_pTasks,
 				HtnDomain * p_pDomain );
@@ -82,16 +169,23 @@ void MakeSoundnessCheckMethods( const HtnTaskList * p_pTasks,
 void MakeTrivialNdCheckers( HtnDomain * p_pDomain );
 void LearnNdCheckers( unsigned int p_iAction,
 		      const StripsSolution * p_pPlan,
-		      HtnDomain * p_pDomain );
+		      HtnDomain * p_pDomain,
+		      const std::tr1::shared_ptr< const HtnDomain > & p_pSnapshot );
 void LearnOneNdChecker( unsigned int p_iInitState,
 			unsigned int p_iFinalState,
 			const Operator * p_pDesiredOp,
 			const StripsSolution * p_pPlan,
-			HtnDomain * p_pDomain );
+			HtnDomain * p_pDomain,
+			const std::tr1::shared_ptr< const HtnDomain > & p_pSnapshot );
 
 unsigned long g_iFlags;
 unsigned int g_iMaxMethodId;
 char g_cMethodIdStr[8];
+unsigned int g_iNumThreads;
+LearnPool g_Pool;
+
+extern TermTable g_TermTable;
+extern HashStr g_StrHasher;
 
 int main( int argc, char * argv[] )
 {
@@ -104,6 +198,9 @@ int main( int argc, char * argv[] )
   std::string l_sProblemFile;
   std::string l_sSolutionFile;
   std::string l_sHtnDomainFile;
+  std::string l_sManifestFile;
+  std::string l_sResumeFile;
+  std::string l_sSaveFile;
 
   try
   {
@@ -126,6 +223,10 @@ int main( int argc, char * argv[] )
     TCLAP::SwitchArg l_aSoundnessCheck( "", "soundness_check", "Include in methods a check to guarantee effects have been achieved.", l_cCmd, false );
     TCLAP::SwitchArg l_aNdCheckers( "", "nd_checkers", "Generate methods to force the desired outcome of a non-deterministic operator.", l_cCmd, false );
     TCLAP::SwitchArg l_aQValues( "", "qvalues", "Calculate initial Q-values for methods.", l_cCmd, false );
+    TCLAP::ValueArg<unsigned int> l_aThreads( "j", "threads", "Learn with this many threads.  The learned domain is the same as with one.", false, 1, "unsigned int", l_cCmd );
+    TCLAP::ValueArg<std::string> l_aManifestFile( "", "batch", "Path to a manifest of further problem and solution files, one pair per line, to learn from in order after the first into the same domain.", false, "", "manifest_file", l_cCmd );
+    TCLAP::ValueArg<std::string> l_aResumeFile( "", "resume", "Path to a learning state saved by an earlier run, whose learned domain must be given as the HTN domain file.  If the first trace is the one it was saved from, learning resumes where it stopped; otherwise, only the new traces are learned from.", false, "", "state_file", l_cCmd );
+    TCLAP::ValueArg<std::string> l_aSaveFile( "", "save_state", "Path to which to save the learning state after the last trace, so that a later run may resume from it.", false, "", "state_file", l_cCmd );
 
     l_cCmd.parse( argc, argv );
 
@@ -134,6 +235,9 @@ int main( int argc, char * argv[] )
     l_sProblemFile = l_aProblemFile.getValue();
     l_sSolutionFile = l_aSolutionFile.getValue();
     l_sHtnDomainFile = l_aHtnDomainFile.getValue();
+    l_sManifestFile = l_aManifestFile.getValue();
+    l_sResumeFile = l_aResumeFile.getValue();
+    l_sSaveFile = l_aSaveFile.getValue();
     if( l_aNoSubsumption.getValue() ) g_iFlags |= FLAG_NO_SUBSUMPTION;
     if( l_aPartialGeneralization.getValue() ) g_iFlags |= FLAG_PARTIAL_GENERALIZATION;
     if( l_aOnlyTaskEffects.getValue() ) g_iFlags |= FLAG_ONLY_TASK_EFFECTS;
@@ -145,6 +249,9 @@ int main( int argc, char * argv[] )
     if( l_aSoundnessCheck.getValue() ) g_iFlags |= FLAG_SOUNDNESS_CHECK;
     if( l_aNdCheckers.getValue() ) g_iFlags |= FLAG_ND_CHECKERS;
     if( l_aQValues.getValue() ) g_iFlags |= FLAG_QVALUES;
+    g_iNumThreads = l_aThreads.getValue();
+    if( g_iNumThreads == 0 )
+      g_iNumThreads = 1;
   }
   catch( TCLAP::ArgException &e )
   {
@@ -153,47 +260,39 @@ int main( int argc, char * argv[] )
   }
 
   std::tr1::shared_ptr< StripsDomain > l_pStripsDomain;
-  std::tr1::shared_ptr< StripsProblem > l_pStripsProblem;
-  AnnotatedPlan * l_pStripsPlan = 0;
   HtnTaskList * l_pHtnTaskList = 0;
   HtnDomain * l_pHtnDomain = 0;
+  std::tr1::shared_ptr< HtnDomain > l_pDomainSnapshot;
 
-  try
+  // Each trace is a problem and its solution, and every one of them is
+  //  learned from into the same domain.
+  std::vector< std::pair< std::string, std::string > > l_vTraces;
+  l_vTraces.push_back( std::make_pair( l_sProblemFile, l_sSolutionFile ) );
+  if( !l_sManifestFile.empty() )
   {
-    l_pStripsDomain = std::tr1::shared_ptr< StripsDomain >( new StripsDomain( ReadFile( l_sStripsDomainFile ) ) );
-  }
-  catch( FileReadException & e )
-  {
-    e.SetFileName( l_sStripsDomainFile );
-    throw e;
+    std::vector< std::pair< std::string, std::string > > l_vMore = ReadManifest( l_sManifestFile );
+    l_vTraces.insert( l_vTraces.end(), l_vMore.begin(), l_vMore.end() );
   }
 
   try
   {
-    l_pStripsProblem = std::tr1::shared_ptr< StripsProblem >( new StripsProblem( ReadFile( l_sProblemFile ), 
-								   l_pStripsDomain ) );
+    l_pStripsDomain = std::tr1::shared_ptr< StripsDomain >( new StripsDomain( ReadFile( l_sStripsDomainFile ) ) );
   }
   catch( FileReadException & e )
   {
-    e.SetFileName( l_sProblemFile );
+    e.SetFileName( l_sStripsDomainFile );
     throw e;
   }
 
-  try
-  {
-    l_pStripsPlan = new AnnotatedPlan( l_pStripsProblem, 
-				       ReadFile( l_sSolutionFile ) );
-  }
-  catch( FileReadException & e )
-  {
-    e.SetFileName( l_sSolutionFile );
-    throw e;
-  }
+  AnnotatedPlan * l_pStripsPlan = ReadTrace( l_vTraces[0].first,
+					     l_vTraces[0].second,
+					     l_pStripsDomain );
 
   try
   {
-    std::stringstream l_sDomainStream( ReadFile( l_sHtnDomainFile ) );
-    l_pHtnDomain = HtnDomain::FromPddl( l_sDomainStream );
+    MappedFile l_DomainFile( l_sHtnDomainFile );
+    PddlTokenizer l_DomainTokens( l_DomainFile.GetData(), l_DomainFile.GetSize() );
+    l_pHtnDomain = HtnDomain::FromPddl( l_DomainTokens );
   }
   catch( FileReadException & e )
   {
@@ -201,9 +300,13 @@ int main( int argc, char * argv[] )
     throw e;
   }
 
+  // Learning never changes the types, predicates, or requirements of the
+  //  domain, so one copy of it serves the task list and every partial method.
+  l_pDomainSnapshot = std::tr1::shared_ptr< HtnDomain >( new HtnDomain( *l_pHtnDomain ) );
+
   try
   {
-    l_pHtnTaskList = new HtnTaskList( std::tr1::shared_ptr< HtnDomain >( new HtnDomain( *l_pHtnDomain ) ), ReadFile( l_sTasksFile ) );
+    l_pHtnTaskList = new HtnTaskList( l_pDomainSnapshot, ReadFile( l_sTasksFile ) );
   }
   catch( FileReadException & e )
   {
@@ -228,15 +331,40 @@ int main( int argc, char * argv[] )
   if( g_iFlags & FLAG_ND_CHECKERS )
     MakeTrivialNdCheckers( l_pHtnDomain );
 
-  LearnMethods( l_pStripsPlan,
-		l_pHtnTaskList,
-		l_pHtnDomain );
+  unsigned int l_iFirstState = 1;
+  if( !l_sResumeFile.empty() )
+    l_iFirstState = ResumeLearning( l_sResumeFile,
+				    l_vTraces[0],
+				    l_pStripsPlan,
+				    l_pHtnDomain );
+
+  for( unsigned int i = 0; i < l_vTraces.size(); i++ )
+  {
+    if( i > 0 )
+    {
+      delete l_pStripsPlan;
+      l_pStripsPlan = ReadTrace( l_vTraces[i].first,
+				 l_vTraces[i].second,
+				 l_pStripsDomain );
+    }
+    LearnMethods( l_pStripsPlan,
+		  l_pHtnTaskList,
+		  l_pHtnDomain,
+		  l_pDomainSnapshot,
+		  i == 0 ? l_iFirstState : 1 );
+  }
+
+  if( !l_sSaveFile.empty() )
+    SaveLearningState( l_sSaveFile,
+		       l_vTraces.back(),
+		       l_pStripsPlan,
+		       l_pHtnDomain );
+  delete l_pStripsPlan;
 
   std::cout << l_pHtnDomain->ToPddl() << "\n";
 
   delete l_pHtnDomain;  
   delete l_pHtnTaskList;
-  delete l_pStripsPlan;
 
 #ifdef CATCH_EXCEPTS
   }catch( Exception & e ){ std::cerr << "\n" << e.ToStr() << "\n"; return 1; }
@@ -245,7 +373,248 @@ int main( int argc, char * argv[] )
   return 0;
 }
 
-std::vector< PartialHtnMethod * > * GetPartials( const HtnDomain * p_pDomain,
+/**
+ *  Read a manifest of plan traces.
+ *  Each line names a problem file and then its solution file, separated by
+ *   whitespace.  Blank lines and lines that begin with a semicolon are
+ *   ignored.
+ *  \param p_sManifestFile IN The path to the manifest.
+ *  \return The problem file and solution file of each trace, in order.
+ */
+std::vector< std::pair< std::string, std::string > > ReadManifest( const std::string & p_sManifestFile )
+{
+  std::vector< std::pair< std::string, std::string > > l_vRet;
+  std::string l_sContents;
+
+  try
+  {
+    l_sContents = ReadFile( p_sManifestFile );
+  }
+  catch( FileReadException & e )
+  {
+    e.SetFileName( p_sManifestFile );
+    throw e;
+  }
+
+  // ReadFile() leaves the end-of-file marker on the contents.
+  if( !l_sContents.empty() && l_sContents[l_sContents.size() - 1] == (char)EOF )
+    l_sContents.erase( l_sContents.size() - 1 );
+
+  std::stringstream l_sManifest( l_sContents );
+  std::string l_sLine;
+  while( std::getline( l_sManifest, l_sLine ) )
+  {
+    std::stringstream l_sFields( l_sLine );
+    std::string l_sProblemFile, l_sSolutionFile, l_sExtra;
+    if( !( l_sFields >> l_sProblemFile ) || l_sProblemFile[0] == ';' )
+      continue;
+    if( !( l_sFields >> l_sSolutionFile ) || ( l_sFields >> l_sExtra ) )
+    {
+      UnexpectedStringException e( "Each line of a manifest must name a problem file and a solution file: " + l_sLine,
+				   __FILE__,
+				   __LINE__ );
+      e.SetFileName( p_sManifestFile );
+      throw e;
+    }
+    l_vRet.push_back( std::make_pair( l_sProblemFile, l_sSolutionFile ) );
+  }
+
+  return l_vRet;
+}
+
+/**
+ *  Read a problem and its solution into a plan trace.
+ *  \param p_sProblemFile IN The path to the STRIPS problem file.
+ *  \param p_sSolutionFile IN The path to the solution file.
+ *  \param p_pStripsDomain IN A smart pointer to the STRIPS domain, which is
+ *   shared among all of the traces.
+ *  \return A pointer to a new plan, which the caller must delete.
+ */
+AnnotatedPlan * ReadTrace( const std::string & p_sProblemFile,
+			   const std::string & p_sSolutionFile,
+			   const std::tr1::shared_ptr< StripsDomain > & p_pStripsDomain )
+{
+  std::tr1::shared_ptr< StripsProblem > l_pStripsProblem;
+
+  try
+  {
+    l_pStripsProblem = std::tr1::shared_ptr< StripsProblem >( new StripsProblem( ReadFile( p_sProblemFile ), 
+								   p_pStripsDomain ) );
+  }
+  catch( FileReadException & e )
+  {
+    e.SetFileName( p_sProblemFile );
+    throw e;
+  }
+
+  try
+  {
+    return new AnnotatedPlan( l_pStripsProblem, 
+			      ReadFile( p_sSolutionFile ) );
+  }
+  catch( FileReadException & e )
+  {
+    e.SetFileName( p_sSolutionFile );
+    throw e;
+  }
+}
+
+/**
+ *  Hash the text of the first steps of a plan.
+ *  Only the names of the operators and their parameters are used, so the
+ *   hash is the same from one run to the next.
+ *  \param p_pPlan IN The plan whose steps to hash.
+ *  \param p_iNumSteps IN How many steps from the start of the plan to hash.
+ *  \return A hash of the number and text of the steps.
+ */
+uint64_t HashPlanSteps( const AnnotatedPlan * p_pPlan,
+			unsigned int p_iNumSteps )
+{
+  uint64_t l_iHash = MixHash( p_iNumSteps );
+
+  for( unsigned int i = 0; i < p_iNumSteps; i++ )
+  {
+    const Operator * l_pOp = p_pPlan->GetCOperator( i );
+    std::string l_sStep = "( " + l_pOp->GetName();
+    for( unsigned int j = 0; j < l_pOp->GetNumParams(); j++ )
+      l_sStep += " " + l_pOp->GetCParam( j )->AfterSubstitution( *p_pPlan->GetCSubstitution( i ), 0 )->ToStr();
+    l_sStep += " )";
+    l_iHash = MixHash( l_iHash ^ g_StrHasher( l_sStep ) );
+  }
+
+  return l_iHash;
+}
+
+/**
+ *  Restore the state of learning saved by SaveLearningState().
+ *  The names of new variables and the ids of new methods continue from where
+ *   they were.  If the first trace to learn from is the one that was saved,
+ *   the methods that were found to cover parts of it are added back to it.
+ *  The trace is known by its files, and the steps of its plan that were
+ *   learned from must be the same as when it was saved.
+ *  \param p_sStateFile IN The path to the saved state.
+ *  \param p_Trace IN The problem file and solution file of the first trace.
+ *  \param p_pPlan INOUT The plan of the first trace.
+ *  \param p_pDomain IN The domain that was learned when the state was saved.
+ *  \return The index of the first state in which tasks of the first trace may
+ *   end that has not already been learned from.
+ */
+unsigned int ResumeLearning( const std::string & p_sStateFile,
+			     const std::pair< std::string, std::string > & p_Trace,
+			     AnnotatedPlan * p_pPlan,
+			     const HtnDomain * p_pDomain )
+{
+  std::stringstream l_sInput;
+  unsigned int l_iRet = 1;
+
+  try
+  {
+    l_sInput.str( ReadFile( p_sStateFile ) );
+
+    EatWhitespace( l_sInput );
+    EatString( l_sInput, "(" );
+    EatWhitespace( l_sInput );
+    EatString( l_sInput, ":learning-state" );
+    EatWhitespace( l_sInput );
+
+    EatString( l_sInput, ":next-var-id" );
+    EatWhitespace( l_sInput );
+    unsigned int l_iNextVarId = atoi( ReadString( l_sInput ).c_str() );
+    if( l_iNextVarId > 0 )
+      IncreaseNextVarId( l_iNextVarId - 1 );
+    EatWhitespace( l_sInput );
+
+    EatString( l_sInput, ":max-method-id" );
+    EatWhitespace( l_sInput );
+    unsigned int l_iMaxMethodId = atoi( ReadString( l_sInput ).c_str() );
+    if( l_iMaxMethodId > g_iMaxMethodId )
+      g_iMaxMethodId = l_iMaxMethodId;
+    EatWhitespace( l_sInput );
+
+    EatString( l_sInput, ":trace" );
+    EatWhitespace( l_sInput );
+    std::string l_sProblemFile = ReadString( l_sInput );
+    EatWhitespace( l_sInput );
+    std::string l_sSolutionFile = ReadString( l_sInput );
+    EatWhitespace( l_sInput );
+
+    EatString( l_sInput, ":states" );
+    EatWhitespace( l_sInput );
+    unsigned int l_iNumStates = atoi( ReadString( l_sInput ).c_str() );
+    EatWhitespace( l_sInput );
+
+    EatString( l_sInput, ":plan-hash" );
+    EatWhitespace( l_sInput );
+    uint64_t l_iPlanHash = 0;
+    std::stringstream( ReadString( l_sInput ) ) >> l_iPlanHash;
+    EatWhitespace( l_sInput );
+
+    // Another trace was finished, so there is nothing more to restore.
+    if( l_sProblemFile != p_Trace.first || l_sSolutionFile != p_Trace.second )
+      return 1;
+
+    if( l_iNumStates > p_pPlan->GetPlanLength() )
+      throw UnexpectedStringException( "The saved learning state covers more of the plan than " + p_Trace.second + " contains.",
+				       __FILE__,
+				       __LINE__ );
+
+    if( HashPlanSteps( p_pPlan, l_iNumStates ) != l_iPlanHash )
+      throw UnexpectedStringException( "The saved learning state was saved from other steps than the plan in " + p_Trace.second + " begins with.",
+				       __FILE__,
+				       __LINE__ );
+
+    EatString( l_sInput, ":instances" );
+    p_pPlan->MethodInstsFromPddl( l_sInput,
+				  p_pDomain->GetAllowableTypes(),
+				  p_pDomain->GetAllowablePredicates(),
+				  p_pDomain->GetRequirements() );
+    l_iRet = l_iNumStates + 1;
+  }
+  catch( FileReadException & e )
+  {
+    e.SetFileName( p_sStateFile );
+    throw e;
+  }
+
+  return l_iRet;
+}
+
+/**
+ *  Save the state of learning after a trace, so that a later run may resume
+ *   from it with ResumeLearning(), given the domain learned by this one.
+ *  \param p_sStateFile IN The path to which to save the state.
+ *  \param p_Trace IN The problem file and solution file of the trace.
+ *  \param p_pPlan IN The plan of the trace, which has been learned from.
+ *  \param p_pDomain IN The domain learned so far.
+ */
+void SaveLearningState( const std::string & p_sStateFile,
+			const std::pair< std::string, std::string > & p_Trace,
+			const AnnotatedPlan * p_pPlan,
+			const HtnDomain * p_pDomain )
+{
+  std::ofstream l_Out( p_sStateFile.c_str() );
+  if( !l_Out.is_open() )
+    throw StreamFailException( "Writing file " + p_sStateFile + " failed.",
+			       __FILE__,
+			       __LINE__ );
+
+  l_Out << "( :learning-state\n";
+  l_Out << "  :next-var-id " << GetNextVarId() << "\n";
+  l_Out << "  :max-method-id " << g_iMaxMethodId << "\n";
+  l_Out << "  :trace " << p_Trace.first << " " << p_Trace.second << "\n";
+  l_Out << "  :states " << p_pPlan->GetPlanLength() << "\n";
+  l_Out << "  :plan-hash " << HashPlanSteps( p_pPlan, p_pPlan->GetPlanLength() ) << "\n";
+  l_Out << "  :instances\n";
+  l_Out << p_pPlan->MethodInstsToPddl( p_pDomain->GetRequirements() );
+  l_Out << ")\n";
+
+  if( !l_Out.good() )
+    throw StreamFailException( "Writing file " + p_sStateFile + " failed.",
+			       __FILE__,
+			       __LINE__ );
+}
+
+std::vector< PartialHtnMethod * > * GetPartials( const std::tr1::shared_ptr< const HtnDomain > & p_pDomain,
 						 const AnnotatedPlan * p_pPlan,
 						 const HtnTaskList * p_pTasks,
 						 unsigned int p_iStateIndex )
@@ -267,7 +636,8 @@ std::vector< PartialHtnMethod * > * GetPartials( const HtnDomain * p_pDomain,
     for( unsigned int i = 0; i < l_vTemp.size(); i++ )
       l_vRelVars.insert( l_vTemp[i] );
 
-    std::vector< Substitution * > * l_pSubs = p_pPlan->GetCState( p_iStateIndex )->GetInstantiations( FormulaPredP( p_pTasks->at( j )->GetCHead() ), p_pTasks->at( j )->GetCEffects(), &l_EmptySub, l_vRelVars );
+    UnifyPlan l_EffectsPlan( p_pTasks->at( j )->GetCEffects() );
+    std::vector< Substitution * > * l_pSubs = p_pPlan->GetCState( p_iStateIndex )->GetInstantiations( FormulaPredP( p_pTasks->at( j )->GetCHead() ), p_pTasks->at( j )->GetCEffects(), &l_EmptySub, l_vRelVars, &l_EffectsPlan );
 
     for( unsigned int k = 0; k < l_pSubs->size(); k++ )
     {
@@ -275,7 +645,7 @@ std::vector< PartialHtnMethod * > * GetPartials( const HtnDomain * p_pDomain,
       // The effects must have just become true.
       if( !p_pPlan->GetCState( p_iStateIndex - 1 )->IsConsistent( l_pGroundEffects ) )
       {
-	PartialHtnMethod * l_pNewPart = new PartialHtnMethod( std::tr1::shared_ptr< HtnDomain >( new HtnDomain( *p_pDomain ) ), p_pTasks->at( j ), l_pSubs->at( k ), p_iStateIndex );
+	PartialHtnMethod * l_pNewPart = new PartialHtnMethod( p_pDomain, p_pTasks->at( j ), l_pSubs->at( k ), p_iStateIndex );
 	l_pRet->push_back( l_pNewPart );
       }
       delete l_pSubs->at( k );
@@ -289,16 +659,21 @@ std::vector< PartialHtnMethod * > * GetPartials( const HtnDomain * p_pDomain,
 
 void LearnMethods( AnnotatedPlan * p_pPlan,
 		   HtnTaskList * p_pTasks,
-		   HtnDomain * p_pHtnDomain )
+		   HtnDomain * p_pHtnDomain,
+		   const std::tr1::shared_ptr< const HtnDomain > & p_pSnapshot,
+		   unsigned int p_iFirstState )
 {
+  if( g_iNumThreads > 1 )
+    StartLearnPool( p_pPlan, p_pHtnDomain );
+
   // Iterate forward through the solution trace.
-  for( unsigned int l_iForState = 1;
+  for( unsigned int l_iForState = p_iFirstState;
        l_iForState < p_pPlan->GetPlanLength() + 1; 
        l_iForState++ )
   {
     // Add new partial methods for tasks that may be ending in this state.
     std::vector< PartialHtnMethod * > * l_pPartials = 
-      GetPartials( p_pHtnDomain,
+      GetPartials( p_pSnapshot,
 		   p_pPlan,
 		   p_pTasks,
 		   l_iForState );
@@ -306,11 +681,17 @@ void LearnMethods( AnnotatedPlan * p_pPlan,
     // Process all of those partials back to each prior state, starting
     //   with the most recent states to encourage composition of learned
     //   methods.
-    LearnFromSubsequences( 0,
-			   l_iForState,
-			   p_pPlan,
-			   p_pHtnDomain,
-			   *l_pPartials );
+    if( g_iNumThreads > 1 )
+      LearnFromSubsequencesParallel( l_iForState,
+				     p_pPlan,
+				     p_pHtnDomain,
+				     *l_pPartials );
+    else
+      LearnFromSubsequences( 0,
+			     l_iForState,
+			     p_pPlan,
+			     p_pHtnDomain,
+			     *l_pPartials );
 
     for( unsigned int l_iCurPartial = 0; 
 	 l_iCurPartial < l_pPartials->size(); 
@@ -322,61 +703,74 @@ void LearnMethods( AnnotatedPlan * p_pPlan,
     if( g_iFlags & FLAG_ND_CHECKERS )
       LearnNdCheckers( l_iForState - 1,
 		       p_pPlan,
-		       p_pHtnDomain );
+		       p_pHtnDomain,
+		       p_pSnapshot );
   }
 
+  if( g_iNumThreads > 1 )
+    StopLearnPool();
 }
 
 void DoSubsumption( HtnDomain * p_pHtnDomain,
 		    HtnMethod * p_pNewMethod )
 {
-  bool l_bFound = false;
-  for( unsigned int m = 0; m < p_pHtnDomain->GetNumMethods() && !l_bFound; m++ )
+  // An exact duplicate is subsumed by the method it duplicates, and only
+  //  structurally compatible methods are worth the full test.
+  bool l_bFound = p_pHtnDomain->FindDuplicate( p_pNewMethod ) >= 0;
+  std::vector< unsigned int > l_vCandidates;
+  if( !l_bFound )
+    l_vCandidates = p_pHtnDomain->GetPossibleSubsumers( p_pNewMethod );
+  for( unsigned int m = 0; m < l_vCandidates.size() && !l_bFound; m++ )
   {
-    if( p_pHtnDomain->GetCMethod( m )->Subsumes( p_pNewMethod ) )
+    if( p_pHtnDomain->GetCMethod( l_vCandidates[m] )->Subsumes( p_pNewMethod ) )
       l_bFound = true;
   }
   if( l_bFound )
     delete p_pNewMethod;
   else
   {
-    bool l_bInserted = false;
-    for( unsigned int m = 0; m < p_pHtnDomain->GetNumMethods(); m++ )
+    l_vCandidates = p_pHtnDomain->GetPossiblySubsumed( p_pNewMethod );
+    std::vector< unsigned int > l_vSubsumed;
+    for( unsigned int m = 0; m < l_vCandidates.size(); m++ )
     {
-      if( p_pNewMethod->Subsumes( p_pHtnDomain->GetCMethod( m ) ) )
-      {
-	if( !l_bInserted )
-	{
-	  l_bInserted = true;
-	  p_pHtnDomain->ReplaceMethod( m, p_pNewMethod );
-	}
-	else
-	{
-	  p_pHtnDomain->RemoveMethod( m );
-	  m--;
-	}
-      }
+      if( p_pNewMethod->Subsumes( p_pHtnDomain->GetCMethod( l_vCandidates[m] ) ) )
+	l_vSubsumed.push_back( l_vCandidates[m] );
     }
-    if( !l_bInserted )
+    if( l_vSubsumed.empty() )
       p_pHtnDomain->AddMethod( p_pNewMethod );
+    else
+    {
+      // The first subsumed method is replaced in place, and the rest are
+      //  removed from the back so that the earlier indices stay valid.
+      p_pHtnDomain->ReplaceMethod( l_vSubsumed[0], p_pNewMethod );
+      for( unsigned int m = l_vSubsumed.size() - 1; m > 0; m-- )
+	p_pHtnDomain->RemoveMethod( l_vSubsumed[m] );
+    }
   }
 }
 
 void DoQValueUpdate( HtnDomain * p_pHtnDomain,
 		     HtnMethod * p_pNewMethod )
 {
-  bool l_bFound = false;
-  for( unsigned int m = 0; m < p_pHtnDomain->GetNumMethods() && !l_bFound; m++ )
+  // An exact duplicate is found by fingerprint; any other equivalent method
+  //  needs the full test.
+  int l_iFound = p_pHtnDomain->FindDuplicate( p_pNewMethod );
+  if( l_iFound < 0 )
   {
-    if( p_pHtnDomain->GetCMethod( m )->Subsumes( p_pNewMethod ) &&
-	p_pNewMethod->Subsumes( p_pHtnDomain->GetCMethod( m ) ) )
+    std::vector< unsigned int > l_vCandidates = p_pHtnDomain->GetPossibleSubsumers( p_pNewMethod );
+    for( unsigned int i = 0; i < l_vCandidates.size() && l_iFound < 0; i++ )
     {
-      l_bFound = true;
-      p_pHtnDomain->UpdateMethodQValue( m, (int)(p_pNewMethod->GetQValue() + 0.5) );
+      unsigned int m = l_vCandidates[i];
+      if( p_pHtnDomain->GetCMethod( m )->Subsumes( p_pNewMethod ) &&
+	  p_pNewMethod->Subsumes( p_pHtnDomain->GetCMethod( m ) ) )
+	l_iFound = m;
     }
   }
-  if( l_bFound )
+  if( l_iFound >= 0 )
+  {
+    p_pHtnDomain->UpdateMethodQValue( l_iFound, (int)(p_pNewMethod->GetQValue() + 0.5) );
     delete p_pNewMethod;
+  }
   else
     p_pHtnDomain->AddMethod( p_pNewMethod );
 }
@@ -395,37 +789,236 @@ void LearnFromSubsequences( unsigned int p_iInitState,
 			   p_vPartials );
 
   for( unsigned int i = 0; i < p_vPartials.size(); i++ )
+    LearnFromPartial( p_iInitState,
+		      p_iFinalState,
+		      p_pPlan,
+		      p_pDomain,
+		      p_vPartials[i],
+		      false );
+}
+
+/**
+ *  Learn from one partial method over one subsequence of the plan.
+ *  \param p_iInitState IN The first state of the subsequence.
+ *  \param p_iFinalState IN The last state of the subsequence, in which the
+ *   task of the partial method ends.
+ *  \param p_pPlan INOUT The plan, to which instances of methods are added.
+ *  \param p_pDomain INOUT The domain, to which learned methods are added.
+ *  \param p_pPartial IN The partial method.
+ *  \param p_bDryRun IN Whether to leave the plan and the domain unchanged,
+ *   only finding out whether they would be changed.
+ *  \return Whether or not the plan or the domain was changed, or would have
+ *   been in a dry run.
+ */
+bool LearnFromPartial( unsigned int p_iInitState,
+		       unsigned int p_iFinalState,
+		       AnnotatedPlan * p_pPlan,
+		       HtnDomain * p_pDomain,
+		       const PartialHtnMethod * p_pPartial,
+		       bool p_bDryRun )
+{
+  if( g_iFlags & FLAG_HARD_SQUELCH )
+  {
+    // Solving the task from any earlier state adds an instance to the plan.
+    for( unsigned int j = 0; j <= p_iInitState; j++ )
+    {
+      if( TrySolving( p_pPlan, 
+		      j,
+		      p_iFinalState,
+		      p_pPartial->GetCTaskDescr(),
+		      p_pPartial->GetCTaskSubs(),
+		      p_pPartial->GetCMasterSubs(),
+		      p_pDomain,
+		      p_bDryRun ) )
+	return true;
+    }
+  }
+
+  return LearnFromExactSequence( p_iInitState,
+				 p_iFinalState,
+				 p_pPlan,
+				 p_pDomain,
+				 p_pPartial,
+				 p_bDryRun );
+}
+
+/**
+ *  Try out the jobs of the current batch until there are none left.
+ *  \param p_pWorker IN The index of this worker.
+ *  \return NULL.
+ */
+void * LearnWorker( void * p_pWorker )
+{
+  // Variables created while trying out a job must not use up the names that
+  //  the main thread will give out.
+  SetThreadVarIdScope( (unsigned int)(size_t)p_pWorker + 1 );
+
+  pthread_mutex_lock( &g_Pool.m_Mutex );
+  while( true )
+  {
+    while( !g_Pool.m_bQuit && g_Pool.m_iNextJob >= g_Pool.m_vJobs.size() )
+      pthread_cond_wait( &g_Pool.m_WorkCond, &g_Pool.m_Mutex );
+    if( g_Pool.m_bQuit )
+      break;
+    LearnJob & l_Job = g_Pool.m_vJobs[g_Pool.m_iNextJob++];
+    pthread_mutex_unlock( &g_Pool.m_Mutex );
+
+    TakeThreadVarIdCount();
+    try
+    {
+      l_Job.m_bChanges = LearnFromPartial( l_Job.m_iInitState,
+					   g_Pool.m_iFinalState,
+					   g_Pool.m_pPlan,
+					   g_Pool.m_pDomain,
+					   l_Job.m_pPartial,
+					   true );
+    }
+    catch( Exception & e )
+    {
+      // The main thread will run it for real and see the exception itself.
+      l_Job.m_bChanges = true;
+    }
+    l_Job.m_iNumVarIds = TakeThreadVarIdCount();
+
+    pthread_mutex_lock( &g_Pool.m_Mutex );
+    if( ++g_Pool.m_iNumDone == g_Pool.m_vJobs.size() )
+      pthread_cond_signal( &g_Pool.m_DoneCond );
+  }
+  pthread_mutex_unlock( &g_Pool.m_Mutex );
+
+  return NULL;
+}
+
+/**
+ *  Start g_iNumThreads workers for learning from a plan.
+ *  \param p_pPlan IN The plan that will be learned from.
+ *  \param p_pDomain IN The domain to which learned methods will be added.
+ */
+void StartLearnPool( AnnotatedPlan * p_pPlan,
+		     HtnDomain * p_pDomain )
+{
+  // The constants of each state are computed the first time they are needed,
+  //  which must not happen in several workers at once.
+  for( unsigned int i = 0; i < p_pPlan->GetPlanLength() + 1; i++ )
+    p_pPlan->GetCState( i )->GetConstants();
+
+  pthread_mutex_init( &g_Pool.m_Mutex, NULL );
+  pthread_cond_init( &g_Pool.m_WorkCond, NULL );
+  pthread_cond_init( &g_Pool.m_DoneCond, NULL );
+  g_Pool.m_iNextJob = 0;
+  g_Pool.m_iNumDone = 0;
+  g_Pool.m_pPlan = p_pPlan;
+  g_Pool.m_pDomain = p_pDomain;
+  g_Pool.m_bQuit = false;
+
+  g_Pool.m_vThreads.resize( g_iNumThreads );
+  for( unsigned int i = 0; i < g_iNumThreads; i++ )
+  {
+    if( pthread_create( &g_Pool.m_vThreads[i], NULL, LearnWorker, (void *)(size_t)i ) != 0 )
+      throw Exception( E_NOT_IMPLEMENTED,
+		       "Could not create a learning thread.",
+		       __FILE__,
+		       __LINE__ );
+  }
+}
+
+/**
+ *  Stop the workers started by StartLearnPool().
+ */
+void StopLearnPool()
+{
+  pthread_mutex_lock( &g_Pool.m_Mutex );
+  g_Pool.m_bQuit = true;
+  pthread_cond_broadcast( &g_Pool.m_WorkCond );
+  pthread_mutex_unlock( &g_Pool.m_Mutex );
+  for( unsigned int i = 0; i < g_Pool.m_vThreads.size(); i++ )
+    pthread_join( g_Pool.m_vThreads[i], NULL );
+
+  g_Pool.m_vThreads.clear();
+  g_Pool.m_vJobs.clear();
+  pthread_cond_destroy( &g_Pool.m_DoneCond );
+  pthread_cond_destroy( &g_Pool.m_WorkCond );
+  pthread_mutex_destroy( &g_Pool.m_Mutex );
+}
+
+/**
+ *  Do the same as LearnFromSubsequences() from the first state, with the
+ *   workers of g_Pool.
+ *  The jobs are taken in the same order as LearnFromSubsequences() takes
+ *   them, and are tried out in batches by the workers.  Most of them change
+ *   nothing, and the main thread only skips over the names of the variables
+ *   they would have created.  The first one in a batch that would change the
+ *   plan or the domain is run for real by the main thread, and the rest of the
+ *   batch is tried again with that change in place.  The result is the same
+ *   as that of LearnFromSubsequences(), down to the names of the variables.
+ *  \param p_iFinalState IN The state in which the tasks of the partial methods
+ *   end.
+ *  \param p_pPlan INOUT The plan, to which instances of methods are added.
+ *  \param p_pDomain INOUT The domain, to which learned methods are added.
+ *  \param p_vPartials IN The partial methods to learn from.
+ */
+void LearnFromSubsequencesParallel( unsigned int p_iFinalState,
+				    AnnotatedPlan * p_pPlan,
+				    HtnDomain * p_pDomain,
+				    const std::vector< PartialHtnMethod * > & p_vPartials )
+{
+  std::vector< LearnJob > l_vAllJobs;
+  for( int l_iInitState = p_iFinalState - 1; l_iInitState >= 0; l_iInitState-- )
+  {
+    for( unsigned int i = 0; i < p_vPartials.size(); i++ )
+    {
+      LearnJob l_Job;
+      l_Job.m_iInitState = l_iInitState;
+      l_Job.m_pPartial = p_vPartials[i];
+      l_vAllJobs.push_back( l_Job );
+    }
+  }
+
+  unsigned int l_iBatchSize = g_iNumThreads * LEARN_JOBS_PER_THREAD;
+  unsigned int l_iNextJob = 0;
+  while( l_iNextJob < l_vAllJobs.size() )
   {
-    bool l_bLearn = true;
-    if( g_iFlags & FLAG_HARD_SQUELCH )
+    unsigned int l_iEnd = l_iNextJob + l_iBatchSize;
+    if( l_iEnd > l_vAllJobs.size() )
+      l_iEnd = l_vAllJobs.size();
+
+    pthread_mutex_lock( &g_Pool.m_Mutex );
+    g_Pool.m_vJobs.assign( l_vAllJobs.begin() + l_iNextJob, l_vAllJobs.begin() + l_iEnd );
+    g_Pool.m_iFinalState = p_iFinalState;
+    g_Pool.m_iNextJob = 0;
+    g_Pool.m_iNumDone = 0;
+    pthread_cond_broadcast( &g_Pool.m_WorkCond );
+    while( g_Pool.m_iNumDone < g_Pool.m_vJobs.size() )
+      pthread_cond_wait( &g_Pool.m_DoneCond, &g_Pool.m_Mutex );
+    pthread_mutex_unlock( &g_Pool.m_Mutex );
+
+    bool l_bChanged = false;
+    for( unsigned int i = 0; i < g_Pool.m_vJobs.size() && !l_bChanged; i++ )
     {
-      for( unsigned int j = 0; j <= p_iInitState && l_bLearn; j++ )
+      const LearnJob & l_Job = g_Pool.m_vJobs[i];
+      l_iNextJob++;
+      if( l_Job.m_bChanges )
       {
-	if( TrySolving( p_pPlan, 
-			j,
-			p_iFinalState,
-			p_vPartials[i]->GetCTaskDescr(),
-			p_vPartials[i]->GetCTaskSubs(),
-			p_vPartials[i]->GetCMasterSubs(),
-			p_pDomain ) )
-	  l_bLearn = false;
+	LearnFromPartial( l_Job.m_iInitState,
+			  p_iFinalState,
+			  p_pPlan,
+			  p_pDomain,
+			  l_Job.m_pPartial,
+			  false );
+	l_bChanged = true;
       }
+      else
+	SkipVarIds( l_Job.m_iNumVarIds );
     }
-
-    if( l_bLearn )
-      LearnFromExactSequence( p_iInitState,
-			      p_iFinalState,
-			      p_pPlan,
-			      p_pDomain,
-			      p_vPartials[i] );
   }
 }
 
-void LearnFromExactSequence( unsigned int p_iInitState,
+bool LearnFromExactSequence( unsigned int p_iInitState,
 			     unsigned int p_iFinalState,
 			     AnnotatedPlan * p_pPlan,
 			     HtnDomain * p_pDomain,
-			     const PartialHtnMethod * p_pPartial )
+			     const PartialHtnMethod * p_pPartial,
+			     bool p_bDryRun )
 {
   PartialHtnMethod * l_pCurPartial = 
     new PartialHtnMethod( *p_pPartial );
@@ -454,12 +1047,13 @@ void LearnFromExactSequence( unsigned int p_iInitState,
 	}
 
 	std::set< TermVariableP > l_vRelVars;
-	std::vector<Substitution *> * l_pTemp = p_pPlan->GetCState( p_iInitState )->GetInstantiations( p_pPlan->GetCMethod( l_iCurMethod )->GetCPreconditions(), &l_Subs, l_vRelVars );
+	std::vector<Substitution *> * l_pTemp = p_pPlan->GetCState( p_iInitState )->GetInstantiations( *p_pPlan->GetCMethod( l_iCurMethod )->GetCPlan(), &l_Subs, l_vRelVars );
 
 	if( l_pTemp->size() > 0 )
 	{
 	  l_bDrop = true;
-	  p_pPlan->AddMethodInst( p_pPlan->GetCMethod( l_iCurMethod ), l_pTemp->at( 0 ), p_iInitState, p_iFinalState, p_pPlan->GetCTaskDescr( l_iCurMethod ), p_pPlan->GetCMethodEffects( l_iCurMethod ), p_pPlan->GetMethodCost( l_iCurMethod ) );
+	  if( !p_bDryRun )
+	    p_pPlan->AddMethodInst( p_pPlan->GetCMethod( l_iCurMethod ), l_pTemp->at( 0 ), p_iInitState, p_iFinalState, p_pPlan->GetCTaskDescr( l_iCurMethod ), p_pPlan->GetCMethodEffects( l_iCurMethod ), p_pPlan->GetMethodCost( l_iCurMethod ) );
 	  //todo This may not exactly be the correct cost to use here, since we would have been learning a method with higher cost.
 
 	  for( unsigned int i = 0; i < l_pTemp->size(); i++ )
@@ -471,7 +1065,7 @@ void LearnFromExactSequence( unsigned int p_iInitState,
     if( l_bDrop )
     {
       delete l_pCurPartial;
-      return;
+      return true;
     }
   }
 
@@ -540,11 +1134,13 @@ void LearnFromExactSequence( unsigned int p_iInitState,
   }
 
   // Should I make a method?
+  bool l_bChanged = false;
   if( l_bRecentHelped )
   {
     FormulaConjP l_pLiftedPrecs( std::tr1::dynamic_pointer_cast< FormulaConj >( l_pCurPartial->GetCTaskDescr()->GetCPreconditions()->AfterSubstitution( *l_pCurPartial->GetCTaskSubs(), 0 ) ) );
     std::set< TermVariableP > l_vRelVars;
-    std::vector< Substitution * > * l_pInstances = p_pPlan->GetCState( p_iInitState )->GetInstantiations( l_pLiftedPrecs, l_pCurPartial->GetCMasterSubs(), l_vRelVars );
+    UnifyPlan l_LiftedPlan( l_pLiftedPrecs );
+    std::vector< Substitution * > * l_pInstances = p_pPlan->GetCState( p_iInitState )->GetInstantiations( l_LiftedPlan, l_pCurPartial->GetCMasterSubs(), l_vRelVars );
     if( !l_pInstances->empty() && l_pCurPartial->RemainingAddListSatisfied( p_pPlan->GetCState( p_iInitState ) ) )
     {
       // Yes, create a method
@@ -560,7 +1156,7 @@ void LearnFromExactSequence( unsigned int p_iInitState,
 	l_pNewMethod->AddNdCheckers();
       if( g_iFlags & FLAG_VARIABLE_LINKAGE && !l_pNewMethod->SubtasksArePartiallyLinked() )
 	l_bDelete = true;
-      if( l_bDelete )
+      if( l_bDelete || p_bDryRun )
       {
 	delete l_pNewMethod;
       }
@@ -575,6 +1171,7 @@ void LearnFromExactSequence( unsigned int p_iInitState,
 	FormulaConjP l_pMethodEffects( l_pCurPartial->GetActualEffects() );
 
 	p_pPlan->AddMethodInst( l_pNewMethod, l_pInstances->at( 0 ), l_pCurPartial->GetInitStateNum(), l_pCurPartial->GetFinalStateNum(), l_pNewTaskDescr, l_pMethodEffects, l_pNewMethod->GetQValue() );
+	l_pNewMethod = NameVarsInOrder( l_pNewMethod );
 
 	if( l_pNewMethod->GetNumSubtasks() == 1 &&
 	    *l_pNewMethod->GetCSubtask( 0 )  == 
@@ -587,12 +1184,44 @@ void LearnFromExactSequence( unsigned int p_iInitState,
 	else
 	  p_pDomain->AddMethod( l_pNewMethod );
       }
+      l_bChanged = !l_bDelete;
     }
     for( unsigned int l_iInst = 0; l_iInst < l_pInstances->size(); l_iInst++ )
       delete l_pInstances->at( l_iInst );
     delete l_pInstances;
   }
   delete l_pCurPartial;
+  return l_bChanged;
+}
+
+/**
+ *  Give the variables of a newly learned method new names, in the order in
+ *   which they first appear in it.
+ *  The order in which a PartialHtnMethod names its variables follows where
+ *   they happen to lie in memory, which varies from run to run when several
+ *   threads allocate at once.  Renaming them here makes the learned domain
+ *   the same from run to run regardless.
+ *  \param p_pMethod IN A pointer to the method, which is deallocated.
+ *  \return A pointer to the renamed method.  The caller is responsible for
+ *   deallocating it.
+ */
+HtnMethod * NameVarsInOrder( HtnMethod * p_pMethod )
+{
+  std::vector< TermVariableP > l_vVars = p_pMethod->GetVariables();
+  Substitution l_Rename;
+  for( unsigned int i = 0; i < l_vVars.size(); i++ )
+  {
+    TermVariableP l_pVar;
+    if( l_vVars[i]->HasTyping() )
+      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId(), l_vVars[i]->GetTyping() ) );
+    else
+      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId() ) );
+    l_Rename.AddPair( l_vVars[i], l_pVar );
+  }
+
+  HtnMethod * l_pRet = p_pMethod->AfterSubstitution( l_Rename, 0 );
+  delete p_pMethod;
+  return l_pRet;
 }
 
 bool TrySolving( AnnotatedPlan * p_pPlan, 
@@ -601,45 +1230,48 @@ bool TrySolving( AnnotatedPlan * p_pPlan,
 		 const std::tr1::shared_ptr< HtnTaskDescr > & p_pTask,
 		 const Substitution * p_pTaskSubs,
 		 const Substitution * p_pMasterSubs,
-		 const HtnDomain *p_pDomain )
+		 const HtnDomain *p_pDomain,
+		 bool p_bDryRun )
 {
   const State * l_pState = p_pPlan->GetCState( p_iInitState );
-  for( unsigned int i = 0; i < p_pDomain->GetNumMethods(); i++ )
+  const std::vector< unsigned int > & l_vCandidates = p_pDomain->GetMethodsForTask( p_pTask->GetCHead()->GetRelationIndex() );
+  for( unsigned int i = 0; i < l_vCandidates.size(); i++ )
   {
-    const HtnMethod * l_pCurMethod = p_pDomain->GetCMethod( i );
-    if( CompareNoCase( l_pCurMethod->GetCHead()->GetName(),
-		       p_pTask->GetCHead()->GetName() ) == 0 )
+    const HtnMethod * l_pCurMethod = p_pDomain->GetCMethod( l_vCandidates[i] );
+    Substitution l_FromMethodSubs;
+    Substitution l_FromTaskSubs;
+    for( unsigned int l_iCurParam = 0;
+	 l_iCurParam < p_pTask->GetCHead()->GetNumParams();
+	 l_iCurParam++ )
     {
-      Substitution l_FromMethodSubs;
-      Substitution l_FromTaskSubs;
-      for( unsigned int l_iCurParam = 0;
-	   l_iCurParam < p_pTask->GetCHead()->GetNumParams();
-	   l_iCurParam++ )
-      {
-	TermVariableP l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( l_pCurMethod->GetCHead()->GetCParam( l_iCurParam ) );
-	TermP l_pTerm = p_pTask->GetCHead()->GetCParam( l_iCurParam );
-	l_FromTaskSubs.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( l_pTerm ), l_pVar );
-	l_pTerm = p_pTaskSubs->FindIndexByVar( std::tr1::dynamic_pointer_cast< TermVariable >( l_pTerm ) )->second;
-	l_pTerm = p_pMasterSubs->FindIndexByVar( std::tr1::dynamic_pointer_cast< TermVariable >( l_pTerm ) )->second;
-	l_FromMethodSubs.AddPair( l_pVar, l_pTerm );
-      }
+      TermVariableP l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( l_pCurMethod->GetCHead()->GetCParam( l_iCurParam ) );
+      TermP l_pTerm = p_pTask->GetCHead()->GetCParam( l_iCurParam );
+      l_FromTaskSubs.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( l_pTerm ), l_pVar );
+      l_pTerm = p_pTaskSubs->FindIndexByVar( std::tr1::dynamic_pointer_cast< TermVariable >( l_pTerm ) )->second;
+      l_pTerm = p_pMasterSubs->FindIndexByVar( std::tr1::dynamic_pointer_cast< TermVariable >( l_pTerm ) )->second;
+      l_FromMethodSubs.AddPair( l_pVar, l_pTerm );
+    }
 
-      std::set< TermVariableP > l_vRelVars;
-      std::vector<Substitution *> * l_pTemp = l_pState->GetInstantiations( l_pCurMethod->GetCPreconditions(), &l_FromMethodSubs, l_vRelVars );
+    std::set< TermVariableP > l_vRelVars;
+    std::vector<Substitution *> * l_pTemp = l_pState->GetInstantiations( *l_pCurMethod->GetCPlan(), &l_FromMethodSubs, l_vRelVars );
 
-      if( l_pTemp->size() > 0 )
+    if( l_pTemp->size() > 0 )
+    {
+      if( !p_bDryRun )
       {
 	FormulaConjP l_pMethodEffects( std::tr1::dynamic_pointer_cast< FormulaConj >( p_pTask->GetCEffects()->AfterSubstitution( l_FromTaskSubs, 0 ) ) );
 	std::tr1::shared_ptr< HtnTaskDescr > l_pTask( p_pTask->AfterSubstitution( l_FromTaskSubs, 0 ) );
 	p_pPlan->AddMethodInst( l_pCurMethod, l_pTemp->at( 0 ), p_iInitState, p_iForState, l_pTask, l_pMethodEffects, l_pCurMethod->GetQValue() );
 	//todo What cost should we really be using here?  This seems like the only option, but does not quite mean what it should.
+      }
 
-	for( unsigned int i = 0; i < l_pTemp->size(); i++ )
-	  delete l_pTemp->at( i );
+      for( unsigned int i = 0; i < l_pTemp->size(); i++ )
+	delete l_pTemp->at( i );
+      delete l_pTemp;
       
-	return true;
-      }
+      return true;
     }
+    delete l_pTemp;
   }
   return false;
 }
@@ -652,15 +1284,7 @@ void MakeSoundnessCheckMethods( const HtnTaskList * p_pTasks,
     std::string l_sTaskName = p_pTasks->at(i)->GetCHead()->GetName();
     l_sTaskName += "-verify";
 
-    bool l_bFound = false;
-    for( unsigned int j = 0; j < p_pDomain->GetNumMethods() && !l_bFound; j++ )
-    {
-      if( CompareNoCase( p_pDomain->GetCMethod( j )->GetCHead()->GetName(),
-			 l_sTaskName ) == 0 )
-	l_bFound = true;
-    }
-
-    if( !l_bFound )
+    if( p_pDomain->GetMethodsForTask( l_sTaskName ).empty() )
     {
       std::string l_sNewMethod = "( :method ";
       l_sNewMethod += l_sTaskName;
@@ -728,7 +1352,7 @@ void MakeTrivialNdCheckers( HtnDomain * p_pDomain )
 
       HtnMethod * l_pNewMethod = HtnMethod::FromPddl( l_sNewMethod, p_pDomain->GetAllowableTypes(), p_pDomain->GetAllowablePredicates(), p_pDomain->GetRequirements() );
       
-      bool l_bFound = false;
+      bool l_bFound = p_pDomain->FindDuplicate( l_pNewMethod ) >= 0;
       for( unsigned int j = 0; j < p_pDomain->GetNumMethods() && !l_bFound; j++ )
       {
 	if( p_pDomain->GetCMethod( j )->Subsumes( l_pNewMethod ) &&
@@ -752,7 +1376,8 @@ void MakeTrivialNdCheckers( HtnDomain * p_pDomain )
 
 void LearnNdCheckers( unsigned int p_iAction,
 		      const StripsSolution * p_pPlan,
-		      HtnDomain * p_pDomain )
+		      HtnDomain * p_pDomain,
+		      const std::tr1::shared_ptr< const HtnDomain > & p_pSnapshot )
 {
   if( ( g_iFlags & FLAG_ND_CHECKERS ) == 0 )
     throw Exception( E_NOT_IMPLEMENTED,
@@ -797,7 +1422,8 @@ void LearnNdCheckers( unsigned int p_iAction,
 			   i,
 			   l_pDesiredOp,
 			   p_pPlan,
-			   p_pDomain );
+			   p_pDomain,
+			   p_pSnapshot );
       }
     }
 
@@ -808,7 +1434,8 @@ void LearnOneNdChecker( unsigned int p_iInitState,
 			unsigned int p_iFinalState,
 			const Operator * p_pDesiredOp,
 			const StripsSolution * p_pPlan,
-			HtnDomain * p_pDomain )
+			HtnDomain * p_pDomain,
+			const std::tr1::shared_ptr< const HtnDomain > & p_pSnapshot )
 {
   //  const Operator * l_pOper = p_pPlan->GetCOperator( p_iInitState - 1 );
   const Substitution * l_pSubs = p_pPlan->GetCSubstitution( p_iInitState - 1 );
@@ -839,7 +1466,7 @@ void LearnOneNdChecker( unsigned int p_iInitState,
 								       p_pDomain->GetAllowableTypes(),
 								       p_pDomain->GetAllowablePredicates() ) );
 
-  PartialHtnMethod l_PartMethod( std::tr1::shared_ptr< HtnDomain >( new HtnDomain( *p_pDomain ) ),
+  PartialHtnMethod l_PartMethod( p_pSnapshot,
 				 l_pTempDescr,
 				 l_pSubs,
 				 p_iFinalState );
@@ -880,6 +1507,7 @@ void LearnOneNdChecker( unsigned int p_iInitState,
     {
       HtnMethod * l_pNewMethod = l_PartMethod.CreateMethod( false, g_iFlags & FLAG_PARTIAL_GENERALIZATION );
       l_pNewMethod->AddNdCheckers();
+      l_pNewMethod = NameVarsInOrder( l_pNewMethod );
 
       if( p_pDomain->GetRequirements() & PDDL_REQ_METHOD_IDS )
       {
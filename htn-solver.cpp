@@ -11,6 +11,7 @@
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_constant.hpp"
@@ -23,6 +24,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "htn_task_head.hpp"
 #include "htn_method.hpp"
@@ -102,8 +105,9 @@ int main( int argc, char * argv[] )
   std::tr1::shared_ptr< HtnDomain > l_pDomain;
   try
   {
-    std::stringstream l_sDomainStream( ReadFile( l_sDomainFile ) );
-    l_pDomain = std::tr1::shared_ptr< HtnDomain >( HtnDomain::FromPddl( l_sDomainStream ) );
+    MappedFile l_DomainFile( l_sDomainFile );
+    PddlTokenizer l_DomainTokens( l_DomainFile.GetData(), l_DomainFile.GetSize() );
+    l_pDomain = std::tr1::shared_ptr< HtnDomain >( HtnDomain::FromPddl( l_DomainTokens ) );
   }
   catch( FileReadException & e )
   {
@@ -114,9 +118,10 @@ int main( int argc, char * argv[] )
   HtnSolution * l_pProblem = NULL;
   try
   {
-    std::stringstream l_sProblemStream( ReadFile( l_sProblemFile ) );
+    MappedFile l_ProblemFile( l_sProblemFile );
+    PddlTokenizer l_ProblemTokens( l_ProblemFile.GetData(), l_ProblemFile.GetSize() );
     l_pProblem = HtnSolution::FromPddl( l_pDomain,
-					l_sProblemStream );
+					l_ProblemTokens );
   }
   catch( FileReadException & e )
   {
@@ -175,12 +180,7 @@ int main( int argc, char * argv[] )
       {
 	l_SeekStartClock = clock();
       }
-      for( unsigned int j = 0; j < l_pDomain->GetNumOperators() && l_iOperIndex == -1; j++ )
-      {
-	if( CompareNoCase( l_pDomain->GetCOperator( j )->GetName(),
-			   l_pTask->GetName() ) == 0 )
-	  l_iOperIndex = j;
-      }
+      l_iOperIndex = l_pDomain->GetOperatorForTask( l_pTask->GetRelationIndex() );
       if( l_iLogLevel > 5 )
       {
 	l_SeekEndClock = clock();
@@ -426,29 +426,26 @@ void FindDecomps( std::vector< int > & p_vMethodIndices,
 		  const HtnSolution * p_pCurSol,
 		  bool p_bEarlyStop )
 {
-  for( unsigned int l_iCurMethod = 0;
-       l_iCurMethod < p_pDomain->GetNumMethods();
-       l_iCurMethod++ )
+  const std::vector< unsigned int > & l_vCandidates = p_pDomain->GetMethodsForTask( p_pCurSol->GetCTopTask()->GetRelationIndex() );
+  for( unsigned int j = 0; j < l_vCandidates.size(); j++ )
   {
-    if( CompareNoCase( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetName(), p_pCurSol->GetCTopTask()->GetName() ) == 0 )
+    unsigned int l_iCurMethod = l_vCandidates[j];
+    Substitution l_PartSub;
+    for( unsigned int i = 0; i < p_pCurSol->GetCTopTask()->GetNumParams(); i++ )
     {
-      Substitution l_PartSub;
-      for( unsigned int i = 0; i < p_pCurSol->GetCTopTask()->GetNumParams(); i++ )
-      {
-	l_PartSub.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ), p_pCurSol->GetCTopTask()->GetCParam( i ) );
-      }
-      std::set< TermVariableP > l_vRelVars = p_pDomain->GetCMethod( l_iCurMethod )->GetRelVars();
-      for( unsigned int i = 0; i < p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetNumParams(); i++ )
-	l_vRelVars.erase( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ) );
-      std::vector< Substitution * > * l_pInstances = p_pCurSol->GetCState()->GetInstantiations( p_pDomain->GetCMethod( l_iCurMethod )->GetCPreconditions(), &l_PartSub, l_vRelVars );
+      l_PartSub.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ), p_pCurSol->GetCTopTask()->GetCParam( i ) );
+    }
+    std::set< TermVariableP > l_vRelVars = p_pDomain->GetCMethod( l_iCurMethod )->GetRelVars();
+    for( unsigned int i = 0; i < p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetNumParams(); i++ )
+      l_vRelVars.erase( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ) );
+    std::vector< Substitution * > * l_pInstances = p_pCurSol->GetCState()->GetInstantiations( *p_pDomain->GetCMethod( l_iCurMethod )->GetCPlan(), &l_PartSub, l_vRelVars );
 
-      if( !l_pInstances->empty() )
-      {
-	p_vMethodIndices.push_back( l_iCurMethod );
-	p_vSubs.push_back( l_pInstances );
-	if( p_bEarlyStop )
-	  return;
-      }
+    if( !l_pInstances->empty() )
+    {
+      p_vMethodIndices.push_back( l_iCurMethod );
+      p_vSubs.push_back( l_pInstances );
+      if( p_bEarlyStop )
+	return;
     }
   }
 }
@@ -7,11 +7,18 @@
 #include <set>
 #include <tr1/memory>
 #include <ctime>
+#include <deque>
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <sys/time.h>
+#include <pthread.h>
 
 #include <tclap/CmdLine.h>
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_constant.hpp"
@@ -24,22 +31,126 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+#include "slot_substitution.hpp"
 #include "state.hpp"
+#include "instantiation_cursor.hpp"
 #include "htn_task_head.hpp"
 #include "htn_method.hpp"
+#include "compiled_domain.hpp"
 #include "htn_domain.hpp"
 #include "htn_problem.hpp"
 #include "htn_solution.hpp"
+#include "failure_cache.hpp"
+
+/**
+ *  A branch of the search that one worker has handed off to be explored by
+ *   any other.
+ */
+struct SearchJob
+{
+  HtnSolution * m_pPartial;
+  unsigned int m_iDepth;
+};
+
+/**
+ *  The jobs belonging to one worker.
+ *  The owner takes the most recent job from the back, while other workers
+ *   steal the oldest, and likely largest, from the front.
+ */
+struct WorkDeque
+{
+  pthread_mutex_t m_Mutex;
+  std::deque< SearchJob > m_dJobs;
+};
+
+/**
+ *  Everything shared among the workers of a parallel search.
+ *  m_iIdle and m_iPending are only changed while holding m_Mutex, but are
+ *   read without it to decide cheaply whether to hand off work.
+ *  A search by a single thread uses one too, with no deques, for its
+ *   m_bDone, m_bFound, m_pOutput, and m_pFailures.
+ *  m_pFailures is NULL when failures are not remembered, which is always the
+ *   case in a parallel search: a worker that hands off part of a node cannot
+ *   tell whether the node failed.
+ */
+struct SearchPool
+{
+  pthread_mutex_t m_Mutex;
+  pthread_cond_t m_Cond;
+  std::tr1::shared_ptr< HtnDomain > m_pDomain;
+  std::vector< WorkDeque * > m_vDeques;
+  volatile unsigned int m_iIdle;
+  volatile unsigned int m_iPending;
+  volatile bool m_bDone;
+  bool m_bFound;
+  std::ostream * m_pOutput;
+  FailureCache * m_pFailures;
+};
+
+/**
+ *  A problem waiting to be solved by the server or in a batch.
+ *  The server reads the text of the problem, while a batch only names its
+ *   file, which the worker reads.
+ */
+struct ServeRequest
+{
+  unsigned int m_iNumber;
+  std::string m_sFileName;
+  std::string m_sProblem;
+};
+
+/**
+ *  How solving one problem of the server or of a batch turned out.
+ */
+enum SolveResult
+{
+  SR_PLAN,
+  SR_NO_PLAN,
+  SR_ERROR,
+};
+
+/**
+ *  Everything shared among the workers of the server or of a batch.
+ *  The reader waits for room in m_dRequests, so that it does not read far
+ *   ahead of the workers.  Replies are written whole while holding
+ *   m_OutputMutex; m_mReplies holds those that must wait for earlier ones.
+ */
+struct ServeQueue
+{
+  pthread_mutex_t m_Mutex;
+  pthread_cond_t m_WorkCond;
+  pthread_cond_t m_SpaceCond;
+  pthread_mutex_t m_OutputMutex;
+  std::vector< pthread_t > m_vThreads;
+  std::tr1::shared_ptr< HtnDomain > m_pDomain;
+  std::deque< ServeRequest > m_dRequests;
+  std::map< unsigned int, std::string > m_mReplies;
+  unsigned int m_iNextReply;
+  bool m_bQuit;
+};
+
+#define SERVE_REQUESTS_PER_THREAD 4
 
 bool FindPlan( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
-	       const HtnSolution * p_pPartial,
+	       HtnSolution * p_pPartial,
 	       unsigned int p_iDepth );
+bool FindPlanParallel( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
+		       HtnSolution * p_pPartial );
+void ReportFailures( std::ostream & p_Output );
+void Serve( const std::tr1::shared_ptr< HtnDomain > & p_pDomain );
+std::vector< std::string > ReadManifest( const std::string & p_sManifestFile );
+void SolveBatch( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+		 const std::vector< std::string > & p_vProblemFiles );
 bool FindPlanOper( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
-		   const HtnSolution * p_pPartial,
-		   unsigned int p_iDepth );
+		   HtnSolution * p_pPartial,
+		   unsigned int p_iDepth,
+		   WorkDeque * p_pDeque );
 bool FindPlanMethod( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
-		     const HtnSolution * p_pPartial,
-		     unsigned int p_iDepth );
+		     HtnSolution * p_pPartial,
+		     unsigned int p_iDepth,
+		     WorkDeque * p_pDeque );
 
 bool g_bShowTrace;
 bool g_bUseQValues;
@@ -47,6 +158,19 @@ bool g_bUpdateQValues;
 bool g_bRandomSelection;
 int g_iDebugLevel;
 unsigned int g_iMaxDepth;
+unsigned int g_iNumThreads;
+unsigned int g_iMemoSize;
+FailureEviction g_iMemoEviction;
+bool g_bServe;
+SearchPool g_Pool;
+ServeQueue g_Serve;
+
+/**
+ *  The search that this thread is working on.
+ *  In a parallel search, this is g_Pool for every worker; the server gives
+ *   each request its own.
+ */
+__thread SearchPool * g_pPool = NULL;
 
 int main( int argc, char * argv[] )
 {
@@ -56,18 +180,24 @@ int main( int argc, char * argv[] )
 
   std::string l_sDomainFile;
   std::string l_sProblemFile;
+  std::string l_sManifestFile;
   try
   {
     TCLAP::CmdLine l_cCmd( "Find an HTN plan", ' ', "1.1" );
 
-    TCLAP::UnlabeledValueArg<std::string> l_aDomainFile( "domain_file", "Path to the domain file.", true, "not_spec", "domain_file", l_cCmd );
-    TCLAP::UnlabeledValueArg<std::string> l_aProblemFile( "problem_file", "Path to the problem file.", true, "not_spec", "problem_file", l_cCmd );
+    TCLAP::UnlabeledValueArg<std::string> l_aDomainFile( "domain_file", "Path to the domain file, in PDDL or as written by compile-domain.", true, "not_spec", "domain_file", l_cCmd );
+    TCLAP::UnlabeledValueArg<std::string> l_aProblemFile( "problem_file", "Path to the problem file, which is not given when serving, and is solved first in a batch.", false, "not_spec", "problem_file", l_cCmd );
     TCLAP::SwitchArg l_aShowTrace( "t", "show_trace", "Show a full decomposition trace of the solution.", l_cCmd, false );
     TCLAP::SwitchArg l_aUseQValues( "q", "use_qvalues", "When decomposing a task, use the applicable method with lowest Q-value.", l_cCmd, false );
     TCLAP::SwitchArg l_aUpdateQValues( "u", "update_qvalues", "After finding a solution, update the Q-values of the methods used.", l_cCmd, false );
     TCLAP::SwitchArg l_aRandomSelection( "r", "random_selection", "Select applicable methods in random order.", l_cCmd, false );
     TCLAP::ValueArg<int> l_aDebugLevel( "d", "debug_level", "Determine how much debug information to print (0-10).", false, 0, "int", l_cCmd );
     TCLAP::ValueArg<unsigned int> l_aMaxDepth( "m", "max_depth", "Only pursue decomposition trees below this depth.", false, 99999, "unsigned int", l_cCmd );
+    TCLAP::ValueArg<unsigned int> l_aMemoSize( "", "memo_size", "Remember at most this many search nodes from which no plan could be found, and do not search them again.  0 remembers none.  Nothing is remembered when searching with more than one thread.", false, 65536, "unsigned int", l_cCmd );
+    TCLAP::ValueArg<std::string> l_aMemoEviction( "", "memo_eviction", "Which remembered node to forget when there are too many: \"lru\" for the one least recently used, or \"fifo\" for the oldest.", false, "lru", "lru|fifo", l_cCmd );
+    TCLAP::ValueArg<unsigned int> l_aThreads( "j", "threads", "Search with this many threads, stopping at the first plan any of them finds.  When serving, solve this many problems at once instead.", false, 1, "unsigned int", l_cCmd );
+    TCLAP::SwitchArg l_aServe( "s", "serve", "Keep the domain loaded, and solve each PDDL problem read from standard input until it ends.  Each reply is framed by \"begin N\" and \"end N\" lines, where N counts the problems from 1.", l_cCmd, false );
+    TCLAP::ValueArg<std::string> l_aManifestFile( "", "batch", "Path to a manifest of problem files, one per line, to solve against the same loaded domain.  One line of JSON is written for each, in order, with its result, its timing, and what would otherwise have been printed.  -j sets how many are solved at once.", false, "", "manifest_file", l_cCmd );
 
     l_cCmd.parse( argc, argv );
 
@@ -79,6 +209,21 @@ int main( int argc, char * argv[] )
     g_bRandomSelection = l_aRandomSelection.getValue();
     g_iDebugLevel = l_aDebugLevel.getValue();
     g_iMaxDepth = l_aMaxDepth.getValue();
+    g_iNumThreads = l_aThreads.getValue();
+    if( g_iNumThreads == 0 )
+      g_iNumThreads = 1;
+    g_iMemoSize = l_aMemoSize.getValue();
+    if( l_aMemoEviction.getValue() == "lru" )
+      g_iMemoEviction = FE_LRU;
+    else if( l_aMemoEviction.getValue() == "fifo" )
+      g_iMemoEviction = FE_FIFO;
+    else
+    {
+      std::cerr << "error: unknown eviction policy " << l_aMemoEviction.getValue() << " for arg --memo_eviction" << std::endl;
+      return 1;
+    }
+    g_bServe = l_aServe.getValue();
+    l_sManifestFile = l_aManifestFile.getValue();
   }
   catch( TCLAP::ArgException &e )
   {
@@ -86,11 +231,34 @@ int main( int argc, char * argv[] )
     return 1;
   }
 
+  bool l_bBatch = !l_sManifestFile.empty();
+  if( g_bServe && l_bBatch )
+  {
+    std::cerr << "error: a batch cannot be solved while serving" << std::endl;
+    return 1;
+  }
+  if( !g_bServe && !l_bBatch && l_sProblemFile == "not_spec" )
+  {
+    std::cerr << "error: a problem file is required unless serving" << std::endl;
+    return 1;
+  }
+  if( ( g_bServe || l_bBatch ) && g_bUpdateQValues )
+  {
+    std::cerr << "error: Q-values cannot be updated while serving or solving a batch" << std::endl;
+    return 1;
+  }
+
   std::tr1::shared_ptr< HtnDomain > l_pDomain;
   try
   {
-    std::stringstream l_sDomainStream( ReadFile( l_sDomainFile ) );
-    l_pDomain = std::tr1::shared_ptr< HtnDomain >( HtnDomain::FromPddl( l_sDomainStream ) );
+    MappedFile l_DomainFile( l_sDomainFile );
+    if( IsCompiledDomain( l_DomainFile.GetData(), l_DomainFile.GetSize() ) )
+      l_pDomain = std::tr1::shared_ptr< HtnDomain >( HtnDomain::FromCompiled( l_DomainFile.GetData(), l_DomainFile.GetSize() ) );
+    else
+    {
+      PddlTokenizer l_DomainTokens( l_DomainFile.GetData(), l_DomainFile.GetSize() );
+      l_pDomain = std::tr1::shared_ptr< HtnDomain >( HtnDomain::FromPddl( l_DomainTokens ) );
+    }
   }
   catch( FileReadException & e )
   {
@@ -98,12 +266,33 @@ int main( int argc, char * argv[] )
     throw e;
   }
 
+  if( g_bUseQValues )
+    l_pDomain->SortMethods();
+
+  if( g_bServe )
+  {
+    Serve( l_pDomain );
+    return 0;
+  }
+
+  if( l_bBatch )
+  {
+    std::vector< std::string > l_vProblemFiles;
+    if( l_sProblemFile != "not_spec" )
+      l_vProblemFiles.push_back( l_sProblemFile );
+    std::vector< std::string > l_vMore = ReadManifest( l_sManifestFile );
+    l_vProblemFiles.insert( l_vProblemFiles.end(), l_vMore.begin(), l_vMore.end() );
+    SolveBatch( l_pDomain, l_vProblemFiles );
+    return 0;
+  }
+
   HtnSolution * l_pProblem = NULL;
   try
   {
-    std::stringstream l_sProblemStream( ReadFile( l_sProblemFile ) );
+    MappedFile l_ProblemFile( l_sProblemFile );
+    PddlTokenizer l_ProblemTokens( l_ProblemFile.GetData(), l_ProblemFile.GetSize() );
     l_pProblem = HtnSolution::FromPddl( l_pDomain,
-					l_sProblemStream );
+					l_ProblemTokens );
   }
   catch( FileReadException & e )
   {
@@ -113,12 +302,25 @@ int main( int argc, char * argv[] )
 
   //  srand( time( 0 ) );
 
-  if( g_bUseQValues )
-    l_pDomain->SortMethods();
+  l_pProblem->EnableUndo();
+
+  g_Pool.m_pOutput = &std::cout;
+  g_Pool.m_pFailures = NULL;
+  if( g_iNumThreads == 1 && g_iMemoSize > 0 )
+    g_Pool.m_pFailures = new FailureCache( g_iMemoSize, g_iMemoEviction );
+  g_pPool = &g_Pool;
 
-  if( !FindPlan( l_pDomain, l_pProblem, 0 ) )
+  bool l_bFound;
+  if( g_iNumThreads > 1 )
+    l_bFound = FindPlanParallel( l_pDomain, l_pProblem );
+  else
+    l_bFound = FindPlan( l_pDomain, l_pProblem, 0 );
+  if( !l_bFound )
     std::cout << "\nNo legal plans.\n";
+  if( g_iDebugLevel > 0 )
+    ReportFailures( std::cout );
 
+  delete g_Pool.m_pFailures;
   delete l_pProblem;
 
   if( g_bUpdateQValues )
@@ -196,40 +398,711 @@ void UpdateQValues( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
     DoThisQValue( p_pDomain, l_vSolutionForest[i] );
 }
 
+/**
+ *  Print a complete plan and update Q-values from it.
+ *  In a parallel search, only the first plan found is reported, and the
+ *   remaining workers are told to stop.
+ */
+void ReportPlan( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+		 const HtnSolution * p_pSolution )
+{
+  bool l_bShared = !g_pPool->m_vDeques.empty();
+  if( l_bShared )
+    pthread_mutex_lock( &g_pPool->m_Mutex );
+
+  if( !g_pPool->m_bFound )
+  {
+    g_pPool->m_bFound = true;
+    g_pPool->m_bDone = true;
+    *g_pPool->m_pOutput << "\nPlan found!\n";
+    *g_pPool->m_pOutput << p_pSolution->Print( g_bShowTrace );
+    UpdateQValues( p_pDomain, p_pSolution );
+  }
+
+  if( l_bShared )
+  {
+    pthread_cond_broadcast( &g_pPool->m_Cond );
+    pthread_mutex_unlock( &g_pPool->m_Mutex );
+  }
+}
+
+/**
+ *  Write how well remembering failures worked for the search of this thread,
+ *   if it remembered them at all.
+ *  \param p_Output INOUT The stream to which to write.
+ */
+void ReportFailures( std::ostream & p_Output )
+{
+  const FailureCache * l_pFailures = g_pPool->m_pFailures;
+  if( l_pFailures == NULL )
+    return;
+
+  p_Output << "\nFailure memo: " << l_pFailures->GetNumHits() << " hits, "
+	   << l_pFailures->GetNumMisses() << " misses, "
+	   << l_pFailures->GetNumEvictions() << " evictions, "
+	   << l_pFailures->GetNumCollisions() << " collisions, "
+	   << l_pFailures->GetSize() << " of " << l_pFailures->GetCapacity() << " entries.\n";
+}
+
+/**
+ *  Fill in the caches of the methods that the search reads.
+ *  HtnMethod::GetRelevantVariables() fills its cache the first time it is
+ *   called, which is a race if two threads do so at once, so this must be
+ *   called before starting any worker.
+ *  \param p_pDomain IN The domain whose methods to prepare.
+ */
+void FillMethodCaches( const std::tr1::shared_ptr< HtnDomain > & p_pDomain )
+{
+  for( unsigned int i = 0; i < p_pDomain->GetNumMethods(); i++ )
+    p_pDomain->GetCMethod( i )->GetRelevantVariables();
+}
+
+/**
+ *  Whether or not some worker is waiting for a job that has not yet been
+ *   handed off.
+ */
+bool ShouldDonate( const WorkDeque * p_pDeque )
+{
+  return p_pDeque != NULL && g_pPool->m_iIdle > g_pPool->m_iPending;
+}
+
+/**
+ *  Hand off a branch of the search to be explored by any worker.
+ *  The pool takes ownership of p_pPartial.
+ */
+void DonateJob( WorkDeque * p_pDeque,
+		HtnSolution * p_pPartial,
+		unsigned int p_iDepth )
+{
+  SearchJob l_Job;
+  l_Job.m_pPartial = p_pPartial;
+  l_Job.m_iDepth = p_iDepth;
+
+  pthread_mutex_lock( &p_pDeque->m_Mutex );
+  p_pDeque->m_dJobs.push_back( l_Job );
+  pthread_mutex_unlock( &p_pDeque->m_Mutex );
+
+  pthread_mutex_lock( &g_pPool->m_Mutex );
+  g_pPool->m_iPending++;
+  pthread_cond_signal( &g_pPool->m_Cond );
+  pthread_mutex_unlock( &g_pPool->m_Mutex );
+}
+
+/**
+ *  Wait for a job, first from this worker's own deque, then by stealing
+ *   from the others.
+ *  \return False once the search is over, either because a plan was found
+ *   or because every worker is idle with no jobs left.
+ */
+bool GetJob( unsigned int p_iWorker,
+	     SearchJob & p_Job )
+{
+  unsigned int l_iNumWorkers = g_pPool->m_vDeques.size();
+
+  while( true )
+  {
+    if( g_pPool->m_bDone )
+      return false;
+
+    for( unsigned int i = 0; i < l_iNumWorkers; i++ )
+    {
+      WorkDeque * l_pDeque = g_pPool->m_vDeques[( p_iWorker + i ) % l_iNumWorkers];
+      bool l_bTaken = false;
+
+      pthread_mutex_lock( &l_pDeque->m_Mutex );
+      if( !l_pDeque->m_dJobs.empty() )
+      {
+	l_bTaken = true;
+	if( i == 0 )
+	{
+	  p_Job = l_pDeque->m_dJobs.back();
+	  l_pDeque->m_dJobs.pop_back();
+	}
+	else
+	{
+	  p_Job = l_pDeque->m_dJobs.front();
+	  l_pDeque->m_dJobs.pop_front();
+	}
+      }
+      pthread_mutex_unlock( &l_pDeque->m_Mutex );
+
+      if( l_bTaken )
+      {
+	pthread_mutex_lock( &g_pPool->m_Mutex );
+	g_pPool->m_iPending--;
+	pthread_mutex_unlock( &g_pPool->m_Mutex );
+	return true;
+      }
+    }
+
+    pthread_mutex_lock( &g_pPool->m_Mutex );
+    g_pPool->m_iIdle++;
+    while( !g_pPool->m_bDone && g_pPool->m_iPending == 0 && g_pPool->m_iIdle < l_iNumWorkers )
+      pthread_cond_wait( &g_pPool->m_Cond, &g_pPool->m_Mutex );
+    if( !g_pPool->m_bDone && g_pPool->m_iPending == 0 && g_pPool->m_iIdle == l_iNumWorkers )
+    {
+      g_pPool->m_bDone = true;
+      pthread_cond_broadcast( &g_pPool->m_Cond );
+    }
+    g_pPool->m_iIdle--;
+    pthread_mutex_unlock( &g_pPool->m_Mutex );
+  }
+}
+
+bool ContinuePlan( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
+		   HtnSolution * p_pPartial,
+		   unsigned int p_iDepth,
+		   WorkDeque * p_pDeque )
+{
+  if( p_pPartial->IsComplete() )
+  {
+    ReportPlan( p_pDomain, p_pPartial );
+    return true;
+  }
+  else if( p_pPartial->GetCTopTask()->GetName()[0] == '!' )
+    return FindPlanOper( p_pDomain, p_pPartial, p_iDepth, p_pDeque );
+  else
+    return FindPlanMethod( p_pDomain, p_pPartial, p_iDepth, p_pDeque );
+}
+
+void * SearchWorker( void * p_pWorker )
+{
+  unsigned int l_iWorker = (unsigned int)(size_t)p_pWorker;
+  SearchJob l_Job;
+
+  // Only a single problem is ever searched in parallel.
+  g_pPool = &g_Pool;
+
+  while( GetJob( l_iWorker, l_Job ) )
+  {
+    try
+    {
+      ContinuePlan( g_pPool->m_pDomain, l_Job.m_pPartial, l_Job.m_iDepth, g_pPool->m_vDeques[l_iWorker] );
+    }
+    catch( Exception & e )
+    {
+      pthread_mutex_lock( &g_pPool->m_Mutex );
+      std::cerr << "\n" << e.ToStr() << "\n";
+      g_pPool->m_bDone = true;
+      pthread_cond_broadcast( &g_pPool->m_Cond );
+      pthread_mutex_unlock( &g_pPool->m_Mutex );
+    }
+    delete l_Job.m_pPartial;
+  }
+
+  return NULL;
+}
+
 bool FindPlan( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
-	       const HtnSolution * p_pPartial,
+	       HtnSolution * p_pPartial,
 	       unsigned int p_iDepth )
 {
   if( p_pPartial->IsComplete() )
   {
-    std::cout << "\nPlan found!\nNo tasks to complete.\n";
+    *g_pPool->m_pOutput << "\nPlan found!\nNo tasks to complete.\n";
     return true;
   }
 
-  if( p_pPartial->GetCTopTask()->GetName()[0] == '!' )
-    return FindPlanOper( p_pDomain, p_pPartial, p_iDepth + 1 );
+  return ContinuePlan( p_pDomain, p_pPartial, p_iDepth + 1, NULL );
+}
+
+/**
+ *  Search for a plan with g_iNumThreads workers.
+ *  Each worker searches depth-first in place, as FindPlan does, but whenever
+ *   another worker is idle it hands off its next alternative as a copy.
+ */
+bool FindPlanParallel( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
+		       HtnSolution * p_pPartial )
+{
+  if( p_pPartial->IsComplete() )
+  {
+    *g_pPool->m_pOutput << "\nPlan found!\nNo tasks to complete.\n";
+    return true;
+  }
+
+  pthread_mutex_init( &g_pPool->m_Mutex, NULL );
+  pthread_cond_init( &g_pPool->m_Cond, NULL );
+  g_pPool->m_pDomain = p_pDomain;
+  g_pPool->m_iIdle = 0;
+  g_pPool->m_iPending = 0;
+  for( unsigned int i = 0; i < g_iNumThreads; i++ )
+  {
+    WorkDeque * l_pDeque = new WorkDeque;
+    pthread_mutex_init( &l_pDeque->m_Mutex, NULL );
+    g_pPool->m_vDeques.push_back( l_pDeque );
+  }
+
+  HtnSolution * l_pRoot = new HtnSolution( *p_pPartial );
+  l_pRoot->EnableUndo();
+  DonateJob( g_pPool->m_vDeques[0], l_pRoot, 1 );
+
+  FillMethodCaches( p_pDomain );
+  std::vector< pthread_t > l_vThreads( g_iNumThreads );
+  for( unsigned int i = 0; i < g_iNumThreads; i++ )
+  {
+    if( pthread_create( &l_vThreads[i], NULL, SearchWorker, (void *)(size_t)i ) != 0 )
+      throw Exception( E_NOT_IMPLEMENTED,
+		       "Could not create a search thread.",
+		       __FILE__,
+		       __LINE__ );
+  }
+  for( unsigned int i = 0; i < g_iNumThreads; i++ )
+    pthread_join( l_vThreads[i], NULL );
+
+  for( unsigned int i = 0; i < g_pPool->m_vDeques.size(); i++ )
+  {
+    WorkDeque * l_pDeque = g_pPool->m_vDeques[i];
+    for( unsigned int j = 0; j < l_pDeque->m_dJobs.size(); j++ )
+      delete l_pDeque->m_dJobs[j].m_pPartial;
+    pthread_mutex_destroy( &l_pDeque->m_Mutex );
+    delete l_pDeque;
+  }
+  g_pPool->m_vDeques.clear();
+  g_pPool->m_pDomain.reset();
+  pthread_cond_destroy( &g_pPool->m_Cond );
+  pthread_mutex_destroy( &g_pPool->m_Mutex );
+
+  return g_pPool->m_bFound;
+}
+
+/**
+ *  Read the next problem from the server's input.
+ *  A problem is everything up to the parenthesis that closes its first open
+ *   one, ignoring comments, so problems may simply follow one another.
+ *  \param p_Input INOUT The stream to read, which is advanced beyond it.
+ *  \param p_sProblem OUT The text of the problem.
+ *  \return Whether a problem was read, rather than the end of the input.
+ */
+bool ReadRequest( std::istream & p_Input,
+		  std::string & p_sProblem )
+{
+  p_sProblem.clear();
+  int l_iDepth = 0;
+  bool l_bStarted = false;
+  bool l_bInComment = false;
+  char l_cNext;
+
+  while( p_Input.get( l_cNext ) )
+  {
+    if( l_bInComment )
+    {
+      if( l_cNext == '\n' )
+	l_bInComment = false;
+      continue;
+    }
+    if( l_cNext == ';' )
+    {
+      l_bInComment = true;
+      continue;
+    }
+    if( !l_bStarted && l_cNext != '(' )
+    {
+      if( !isspace( l_cNext ) )
+	p_sProblem += l_cNext;
+      continue;
+    }
+
+    p_sProblem += l_cNext;
+    if( l_cNext == '(' )
+    {
+      l_bStarted = true;
+      l_iDepth++;
+    }
+    else if( l_cNext == ')' && --l_iDepth == 0 )
+      return true;
+  }
+
+  // Hand an unfinished problem to the parser, so that it is reported.
+  return !p_sProblem.empty();
+}
+
+/**
+ *  Read a manifest of problems to solve in a batch.
+ *  Each line names a problem file.  Blank lines and lines that begin with a
+ *   semicolon are ignored.
+ *  \param p_sManifestFile IN The path to the manifest.
+ *  \return The problem files, in order.
+ */
+std::vector< std::string > ReadManifest( const std::string & p_sManifestFile )
+{
+  std::vector< std::string > l_vRet;
+  std::string l_sContents;
+
+  try
+  {
+    l_sContents = ReadFile( p_sManifestFile );
+  }
+  catch( FileReadException & e )
+  {
+    e.SetFileName( p_sManifestFile );
+    throw e;
+  }
+
+  // ReadFile() leaves the end-of-file marker on the contents.
+  if( !l_sContents.empty() && l_sContents[l_sContents.size() - 1] == (char)EOF )
+    l_sContents.erase( l_sContents.size() - 1 );
+
+  std::stringstream l_sManifest( l_sContents );
+  std::string l_sLine;
+  while( std::getline( l_sManifest, l_sLine ) )
+  {
+    std::stringstream l_sFields( l_sLine );
+    std::string l_sProblemFile, l_sExtra;
+    if( !( l_sFields >> l_sProblemFile ) || l_sProblemFile[0] == ';' )
+      continue;
+    if( l_sFields >> l_sExtra )
+    {
+      UnexpectedStringException e( "Each line of a manifest must name a single problem file: " + l_sLine,
+				   __FILE__,
+				   __LINE__ );
+      e.SetFileName( p_sManifestFile );
+      throw e;
+    }
+    l_vRet.push_back( l_sProblemFile );
+  }
+
+  return l_vRet;
+}
+
+/**
+ *  Retrieve the time of day, for timing the problems of a batch.
+ *  Processor time would count every worker, so this is wall-clock time.
+ *  \return The time of day, in seconds.
+ */
+double GetWallSeconds()
+{
+  struct timeval l_Now;
+  gettimeofday( &l_Now, NULL );
+  return l_Now.tv_sec + l_Now.tv_usec / 1000000.0;
+}
+
+/**
+ *  Retrieve a string as a JSON string literal.
+ *  \param p_sString IN The string.
+ *  \return The string, quoted and escaped.
+ */
+std::string JsonString( const std::string & p_sString )
+{
+  std::string l_sRet = "\"";
+  for( unsigned int i = 0; i < p_sString.size(); i++ )
+  {
+    unsigned char l_cNext = p_sString[i];
+    if( l_cNext == '"' || l_cNext == '\\' )
+    {
+      l_sRet += '\\';
+      l_sRet += l_cNext;
+    }
+    else if( l_cNext == '\n' )
+      l_sRet += "\\n";
+    else if( l_cNext == '\t' )
+      l_sRet += "\\t";
+    else if( l_cNext < 0x20 )
+    {
+      char l_sCode[8];
+      snprintf( l_sCode, sizeof( l_sCode ), "\\u%04x", l_cNext );
+      l_sRet += l_sCode;
+    }
+    else
+      l_sRet += l_cNext;
+  }
+  return l_sRet + "\"";
+}
+
+/**
+ *  Solve one problem for the server, on the calling thread.
+ *  \param p_pDomain IN The domain, which is shared with the other workers.
+ *  \param p_Request IN The problem, either as text or as the name of a file.
+ *  \param p_Output INOUT The stream to which to write what the one-shot
+ *   solver would have printed for this problem.
+ *  \param p_pFailures INOUT An empty record of the failures of this search,
+ *   or NULL to not remember them.
+ *  \param p_fParseSeconds OUT The time spent reading the problem.
+ *  \param p_fSearchSeconds OUT The time spent searching for a plan.
+ *  \return Whether a plan was found, none exists, or there was an error.
+ */
+SolveResult SolveRequest( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+			  const ServeRequest & p_Request,
+			  std::ostream & p_Output,
+			  FailureCache * p_pFailures,
+			  double & p_fParseSeconds,
+			  double & p_fSearchSeconds )
+{
+  SearchPool l_Pool;
+  l_Pool.m_iIdle = 0;
+  l_Pool.m_iPending = 0;
+  l_Pool.m_bDone = false;
+  l_Pool.m_bFound = false;
+  l_Pool.m_pOutput = &p_Output;
+  l_Pool.m_pFailures = p_pFailures;
+  g_pPool = &l_Pool;
+
+  SolveResult l_iRet = SR_ERROR;
+  p_fParseSeconds = 0;
+  p_fSearchSeconds = 0;
+  double l_fStart = GetWallSeconds();
+  HtnSolution * l_pProblem = NULL;
+  try
+  {
+    if( p_Request.m_sFileName.empty() )
+    {
+      PddlTokenizer l_ProblemTokens( p_Request.m_sProblem );
+      l_pProblem = HtnSolution::FromPddl( p_pDomain,
+					  l_ProblemTokens );
+    }
+    else
+    {
+      try
+      {
+	MappedFile l_ProblemFile( p_Request.m_sFileName );
+	PddlTokenizer l_ProblemTokens( l_ProblemFile.GetData(), l_ProblemFile.GetSize() );
+	l_pProblem = HtnSolution::FromPddl( p_pDomain,
+					    l_ProblemTokens );
+      }
+      catch( FileReadException & e )
+      {
+	e.SetFileName( p_Request.m_sFileName );
+	throw e;
+      }
+    }
+    p_fParseSeconds = GetWallSeconds() - l_fStart;
+
+    l_pProblem->EnableUndo();
+    l_fStart = GetWallSeconds();
+    if( FindPlan( p_pDomain, l_pProblem, 0 ) )
+      l_iRet = SR_PLAN;
+    else
+    {
+      p_Output << "\nNo legal plans.\n";
+      l_iRet = SR_NO_PLAN;
+    }
+    p_fSearchSeconds = GetWallSeconds() - l_fStart;
+    if( g_iDebugLevel > 0 )
+      ReportFailures( p_Output );
+  }
+  catch( Exception & e )
+  {
+    p_Output << "\n" << e.ToStr() << "\n";
+  }
+
+  delete l_pProblem;
+  g_pPool = NULL;
+  return l_iRet;
+}
+
+/**
+ *  Wait for a problem for a worker of the server.
+ *  \return False once the input has ended and every problem has been taken.
+ */
+bool GetRequest( ServeRequest & p_Request )
+{
+  pthread_mutex_lock( &g_Serve.m_Mutex );
+  while( g_Serve.m_dRequests.empty() && !g_Serve.m_bQuit )
+    pthread_cond_wait( &g_Serve.m_WorkCond, &g_Serve.m_Mutex );
+
+  bool l_bTaken = false;
+  if( !g_Serve.m_dRequests.empty() )
+  {
+    p_Request = g_Serve.m_dRequests.front();
+    g_Serve.m_dRequests.pop_front();
+    pthread_cond_signal( &g_Serve.m_SpaceCond );
+    l_bTaken = true;
+  }
+  pthread_mutex_unlock( &g_Serve.m_Mutex );
+  return l_bTaken;
+}
+
+/**
+ *  Write the reply to a request.
+ *  The server writes each reply as soon as it is ready.  A batch writes one
+ *   line of JSON for each problem, holding back any that finish early so
+ *   that the lines are in the order of the manifest.
+ */
+void WriteReply( const ServeRequest & p_Request,
+		 SolveResult p_iResult,
+		 const std::string & p_sOutput,
+		 const FailureCache * p_pFailures,
+		 double p_fParseSeconds,
+		 double p_fSearchSeconds )
+{
+  std::stringstream l_sReply;
+  if( g_bServe )
+    l_sReply << "begin " << p_Request.m_iNumber << "\n"
+	     << p_sOutput
+	     << "\nend " << p_Request.m_iNumber << "\n";
   else
-    return FindPlanMethod( p_pDomain, p_pPartial, p_iDepth + 1 );
+  {
+    const char * l_aResults[] = { "plan", "no plan", "error" };
+    l_sReply << "{\"index\": " << p_Request.m_iNumber
+	     << ", \"problem\": " << JsonString( p_Request.m_sFileName )
+	     << ", \"result\": " << JsonString( l_aResults[p_iResult] )
+	     << ", \"parse_seconds\": " << p_fParseSeconds
+	     << ", \"search_seconds\": " << p_fSearchSeconds
+	     << ", \"memo_hits\": " << ( p_pFailures == NULL ? 0 : p_pFailures->GetNumHits() )
+	     << ", \"memo_misses\": " << ( p_pFailures == NULL ? 0 : p_pFailures->GetNumMisses() )
+	     << ", \"memo_collisions\": " << ( p_pFailures == NULL ? 0 : p_pFailures->GetNumCollisions() )
+	     << ", \"output\": " << JsonString( p_sOutput )
+	     << "}\n";
+  }
+
+  pthread_mutex_lock( &g_Serve.m_OutputMutex );
+  g_Serve.m_mReplies[p_Request.m_iNumber] = l_sReply.str();
+  std::map< unsigned int, std::string >::iterator l_Next = g_Serve.m_mReplies.begin();
+  while( l_Next != g_Serve.m_mReplies.end() &&
+	 ( g_bServe || l_Next->first == g_Serve.m_iNextReply ) )
+  {
+    std::cout << l_Next->second;
+    g_Serve.m_iNextReply++;
+    g_Serve.m_mReplies.erase( l_Next++ );
+  }
+  std::cout.flush();
+  pthread_mutex_unlock( &g_Serve.m_OutputMutex );
+}
+
+void * ServeWorker( void * )
+{
+  ServeRequest l_Request;
+
+  while( GetRequest( l_Request ) )
+  {
+    std::stringstream l_sOutput;
+    double l_fParseSeconds, l_fSearchSeconds;
+    FailureCache * l_pFailures = NULL;
+    if( g_iMemoSize > 0 )
+      l_pFailures = new FailureCache( g_iMemoSize, g_iMemoEviction );
+    SolveResult l_iResult = SolveRequest( g_Serve.m_pDomain, l_Request, l_sOutput, l_pFailures, l_fParseSeconds, l_fSearchSeconds );
+    WriteReply( l_Request, l_iResult, l_sOutput.str(), l_pFailures, l_fParseSeconds, l_fSearchSeconds );
+    delete l_pFailures;
+  }
+
+  return NULL;
+}
+
+/**
+ *  Start g_iNumThreads workers that each solve one problem at a time.
+ *  \param p_pDomain IN The domain, which stays loaded until StopServing().
+ */
+void StartServing( const std::tr1::shared_ptr< HtnDomain > & p_pDomain )
+{
+  pthread_mutex_init( &g_Serve.m_Mutex, NULL );
+  pthread_cond_init( &g_Serve.m_WorkCond, NULL );
+  pthread_cond_init( &g_Serve.m_SpaceCond, NULL );
+  pthread_mutex_init( &g_Serve.m_OutputMutex, NULL );
+  g_Serve.m_pDomain = p_pDomain;
+  g_Serve.m_iNextReply = 1;
+  g_Serve.m_bQuit = false;
+
+  FillMethodCaches( p_pDomain );
+  g_Serve.m_vThreads.resize( g_iNumThreads );
+  for( unsigned int i = 0; i < g_iNumThreads; i++ )
+  {
+    if( pthread_create( &g_Serve.m_vThreads[i], NULL, ServeWorker, NULL ) != 0 )
+      throw Exception( E_NOT_IMPLEMENTED,
+		       "Could not create a server thread.",
+		       __FILE__,
+		       __LINE__ );
+  }
+}
+
+/**
+ *  Hand a problem to the workers, waiting until there is room for it.
+ *  \param p_Request IN The problem.
+ */
+void SubmitRequest( const ServeRequest & p_Request )
+{
+  pthread_mutex_lock( &g_Serve.m_Mutex );
+  while( g_Serve.m_dRequests.size() >= g_iNumThreads * SERVE_REQUESTS_PER_THREAD )
+    pthread_cond_wait( &g_Serve.m_SpaceCond, &g_Serve.m_Mutex );
+  g_Serve.m_dRequests.push_back( p_Request );
+  pthread_cond_signal( &g_Serve.m_WorkCond );
+  pthread_mutex_unlock( &g_Serve.m_Mutex );
+}
+
+/**
+ *  Wait for the workers to finish every problem, and stop them.
+ */
+void StopServing()
+{
+  pthread_mutex_lock( &g_Serve.m_Mutex );
+  g_Serve.m_bQuit = true;
+  pthread_cond_broadcast( &g_Serve.m_WorkCond );
+  pthread_mutex_unlock( &g_Serve.m_Mutex );
+
+  for( unsigned int i = 0; i < g_Serve.m_vThreads.size(); i++ )
+    pthread_join( g_Serve.m_vThreads[i], NULL );
+  g_Serve.m_vThreads.clear();
+
+  g_Serve.m_pDomain.reset();
+  pthread_mutex_destroy( &g_Serve.m_OutputMutex );
+  pthread_cond_destroy( &g_Serve.m_SpaceCond );
+  pthread_cond_destroy( &g_Serve.m_WorkCond );
+  pthread_mutex_destroy( &g_Serve.m_Mutex );
+}
+
+/**
+ *  Solve every problem read from standard input, with g_iNumThreads workers
+ *   that each search one problem at a time.
+ *  The domain stays loaded throughout, so a problem costs only its own
+ *   parsing and search.
+ */
+void Serve( const std::tr1::shared_ptr< HtnDomain > & p_pDomain )
+{
+  StartServing( p_pDomain );
+
+  ServeRequest l_Request;
+  l_Request.m_iNumber = 0;
+  while( ReadRequest( std::cin, l_Request.m_sProblem ) )
+  {
+    l_Request.m_iNumber++;
+    SubmitRequest( l_Request );
+  }
+
+  StopServing();
+}
+
+/**
+ *  Solve each of a list of problem files, with g_iNumThreads workers that
+ *   each search one problem at a time, against the same loaded domain.
+ *  \param p_pDomain IN The domain.
+ *  \param p_vProblemFiles IN The paths to the problem files.
+ */
+void SolveBatch( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+		 const std::vector< std::string > & p_vProblemFiles )
+{
+  StartServing( p_pDomain );
+
+  ServeRequest l_Request;
+  for( unsigned int i = 0; i < p_vProblemFiles.size(); i++ )
+  {
+    l_Request.m_iNumber = i + 1;
+    l_Request.m_sFileName = p_vProblemFiles[i];
+    SubmitRequest( l_Request );
+  }
+
+  StopServing();
 }
 
 bool FindPlanOper( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
-		   const HtnSolution * p_pPartial,
-		   unsigned int p_iDepth )
+		   HtnSolution * p_pPartial,
+		   unsigned int p_iDepth,
+		   WorkDeque * p_pDeque )
 {
-  if( p_iDepth > g_iMaxDepth )
+  if( p_iDepth > g_iMaxDepth || g_pPool->m_bDone )
     return false;
 
+  uint64_t l_iNode = 0;
+  uint64_t l_iCheck = 0;
+  if( g_pPool->m_pFailures != NULL )
+  {
+    l_iNode = p_pPartial->GetHash();
+    l_iCheck = p_pPartial->GetCheckHash();
+    if( g_pPool->m_pFailures->IsFailure( l_iNode, l_iCheck, p_iDepth ) )
+      return false;
+  }
+
   bool l_bSuccess = false;
 
-  int l_iOperIndex = -1;
   HtnTaskHeadP l_pTask( p_pPartial->GetCTopTask() );
-
-  for( unsigned int j = 0; j < p_pDomain->GetNumOperators() && l_iOperIndex == -1; j++ )
-  {
-    if( CompareNoCase( p_pDomain->GetCOperator( j )->GetName(),
-		       l_pTask->GetName() ) == 0 )
-      l_iOperIndex = j;
-  }
+  int l_iOperIndex = p_pDomain->GetOperatorForTask( l_pTask->GetRelationIndex() );
 
   if( l_iOperIndex != -1 )
   {
@@ -238,29 +1111,21 @@ bool FindPlanOper( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
       l_OperSubs.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCOperator( l_iOperIndex )->GetCParam( j ) ), l_pTask->GetCParam( j ) );
     std::vector< Substitution * > * l_pAllOperSubs = p_pPartial->GetCState()->GetInstantiations( p_pDomain->GetCOperator( l_iOperIndex ), &l_OperSubs );
 
-    for( unsigned int k = 0; k < l_pAllOperSubs->size() && !l_bSuccess; k++ )
+    for( unsigned int k = 0; k < l_pAllOperSubs->size() && !l_bSuccess && !g_pPool->m_bDone; k++ )
     {
-      HtnSolution * l_pNewSolution = new HtnSolution( *p_pPartial );
-      l_pNewSolution->ApplyOperator( l_iOperIndex, l_pAllOperSubs->at( k ) );
-
-      if( l_pNewSolution->IsComplete() )
+      if( k + 1 < l_pAllOperSubs->size() && ShouldDonate( p_pDeque ) )
       {
-	std::cout << "\nPlan found!\n";
-	std::cout << l_pNewSolution->Print( g_bShowTrace );
-	l_bSuccess = true;
-	UpdateQValues( p_pDomain, l_pNewSolution );
-      }
-      else if( l_pNewSolution->GetCTopTask()->GetName()[0] == '!' )
-      {
-	l_bSuccess = FindPlanOper( p_pDomain, l_pNewSolution, p_iDepth + 1 );
-      }
-      else
-      {
-	l_bSuccess = FindPlanMethod( p_pDomain, l_pNewSolution, p_iDepth + 1 );
+	HtnSolution * l_pBranch = new HtnSolution( *p_pPartial );
+	l_pBranch->EnableUndo();
+	l_pBranch->ApplyOperator( l_iOperIndex, l_pAllOperSubs->at( k ) );
+	DonateJob( p_pDeque, l_pBranch, p_iDepth + 1 );
+	continue;
       }
 
-      delete l_pNewSolution;
-
+      unsigned int l_iUndoMark = p_pPartial->GetUndoMark();
+      p_pPartial->ApplyOperator( l_iOperIndex, l_pAllOperSubs->at( k ) );
+      l_bSuccess = ContinuePlan( p_pDomain, p_pPartial, p_iDepth + 1, p_pDeque );
+      p_pPartial->UndoTo( l_iUndoMark );
     }
 
     for( unsigned int k = 0; k < l_pAllOperSubs->size(); k++ )
@@ -268,138 +1133,170 @@ bool FindPlanOper( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
     delete l_pAllOperSubs;
   }
 
+  // A search that was cut short proves nothing.
+  if( g_pPool->m_pFailures != NULL && !l_bSuccess && !g_pPool->m_bDone )
+    g_pPool->m_pFailures->AddFailure( l_iNode, l_iCheck, p_iDepth );
+
   return l_bSuccess;
 }
 
-void RemoveIrrelevantBindings( std::vector< Substitution * > * p_pInstances,
-			       const HtnMethod * p_pMethod )
+/**
+ *  Retrieve the next instance of a method from its cursor.
+ *  The cursor is projected onto the relevant variables of the method, so
+ *   instances that differ only in the bindings of variables that appear in
+ *   the preconditions alone, and would lead to the same search, are never
+ *   yielded.
+ *  \param p_Cursor INOUT The cursor over the instances of the method.
+ *  \param p_vInstances INOUT The instances retrieved so far, which owns them.
+ *   The new one is added.
+ *  \return The next instance, or NULL if there are no more.
+ */
+Substitution * NextInstance( InstantiationCursor & p_Cursor,
+			     std::vector< Substitution * > & p_vInstances )
 {
-  std::tr1::shared_ptr< const std::vector< TermVariableP > > l_pVars = p_pMethod->GetRelevantVariables();
-
-  std::vector< Substitution * > l_vTemp( *p_pInstances );
-  p_pInstances->clear();
+  Substitution * l_pCurSubst = p_Cursor.Next();
+  if( l_pCurSubst != NULL )
+    p_vInstances.push_back( l_pCurSubst );
+  return l_pCurSubst;
+}
 
-  for( unsigned int i = 0; i < l_vTemp.size(); i++ )
+/**
+ *  Retrieve the next instance of a method to try.
+ *  With random selection, every instance has already been retrieved, and
+ *   they are tried in order starting from a random one.  Otherwise, they are
+ *   retrieved only as they are needed.
+ *  \param p_Cursor INOUT The cursor over the instances of the method.
+ *  \param p_vInstances INOUT The instances retrieved so far.
+ *  \param p_iNumTaken INOUT The number of instances tried so far.
+ *  \param p_iStart IN With random selection, the first instance to try.
+ *  \return The next instance to try, or NULL if there are no more.
+ */
+Substitution * TakeInstance( InstantiationCursor & p_Cursor,
+			     std::vector< Substitution * > & p_vInstances,
+			     unsigned int & p_iNumTaken,
+			     unsigned int p_iStart )
+{
+  if( g_bRandomSelection )
   {
-    Substitution * l_pCurSubst = l_vTemp[i];
-    bool l_bFound = false;
-    for( unsigned int j = 0; j < p_pInstances->size() && !l_bFound; j++ )
-    {
-      Substitution * l_pOldSubst = p_pInstances->at( j );
-      bool l_bDiff = false;
-      for( unsigned int k = 0; k < l_pVars->size() && !l_bDiff; k++ )
-      {
-	if( l_pCurSubst->FindIndexByVar( l_pVars->at( k ) )->second !=
-	    l_pOldSubst->FindIndexByVar( l_pVars->at( k ) )->second )
-	  l_bDiff = true;
-      }
-      if( !l_bDiff )
-	l_bFound = true;
-    }
-    if( l_bFound )
-      delete l_pCurSubst;
-    else
-      p_pInstances->push_back( l_pCurSubst );
+    if( p_iNumTaken >= p_vInstances.size() )
+      return NULL;
+    return p_vInstances[( p_iStart + p_iNumTaken++ ) % p_vInstances.size()];
   }
+  p_iNumTaken++;
+  return NextInstance( p_Cursor, p_vInstances );
 }
 
 bool FindPlanMethod( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
-		     const HtnSolution * p_pPartial,
-		     unsigned int p_iDepth )
+		     HtnSolution * p_pPartial,
+		     unsigned int p_iDepth,
+		     WorkDeque * p_pDeque )
 {
-  if( p_iDepth > g_iMaxDepth )
+  if( p_iDepth > g_iMaxDepth || g_pPool->m_bDone )
     return false;
 
+  uint64_t l_iNode = 0;
+  uint64_t l_iCheck = 0;
+  if( g_pPool->m_pFailures != NULL )
+  {
+    l_iNode = p_pPartial->GetHash();
+    l_iCheck = p_pPartial->GetCheckHash();
+    if( g_pPool->m_pFailures->IsFailure( l_iNode, l_iCheck, p_iDepth ) )
+    {
+      if( g_iDebugLevel > 5 )
+	*g_pPool->m_pOutput << "\nTask " << p_pPartial->GetCTopTask()->ToStr() << " is known to fail from this state at depth " << p_iDepth << ".\n";
+      return false;
+    }
+  }
+
   bool l_bSuccess = false;
 
-  std::vector< unsigned int> l_vMethodIndices;
-  for( unsigned int l_iCurMethod = 0;
-       l_iCurMethod < p_pDomain->GetNumMethods();
-       l_iCurMethod ++ )
-    l_vMethodIndices.push_back( l_iCurMethod );
+  std::vector< unsigned int> l_vMethodIndices( p_pDomain->GetMethodsForTask( p_pPartial->GetCTopTask()->GetRelationIndex() ) );
 
   if( g_bRandomSelection )
     std::random_shuffle( l_vMethodIndices.begin(), l_vMethodIndices.end() );
 
   for( unsigned int i = 0;
-       i < l_vMethodIndices.size() && !l_bSuccess;
+       i < l_vMethodIndices.size() && !l_bSuccess && !g_pPool->m_bDone;
        i++ )
   {
     unsigned int l_iCurMethod = l_vMethodIndices[i];
-    if( CompareNoCase( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetName(), p_pPartial->GetCTopTask()->GetName() ) == 0 )
+    Substitution l_PartSub;
+    for( unsigned int i = 0; 
+	 i < p_pPartial->GetCTopTask()->GetNumParams(); 
+	 i++ )
     {
-      Substitution l_PartSub;
-      for( unsigned int i = 0; 
-	   i < p_pPartial->GetCTopTask()->GetNumParams(); 
-	   i++ )
-      {
-	l_PartSub.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ), p_pPartial->GetCTopTask()->GetCParam( i ) );
-      }
-      std::set< TermVariableP > l_vRelVars = p_pDomain->GetCMethod( l_iCurMethod )->GetRelVars();
-      for( unsigned int i = 0;
-	   i < p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetNumParams();
-	   i++ )
-	l_vRelVars.erase( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ) );
-      std::vector< Substitution * > * l_pInstances = p_pPartial->GetCState()->GetInstantiations( p_pDomain->GetCMethod( l_iCurMethod )->GetCPreconditions(), &l_PartSub, l_vRelVars );
-
-      if( g_iDebugLevel > 5 && !l_pInstances->empty() )
-      {
-	std::cout << "\nTrying method #" << l_iCurMethod << " for task " << p_pPartial->GetCTopTask()->ToStr() << ", " << l_pInstances->size() << " instances possible, depth " << p_iDepth << ".\n";
-      }
+      l_PartSub.AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ), p_pPartial->GetCTopTask()->GetCParam( i ) );
+    }
+    std::set< TermVariableP > l_vRelVars = p_pDomain->GetCMethod( l_iCurMethod )->GetRelVars();
+    for( unsigned int i = 0;
+	 i < p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetNumParams();
+	 i++ )
+      l_vRelVars.erase( std::tr1::dynamic_pointer_cast< TermVariable >( p_pDomain->GetCMethod( l_iCurMethod )->GetCHead()->GetCParam( i ) ) );
+    const HtnMethod * l_pMethod = p_pDomain->GetCMethod( l_iCurMethod );
+    InstantiationCursor l_Cursor( p_pPartial->GetCState(), *l_pMethod->GetCPlan(), &l_PartSub, l_vRelVars );
+    l_Cursor.Project( *l_pMethod->GetRelevantVariables() );
+    std::vector< Substitution * > l_vInstances;
+    unsigned int l_iNumTaken = 0;
+    unsigned int l_iRandInst = 0;
+    if( g_bRandomSelection )
+    {
+      while( NextInstance( l_Cursor, l_vInstances ) != NULL );
+      if( !l_vInstances.empty() )
+	l_iRandInst = rand() % l_vInstances.size();
+    }
 
-      RemoveIrrelevantBindings( l_pInstances, p_pDomain->GetCMethod( l_iCurMethod ) );
+    Substitution * l_pCurInst = TakeInstance( l_Cursor, l_vInstances, l_iNumTaken, l_iRandInst );
 
-      if( g_iDebugLevel > 6 && !l_pInstances->empty() )
-	std::cout << l_pInstances->size() << " unique instances retained.\n";
+    if( g_iDebugLevel > 5 && l_pCurInst != NULL )
+    {
+      *g_pPool->m_pOutput << "\nTrying method #" << l_iCurMethod << " for task " << p_pPartial->GetCTopTask()->ToStr() << ", depth " << p_iDepth << ".\n";
+    }
 
-      if( l_pInstances->size() > 0 )
+    while( l_pCurInst != NULL && !l_bSuccess && !g_pPool->m_bDone )
+    {
+      if( ShouldDonate( p_pDeque ) )
       {
-	bool l_bFirstInst = true;
-	int l_iRandInst = rand() % l_pInstances->size();
-	for( int l_iCurInst = l_iRandInst;
-	     ( l_bFirstInst || l_iCurInst != l_iRandInst ) && !l_bSuccess;
-	     l_iCurInst = ( l_iCurInst + 1 ) % l_pInstances->size() )
+	// Only hand off an instance if this worker has another to try.
+	Substitution * l_pNextInst = TakeInstance( l_Cursor, l_vInstances, l_iNumTaken, l_iRandInst );
+	if( l_pNextInst != NULL )
 	{
-	  l_bFirstInst = false;
-
-	  if( g_iDebugLevel > 5 )
-	    std::cout << "\nTrying substitution " << l_pInstances->at( l_iCurInst )->ToStr() << " for method #" << l_iCurMethod << " at depth " << p_iDepth << "\n";
-
-	  HtnSolution * l_pNewSolution = new HtnSolution( *p_pPartial );
-	  l_pNewSolution->ApplyMethod( l_iCurMethod, l_pInstances->at( l_iCurInst ) );
-	  if( l_pNewSolution->IsComplete() )
-	  {
-	    std::cout << "\nPlan found!\n";
-	    std::cout << l_pNewSolution->Print( g_bShowTrace );
-	    l_bSuccess = true;
-	    UpdateQValues( p_pDomain, l_pNewSolution );
-	  }
-	  else if( l_pNewSolution->GetCTopTask()->GetName()[0] == '!' )
-	  {
-	    l_bSuccess = FindPlanOper( p_pDomain, l_pNewSolution, p_iDepth + 1 );
-	  }
-	  else
-	  {
-	    l_bSuccess = FindPlanMethod( p_pDomain, l_pNewSolution, p_iDepth + 1 );
-	  }
-
-	  delete l_pNewSolution;
+	  HtnSolution * l_pBranch = new HtnSolution( *p_pPartial );
+	  l_pBranch->EnableUndo();
+	  l_pBranch->ApplyMethod( l_iCurMethod, l_pCurInst );
+	  DonateJob( p_pDeque, l_pBranch, p_iDepth + 1 );
+	  l_pCurInst = l_pNextInst;
+	  continue;
 	}
       }
 
+      if( g_iDebugLevel > 5 )
+	*g_pPool->m_pOutput << "\nTrying substitution " << l_pCurInst->ToStr() << " for method #" << l_iCurMethod << " at depth " << p_iDepth << "\n";
 
-      for( unsigned int l_iCurInstance = 0;
-	   l_iCurInstance < l_pInstances->size();
-	   l_iCurInstance++ )
-      {
-	delete (*l_pInstances)[l_iCurInstance];
-      }
-      delete l_pInstances;
+      unsigned int l_iUndoMark = p_pPartial->GetUndoMark();
+      p_pPartial->ApplyMethod( l_iCurMethod, l_pCurInst );
+      l_bSuccess = ContinuePlan( p_pDomain, p_pPartial, p_iDepth + 1, p_pDeque );
+      p_pPartial->UndoTo( l_iUndoMark );
+
+      // Stop enumerating as soon as a branch succeeds.
+      l_pCurInst = NULL;
+      if( !l_bSuccess && !g_pPool->m_bDone )
+	l_pCurInst = TakeInstance( l_Cursor, l_vInstances, l_iNumTaken, l_iRandInst );
+    }
+
+    for( unsigned int l_iCurInstance = 0;
+	 l_iCurInstance < l_vInstances.size();
+	 l_iCurInstance++ )
+    {
+      delete l_vInstances[l_iCurInstance];
     }
   }
 
   if( g_iDebugLevel > 5 && !l_bSuccess )
-    std::cout << "Backtracking from depth " << p_iDepth << "\n";
+    *g_pPool->m_pOutput << "Backtracking from depth " << p_iDepth << "\n";
+
+  // A search that was cut short proves nothing.
+  if( g_pPool->m_pFailures != NULL && !l_bSuccess && !g_pPool->m_bDone )
+    g_pPool->m_pFailures->AddFailure( l_iNode, l_iCheck, p_iDepth );
 
   return l_bSuccess;
 }
@@ -9,6 +9,8 @@
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
+#include "string_table.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_constant.hpp"
@@ -21,6 +23,7 @@
 #include "operator.hpp"
 #include "htn_task_head.hpp"
 #include "htn_method.hpp"
+#include "compiled_domain.hpp"
 #include "htn_domain.hpp"
 
 /** \file htn_domain.hpp
@@ -73,6 +76,37 @@
  *   Otherwise, any may be used.
  */
 
+/** \var HtnDomain::m_mMethodsByTask
+ *  For the index in the global StringTable of each task name, the indices of
+ *   the methods for that task, in the order in which they appear in
+ *   m_vMethods.
+ */
+
+/** \var HtnDomain::m_mOperatorByTask
+ *  For the index in the global StringTable of each primitive task name, the
+ *   index of the first operator with that name.
+ */
+
+/** \var HtnDomain::m_mMethodsByShape
+ *  For the hash value of each shape of method, as from
+ *   HtnMethod::GetShapeHash(), the indices of the methods with that shape,
+ *   in the order in which they appear in m_vMethods.
+ *  Only methods with the same shape can subsume one another.
+ */
+
+/** \var HtnDomain::m_mMethodsByFingerprint
+ *  For each fingerprint of a method, as from HtnMethod::GetFingerprint(), the
+ *   indices of the methods with that fingerprint, in the order in which they
+ *   appear in m_vMethods.
+ */
+
+extern StringTable g_StrTable;
+
+/**
+ *  An empty list of method indices, for tasks that have no methods.
+ */
+static const std::vector< unsigned int > g_vNoMethods;
+
 /**
  *  Retrieve a pointer to a new HtnDomain from its PDDL representation.
  *  \param p_sInput INOUT A stream containing a textual description of the
@@ -81,23 +115,36 @@
  *   responsible for deallocating it.
  */
 HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
+{
+  std::string l_sInput = p_sInput.str();
+  PddlTokenizer l_Tokens( l_sInput );
+  l_Tokens.SetOffset( p_sInput.tellg() );
+  HtnDomain * l_pRet = FromPddl( l_Tokens );
+  p_sInput.seekg( l_Tokens.GetOffset() );
+  return l_pRet;
+}
+
+/**
+ *  Retrieve a pointer to a new HtnDomain from its PDDL representation.
+ *  The top level of the domain is read directly from the tokenizer.  Each
+ *   action and method is handed to Operator::FromPddl() or
+ *   HtnMethod::FromPddl() as its own normalized string.
+ *  \param p_Tokens INOUT A tokenizer over a textual description of the domain
+ *   in the PDDL language.  It is advanced beyond this.
+ *  \return A pointer to a new HtnDomain based on the text.  The caller is
+ *   responsible for deallocating it.
+ */
+HtnDomain * HtnDomain::FromPddl( PddlTokenizer & p_Tokens )
 {
   HtnDomain * l_pRet = new HtnDomain();
   l_pRet->m_iRequirements = PDDL_REQ_STRIPS | PDDL_REQ_HTN;
 
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "(" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "define" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "(" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "domain" );
-  EatWhitespace( p_sInput );
-  l_pRet->m_sDomainName = ReadString( p_sInput );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, ")" );
-  EatWhitespace( p_sInput );
+  p_Tokens.Eat( "(" );
+  p_Tokens.Eat( "define" );
+  p_Tokens.Eat( "(" );
+  p_Tokens.Eat( "domain" );
+  l_pRet->m_sDomainName = p_Tokens.ReadAtom();
+  p_Tokens.Eat( ")" );
 
   bool l_bHasRequirements = false,
     l_bHasTypes = false,
@@ -105,18 +152,17 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
     l_bHasPredicates = false,
     l_bHasActions = false;
 
-  while( p_sInput.peek() == '(' )
+  while( p_Tokens.PeekOpen() )
   {
-    std::string l_sFeature = ReadParenthetical( p_sInput );
-    std::stringstream l_sFeatureStream( l_sFeature );
-    EatString( l_sFeatureStream, "(" );
-    EatWhitespace( l_sFeatureStream );
-    std::string l_sFeatureName = ReadString( l_sFeatureStream );
+    size_t l_iFeatureStart = p_Tokens.GetOffset();
+    p_Tokens.Eat( "(" );
+    std::string l_sFeatureName = p_Tokens.ReadAtom();
 
     if( CompareNoCase( l_sFeatureName, ":action" ) == 0 )
     {
       l_bHasActions = true;
-      l_sFeatureStream.seekg( 0, std::ios::beg );
+      p_Tokens.SetOffset( l_iFeatureStart );
+      std::stringstream l_sFeatureStream( p_Tokens.ReadParenthetical() );
       l_pRet->m_vOperators.push_back( Operator::FromPddl( l_sFeatureStream, l_pRet->m_sAllowableTypes, l_pRet->m_vAllowablePredicates ) );
     }
     else if( CompareNoCase( l_sFeatureName, ":requirements" ) == 0 )
@@ -147,7 +193,8 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 			 __FILE__,
 			 __LINE__ );
       l_bHasRequirements = true;
-      l_pRet->m_iRequirements = ParseRequirements( l_sFeature, true );
+      p_Tokens.SetOffset( l_iFeatureStart );
+      l_pRet->m_iRequirements = ParseRequirements( p_Tokens.ReadParenthetical(), true );
     }
     else if( CompareNoCase( l_sFeatureName, ":types" ) == 0 )
     {
@@ -177,16 +224,15 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 			 __FILE__,
 			 __LINE__ );
       l_bHasTypes = true;
-      EatWhitespace( l_sFeatureStream );
-      while( l_sFeatureStream.peek() != ')' )
+      while( !p_Tokens.PeekClose() )
       {
-	std::string l_sNewType = ReadString( l_sFeatureStream );
+	std::string l_sNewType = p_Tokens.ReadAtom();
 	if( l_pRet->m_sAllowableTypes.find( l_sNewType ) == l_pRet->m_sAllowableTypes.end() )
 	{
 	  l_pRet->m_sAllowableTypes.insert( l_sNewType );
 	}
-	EatWhitespace( l_sFeatureStream );
       }
+      p_Tokens.Eat( ")" );
     }
     else if( CompareNoCase( l_sFeatureName, ":constants" ) == 0 )
     {
@@ -206,18 +252,14 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 			 __FILE__,
 			 __LINE__ );
       l_bHasConstants = true;
-      EatWhitespace( l_sFeatureStream );
-      while( l_sFeatureStream.peek() != ')' )
+      while( !p_Tokens.PeekClose() )
       {
-	std::string l_sConstant = ReadString( l_sFeatureStream );
-	EatWhitespace( l_sFeatureStream );
+	std::string l_sConstant = p_Tokens.ReadAtom();
 	std::string l_sTyping = "";
 	if( l_pRet->m_iRequirements & PDDL_REQ_TYPING )
 	{
-	  EatString( l_sFeatureStream, "-" );
-	  EatWhitespace( l_sFeatureStream );
-	  l_sTyping = ReadString( l_sFeatureStream );
-	  EatWhitespace( l_sFeatureStream );
+	  p_Tokens.Eat( "-" );
+	  l_sTyping = p_Tokens.ReadAtom();
 	}
 
 	if( l_pRet->m_ConstantTypes.find( l_sConstant ) == l_pRet->m_ConstantTypes.end() )
@@ -228,6 +270,7 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 			   __FILE__,
 			   __LINE__ );
       }
+      p_Tokens.Eat( ")" );
     }
     else if( CompareNoCase( l_sFeatureName, ":predicates" ) == 0 )
     {
@@ -243,27 +286,21 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 			 __LINE__ );
       l_bHasPredicates = true;
 
-      EatWhitespace( l_sFeatureStream );
-      while( l_sFeatureStream.peek() != ')' )
+      while( !p_Tokens.PeekClose() )
       {
 	TypeTable l_TempTypes;
 	std::string l_sNewPred = "";
-	EatString( l_sFeatureStream, "(" );
-	EatWhitespace( l_sFeatureStream );
-	std::string l_sRelation = ReadString( l_sFeatureStream );
+	p_Tokens.Eat( "(" );
+	std::string l_sRelation = p_Tokens.ReadAtom();
 	l_sNewPred += "( " + l_sRelation;
-	EatWhitespace( l_sFeatureStream );
-	while( l_sFeatureStream.peek() != ')' )
+	while( !p_Tokens.PeekClose() )
 	{
-	  std::string l_sVar = ReadString( l_sFeatureStream );
-	  EatWhitespace( l_sFeatureStream );
+	  std::string l_sVar = p_Tokens.ReadAtom();
 	  l_sNewPred += " " + l_sVar;
 	  if( l_pRet->m_iRequirements & PDDL_REQ_TYPING )
 	  {
-	    EatString( l_sFeatureStream, "-" );
-	    EatWhitespace( l_sFeatureStream );
-	    std::string l_sTyping = ReadString( l_sFeatureStream );
-	    EatWhitespace( l_sFeatureStream );
+	    p_Tokens.Eat( "-" );
+	    std::string l_sTyping = p_Tokens.ReadAtom();
 	    l_TempTypes[l_sVar] = l_sTyping;
 	    if( l_pRet->m_sAllowableTypes.size() != 0 )
 	    {
@@ -275,8 +312,7 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 	    }
 	  }
 	}
-	EatString( l_sFeatureStream, ")" );
-	EatWhitespace( l_sFeatureStream );
+	p_Tokens.Eat( ")" );
 	l_sNewPred += " )";
 	for( unsigned int i = 0; i < l_pRet->m_vAllowablePredicates.size(); i++ )
 	{
@@ -289,6 +325,7 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 	}
 	l_pRet->m_vAllowablePredicates.push_back( FormulaPred( l_sNewPred, l_TempTypes, std::vector< FormulaPred >() ) );
       }
+      p_Tokens.Eat( ")" );
     }
     else if( CompareNoCase( l_sFeatureName, ":functions" ) == 0 )
     {
@@ -307,23 +344,24 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
     else if( CompareNoCase( l_sFeatureName, ":method" ) == 0 )
     {
       l_bHasActions = true;
-      l_sFeatureStream.seekg( 0, std::ios::beg );
+      p_Tokens.SetOffset( l_iFeatureStart );
+      std::stringstream l_sFeatureStream( p_Tokens.ReadParenthetical() );
       l_pRet->m_vMethods.push_back( HtnMethod::FromPddl( l_sFeatureStream, l_pRet->m_sAllowableTypes, l_pRet->m_vAllowablePredicates, l_pRet->m_iRequirements ) );
     }
     else
     {
+      p_Tokens.SetOffset( l_iFeatureStart );
       std::string l_sMessage;
       l_sMessage += "Unrecognized PDDL feature: ";
-      l_sMessage += l_sFeature;
+      l_sMessage += p_Tokens.ReadParenthetical();
       throw Exception( E_NOT_IMPLEMENTED,
 		       l_sMessage,
 		       __FILE__,
 		       __LINE__ );
     }
-    EatWhitespace( p_sInput );
   }
 
-  EatString( p_sInput, ")" );
+  p_Tokens.Eat( ")" );
 
   if( ( l_pRet->m_iRequirements & PDDL_REQ_TYPING ) && !l_bHasTypes )
     throw Exception( E_NOT_IMPLEMENTED,
@@ -331,6 +369,7 @@ HtnDomain * HtnDomain::FromPddl( std::stringstream & p_sInput )
 		     __FILE__,
 		     __LINE__ );
 
+  l_pRet->IndexTasks();
   return l_pRet;
 }
 
@@ -384,13 +423,66 @@ HtnDomain * HtnDomain::FromShop( std::stringstream & p_sInput )
 
   l_pRet->m_iRequirements = PDDL_REQ_STRIPS | PDDL_REQ_HTN;
 
+  l_pRet->IndexTasks();
+  return l_pRet;
+}
+
+/**
+ *  Retrieve a pointer to a new HtnDomain from its compiled representation, as
+ *   written by HtnDomain::ToCompiled().
+ *  No text is parsed; the relations and constants are interned in the order
+ *   in which parsing the original PDDL would have interned them, and the
+ *   UnifyPlans are rebuilt.
+ *  \param p_pData IN A pointer to the compiled domain, usually the contents
+ *   of a MappedFile.
+ *  \param p_iSize IN The number of bytes in the compiled domain.
+ *  \return A pointer to a new HtnDomain.  The caller is responsible for
+ *   deallocating it.
+ */
+HtnDomain * HtnDomain::FromCompiled( const char * p_pData, size_t p_iSize )
+{
+  CompiledDomainReader l_Reader( p_pData, p_iSize );
+  HtnDomain * l_pRet = new HtnDomain();
+
+  l_pRet->m_sDomainName = l_Reader.ReadString();
+  l_pRet->m_iRequirements = l_Reader.ReadWord();
+
+  uint32_t l_iNumTypes = l_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumTypes; i++ )
+    l_pRet->m_sAllowableTypes.insert( l_Reader.ReadString() );
+
+  uint32_t l_iNumConstants = l_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumConstants; i++ )
+  {
+    std::string l_sConstant = l_Reader.ReadString();
+    l_pRet->m_ConstantTypes[l_sConstant] = l_Reader.ReadString();
+  }
+
+  uint32_t l_iNumPredicates = l_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumPredicates; i++ )
+    l_pRet->m_vAllowablePredicates.push_back( *l_Reader.ReadPred() );
+
+  uint32_t l_iNumOperators = l_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumOperators; i++ )
+    l_pRet->m_vOperators.push_back( Operator::FromCompiled( l_Reader ) );
+
+  uint32_t l_iNumMethods = l_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumMethods; i++ )
+    l_pRet->m_vMethods.push_back( HtnMethod::FromCompiled( l_Reader ) );
+
+  if( !l_Reader.AtEnd() )
+    throw UnexpectedStringException( "The compiled domain has trailing data.",
+				     __FILE__,
+				     __LINE__ );
+
+  l_pRet->IndexTasks();
   return l_pRet;
 }
 
 /**
  *  Construct a default HtnDomain.
- *  This exists only to be called from HtnDomain::FromPddl() and 
- *   HtnDomain::FromShop().
+ *  This exists only to be called from HtnDomain::FromPddl(), 
+ *   HtnDomain::FromShop(), and HtnDomain::FromCompiled().
  */
 HtnDomain::HtnDomain()
 {
@@ -411,6 +503,10 @@ HtnDomain::HtnDomain( const HtnDomain & p_Other )
     m_vOperators.push_back( new Operator( *p_Other.m_vOperators[i] ) );
   m_sDomainName = p_Other.m_sDomainName;
   m_iRequirements = p_Other.m_iRequirements;
+  m_mMethodsByTask = p_Other.m_mMethodsByTask;
+  m_mOperatorByTask = p_Other.m_mOperatorByTask;
+  m_mMethodsByShape = p_Other.m_mMethodsByShape;
+  m_mMethodsByFingerprint = p_Other.m_mMethodsByFingerprint;
 }
 
 /**
@@ -434,6 +530,7 @@ HtnDomain::~HtnDomain()
 void HtnDomain::AddOperator( Operator * p_pNewOper )
 {
   m_vOperators.push_back( p_pNewOper );
+  m_mOperatorByTask.insert( std::make_pair( g_StrTable.Lookup( p_pNewOper->GetName() ), m_vOperators.size() - 1 ) );
 }
 
 /**
@@ -446,6 +543,9 @@ void HtnDomain::AddOperator( Operator * p_pNewOper )
 void HtnDomain::AddMethod( HtnMethod * p_pNewMethod )
 {
   m_vMethods.push_back( p_pNewMethod );
+  m_mMethodsByTask[p_pNewMethod->GetCHead()->GetRelationIndex()].push_back( m_vMethods.size() - 1 );
+  m_mMethodsByShape[p_pNewMethod->GetShapeHash()].push_back( m_vMethods.size() - 1 );
+  m_mMethodsByFingerprint[p_pNewMethod->GetFingerprint()].push_back( m_vMethods.size() - 1 );
 }
 
 /**
@@ -462,6 +562,7 @@ void HtnDomain::RemoveOperator( unsigned int p_iIndex )
       l_Iter++;
     delete *l_Iter;
     m_vOperators.erase( l_Iter );
+    IndexTasks();
   }
   else
     throw Exception( E_INDEX_OUT_OF_BOUNDS,
@@ -484,6 +585,7 @@ void HtnDomain::RemoveMethod( unsigned int p_iIndex )
       l_Iter++;
     delete *l_Iter;
     m_vMethods.erase( l_Iter );
+    IndexTasks();
   }
   else
     throw Exception( E_INDEX_OUT_OF_BOUNDS,
@@ -500,8 +602,21 @@ void HtnDomain::RemoveMethod( unsigned int p_iIndex )
  */
 void HtnDomain::ReplaceMethod( unsigned int p_iIndex, HtnMethod * p_pNewMethod )
 {
+  // The shape includes the name of the head.
+  bool l_bSameShape = m_vMethods[p_iIndex]->GetShape() == p_pNewMethod->GetShape();
+  if( l_bSameShape && m_vMethods[p_iIndex]->GetFingerprint() != p_pNewMethod->GetFingerprint() )
+  {
+    std::vector< unsigned int > & l_vOld = m_mMethodsByFingerprint[m_vMethods[p_iIndex]->GetFingerprint()];
+    l_vOld.erase( std::find( l_vOld.begin(), l_vOld.end(), p_iIndex ) );
+    if( l_vOld.empty() )
+      m_mMethodsByFingerprint.erase( m_vMethods[p_iIndex]->GetFingerprint() );
+    std::vector< unsigned int > & l_vNew = m_mMethodsByFingerprint[p_pNewMethod->GetFingerprint()];
+    l_vNew.insert( std::lower_bound( l_vNew.begin(), l_vNew.end(), p_iIndex ), p_iIndex );
+  }
   delete m_vMethods[p_iIndex];
   m_vMethods[p_iIndex] = p_pNewMethod;
+  if( !l_bSameShape )
+    IndexTasks();
 }
 
 /**
@@ -554,6 +669,135 @@ const HtnMethod * HtnDomain::GetCMethod( unsigned int p_iIndex ) const
 		     __LINE__ );
 }
 
+/**
+ *  Retrieve the indices of the methods for a task.
+ *  \param p_iTaskId IN The index of the name of the task in the global
+ *   StringTable, as from HtnTaskHead::GetRelationIndex().
+ *  \return A list of the indices of the methods whose heads have that name,
+ *   in increasing order.  This is only valid until the next change to the
+ *   methods of this domain.
+ */
+const std::vector< unsigned int > & HtnDomain::GetMethodsForTask( unsigned int p_iTaskId ) const
+{
+  TaskMethodMap::const_iterator l_iIter = m_mMethodsByTask.find( p_iTaskId );
+  if( l_iIter == m_mMethodsByTask.end() )
+    return g_vNoMethods;
+  return l_iIter->second;
+}
+
+/**
+ *  Retrieve the indices of the methods for a task.
+ *  \param p_sTaskName IN The name of the task.
+ *  \return A list of the indices of the methods whose heads have that name,
+ *   in increasing order.  This is only valid until the next change to the
+ *   methods of this domain.
+ */
+const std::vector< unsigned int > & HtnDomain::GetMethodsForTask( const std::string & p_sTaskName ) const
+{
+  return GetMethodsForTask( g_StrTable.Lookup( p_sTaskName ) );
+}
+
+/**
+ *  Retrieve the index of the operator for a primitive task.
+ *  \param p_iTaskId IN The index of the name of the task in the global
+ *   StringTable, as from HtnTaskHead::GetRelationIndex().
+ *  \return The index of the first operator with that name, or -1 if there
+ *   is none.
+ */
+int HtnDomain::GetOperatorForTask( unsigned int p_iTaskId ) const
+{
+  TaskOperatorMap::const_iterator l_iIter = m_mOperatorByTask.find( p_iTaskId );
+  if( l_iIter == m_mOperatorByTask.end() )
+    return -1;
+  return l_iIter->second;
+}
+
+/**
+ *  Retrieve the indices of the methods that might subsume a method.
+ *  \param p_pMethod IN A pointer to the method.
+ *  \return A list, in increasing order, of the indices of every method in
+ *   this domain that might subsume p_pMethod, according to
+ *   HtnMethod::MightSubsume().  Any method that does is among them.
+ */
+std::vector< unsigned int > HtnDomain::GetPossibleSubsumers( const HtnMethod * p_pMethod ) const
+{
+  std::vector< unsigned int > l_vRet;
+  ShapeMethodMap::const_iterator l_iIter = m_mMethodsByShape.find( p_pMethod->GetShapeHash() );
+  if( l_iIter == m_mMethodsByShape.end() )
+    return l_vRet;
+  for( unsigned int i = 0; i < l_iIter->second.size(); i++ )
+  {
+    if( m_vMethods[l_iIter->second[i]]->MightSubsume( p_pMethod ) )
+      l_vRet.push_back( l_iIter->second[i] );
+  }
+  return l_vRet;
+}
+
+/**
+ *  Retrieve the indices of the methods that a method might subsume.
+ *  \param p_pMethod IN A pointer to the method.
+ *  \return A list, in increasing order, of the indices of every method in
+ *   this domain that p_pMethod might subsume, according to
+ *   HtnMethod::MightSubsume().  Any method that it does is among them.
+ */
+std::vector< unsigned int > HtnDomain::GetPossiblySubsumed( const HtnMethod * p_pMethod ) const
+{
+  std::vector< unsigned int > l_vRet;
+  ShapeMethodMap::const_iterator l_iIter = m_mMethodsByShape.find( p_pMethod->GetShapeHash() );
+  if( l_iIter == m_mMethodsByShape.end() )
+    return l_vRet;
+  for( unsigned int i = 0; i < l_iIter->second.size(); i++ )
+  {
+    if( p_pMethod->MightSubsume( m_vMethods[l_iIter->second[i]] ) )
+      l_vRet.push_back( l_iIter->second[i] );
+  }
+  return l_vRet;
+}
+
+/**
+ *  Retrieve the index of a method in this domain that is an exact duplicate
+ *   of another, up to the names of its variables and the order of its
+ *   preconditions.
+ *  \param p_pMethod IN A pointer to the other method.
+ *  \return The index of the first method in this domain with the same
+ *   canonical form as p_pMethod, or -1 if there is none.  Any such method
+ *   and p_pMethod subsume each other.
+ */
+int HtnDomain::FindDuplicate( const HtnMethod * p_pMethod ) const
+{
+  FingerprintMethodMap::const_iterator l_iIter = m_mMethodsByFingerprint.find( p_pMethod->GetFingerprint() );
+  if( l_iIter == m_mMethodsByFingerprint.end() )
+    return -1;
+  for( unsigned int i = 0; i < l_iIter->second.size(); i++ )
+  {
+    if( m_vMethods[l_iIter->second[i]]->GetCanonicalForm() == p_pMethod->GetCanonicalForm() )
+      return l_iIter->second[i];
+  }
+  return -1;
+}
+
+/**
+ *  Rebuild the indices from task names to methods and operators, and from
+ *   shapes and fingerprints to methods.
+ *  This must be called whenever methods or operators are removed or
+ *   reordered.
+ */
+void HtnDomain::IndexTasks()
+{
+  m_mMethodsByTask.clear();
+  m_mOperatorByTask.clear();
+  m_mMethodsByShape.clear();
+  m_mMethodsByFingerprint.clear();
+  for( unsigned int i = 0; i < m_vMethods.size(); i++ )
+  {
+    m_mMethodsByTask[m_vMethods[i]->GetCHead()->GetRelationIndex()].push_back( i );
+    m_mMethodsByShape[m_vMethods[i]->GetShapeHash()].push_back( i );
+    m_mMethodsByFingerprint[m_vMethods[i]->GetFingerprint()].push_back( i );
+  }
+  for( unsigned int i = 0; i < m_vOperators.size(); i++ )
+    m_mOperatorByTask.insert( std::make_pair( g_StrTable.Lookup( m_vOperators[i]->GetName() ), i ) );
+}
+
 /**
  *  Retrieve the name of the domain.
  */
@@ -652,6 +896,45 @@ std::string HtnDomain::ToShop() const
   return ToStr();
 }
 
+/**
+ *  Retrieve the compiled representation of this domain, which
+ *   HtnDomain::FromCompiled() can load without parsing any text.
+ *  It is only meaningful on a machine with the same byte order.
+ *  \return A string containing the compiled representation of this domain.
+ */
+std::string HtnDomain::ToCompiled() const
+{
+  CompiledDomainWriter l_Writer;
+
+  l_Writer.WriteString( m_sDomainName );
+  l_Writer.WriteWord( (uint32_t)m_iRequirements );
+
+  l_Writer.WriteWord( m_sAllowableTypes.size() );
+  for( std::set< std::string, StrLessNoCase >::const_iterator i = m_sAllowableTypes.begin(); i != m_sAllowableTypes.end(); i++ )
+    l_Writer.WriteString( *i );
+
+  l_Writer.WriteWord( m_ConstantTypes.size() );
+  for( TypeTable::const_iterator i = m_ConstantTypes.begin(); i != m_ConstantTypes.end(); i++ )
+  {
+    l_Writer.WriteString( i->first );
+    l_Writer.WriteString( i->second );
+  }
+
+  l_Writer.WriteWord( m_vAllowablePredicates.size() );
+  for( unsigned int i = 0; i < m_vAllowablePredicates.size(); i++ )
+    l_Writer.WritePred( m_vAllowablePredicates[i] );
+
+  l_Writer.WriteWord( m_vOperators.size() );
+  for( unsigned int i = 0; i < m_vOperators.size(); i++ )
+    m_vOperators[i]->ToCompiled( l_Writer );
+
+  l_Writer.WriteWord( m_vMethods.size() );
+  for( unsigned int i = 0; i < m_vMethods.size(); i++ )
+    m_vMethods[i]->ToCompiled( l_Writer );
+
+  return l_Writer.Finish();
+}
+
 /**
  *  Determine whether or not another domain is equivalent to this one.
  *  \param p_pOther A pointer to the other domain.
@@ -684,7 +967,9 @@ bool HtnDomain::Equivalent( const HtnDomain * p_pOther ) const
 
   for( unsigned int i = 0; i < m_vMethods.size(); i++ )
   {
-    bool l_bFound = false;
+    // Exact duplicates are found by fingerprint; only the rest need the
+    //  pairwise test.
+    bool l_bFound = p_pOther->FindDuplicate( m_vMethods[i] ) >= 0;
     for( unsigned int j = 0; j < p_pOther->m_vMethods.size() && !l_bFound; j++ )
     {
       if( m_vMethods[i]->Subsumes( p_pOther->m_vMethods[j] ) &&
@@ -752,6 +1037,15 @@ void HtnDomain::UpdateMethodQValue( unsigned int p_iMethodIndex,
 size_t HtnDomain::GetMemSizeMin() const
 {
   size_t l_iSize = sizeof( HtnDomain ) + m_vOperators.capacity() * sizeof( Operator * ) + m_vMethods.capacity() * sizeof( HtnMethod * ) + m_sDomainName.capacity() + m_sAllowableTypes.size() * sizeof( std::string ) + m_ConstantTypes.size() * sizeof( std::string ) * 2 + m_vAllowablePredicates.capacity() * sizeof( FormulaPred );
+  l_iSize += ( m_mMethodsByTask.bucket_count() + m_mOperatorByTask.bucket_count() ) * sizeof( void * ) + m_mOperatorByTask.size() * ( sizeof( void * ) + sizeof( unsigned int ) * 2 );
+  for( TaskMethodMap::const_iterator i = m_mMethodsByTask.begin(); i != m_mMethodsByTask.end(); i++ )
+    l_iSize += sizeof( void * ) + sizeof( unsigned int ) + sizeof( std::vector< unsigned int > ) + (*i).second.capacity() * sizeof( unsigned int );
+  l_iSize += m_mMethodsByShape.bucket_count() * sizeof( void * );
+  for( ShapeMethodMap::const_iterator i = m_mMethodsByShape.begin(); i != m_mMethodsByShape.end(); i++ )
+    l_iSize += sizeof( void * ) + sizeof( size_t ) + sizeof( std::vector< unsigned int > ) + (*i).second.capacity() * sizeof( unsigned int );
+  l_iSize += m_mMethodsByFingerprint.bucket_count() * sizeof( void * );
+  for( FingerprintMethodMap::const_iterator i = m_mMethodsByFingerprint.begin(); i != m_mMethodsByFingerprint.end(); i++ )
+    l_iSize += sizeof( void * ) + sizeof( uint64_t ) + sizeof( std::vector< unsigned int > ) + (*i).second.capacity() * sizeof( unsigned int );
   for( unsigned int i = 0; i < m_vOperators.size(); i++ )
     l_iSize += m_vOperators[i]->GetMemSizeMin();
   for( unsigned int i = 0; i < m_vMethods.size(); i++ )
@@ -768,6 +1062,15 @@ size_t HtnDomain::GetMemSizeMin() const
 size_t HtnDomain::GetMemSizeMax() const
 {
   size_t l_iSize = sizeof( HtnDomain ) + m_vOperators.capacity() * sizeof( Operator * ) + m_vMethods.capacity() * sizeof( HtnMethod * ) + m_sDomainName.capacity() + m_sAllowableTypes.size() * sizeof( std::string ) + m_ConstantTypes.size() * sizeof( std::string ) * 2 + m_vAllowablePredicates.capacity() * sizeof( FormulaPred );
+  l_iSize += ( m_mMethodsByTask.bucket_count() + m_mOperatorByTask.bucket_count() ) * sizeof( void * ) + m_mOperatorByTask.size() * ( sizeof( void * ) + sizeof( unsigned int ) * 2 );
+  for( TaskMethodMap::const_iterator i = m_mMethodsByTask.begin(); i != m_mMethodsByTask.end(); i++ )
+    l_iSize += sizeof( void * ) + sizeof( unsigned int ) + sizeof( std::vector< unsigned int > ) + (*i).second.capacity() * sizeof( unsigned int );
+  l_iSize += m_mMethodsByShape.bucket_count() * sizeof( void * );
+  for( ShapeMethodMap::const_iterator i = m_mMethodsByShape.begin(); i != m_mMethodsByShape.end(); i++ )
+    l_iSize += sizeof( void * ) + sizeof( size_t ) + sizeof( std::vector< unsigned int > ) + (*i).second.capacity() * sizeof( unsigned int );
+  l_iSize += m_mMethodsByFingerprint.bucket_count() * sizeof( void * );
+  for( FingerprintMethodMap::const_iterator i = m_mMethodsByFingerprint.begin(); i != m_mMethodsByFingerprint.end(); i++ )
+    l_iSize += sizeof( void * ) + sizeof( uint64_t ) + sizeof( std::vector< unsigned int > ) + (*i).second.capacity() * sizeof( unsigned int );
   for( unsigned int i = 0; i < m_vOperators.size(); i++ )
     l_iSize += m_vOperators[i]->GetMemSizeMax();
   for( unsigned int i = 0; i < m_vMethods.size(); i++ )
@@ -797,11 +1100,13 @@ void HtnDomain::SortMethods()
 {
   static HtnMethodStarLess sorter;
   std::stable_sort( m_vMethods.begin(), m_vMethods.end(), sorter );
+  IndexTasks();
 }
 
 void HtnDomain::RandomizeMethodOrder()
 {
   std::random_shuffle( m_vMethods.begin(), m_vMethods.end() );
+  IndexTasks();
 }
 
 void HtnDomain::SetMethodId( unsigned int p_iIndex,
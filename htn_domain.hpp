@@ -1,11 +1,23 @@
 #ifndef HTN_DOMAIN_HPP__
 #define HTN_DOMAIN_HPP__
 
+#include <stdint.h>
+#include <tr1/unordered_map>
+
+class PddlTokenizer;
+
+typedef std::tr1::unordered_map< unsigned int, std::vector< unsigned int > > TaskMethodMap;
+typedef std::tr1::unordered_map< unsigned int, unsigned int > TaskOperatorMap;
+typedef std::tr1::unordered_map< size_t, std::vector< unsigned int > > ShapeMethodMap;
+typedef std::tr1::unordered_map< uint64_t, std::vector< unsigned int > > FingerprintMethodMap;
+
 class HtnDomain
 {
 public:
   static HtnDomain * FromPddl( std::stringstream & p_sInput );
+  static HtnDomain * FromPddl( PddlTokenizer & p_Tokens );
   static HtnDomain * FromShop( std::stringstream & p_sInput );
+  static HtnDomain * FromCompiled( const char * p_pData, size_t p_iSize );
 
   HtnDomain( const HtnDomain & p_Other );
 
@@ -23,11 +35,20 @@ public:
   const Operator * GetCOperator( unsigned int p_iIndex ) const;
   const HtnMethod * GetCMethod( unsigned int p_iIndex ) const;
 
+  const std::vector< unsigned int > & GetMethodsForTask( unsigned int p_iTaskId ) const;
+  const std::vector< unsigned int > & GetMethodsForTask( const std::string & p_sTaskName ) const;
+  int GetOperatorForTask( unsigned int p_iTaskId ) const;
+
+  std::vector< unsigned int > GetPossibleSubsumers( const HtnMethod * p_pMethod ) const;
+  std::vector< unsigned int > GetPossiblySubsumed( const HtnMethod * p_pMethod ) const;
+  int FindDuplicate( const HtnMethod * p_pMethod ) const;
+
   std::string GetDomainName() const;
 
   std::string ToStr() const;
   std::string ToPddl() const;
   std::string ToShop() const;
+  std::string ToCompiled() const;
 
   long GetRequirements() const;
   void AddRequirement( long p_iAdditionalRequirement );
@@ -51,6 +72,8 @@ public:
 private:
   HtnDomain();
 
+  void IndexTasks();
+
   std::vector< Operator *> m_vOperators;
   std::vector< HtnMethod *> m_vMethods;
   std::string m_sDomainName;
@@ -58,6 +81,10 @@ private:
   std::set< std::string, StrLessNoCase > m_sAllowableTypes;
   TypeTable m_ConstantTypes;
   std::vector< FormulaPred > m_vAllowablePredicates;
+  TaskMethodMap m_mMethodsByTask;
+  TaskOperatorMap m_mOperatorByTask;
+  ShapeMethodMap m_mMethodsByShape;
+  FingerprintMethodMap m_mMethodsByFingerprint;
 };
 
 #endif//HTN_DOMAIN_HPP__
@@ -3,8 +3,10 @@
 #include <sstream>
 #include <iostream>
 #include <set>
+#include <map>
 #include <tr1/memory>
 #include <cstdlib>
+#include <cctype>
 #include <algorithm>
 
 #include "exception.hpp"
@@ -21,8 +23,11 @@
 #include "formula_equ.hpp"
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "operator.hpp"
 #include "htn_task_head.hpp"
+#include "compiled_domain.hpp"
 #include "htn_method.hpp"
 
 /** \file htn_method.hpp
@@ -55,6 +60,11 @@
  *  A smart pointer to the precondition of this method.
  */
 
+/** \var HtnMethod::m_pPlan
+ *  A smart pointer to the precondition of this method, compiled for matching
+ *   against a State.
+ */
+
 /** \var HtnMethod::m_vSubtasks
  *  A list of smart pointers to the subtasks of this method.
  */
@@ -73,6 +83,26 @@
  *  This is used by reinforcement learning.
  */
 
+/** \var HtnMethod::m_pShape
+ *  A smart pointer to the result of GetShape(), or a null pointer if that has
+ *   not been computed yet.
+ */
+
+/** \var HtnMethod::m_pSignature
+ *  A smart pointer to the sorted codes of the kinds of conjunct in the
+ *   precondition, as used by MightSubsume(), or a null pointer if those have
+ *   not been computed yet.
+ */
+
+/** \var HtnMethod::m_pCanonicalForm
+ *  A smart pointer to the result of GetCanonicalForm(), or a null pointer if
+ *   that has not been computed yet.
+ */
+
+/** \var HtnMethod::m_iFingerprint
+ *  The result of GetFingerprint(), if m_pCanonicalForm is not null.
+ */
+
 /**
  *  The one and only TermTable.
  */
@@ -222,6 +252,7 @@ HtnMethod * HtnMethod::FromPddl( std::stringstream & p_sInput,
 			 __LINE__ );
       l_bHasPreconditions = true;
       l_pRet->m_pPreconditions = FormulaConjP( new FormulaConj( p_sInput, l_pRet->m_TypeTable, p_vAllowablePredicates ) );
+      l_pRet->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pRet->m_pPreconditions ) );
     }
     else if( CompareNoCase( l_sFeatureName, ":subtasks" ) == 0 )
     {
@@ -326,6 +357,7 @@ HtnMethod * HtnMethod::FromShop( std::stringstream & p_sInput )
   l_pRet->m_pHead = HtnTaskHeadP( new HtnTaskHead( p_sInput, l_pRet->m_TypeTable ) );
   EatWhitespace( p_sInput );
   l_pRet->m_pPreconditions = FormulaConjP( new FormulaConj( p_sInput, l_pRet->m_TypeTable, std::vector< FormulaPred >() ) );
+  l_pRet->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pRet->m_pPreconditions ) );
   EatWhitespace( p_sInput );
   EatString( p_sInput, "(" );
   EatWhitespace( p_sInput );
@@ -343,9 +375,43 @@ HtnMethod * HtnMethod::FromShop( std::stringstream & p_sInput )
   return l_pRet;
 }
 
+/**
+ *  Retrieve a pointer to a new HtnMethod from its compiled representation, as
+ *   written by HtnMethod::ToCompiled().
+ *  \param p_Reader INOUT The reader of a compiled domain, which will be
+ *   advanced beyond the method.
+ *  \return A pointer to a new HtnMethod.  The caller is responsible for
+ *   deallocating it.
+ */
+HtnMethod * HtnMethod::FromCompiled( CompiledDomainReader & p_Reader )
+{
+  HtnMethod * l_pRet = new HtnMethod();
+
+  p_Reader.ReadOptionalString( l_pRet->m_sId );
+  l_pRet->m_fQValue = p_Reader.ReadDouble();
+  l_pRet->m_iQCount = (int)p_Reader.ReadWord();
+
+  uint32_t l_iNumTypes = p_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumTypes; i++ )
+  {
+    std::string l_sName = p_Reader.ReadString();
+    l_pRet->m_TypeTable[l_sName] = p_Reader.ReadString();
+  }
+
+  l_pRet->m_pHead = HtnTaskHeadP( new HtnTaskHead( *p_Reader.ReadPred() ) );
+  l_pRet->m_pPreconditions = p_Reader.ReadConj();
+  l_pRet->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pRet->m_pPreconditions ) );
+
+  uint32_t l_iNumSubtasks = p_Reader.ReadWord();
+  for( uint32_t i = 0; i < l_iNumSubtasks; i++ )
+    l_pRet->m_vSubtasks.push_back( HtnTaskHeadP( new HtnTaskHead( *p_Reader.ReadPred() ) ) );
+
+  return l_pRet;
+}
+
 /**
  *  Construct a default HtnMethod.  This should only be called by the 
- *   FromShop() and FromPddl() methods.
+ *   FromShop(), FromPddl(), and FromCompiled() methods.
  */
 HtnMethod::HtnMethod()
 {
@@ -361,6 +427,7 @@ HtnMethod::HtnMethod()
 HtnMethod::HtnMethod( const HtnMethod & p_Other )
   : m_pHead( p_Other.m_pHead ),
     m_pPreconditions( p_Other.m_pPreconditions ),
+    m_pPlan( p_Other.m_pPlan ),
     m_fQValue( p_Other.m_fQValue ),
     m_iQCount( p_Other.m_iQCount )
 {
@@ -394,6 +461,17 @@ FormulaConjP HtnMethod::GetCPreconditions() const
   return m_pPreconditions;
 }
 
+/**
+ *  Retrieve the preconditions of this HtnMethod, compiled for matching against
+ *   a State.
+ *  \return A pointer to the compiled preconditions, which has the same
+ *   lifetime as this HtnMethod.
+ */
+const UnifyPlan * HtnMethod::GetCPlan() const
+{
+  return m_pPlan.get();
+}
+
 /**
  *  Retrieve the number of subtasks in this HtnMethod.
  *  \return The number of subtasks in this HtnMethod.
@@ -989,12 +1067,12 @@ bool HtnMethod::Subsumes( const HtnMethod * p_pOther ) const
     if( l_vVars[i]->HasTyping() )
     {
       l_MySubs.AddPair( l_vVars[i],
-			g_TermTable.Lookup( MakeTempOldId(), l_vVars[i]->GetTyping() ) );
+			g_TermTable.LookupTemp( MakeTempOldId(), l_vVars[i]->GetTyping() ) );
     }
     else
     {
       l_MySubs.AddPair( l_vVars[i],
-			g_TermTable.Lookup( MakeTempOldId() ) );
+			g_TermTable.LookupTemp( MakeTempOldId() ) );
     }
   }
 
@@ -1005,12 +1083,12 @@ bool HtnMethod::Subsumes( const HtnMethod * p_pOther ) const
     if( l_vVars[i]->HasTyping() )
     {
       l_OtherSubs.AddPair( l_vVars[i],
-			   g_TermTable.Lookup( MakeTempNewId(), l_vVars[i]->GetTyping() ) );
+			   g_TermTable.LookupTemp( MakeTempNewId(), l_vVars[i]->GetTyping() ) );
     }
     else
     {
       l_OtherSubs.AddPair( l_vVars[i],
-			   g_TermTable.Lookup( MakeTempNewId() ) );
+			   g_TermTable.LookupTemp( MakeTempNewId() ) );
     }
   } 
 
@@ -1089,6 +1167,244 @@ bool HtnMethod::Subsumes( const HtnMethod * p_pOther ) const
   return CanSubsume( l_vMine, l_vHis, l_MasterSubs );
 }
 
+/**
+ *  Determine cheaply whether or not this HtnMethod might subsume another.
+ *  This checks only conditions that Subsumes() requires: both methods must
+ *   have the same shape, and every kind of conjunct in the precondition of
+ *   this must also appear in the precondition of the other.  If this returns
+ *   false, so would Subsumes().
+ *  \param p_pOther IN A pointer to the other HtnMethod that this might
+ *   subsume.
+ *  \return Whether or not this might subsume the other.
+ */
+bool HtnMethod::MightSubsume( const HtnMethod * p_pOther ) const
+{
+  if( GetShape() != p_pOther->GetShape() )
+    return false;
+  return std::includes( p_pOther->m_pSignature->begin(), p_pOther->m_pSignature->end(),
+			m_pSignature->begin(), m_pSignature->end() );
+}
+
+/**
+ *  Retrieve the shape of this HtnMethod, which is what Subsumes() requires to
+ *   be identical between two methods before it compares their preconditions.
+ *  \return The index of the name of the head in the global StringTable, the
+ *   number of parameters of the head, the number of subtasks, and the index
+ *   of the name of each subtask.  This is valid for the lifetime of this
+ *   HtnMethod.
+ */
+const std::vector< unsigned int > & HtnMethod::GetShape() const
+{
+  if( !m_pShape )
+    MakeSubsumptionKeys();
+  return *m_pShape;
+}
+
+/**
+ *  Retrieve a hash value of the shape of this HtnMethod.
+ *  \return A hash value of the result of GetShape().
+ */
+size_t HtnMethod::GetShapeHash() const
+{
+  const std::vector< unsigned int > & l_vShape = GetShape();
+  size_t l_iHash = 0;
+  for( unsigned int i = 0; i < l_vShape.size(); i++ )
+    l_iHash = ( l_iHash << 5 ) - l_iHash + l_vShape[i];
+  return l_iHash;
+}
+
+/**
+ *  Compute the shape of this HtnMethod and the signature of its precondition.
+ */
+void HtnMethod::MakeSubsumptionKeys() const
+{
+  std::vector< unsigned int > * l_pShape = new std::vector< unsigned int >();
+  l_pShape->push_back( m_pHead->GetRelationIndex() );
+  l_pShape->push_back( m_pHead->GetNumParams() );
+  l_pShape->push_back( m_vSubtasks.size() );
+  for( unsigned int i = 0; i < m_vSubtasks.size(); i++ )
+    l_pShape->push_back( m_vSubtasks[i]->GetRelationIndex() );
+
+  std::vector< unsigned int > * l_pSignature = new std::vector< unsigned int >();
+  for( FormulaPVecCI i = m_pPreconditions->GetBeginConj();
+       i != m_pPreconditions->GetEndConj();
+       i++ )
+  {
+    switch( (*i)->GetType() )
+    {
+    case FT_EQU:
+      l_pSignature->push_back( 0 );
+      break;
+    case FT_NEG:
+      l_pSignature->push_back( 1 );
+      break;
+    case FT_PRED:
+    {
+      FormulaPredP l_pPred = std::tr1::dynamic_pointer_cast< FormulaPred >( *i );
+      // Distinct predicates may share a code, which only weakens the check.
+      l_pSignature->push_back( 2 + l_pPred->GetRelationIndex() * 16 + ( l_pPred->GetValence() < 15 ? l_pPred->GetValence() : 15 ) );
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  std::sort( l_pSignature->begin(), l_pSignature->end() );
+  l_pSignature->erase( std::unique( l_pSignature->begin(), l_pSignature->end() ), l_pSignature->end() );
+
+  m_pSignature = std::tr1::shared_ptr< std::vector< unsigned int > >( l_pSignature );
+  m_pShape = std::tr1::shared_ptr< std::vector< unsigned int > >( l_pShape );
+}
+
+/**
+ *  Print a Term for the canonical form of an HtnMethod.
+ *  This is a helper function for HtnMethod::MakeCanonicalForm().
+ *  \param p_pTerm IN A smart pointer to the Term to print.
+ *  \param p_mVars INOUT The canonical number of each variable named so far.
+ *  \param p_bName IN Whether or not a variable that has not been named yet
+ *   should be given the next number.  If not, it is printed as a placeholder.
+ *  \return The canonical representation of the Term, in upper case.
+ */
+std::string CanonicalTerm( const TermP & p_pTerm,
+			   std::map< const Term *, unsigned int > & p_mVars,
+			   bool p_bName )
+{
+  std::string l_sRet;
+  if( p_pTerm->GetType() == TT_VARIABLE )
+  {
+    std::map< const Term *, unsigned int >::const_iterator l_Iter = p_mVars.find( p_pTerm.get() );
+    if( l_Iter == p_mVars.end() && p_bName )
+      l_Iter = p_mVars.insert( std::make_pair( p_pTerm.get(), (unsigned int)p_mVars.size() ) ).first;
+    if( l_Iter == p_mVars.end() )
+      l_sRet = "?";
+    else
+    {
+      std::stringstream l_sStream;
+      l_sStream << "?" << l_Iter->second;
+      l_sRet = l_sStream.str();
+    }
+  }
+  else
+    l_sRet = p_pTerm->ToStrNoTyping();
+  if( p_pTerm->HasTyping() )
+    l_sRet += " - " + p_pTerm->GetTyping();
+  for( unsigned int i = 0; i < l_sRet.size(); i++ )
+    l_sRet[i] = toupper( l_sRet[i] );
+  return l_sRet;
+}
+
+/**
+ *  Print a Formula for the canonical form of an HtnMethod.
+ *  This is a helper function for HtnMethod::MakeCanonicalForm().
+ *  Only predicates, equalities, and negations of those have their variables
+ *   renamed; anything else is printed as is.
+ *  \param p_pForm IN A smart pointer to the Formula to print.
+ *  \param p_mVars INOUT The canonical number of each variable named so far.
+ *  \param p_bName IN Whether or not variables that have not been named yet
+ *   should be given the next numbers.
+ *  \return The canonical representation of the Formula.
+ */
+std::string CanonicalFormula( const FormulaP & p_pForm,
+			      std::map< const Term *, unsigned int > & p_mVars,
+			      bool p_bName )
+{
+  switch( p_pForm->GetType() )
+  {
+  case FT_PRED:
+  {
+    FormulaPredP l_pPred = std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm );
+    std::string l_sRet = "( " + l_pPred->GetRelation();
+    for( unsigned int i = 0; i < l_sRet.size(); i++ )
+      l_sRet[i] = toupper( l_sRet[i] );
+    for( unsigned int i = 0; i < l_pPred->GetValence(); i++ )
+      l_sRet += " " + CanonicalTerm( l_pPred->GetCParam( i ), p_mVars, p_bName );
+    return l_sRet + " )";
+  }
+  case FT_EQU:
+  {
+    FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( p_pForm );
+    std::string l_sFirst = CanonicalTerm( l_pEqu->GetCFirst(), p_mVars, p_bName );
+    return "( = " + l_sFirst + " " + CanonicalTerm( l_pEqu->GetCSecond(), p_mVars, p_bName ) + " )";
+  }
+  case FT_NEG:
+    return "( NOT " + CanonicalFormula( std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pForm )->GetCNegForm(), p_mVars, p_bName ) + " )";
+  default:
+    return p_pForm->ToStr();
+  }
+}
+
+/**
+ *  Retrieve the canonical form of this HtnMethod.
+ *  Two HtnMethods with the same canonical form are identical up to the names
+ *   of their variables and the order of their preconditions, so each
+ *   subsumes the other.  The converse does not hold: methods whose
+ *   preconditions can only be told apart through their variables may be
+ *   equivalent and still have different canonical forms.
+ *  The ID and Q-value of the method are not part of its canonical form.
+ *  \return The canonical form of this HtnMethod, which is valid for the
+ *   lifetime of this HtnMethod.
+ */
+const std::string & HtnMethod::GetCanonicalForm() const
+{
+  if( !m_pCanonicalForm )
+    MakeCanonicalForm();
+  return *m_pCanonicalForm;
+}
+
+/**
+ *  Retrieve a 64-bit fingerprint of the canonical form of this HtnMethod.
+ *  This is stable across runs, so it may be stored or compared between
+ *   processes.
+ *  \return The FNV-1a hash of the result of GetCanonicalForm().
+ */
+uint64_t HtnMethod::GetFingerprint() const
+{
+  if( !m_pCanonicalForm )
+    MakeCanonicalForm();
+  return m_iFingerprint;
+}
+
+/**
+ *  Compute the canonical form of this HtnMethod and its fingerprint.
+ *  Variables are numbered in order of first appearance in the head and then
+ *   in the subtasks.  The preconditions are sorted with any variables that
+ *   appear in neither printed as placeholders, those variables are numbered
+ *   in order of first appearance in the sorted list, and the preconditions
+ *   are then sorted again with every variable named.
+ */
+void HtnMethod::MakeCanonicalForm() const
+{
+  std::map< const Term *, unsigned int > l_mVars;
+
+  std::string l_sRet = CanonicalFormula( m_pHead, l_mVars, true ) + "\n";
+  for( unsigned int i = 0; i < m_vSubtasks.size(); i++ )
+    l_sRet += CanonicalFormula( m_vSubtasks[i], l_mVars, true ) + "\n";
+
+  std::vector< std::pair< std::string, FormulaP > > l_vPrecs;
+  for( FormulaPVecCI i = m_pPreconditions->GetBeginConj();
+       i != m_pPreconditions->GetEndConj();
+       i++ )
+    l_vPrecs.push_back( std::make_pair( CanonicalFormula( *i, l_mVars, false ), *i ) );
+  std::stable_sort( l_vPrecs.begin(), l_vPrecs.end() );
+
+  std::vector< std::string > l_vNamed;
+  for( unsigned int i = 0; i < l_vPrecs.size(); i++ )
+    l_vNamed.push_back( CanonicalFormula( l_vPrecs[i].second, l_mVars, true ) );
+  std::sort( l_vNamed.begin(), l_vNamed.end() );
+  for( unsigned int i = 0; i < l_vNamed.size(); i++ )
+    l_sRet += ":" + l_vNamed[i] + "\n";
+
+  uint64_t l_iHash = 14695981039346656037ULL;
+  for( unsigned int i = 0; i < l_sRet.size(); i++ )
+  {
+    l_iHash ^= (unsigned char)l_sRet[i];
+    l_iHash *= 1099511628211ULL;
+  }
+
+  m_iFingerprint = l_iHash;
+  m_pCanonicalForm = std::tr1::shared_ptr< std::string >( new std::string( l_sRet ) );
+}
+
 /**
  *  Return a pointer to a substitution that unifies p_pNewEqu with OldEqu 
  *   and is an extension of p_pOldSubs, or NULL if none exists.
@@ -1332,6 +1648,36 @@ bool VecContainsTerm( const std::vector< TermP > & p_Vec,
   return false;
 }
 
+/**
+ *  Write the compiled representation of this HtnMethod.
+ *  Its UnifyPlan and cached keys are not written; they are rebuilt when it
+ *   is read.
+ *  \param p_Writer INOUT The writer of a compiled domain.
+ */
+void HtnMethod::ToCompiled( CompiledDomainWriter & p_Writer ) const
+{
+  if( m_sId.empty() )
+    p_Writer.WriteNoString();
+  else
+    p_Writer.WriteString( m_sId );
+  p_Writer.WriteDouble( m_fQValue );
+  p_Writer.WriteWord( (uint32_t)m_iQCount );
+
+  p_Writer.WriteWord( m_TypeTable.size() );
+  for( TypeTable::const_iterator i = m_TypeTable.begin(); i != m_TypeTable.end(); i++ )
+  {
+    p_Writer.WriteString( i->first );
+    p_Writer.WriteString( i->second );
+  }
+
+  p_Writer.WritePred( *m_pHead );
+  p_Writer.WriteFormula( m_pPreconditions );
+
+  p_Writer.WriteWord( m_vSubtasks.size() );
+  for( unsigned int i = 0; i < m_vSubtasks.size(); i++ )
+    p_Writer.WritePred( *m_vSubtasks[i] );
+}
+
 /**
  *  Determine whether or not each of the subtasks of this method contains at
  *   least one parameter that also appears in the head or preconditions of the
@@ -1418,6 +1764,7 @@ HtnMethod * HtnMethod::AfterSubstitution( const Substitution & p_sSub,
 
   l_pNew->m_pHead = std::tr1::dynamic_pointer_cast< HtnTaskHead >( m_pHead->AfterSubstitution( p_sSub, p_iDepth ) );
   l_pNew->m_pPreconditions = std::tr1::dynamic_pointer_cast< FormulaConj >( m_pPreconditions->AfterSubstitution( p_sSub, p_iDepth ) );
+  l_pNew->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pNew->m_pPreconditions ) );
 
   for( unsigned int i = 0; i < m_vSubtasks.size(); i++ )
   {
@@ -1475,6 +1822,9 @@ void HtnMethod::AddNdCheckers()
     HtnTaskHeadP l_pNewTask( new HtnTaskHead( *GetCHead() ) );
     m_vSubtasks.push_back( l_pNewTask );
   }
+  m_pShape.reset();
+  m_pSignature.reset();
+  m_pCanonicalForm.reset();
 }
 
 /**
@@ -1516,6 +1866,10 @@ size_t HtnMethod::GetMemSizeMin() const
   size_t l_iSize = sizeof( HtnMethod ) + m_sId.capacity() + m_vSubtasks.capacity() * sizeof( HtnTaskHeadP );
   if( m_pVariables )
     l_iSize += m_pVariables->capacity() * sizeof( TermVariableP );
+  if( m_pShape )
+    l_iSize += ( m_pShape->capacity() + m_pSignature->capacity() ) * sizeof( unsigned int );
+  if( m_pCanonicalForm )
+    l_iSize += sizeof( std::string ) + m_pCanonicalForm->capacity();
   return l_iSize;
 }
 
@@ -1524,6 +1878,10 @@ size_t HtnMethod::GetMemSizeMax() const
   size_t l_iSize = sizeof( HtnMethod ) + m_sId.capacity() + (m_vSubtasks.capacity() - m_vSubtasks.size()) * sizeof( HtnTaskHeadP );
   if( m_pVariables)
     l_iSize += m_pVariables->capacity() * sizeof( TermVariableP );
+  if( m_pShape )
+    l_iSize += ( m_pShape->capacity() + m_pSignature->capacity() ) * sizeof( unsigned int );
+  if( m_pCanonicalForm )
+    l_iSize += sizeof( std::string ) + m_pCanonicalForm->capacity();
   for( unsigned int i = 0; i < m_vSubtasks.size(); i++ )
     l_iSize += m_vSubtasks[i]->GetMemSizeMax();
   return l_iSize;
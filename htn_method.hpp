@@ -1,6 +1,12 @@
 #ifndef HTN_METHOD_HPP__
 #define HTN_METHOD_HPP__
 
+#include <stdint.h>
+
+class UnifyPlan;
+class CompiledDomainReader;
+class CompiledDomainWriter;
+
 class HtnMethod
 {
 public:
@@ -9,6 +15,7 @@ public:
 			       const std::vector< FormulaPred > & p_vAllowablePredicates,
 			       long p_iRequirements );
   static HtnMethod * FromShop( std::stringstream & p_sInput );
+  static HtnMethod * FromCompiled( CompiledDomainReader & p_Reader );
 
   HtnMethod( const HtnMethod & p_Other );
 
@@ -16,10 +23,16 @@ public:
 
   HtnTaskHeadP GetCHead() const;
   FormulaConjP GetCPreconditions() const;
+  const UnifyPlan * GetCPlan() const;
   unsigned int GetNumSubtasks() const;
   HtnTaskHeadP GetCSubtask( unsigned int p_iIndex ) const;
 
   bool Subsumes( const HtnMethod * p_pOther ) const;
+  bool MightSubsume( const HtnMethod * p_pOther ) const;
+  const std::vector< unsigned int > & GetShape() const;
+  size_t GetShapeHash() const;
+  const std::string & GetCanonicalForm() const;
+  uint64_t GetFingerprint() const;
 
   std::vector< TermVariableP > GetVariables() const;
   std::set< TermVariableP > GetRelVars() const;
@@ -27,6 +40,7 @@ public:
 
   std::string ToStr() const;
   std::string ToPddl( long p_iRequirements ) const;
+  void ToCompiled( CompiledDomainWriter & p_Writer ) const;
 
   bool SubtasksArePartiallyLinked() const;
 
@@ -47,14 +61,22 @@ public:
 private:
   HtnMethod();
 
+  void MakeSubsumptionKeys() const;
+  void MakeCanonicalForm() const;
+
   std::string m_sId;
   HtnTaskHeadP m_pHead;
   FormulaConjP m_pPreconditions;
+  std::tr1::shared_ptr< UnifyPlan > m_pPlan;
   std::vector< HtnTaskHeadP > m_vSubtasks;
   TypeTable m_TypeTable;
   double m_fQValue;
   int m_iQCount;
   mutable std::tr1::shared_ptr< std::vector< TermVariableP > > m_pVariables;
+  mutable std::tr1::shared_ptr< std::vector< unsigned int > > m_pShape;
+  mutable std::tr1::shared_ptr< std::vector< unsigned int > > m_pSignature;
+  mutable std::tr1::shared_ptr< std::string > m_pCanonicalForm;
+  mutable uint64_t m_iFingerprint;
 };
 
 #endif//HTN_METHOD_HPP__
@@ -6,6 +6,7 @@
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_variable.hpp"
@@ -18,6 +19,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "htn_task_head.hpp"
 #include "htn_method.hpp"
@@ -62,6 +65,11 @@
  *  See the constants in funcs.hpp.
  */
 
+/**
+ *  The one and only string hasher, defined in funcs.cpp.
+ */
+extern HashStr g_StrHasher;
+
 /**
  *  Construct a default HtnProblem.
  *  This exists only for HtnProblem::FromShop() and HtnProblem::FromPddl().
@@ -164,34 +172,43 @@ HtnProblem * HtnProblem::FromShop( const std::tr1::shared_ptr< HtnDomain > & p_p
  */
 HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
 				   std::stringstream & p_sInput )
+{
+  std::string l_sInput = p_sInput.str();
+  PddlTokenizer l_Tokens( l_sInput );
+  l_Tokens.SetOffset( p_sInput.tellg() );
+  HtnProblem * l_pRet = FromPddl( p_pDomain, l_Tokens );
+  p_sInput.seekg( l_Tokens.GetOffset() );
+  return l_pRet;
+}
+
+/**
+ *  Retrieve a pointer to a new HtnProblem based on its PDDL representation.
+ *  \param p_pDomain IN A smart pointer to the associated domain.
+ *  \param p_Tokens INOUT A tokenizer over a textual representation of this
+ *   problem in the PDDL language.  It is advanced beyond this.
+ *  \return A pointer to a new HtnProblem based on the text.  The caller is
+ *   responsible for deallocating it.
+ */
+HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+				   PddlTokenizer & p_Tokens )
 {
   HtnProblem * l_pRet = new HtnProblem( p_pDomain );
   l_pRet->m_iRequirements = PDDL_REQ_STRIPS | PDDL_REQ_HTN;
 
   TypeTable l_ObjectTypes;
 
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "(" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "define" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "(" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "htn-problem" );
-  EatWhitespace( p_sInput );
+  p_Tokens.Eat( "(" );
+  p_Tokens.Eat( "define" );
+  p_Tokens.Eat( "(" );
+  p_Tokens.Eat( "htn-problem" );
 
-  l_pRet->m_sProbName = ReadString( p_sInput );
+  l_pRet->m_sProbName = p_Tokens.ReadAtom();
 
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, ")" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, "(" );
-  EatWhitespace( p_sInput );
-  EatString( p_sInput, ":domain" );
-  EatWhitespace( p_sInput );
+  p_Tokens.Eat( ")" );
+  p_Tokens.Eat( "(" );
+  p_Tokens.Eat( ":domain" );
 
-  std::string l_sDomainName = ReadString( p_sInput );
-  EatWhitespace( p_sInput );
+  std::string l_sDomainName = p_Tokens.ReadAtom();
 
   if( CompareNoCase( l_sDomainName, p_pDomain->GetDomainName() ) != 0 )
     throw Exception( E_DOMAIN_MATCH,
@@ -199,24 +216,18 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
 		     __FILE__,
 		     __LINE__ );
 
-  EatString( p_sInput, ")" );
-  EatWhitespace( p_sInput );
+  p_Tokens.Eat( ")" );
 
   bool l_bHasRequirements = false,
     l_bHasObjects = false,
     l_bHasInit = false,
     l_bHasGoal = false;
 
-  while( p_sInput.peek() == '(' )
+  while( p_Tokens.PeekOpen() )
   {
-    std::string l_sFeature = ReadParenthetical( p_sInput );
-    EatWhitespace( p_sInput );
-
-    std::stringstream l_sFeatureStream( l_sFeature );
-    EatString( l_sFeatureStream, "(" );
-    EatWhitespace( l_sFeatureStream );
-    std::string l_sFeatureName = ReadString( l_sFeatureStream );
-    EatWhitespace( l_sFeatureStream );
+    size_t l_iFeatureStart = p_Tokens.GetOffset();
+    p_Tokens.Eat( "(" );
+    std::string l_sFeatureName = p_Tokens.ReadAtom();
 
     if( CompareNoCase( l_sFeatureName, ":requirements" ) == 0 )
     {
@@ -241,7 +252,8 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
 			 __FILE__,
 			 __LINE__ );
       l_bHasRequirements = true;
-      l_pRet->m_iRequirements = ParseRequirements( l_sFeature, true );
+      p_Tokens.SetOffset( l_iFeatureStart );
+      l_pRet->m_iRequirements = ParseRequirements( p_Tokens.ReadParenthetical(), true );
     }
     else if( CompareNoCase( l_sFeatureName, ":objects" ) == 0 )
     {
@@ -262,17 +274,14 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
 			 __LINE__ );
       l_bHasObjects = true;
 
-      while( l_sFeatureStream.peek() != ')' )
+      while( !p_Tokens.PeekClose() )
       {
-	std::string l_sNewObj = ReadString( l_sFeatureStream );
-	EatWhitespace( l_sFeatureStream );
+	std::string l_sNewObj = p_Tokens.ReadAtom();
 	std::string l_sTyping = "";
 	if( p_pDomain->GetRequirements() & PDDL_REQ_TYPING )
 	{
-	  EatString( l_sFeatureStream, "-" );
-	  EatWhitespace( l_sFeatureStream );
-	  l_sTyping = ReadString( l_sFeatureStream );
-	  EatWhitespace( l_sFeatureStream );
+	  p_Tokens.Eat( "-" );
+	  l_sTyping = p_Tokens.ReadAtom();
 	}
 
 	if( l_ObjectTypes.find( l_sNewObj ) == l_ObjectTypes.end() )
@@ -299,6 +308,7 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
 			   __FILE__,
 			   __LINE__ );
       }
+      p_Tokens.Eat( ")" );
     }
     else if( CompareNoCase( l_sFeatureName, ":init" ) == 0 )
     {
@@ -314,13 +324,13 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
 			 __LINE__ );
       l_bHasInit = true;
       std::string l_sInitState = "( ";
-      while( l_sFeatureStream.peek() == '(' )
+      while( p_Tokens.PeekOpen() )
       {
-	l_sInitState += ReadParenthetical( l_sFeatureStream );
+	l_sInitState += p_Tokens.ReadParenthetical();
 	l_sInitState += " ";
-	EatWhitespace( l_sFeatureStream );
       }
       l_sInitState += ")";
+      p_Tokens.Eat( ")" );
 
       l_pRet->m_pState = new State( l_sInitState, 0, ( l_ObjectTypes.size() > 0 ? l_ObjectTypes : p_pDomain->GetConstantTypes() ), p_pDomain->GetAllowablePredicates() );
     }
@@ -333,16 +343,16 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
 			 __LINE__ );
       l_bHasGoal = true;
       std::vector< HtnTaskHeadP > l_vTasks;
-      while( l_sFeatureStream.peek() == '(' )
+      while( p_Tokens.PeekOpen() )
       {
-	l_vTasks.push_back( HtnTaskHeadP( new HtnTaskHead( l_sFeatureStream, ( l_ObjectTypes.size() > 0 ? l_ObjectTypes : p_pDomain->GetConstantTypes() ) ) ) );
-	EatWhitespace( p_sInput );
+	std::stringstream l_sTaskStream( p_Tokens.ReadParenthetical() );
+	l_vTasks.push_back( HtnTaskHeadP( new HtnTaskHead( l_sTaskStream, ( l_ObjectTypes.size() > 0 ? l_ObjectTypes : p_pDomain->GetConstantTypes() ) ) ) );
       }
 
       for( unsigned int i = l_vTasks.size(); i > 0; i-- )
 	l_pRet->m_vOutstandingTasks.push_back( l_vTasks[i-1] );
 
-      EatString( l_sFeatureStream, ")" );
+      p_Tokens.Eat( ")" );
     }
     else if( CompareNoCase( l_sFeatureName, ":goal" ) == 0 )
     {
@@ -378,7 +388,7 @@ HtnProblem * HtnProblem::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_p
     }
   }
 
-  EatString( p_sInput, ")" );
+  p_Tokens.Eat( ")" );
 
   if( !l_bHasInit )
     throw Exception( E_NOT_IMPLEMENTED,
@@ -479,6 +489,63 @@ bool HtnProblem::Equivalent( const HtnProblem & p_Other ) const
   return true;
 }
 
+/**
+ *  Retrieve a hash of the search node that this problem represents: its
+ *   State together with the ordered list of outstanding tasks.
+ *  Equivalent problems have equal hashes, but distinct problems may collide.
+ *  \return A hash of the state and outstanding tasks of this problem.
+ */
+uint64_t HtnProblem::GetHash() const
+{
+  uint64_t l_iHash = m_pState->GetHash();
+
+  for( unsigned int i = 0; i < m_vOutstandingTasks.size(); i++ )
+  {
+    const HtnTaskHead & l_Task = *m_vOutstandingTasks[i];
+    uint64_t l_iTaskHash = l_Task.GetRelationIndex();
+    for( unsigned int j = 0; j < l_Task.GetValence(); j++ )
+    {
+      TermP l_pParam = l_Task.GetCParam( j );
+      uint64_t l_iParamHash = l_pParam->GetId();
+      if( l_iParamHash == TERM_NO_ID )
+	l_iParamHash = g_StrHasher( l_pParam->ToStr() );
+      l_iTaskHash = l_iTaskHash * 31 + l_iParamHash;
+    }
+    l_iHash = MixHash( l_iHash + MixHash( l_iTaskHash ) );
+  }
+
+  return l_iHash;
+}
+
+/**
+ *  Retrieve a second hash of the search node that this problem represents,
+ *   which is computed independently of HtnProblem::GetHash().
+ *  Two problems with the same hash are only taken to be the same if this
+ *   matches as well.
+ *  \return A second hash of the state and outstanding tasks of this problem.
+ */
+uint64_t HtnProblem::GetCheckHash() const
+{
+  uint64_t l_iHash = m_pState->GetCheckHash();
+
+  for( unsigned int i = 0; i < m_vOutstandingTasks.size(); i++ )
+  {
+    const HtnTaskHead & l_Task = *m_vOutstandingTasks[i];
+    uint64_t l_iTaskHash = MixHash( ( (uint64_t)l_Task.GetRelationIndex() << 32 ) | l_Task.GetValence() );
+    for( unsigned int j = 0; j < l_Task.GetValence(); j++ )
+    {
+      TermP l_pParam = l_Task.GetCParam( j );
+      uint64_t l_iParamHash = l_pParam->GetId();
+      if( l_iParamHash == TERM_NO_ID )
+	l_iParamHash = MixHash( g_StrHasher( l_pParam->ToStr() ) );
+      l_iTaskHash = MixHash( l_iTaskHash ^ l_iParamHash );
+    }
+    l_iHash = MixHash( l_iHash ^ l_iTaskHash );
+  }
+
+  return l_iHash;
+}
+
 /**
  *  Retrieve a smart pointer to the domain associated with this problem.
  *  \return A reference-counted pointer to the domain associated with this 
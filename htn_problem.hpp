@@ -1,6 +1,8 @@
 #ifndef HTN_PROBLEM_HPP__
 #define HTN_PROBLEM_HPP__
 
+class PddlTokenizer;
+
 class HtnProblem
 {
 public:
@@ -8,6 +10,8 @@ public:
 				std::stringstream & p_sInput );
   static HtnProblem * FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
 				std::stringstream & p_sInput );
+  static HtnProblem * FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+				PddlTokenizer & p_Tokens );
 
   HtnProblem( const HtnProblem & p_Other );
 
@@ -20,6 +24,8 @@ public:
   unsigned int GetNumOutstandingTasks() const;
 
   bool Equivalent( const HtnProblem & p_Other ) const;
+  uint64_t GetHash() const;
+  uint64_t GetCheckHash() const;
 
   const std::tr1::shared_ptr< HtnDomain > & GetDomain() const;
   HtnTaskHeadP GetTask( unsigned int p_iIndex ) const;
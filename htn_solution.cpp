@@ -19,6 +19,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "htn_task_head.hpp"
 #include "htn_method.hpp"
@@ -106,6 +108,20 @@ void DecompPart::AddChild( DecompPart * p_pNew )
   m_vChildren.push_back( p_pNew );
 }
 
+/**
+ *  Remove and deallocate the most recently added child of this node.
+ */
+void DecompPart::RemoveLastChild()
+{
+  if( m_vChildren.empty() )
+    throw Exception( E_INDEX_OUT_OF_BOUNDS,
+		     "Attempt to remove a child from a node with none.",
+		     __FILE__,
+		     __LINE__ );
+  delete m_vChildren.back();
+  m_vChildren.pop_back();
+}
+
 /**
  *  Print this node and its children to a string.
  *  \param p_sIndent IN A string of spaces to make this fit properly in a 
@@ -218,6 +234,43 @@ size_t DecompPart::GetMemSizeMax() const
  *   deallocated there.
  */
 
+/**
+ *  \var HtnSolution::m_bRecordUndo
+ *  Whether or not ApplyMethod and ApplyOperator should record how to reverse
+ *   themselves in m_vUndoLog.
+ */
+
+/**
+ *  \var HtnSolution::m_vUndoLog
+ *  A list of the information needed to reverse each method or operator that
+ *   has been applied since undo recording was enabled, most recent last.
+ *  A search can then extend a single HtnSolution in place and call UndoTo
+ *   when it backtracks, instead of copying the HtnSolution for each branch.
+ *  Any old States in this must be deallocated with the HtnSolution.
+ */
+
+/** \class UndoRecord
+ *  The information needed to reverse one application of a method or operator
+ *   to an HtnSolution.
+ */
+
+/** \var UndoRecord::m_pOldState
+ *  For an operator, a pointer to the State before it was applied.
+ *  For a method, NULL.
+ */
+
+/** \var UndoRecord::m_pTask
+ *  The task that was accomplished, and must be put back on the task list.
+ */
+
+/** \var UndoRecord::m_pParent
+ *  The parent of the task that was accomplished.
+ */
+
+/** \var UndoRecord::m_iNumSubtasks
+ *  For a method, the number of subtasks that it added to the task list.
+ */
+
 /**
  *  Construct a default HtnSolution.
  *  This exists only for the benefit of FromShop and FromPddl.
@@ -228,6 +281,7 @@ HtnSolution::HtnSolution( const std::tr1::shared_ptr< HtnDomain > & p_pDomain )
 {
   m_iNumDecomps = 0;
   m_pInitState = NULL;
+  m_bRecordUndo = false;
 }
 
 /**
@@ -272,6 +326,26 @@ HtnSolution * HtnSolution::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p
   return l_pRet;
 }
 
+/**
+ *  Retrieve a pointer to a new HtnSolution from the PDDL representation of 
+ *   its problem, read directly from a tokenizer.
+ *  As with the stream version, the new "solution" is a blank slate on which
+ *   a solution may be constructed.
+ *  \param p_pDomain IN A pointer to the domain associated with this problem.
+ *  \param p_Tokens INOUT A tokenizer over a PDDL representation of this.  It
+ *   is advanced beyond this.
+ *  \return A pointer to a new HtnSolution.  The caller is responsible for
+ *   deallocating it.
+ */
+HtnSolution * HtnSolution::FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+				     PddlTokenizer & p_Tokens )
+{
+  HtnProblem * l_pProb = HtnProblem::FromPddl( p_pDomain, p_Tokens );
+  HtnSolution * l_pRet = HtnSolution::FromProblem( l_pProb );
+  delete l_pProb;
+  return l_pRet;
+}
+
 /**
  *  Retrieve a pointer to a new HtnSolution from the HtnProblem that it
  *   solves.
@@ -329,12 +403,15 @@ DecompPart * FindEquiv( const DecompPart * p_pToFind,
 
 /**
  *  Construct an HtnSolution as a copy of an existing one.
+ *  The copy does not record undo information, and cannot undo anything that
+ *   was done to the original.
  *  \param p_Other IN The HtnSolution to copy.
  */
 HtnSolution::HtnSolution( const HtnSolution & p_Other )
   : HtnProblem( p_Other ),
     m_pInitState( new State( *p_Other.m_pInitState ) )
 {
+  m_bRecordUndo = false;
   m_iNumDecomps = p_Other.m_iNumDecomps;
   for( unsigned int i = 0; i < p_Other.m_vOperIndices.size(); i++ )
     m_vOperIndices.push_back( p_Other.m_vOperIndices[i] );
@@ -373,6 +450,8 @@ HtnSolution::~HtnSolution()
     delete m_vOperSubs[i];
   for( unsigned int i = 0; i < m_vDecompTree.size(); i++ )
     delete m_vDecompTree[i];
+  for( unsigned int i = 0; i < m_vUndoLog.size(); i++ )
+    delete m_vUndoLog[i].m_pOldState;
   delete m_pInitState;
 }
 
@@ -415,7 +494,17 @@ void HtnSolution::ApplyOperator( unsigned int p_iOperIndexInDomain,
 
   State * l_pOldState = m_pState;
   m_pState = l_pOldState->NextState( m_pDomain->GetCOperator( p_iOperIndexInDomain ), p_pNewSub );
-  delete l_pOldState;
+  if( m_bRecordUndo )
+  {
+    UndoRecord l_Undo;
+    l_Undo.m_pOldState = l_pOldState;
+    l_Undo.m_pTask = m_vOutstandingTasks.back();
+    l_Undo.m_pParent = m_vParents.back();
+    l_Undo.m_iNumSubtasks = 0;
+    m_vUndoLog.push_back( l_Undo );
+  }
+  else
+    delete l_pOldState;
   m_vOperIndices.push_back( p_iOperIndexInDomain );
   m_vOperSubs.push_back( new Substitution( *p_pNewSub ) );
 
@@ -479,6 +568,16 @@ void HtnSolution::ApplyMethod( unsigned int p_iMethodIndexInDomain,
   else
     m_vParents.back()->AddChild( l_pNewPart );
 
+  if( m_bRecordUndo )
+  {
+    UndoRecord l_Undo;
+    l_Undo.m_pOldState = NULL;
+    l_Undo.m_pTask = m_vOutstandingTasks.back();
+    l_Undo.m_pParent = m_vParents.back();
+    l_Undo.m_iNumSubtasks = l_pMethod->GetNumSubtasks();
+    m_vUndoLog.push_back( l_Undo );
+  }
+
   m_vOutstandingTasks.pop_back();
   m_vParents.pop_back();
 
@@ -499,6 +598,75 @@ void HtnSolution::ApplyMethod( unsigned int p_iMethodIndexInDomain,
   }
 }
 
+/**
+ *  Begin recording the information needed to reverse each subsequent call to
+ *   ApplyMethod or ApplyOperator.
+ */
+void HtnSolution::EnableUndo()
+{
+  m_bRecordUndo = true;
+}
+
+/**
+ *  Retrieve a mark representing the current point in the undo log, to be
+ *   passed later to UndoTo.
+ *  \return A mark representing the current point in the undo log.
+ */
+unsigned int HtnSolution::GetUndoMark() const
+{
+  return m_vUndoLog.size();
+}
+
+/**
+ *  Reverse every method and operator application since a mark was taken, 
+ *   restoring this HtnSolution to exactly the way it was at that time.
+ *  \param p_iMark IN A mark previously returned by GetUndoMark, which must
+ *   not have already been undone.
+ */
+void HtnSolution::UndoTo( unsigned int p_iMark )
+{
+  if( p_iMark > m_vUndoLog.size() )
+    throw Exception( E_INDEX_OUT_OF_BOUNDS,
+		     "Attempt to undo to a mark that has already been undone.",
+		     __FILE__,
+		     __LINE__ );
+
+  while( m_vUndoLog.size() > p_iMark )
+  {
+    const UndoRecord & l_Undo = m_vUndoLog.back();
+
+    if( l_Undo.m_pOldState != NULL )
+    {
+      delete m_pState;
+      m_pState = l_Undo.m_pOldState;
+      m_vOperIndices.pop_back();
+      delete m_vOperSubs.back();
+      m_vOperSubs.pop_back();
+    }
+    else
+    {
+      for( unsigned int i = 0; i < l_Undo.m_iNumSubtasks; i++ )
+      {
+	m_vOutstandingTasks.pop_back();
+	m_vParents.pop_back();
+      }
+      m_iNumDecomps--;
+    }
+
+    if( l_Undo.m_pParent == NULL )
+    {
+      delete m_vDecompTree.back();
+      m_vDecompTree.pop_back();
+    }
+    else
+      l_Undo.m_pParent->RemoveLastChild();
+
+    m_vOutstandingTasks.push_back( l_Undo.m_pTask );
+    m_vParents.push_back( l_Undo.m_pParent );
+    m_vUndoLog.pop_back();
+  }
+}
+
 /**
  *  Retrieve the length of the plan thus far.
  *  \return The number of leaves in the current decomposition tree.
@@ -12,6 +12,7 @@ public:
   virtual ~DecompPart();
 
   void AddChild( DecompPart * p_pNew );
+  void RemoveLastChild();
 
   std::string Print( const std::string & p_sIndent ) const;
 
@@ -28,6 +29,14 @@ private:
   std::vector< DecompPart * > m_vChildren;
 };
 
+struct UndoRecord
+{
+  State * m_pOldState;
+  HtnTaskHeadP m_pTask;
+  DecompPart * m_pParent;
+  unsigned int m_iNumSubtasks;
+};
+
 class HtnSolution : public HtnProblem
 {
 public:
@@ -35,6 +44,8 @@ public:
 				 std::stringstream & p_sInput );
   static HtnSolution * FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
 				 std::stringstream & p_sINput );
+  static HtnSolution * FromPddl( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+				 PddlTokenizer & p_Tokens );
 
   static HtnSolution * FromProblem( const HtnProblem * p_pProblem );
 
@@ -54,6 +65,10 @@ public:
 
   bool IsComplete() const;
 
+  void EnableUndo();
+  unsigned int GetUndoMark() const;
+  void UndoTo( unsigned int p_iMark );
+
   std::string Print( bool p_bIncludeTrace ) const;
   std::string ToStr() const;
 
@@ -75,6 +90,9 @@ private:
 
   std::vector< DecompPart * > m_vDecompTree;
   std::vector< DecompPart * > m_vParents;
+
+  bool m_bRecordUndo;
+  std::vector< UndoRecord > m_vUndoLog;
 };
 
 #endif//HTN_SOLUTION_HPP__
@@ -227,6 +227,30 @@ std::tr1::shared_ptr< HtnTaskDescr > HtnTaskDescr::AfterSubstitution( const Subs
   return std::tr1::shared_ptr< HtnTaskDescr >( l_pRet );
 }
 
+/**
+ *  Retrieve a PDDL representation of this HtnTaskDescr, in the same form in
+ *   which it may be read from a list of tasks.
+ *  \return A PDDL representation of this HtnTaskDescr.
+ */
+std::string HtnTaskDescr::ToPddl() const
+{
+  std::string l_sRet = "";
+
+  l_sRet += "  ( :task " + m_pHead->GetName() + "\n";
+  l_sRet += "    :parameters\n";
+  l_sRet += "    (\n";
+  for( unsigned int i = 0; i < m_pHead->GetNumParams(); i++ )
+    l_sRet += "      " + m_pHead->GetCParam( i )->ToStr() + "\n";
+  l_sRet += "    )\n";
+  l_sRet += "    :precondition\n";
+  l_sRet += "    " + m_pPreconditions->ToStrNoTyping() + "\n";
+  l_sRet += "    :effect\n";
+  l_sRet += "    " + m_pEffects->ToStrNoTyping() + "\n";
+  l_sRet += "  )\n";
+
+  return l_sRet;
+}
+
 size_t HtnTaskDescr::GetMemSizeMin() const
 {
   size_t l_iSize = sizeof( HtnTaskDescr );
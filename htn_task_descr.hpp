@@ -23,6 +23,8 @@ public:
   std::tr1::shared_ptr< HtnTaskDescr > AfterSubstitution( const Substitution & p_Sub,
 							  unsigned int p_iRecurseLevel ) const;
 
+  std::string ToPddl() const;
+
   size_t GetMemSizeMin() const;
   size_t GetMemSizeMax() const;
 
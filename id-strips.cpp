@@ -23,8 +23,11 @@
 #include "formula_conj.hpp"
 #include "operator.hpp"
 #include "strips_domain.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_problem.hpp"
+#include "strips_grounding.hpp"
 
 void Search( std::tr1::shared_ptr< StripsProblem > p_pProblem,
 	     const State * p_pCurState,
@@ -86,12 +89,63 @@ void Search( std::tr1::shared_ptr< StripsProblem > p_pProblem,
   }
 }
 
+void GroundedSearch( const StripsGrounding & p_Grounding,
+		     std::tr1::shared_ptr< StripsProblem > p_pProblem,
+		     const AtomBits & p_vCurState,
+		     std::vector< unsigned int > & p_vActions,
+		     unsigned int p_iCurDepth,
+		     unsigned int p_iMaxDepth )
+{
+  // Nothing searches past the limit, since the caller stops one short of it.
+  assert( p_iCurDepth < p_iMaxDepth );
+
+  std::vector< unsigned int > l_vApplicable;
+  p_Grounding.GetApplicable( p_vCurState, l_vApplicable );
+  AtomBits l_vNewState;
+
+  for( unsigned int j = 0; j < l_vApplicable.size(); j++ )
+  {
+    p_Grounding.Apply( l_vApplicable[j], p_vCurState, l_vNewState );
+    p_vActions.push_back( l_vApplicable[j] );
+
+    if( p_Grounding.SatisfiesGoals( l_vNewState ) )
+    {
+      std::cout << "\nPlan found at depth " << p_iCurDepth + 1 << ".\n";
+
+      for( unsigned int k = 0; k < p_vActions.size(); k++ )
+      {
+	const Operator * l_pOp = p_pProblem->GetCDomain()->GetCOper( p_Grounding.GetOperIndex( p_vActions[k] ) );
+	std::cout << "\t( " << l_pOp->GetName() << " ";
+
+	for( unsigned int l = 0; l < l_pOp->GetNumParams(); l++ )
+	{
+	  std::cout << l_pOp->GetCParam( l )->AfterSubstitution( *p_Grounding.GetCSubstitution( p_vActions[k] ), 0 )->ToStr() << " ";
+	}
+
+	std::cout << ")\n";
+      }
+      exit( 0 );
+    }
+
+    if( p_iCurDepth < p_iMaxDepth - 1 )
+      GroundedSearch( p_Grounding,
+		      p_pProblem,
+		      l_vNewState,
+		      p_vActions,
+		      p_iCurDepth + 1,
+		      p_iMaxDepth );
+
+    p_vActions.pop_back();
+  }
+}
+
 int main( int argc, char * argv[] )
 {
-  if( argc != 3 )
+  if( argc < 3 || argc > 4 || ( argc == 4 && std::string( argv[3] ) != "-g" ) )
   {
     std::cerr << "\nUsage: \n";
-    std::cerr << "id_strips <domain-file> <problem-file>\n";
+    std::cerr << "id_strips <domain-file> <problem-file> [-g]\n";
+    std::cerr << "-g grounds the problem first and searches over bitset states\n";
     return 1;
   }
 
@@ -127,16 +181,28 @@ int main( int argc, char * argv[] )
     return 0;
   }
 
+  std::tr1::shared_ptr< StripsGrounding > l_pGrounding;
+  if( argc == 4 )
+    l_pGrounding = std::tr1::shared_ptr< StripsGrounding >( new StripsGrounding( l_pProblem ) );
+
   std::vector< unsigned int > l_vOperatorIndices;
   std::vector< Substitution * > l_vSubstitutions;
   for( unsigned int i = 1; i < 100; i++ )
   {
-    Search( l_pProblem,
-	    l_pProblem->GetCInitState(),
-	    l_vOperatorIndices,
-	    l_vSubstitutions,
-	    0,
-	    i );
+    if( l_pGrounding )
+      GroundedSearch( *l_pGrounding,
+		      l_pProblem,
+		      l_pGrounding->GetInitState(),
+		      l_vOperatorIndices,
+		      0,
+		      i );
+    else
+      Search( l_pProblem,
+	      l_pProblem->GetCInitState(),
+	      l_vOperatorIndices,
+	      l_vSubstitutions,
+	      0,
+	      i );
     std::cout << "Failed at depth " << i << "." << std::endl;
   }
   std::cout << "Gave up after trying depth 100.\n";
@@ -0,0 +1,973 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <set>
+#include <algorithm>
+#include <tr1/memory>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
+#include <pthread.h>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_variable.hpp"
+#include "term_constant.hpp"
+#include "term_table.hpp"
+#include "type_table.hpp"
+#include "substitution.hpp"
+#include "formula.hpp"
+#include "formula_pred.hpp"
+#include "formula_equ.hpp"
+#include "formula_neg.hpp"
+#include "formula_conj.hpp"
+#include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+#include "slot_substitution.hpp"
+#include "state.hpp"
+#include "instantiation_cursor.hpp"
+
+/** \file instantiation_cursor.hpp
+ *  Declaration of the InstantiationCursor class.
+ */
+
+/** \file instantiation_cursor.cpp
+ *  Definition of the InstantiationCursor class.
+ */
+
+/** \class UnifyKey
+ *  The key by which the literals of a UnifyPlan are ordered at each step.
+ *  This holds the same information that FormulaPMostSpecified would compute
+ *   from the literal after substitution.
+ */
+
+/** \var UnifyKey::m_iRank
+ *  0 for an equality, 1 for a predicate, and 2 for a negation.
+ */
+
+/** \var UnifyKey::m_iFirst
+ *  For a predicate, the number of atoms with which it might unify.
+ *  Otherwise, the number of distinct constants among its parameters.
+ */
+
+/** \var UnifyKey::m_iSecond
+ *  For anything but a predicate, the number of distinct variables among its
+ *   parameters.
+ */
+
+/** \class HashIdTuple
+ *  A functor to hash tuples of Term ids.
+ */
+
+/** \enum UnifyFrameType
+ *  The way in which a UnifyFrame extends the bindings to satisfy its first
+ *   literal.
+ */
+
+/** \var UF_PREDICATE
+ *  By unifying a predicate with each candidate atom in turn.
+ */
+
+/** \var UF_EQUALITY
+ *  By binding the variable side of an equality to the constant side.
+ */
+
+/** \var UF_NEG_CONSTANT
+ *  By binding the variable side of a negated equality to each properly typed
+ *   constant that differs from the constant side.
+ */
+
+/** \var UF_NEG_PAIRS
+ *  By binding both sides of a negated equality to each pair of properly typed
+ *   different constants.
+ */
+
+/** \class UnifyFrame
+ *  One suspended step of an InstantiationCursor.
+ *  This is what a call to one of the branches of State::GetInstantiations()
+ *   would hold in its local variables, so that the search can return a
+ *   result from deep inside and later resume where it left off.
+ */
+
+/** \var UnifyFrame::m_iType
+ *  How this step extends the bindings.
+ */
+
+/** \var UnifyFrame::m_vLiterals
+ *  The indices of the literals still to be satisfied, most specified first.
+ *  The first is the one this step satisfies.
+ */
+
+/** \var UnifyFrame::m_iCheckpoint
+ *  The checkpoint of the bindings when this step began.
+ */
+
+/** \var UnifyFrame::m_iNumResults
+ *  The number of results yielded when this step began.
+ */
+
+/** \var UnifyFrame::m_bStarted
+ *  Whether or not this step has tried any alternative yet.
+ */
+
+/** \var UnifyFrame::m_pRow
+ *  For a predicate, the row of the State holding the candidate atoms.
+ */
+
+/** \var UnifyFrame::m_pList
+ *  For a predicate, the indices of the candidates in m_pRow, or NULL if
+ *   every atom in the row is a candidate.
+ */
+
+/** \var UnifyFrame::m_iNumCandidates
+ *  For a predicate, the number of candidate atoms.
+ */
+
+/** \var UnifyFrame::m_iFirst
+ *  The next candidate atom or constant to try.
+ */
+
+/** \var UnifyFrame::m_iSecond
+ *  For a pair of constants, the next second constant to try.
+ */
+
+/** \var UnifyFrame::m_iFirstSlot
+ *  For anything but a predicate, the slot of the variable to bind.
+ */
+
+/** \var UnifyFrame::m_iSecondSlot
+ *  For a pair of constants, the slot of the second variable to bind.
+ */
+
+/** \var UnifyFrame::m_iId
+ *  For an equality or a negated equality with a constant side, the id of the
+ *   constant.
+ */
+
+/** \var UnifyFrame::m_pFirstVar
+ *  For a negated equality, the variable bound by m_iFirstSlot.
+ */
+
+/** \var UnifyFrame::m_pSecondVar
+ *  For a pair of constants, the variable bound by m_iSecondSlot.
+ */
+
+/** \var UnifyFrame::m_vConstants
+ *  For a negated equality, the constants of the State.
+ */
+
+/** \class InstantiationCursor
+ *  A pull-based enumeration of the Substitutions that make a UnifyPlan hold
+ *   in a State.
+ *  Each call to Next() yields the next Substitution in exactly the order that
+ *   State::GetInstantiations() would list them, but only does as much of the
+ *   search as is needed to find it.  A caller that is satisfied by an early
+ *   result never pays for the rest.
+ *  The search keeps its bindings in a SlotSubstitution and its suspended
+ *   steps in an explicit stack of UnifyFrames.
+ *  If the cursor is given a projection, it yields only the first Substitution
+ *   for each distinct binding of the projected variables, and skips any branch
+ *   of the search that could only repeat a binding it has already yielded.
+ *  The State, plan, partial Substitution, and set of relevant variables must
+ *   all outlive the cursor, and the State must not change.
+ */
+
+/** \var InstantiationCursor::m_pState
+ *  The State in which the plan must hold.
+ */
+
+/** \var InstantiationCursor::m_Plan
+ *  The plan being matched.
+ */
+
+/** \var InstantiationCursor::m_pSub
+ *  The partial Substitution of which to find extensions.
+ */
+
+/** \var InstantiationCursor::m_vRelVars
+ *  The variables for which every possible replacement is wanted.
+ */
+
+/** \var InstantiationCursor::m_Slots
+ *  The current bindings of the variables of the plan.
+ */
+
+/** \var InstantiationCursor::m_vKeys
+ *  Space for the key of each literal at the current step.
+ */
+
+/** \var InstantiationCursor::m_vRoot
+ *  The indices of every literal of the plan, in order.
+ */
+
+/** \var InstantiationCursor::m_vFrames
+ *  The suspended steps of the search, innermost last.
+ */
+
+/** \var InstantiationCursor::m_iNumFound
+ *  The number of Substitutions found so far, including those that were not
+ *   yielded because they repeated the binding of the projected variables.
+ */
+
+/** \var InstantiationCursor::m_iNumYielded
+ *  The number of Substitutions yielded so far.
+ */
+
+/** \var InstantiationCursor::m_bStarted
+ *  Whether or not Next() has been called yet.
+ */
+
+/** \var InstantiationCursor::m_pFallBack
+ *  If the plan could not be used, the Substitutions found from the
+ *   uncompiled preconditions instead.  Otherwise NULL.
+ */
+
+/** \var InstantiationCursor::m_iNextFallBack
+ *  The index in m_pFallBack of the next Substitution to yield.
+ */
+
+/** \var InstantiationCursor::m_bProject
+ *  Whether or not only one Substitution is yielded for each binding of the
+ *   projected variables.
+ */
+
+/** \var InstantiationCursor::m_bPrune
+ *  Whether or not a branch of the search may be skipped once every projected
+ *   variable is bound to a tuple already yielded.
+ *  This is only safe when every projected variable that the search must bind
+ *   is also a relevant variable, because otherwise the early break after a
+ *   skipped branch could differ from the one after a searched branch.
+ */
+
+/** \var InstantiationCursor::m_vProjectVars
+ *  The projected variables.
+ */
+
+/** \var InstantiationCursor::m_vProjectSlots
+ *  For each projected variable, its slot in the plan, or TERM_NO_ID if it
+ *   has none.
+ */
+
+/** \var InstantiationCursor::m_vProjectIds
+ *  For each projected variable without a slot, the id of the Term to which
+ *   the partial Substitution binds it, or TERM_NO_ID if it is unbound.
+ */
+
+/** \var InstantiationCursor::m_vKey
+ *  Space for the binding of the projected variables.
+ */
+
+/** \var InstantiationCursor::m_sSeen
+ *  Every binding of the projected variables yielded so far.
+ */
+
+extern TermTable g_TermTable;
+
+/**
+ *  A functor to order the literals of a UnifyPlan from most specified to
+ *   least, by their UnifyKeys.
+ *  Because it answers every comparison exactly as FormulaPMostSpecified would
+ *   for the same literals, std::sort() puts them in the same order.
+ */
+struct UnifyKeyLess
+{
+  /**
+   *  Construct a functor that orders literals by their keys.
+   *  \param p_vKeys IN The key of each literal, indexed by literal.
+   */
+  UnifyKeyLess( const std::vector< UnifyKey > & p_vKeys )
+    : m_vKeys( p_vKeys )
+  {
+  }
+
+  /**
+   *  Determine if the first literal is more specified than the second.
+   *  \param p_iFirst IN The index of the first literal.
+   *  \param p_iSecond IN The index of the second literal.
+   *  \return Whether or not the first literal is more specified.
+   */
+  bool operator()( unsigned int p_iFirst,
+		   unsigned int p_iSecond ) const
+  {
+    const UnifyKey & l_Key1 = m_vKeys[p_iFirst];
+    const UnifyKey & l_Key2 = m_vKeys[p_iSecond];
+    if( l_Key1.m_iRank != l_Key2.m_iRank )
+      return l_Key1.m_iRank < l_Key2.m_iRank;
+    if( l_Key1.m_iRank == 1 )
+      return l_Key1.m_iFirst < l_Key2.m_iFirst;
+    if( l_Key1.m_iFirst != l_Key2.m_iFirst )
+      return l_Key1.m_iFirst > l_Key2.m_iFirst;
+    return l_Key1.m_iSecond < l_Key2.m_iSecond;
+  }
+
+  /**
+   *  The key of each literal.
+   */
+  const std::vector< UnifyKey > & m_vKeys;
+};
+
+/**
+ *  Construct a cursor over the Substitutions that make a plan hold in a
+ *   State.
+ *  No searching is done until the first call to Next().  If the plan could
+ *   not be compiled, or the partial Substitution binds one of its variables
+ *   to anything but a constant, the uncompiled preconditions are matched
+ *   instead, all at once.
+ *  \param p_pState IN The State in which the plan must hold.
+ *  \param p_Plan IN The compiled preconditions.
+ *  \param p_pSub IN The partial Substitution of which to find extensions.
+ *  \param p_vRelVars IN A list of those variables for which we actually want
+ *   all possible replacements.
+ */
+InstantiationCursor::InstantiationCursor( const State * p_pState,
+					  const UnifyPlan & p_Plan,
+					  const Substitution * p_pSub,
+					  const std::set< TermVariableP > & p_vRelVars )
+  : m_pState( p_pState ),
+    m_Plan( p_Plan ),
+    m_pSub( p_pSub ),
+    m_vRelVars( p_vRelVars ),
+    m_Slots( p_Plan.GetCVars() ),
+    m_vKeys( p_Plan.GetNumLiterals() ),
+    m_iNumFound( 0 ),
+    m_iNumYielded( 0 ),
+    m_bStarted( false ),
+    m_pFallBack( NULL ),
+    m_iNextFallBack( 0 ),
+    m_bProject( false ),
+    m_bPrune( false )
+{
+  if( !p_Plan.IsCompiled() || !m_Slots.Load( *p_pSub ) )
+  {
+    FallBack();
+    return;
+  }
+  m_Slots.Watch( p_vRelVars );
+
+  for( unsigned int i = 0; i < p_Plan.GetNumLiterals(); i++ )
+    m_vRoot.push_back( i );
+  // Each step makes at least one more literal ground.
+  m_vFrames.reserve( p_Plan.GetNumLiterals() );
+}
+
+/**
+ *  Destruct an InstantiationCursor, along with any Substitutions that were
+ *   found but not yet yielded.
+ */
+InstantiationCursor::~InstantiationCursor()
+{
+  if( m_pFallBack != NULL )
+  {
+    for( unsigned int i = m_iNextFallBack; i < m_pFallBack->size(); i++ )
+      delete m_pFallBack->at( i );
+    delete m_pFallBack;
+  }
+}
+
+/**
+ *  Yield only the first Substitution for each distinct binding of some
+ *   variables.
+ *  This must be called before the first call to Next().
+ *  \param p_vVars IN The variables onto which to project.  Normally these are
+ *   HtnMethod::GetRelevantVariables().
+ */
+void InstantiationCursor::Project( const std::vector< TermVariableP > & p_vVars )
+{
+  if( m_bStarted )
+    throw Exception( E_NOT_IMPLEMENTED,
+		     "A cursor cannot be projected once it has started.",
+		     __FILE__,
+		     __LINE__ );
+
+  m_bProject = true;
+  m_bPrune = ( m_pFallBack == NULL );
+  m_vProjectVars = p_vVars;
+  m_vProjectSlots.assign( p_vVars.size(), TERM_NO_ID );
+  m_vProjectIds.assign( p_vVars.size(), TERM_NO_ID );
+  m_vKey.resize( p_vVars.size() );
+  for( unsigned int i = 0; i < p_vVars.size(); i++ )
+  {
+    for( unsigned int j = 0; j < m_Plan.GetNumVars() && m_pFallBack == NULL; j++ )
+    {
+      if( m_Plan.GetCVar( j ) == p_vVars[i] )
+	m_vProjectSlots[i] = j;
+    }
+    if( m_vProjectSlots[i] == TERM_NO_ID )
+    {
+      SubMap::const_iterator l_iIter = m_pSub->FindIndexByVar( p_vVars[i] );
+      if( l_iIter != m_pSub->End() )
+	m_vProjectIds[i] = l_iIter->second->GetId();
+    }
+    else if( m_Slots.GetId( m_vProjectSlots[i] ) == TERM_NO_ID &&
+	     m_vRelVars.find( p_vVars[i] ) == m_vRelVars.end() )
+      m_bPrune = false;
+  }
+}
+
+/**
+ *  Retrieve the next Substitution that makes the plan hold in the State.
+ *  \return A new Substitution that extends the partial one, which the caller
+ *   must deallocate, or NULL if there are no more.
+ */
+Substitution * InstantiationCursor::Next()
+{
+  bool l_bEnter = !m_bStarted;
+  m_bStarted = true;
+
+  while( m_pFallBack == NULL )
+  {
+    if( l_bEnter )
+    {
+      l_bEnter = false;
+      // Below here, every result would repeat a binding already yielded.
+      if( m_bPrune && MakeKey() && m_sSeen.count( m_vKey ) > 0 )
+	continue;
+      if( EnterLevel( m_vFrames.empty() ? m_vRoot : m_vFrames.back().m_vLiterals ) )
+      {
+	m_iNumFound++;
+	if( m_bProject )
+	{
+	  MakeKey();
+	  if( !m_sSeen.insert( m_vKey ).second )
+	    continue;
+	}
+	m_iNumYielded++;
+	return m_Slots.ToSubstitution( *m_pSub );
+      }
+      continue;
+    }
+
+    if( m_vFrames.empty() )
+      return NULL;
+
+    if( Step( m_vFrames.back() ) )
+      l_bEnter = true;
+    else
+    {
+      m_Slots.Rollback( m_vFrames.back().m_iCheckpoint );
+      m_vFrames.pop_back();
+    }
+  }
+
+  while( m_iNextFallBack < m_pFallBack->size() )
+  {
+    Substitution * l_pSub = m_pFallBack->at( m_iNextFallBack++ );
+    if( m_bProject )
+    {
+      MakeKey( *l_pSub );
+      if( !m_sSeen.insert( m_vKey ).second )
+      {
+	delete l_pSub;
+	continue;
+      }
+    }
+    m_iNumYielded++;
+    return l_pSub;
+  }
+  return NULL;
+}
+
+/**
+ *  Retrieve the number of Substitutions yielded so far.
+ *  \return The number of Substitutions yielded so far.
+ */
+unsigned int InstantiationCursor::GetNumYielded() const
+{
+  return m_iNumYielded;
+}
+
+/**
+ *  Retrieve the id of the constant that is a parameter of a literal under
+ *   the current bindings.
+ *  \param p_Literal IN The literal.
+ *  \param p_iIndex IN The position of the parameter.
+ *  \return The id of the constant, or TERM_NO_ID if it is an unbound
+ *   variable.
+ */
+unsigned int InstantiationCursor::GetArg( const UnifyLiteral & p_Literal,
+					  unsigned int p_iIndex ) const
+{
+  if( !p_Literal.m_aIsVar[p_iIndex] )
+    return p_Literal.m_aArgs[p_iIndex];
+  return m_Slots.GetId( p_Literal.m_aArgs[p_iIndex] );
+}
+
+/**
+ *  Retrieve the Term that is a parameter of a literal under the current
+ *   bindings.
+ *  \param p_Literal IN The literal.
+ *  \param p_iIndex IN The position of the parameter.
+ *  \return A pointer to the constant, or to the variable if it is unbound.
+ */
+const Term * InstantiationCursor::GetTerm( const UnifyLiteral & p_Literal,
+					   unsigned int p_iIndex ) const
+{
+  unsigned int l_iId = GetArg( p_Literal, p_iIndex );
+  if( l_iId == TERM_NO_ID )
+    return m_Plan.GetCVar( p_Literal.m_aArgs[p_iIndex] ).get();
+  return g_TermTable.LookupId( l_iId ).get();
+}
+
+/**
+ *  Determine whether or not every parameter of a literal is bound.
+ *  \param p_Literal IN The literal.
+ *  \return Whether or not the literal is ground under the current bindings.
+ */
+bool InstantiationCursor::IsGround( const UnifyLiteral & p_Literal ) const
+{
+  for( unsigned int i = 0; i < p_Literal.m_iValence; i++ )
+  {
+    if( GetArg( p_Literal, i ) == TERM_NO_ID )
+      return false;
+  }
+  return true;
+}
+
+/**
+ *  Determine whether or not a step has found enough, because it has found
+ *   something and every variable for which all replacements are wanted is
+ *   bound.
+ *  \param p_Frame IN The step.
+ *  \return Whether or not the step should try no more alternatives.
+ */
+bool InstantiationCursor::IsDone( const UnifyFrame & p_Frame ) const
+{
+  return m_iNumFound > p_Frame.m_iNumResults && m_Slots.GetNumUnboundWatched() == 0;
+}
+
+/**
+ *  Determine whether or not a ground literal holds in the State.
+ *  \param p_Literal IN The literal, which is ground under the current
+ *   bindings.
+ *  \return Whether or not the literal holds in the State.
+ */
+bool InstantiationCursor::Holds( const UnifyLiteral & p_Literal ) const
+{
+  FormulaType l_iType = p_Literal.m_iType == FT_NEG ? p_Literal.m_iNegType : p_Literal.m_iType;
+  bool l_bHolds;
+  if( l_iType == FT_EQU )
+    l_bHolds = ( GetArg( p_Literal, 0 ) == GetArg( p_Literal, 1 ) );
+  else
+  {
+    unsigned int l_aArgs[GROUND_ATOM_MAX_ARGS];
+    for( unsigned int i = 0; i < p_Literal.m_iValence; i++ )
+      l_aArgs[i] = GetArg( p_Literal, i );
+    GroundAtom l_Atom( p_Literal.m_iRelation, p_Literal.m_iValence, l_aArgs );
+    const AtomRow * l_pRow = m_pState->FindRow( l_Atom.GetRelationIndex() );
+    l_bHolds = ( l_pRow != NULL && l_pRow->Find( l_Atom ) >= 0 );
+  }
+  return p_Literal.m_iType == FT_NEG ? !l_bHolds : l_bHolds;
+}
+
+/**
+ *  Count the atoms in the State that agree with a predicate literal on all of
+ *   its bound parameters.
+ *  \param p_Literal IN The predicate literal.
+ *  \return The number of atoms with which the literal might unify.
+ */
+unsigned int InstantiationCursor::Count( const UnifyLiteral & p_Literal ) const
+{
+  unsigned int l_aArgs[GROUND_ATOM_MAX_ARGS];
+  for( unsigned int i = 0; i < p_Literal.m_iValence; i++ )
+    l_aArgs[i] = GetArg( p_Literal, i );
+
+  const std::vector< unsigned int > * l_pList;
+  const AtomRow * l_pRow = m_pState->FindCandidates( p_Literal.m_iRelation, p_Literal.m_iValence, l_aArgs, l_pList );
+  if( l_pRow == NULL )
+    return 0;
+
+  unsigned int l_iNumInstances = 0;
+  unsigned int l_iNumCandidates = l_pList == NULL ? l_pRow->m_vAtoms.size() : l_pList->size();
+  for( unsigned int j = 0; j < l_iNumCandidates; j++ )
+  {
+    const GroundAtom & l_Atom = l_pRow->m_vAtoms[l_pList == NULL ? j : (*l_pList)[j]];
+    bool l_bReject = false;
+    for( unsigned int k = 0; k < p_Literal.m_iValence && !l_bReject; k++ )
+    {
+      if( l_aArgs[k] != TERM_NO_ID && l_aArgs[k] != l_Atom.GetArgId( k ) )
+	l_bReject = true;
+    }
+    if( !l_bReject )
+      l_iNumInstances++;
+  }
+  return l_iNumInstances;
+}
+
+/**
+ *  Begin a step of the search under the current bindings.
+ *  This follows the uncompiled State::GetInstantiations() exactly: the ground
+ *   literals are checked and dropped, the rest are ordered from most
+ *   specified to least, and a new UnifyFrame is pushed to satisfy the first.
+ *  \param p_vLiterals IN The indices of the literals still to be satisfied,
+ *   in their order from the previous step.
+ *  \return Whether or not every literal is ground and holds, so that the
+ *   current bindings are a result.
+ */
+bool InstantiationCursor::EnterLevel( const std::vector< unsigned int > & p_vLiterals )
+{
+  std::vector< unsigned int > l_vNew;
+  for( unsigned int i = 0; i < p_vLiterals.size(); i++ )
+  {
+    const UnifyLiteral & l_Literal = m_Plan.GetCLiteral( p_vLiterals[i] );
+    if( IsGround( l_Literal ) )
+    {
+      if( !Holds( l_Literal ) )
+	return false;
+    }
+    else
+      l_vNew.push_back( p_vLiterals[i] );
+  }
+
+  if( l_vNew.size() == 0 )
+    return true;
+
+  for( unsigned int i = 0; i < l_vNew.size(); i++ )
+  {
+    const UnifyLiteral & l_Literal = m_Plan.GetCLiteral( l_vNew[i] );
+    UnifyKey & l_Key = m_vKeys[l_vNew[i]];
+    l_Key.m_iRank = l_Literal.m_iType == FT_EQU ? 0 : ( l_Literal.m_iType == FT_PRED ? 1 : 2 );
+    l_Key.m_iFirst = 0;
+    l_Key.m_iSecond = 0;
+    if( l_Literal.m_iType == FT_PRED )
+    {
+      l_Key.m_iFirst = Count( l_Literal );
+      continue;
+    }
+    for( unsigned int j = 0; j < l_Literal.m_iValence; j++ )
+    {
+      bool l_bRepeat = false;
+      for( unsigned int k = 0; k < j && !l_bRepeat; k++ )
+	l_bRepeat = ( GetTerm( l_Literal, k ) == GetTerm( l_Literal, j ) );
+      if( l_bRepeat )
+	continue;
+      if( GetArg( l_Literal, j ) == TERM_NO_ID )
+	l_Key.m_iSecond++;
+      else
+	l_Key.m_iFirst++;
+    }
+  }
+
+  std::sort( l_vNew.begin(), l_vNew.end(), UnifyKeyLess( m_vKeys ) );
+
+  const UnifyLiteral & l_Literal = m_Plan.GetCLiteral( l_vNew[0] );
+  UnifyFrame l_Frame;
+  l_Frame.m_iCheckpoint = m_Slots.Checkpoint();
+  l_Frame.m_iNumResults = m_iNumFound;
+  l_Frame.m_bStarted = false;
+  l_Frame.m_iFirst = 0;
+  l_Frame.m_iSecond = 0;
+
+  if( l_Literal.m_iType == FT_PRED )
+  {
+    unsigned int l_aArgs[GROUND_ATOM_MAX_ARGS];
+    for( unsigned int i = 0; i < l_Literal.m_iValence; i++ )
+      l_aArgs[i] = GetArg( l_Literal, i );
+    l_Frame.m_iType = UF_PREDICATE;
+    l_Frame.m_pRow = m_pState->FindCandidates( l_Literal.m_iRelation, l_Literal.m_iValence, l_aArgs, l_Frame.m_pList );
+    if( l_Frame.m_pRow == NULL )
+      return false;
+    l_Frame.m_iNumCandidates = l_Frame.m_pList == NULL ? l_Frame.m_pRow->m_vAtoms.size() : l_Frame.m_pList->size();
+  }
+  else if( l_Literal.m_iType == FT_EQU )
+  {
+    const Term * l_pFirst = GetTerm( l_Literal, 0 );
+    const Term * l_pSecond = GetTerm( l_Literal, 1 );
+    l_Frame.m_iType = UF_EQUALITY;
+    if( l_pFirst->HasTyping() && CompareNoCase( l_pFirst->GetTyping(), l_pSecond->GetTyping() ) != 0 )
+      return false;
+    else if( l_pFirst->GetType() == TT_CONSTANT )
+    {
+      l_Frame.m_iFirstSlot = l_Literal.m_aArgs[1];
+      l_Frame.m_iId = l_pFirst->GetId();
+    }
+    else if( l_pSecond->GetType() == TT_CONSTANT )
+    {
+      l_Frame.m_iFirstSlot = l_Literal.m_aArgs[0];
+      l_Frame.m_iId = l_pSecond->GetId();
+    }
+    else
+    {
+      // Binding a variable to a variable cannot be represented in the slots.
+      FallBack();
+      return false;
+    }
+  }
+  else
+  {
+    if( l_Literal.m_iNegType != FT_EQU )
+    {
+      throw Exception( E_NOT_IMPLEMENTED,
+		       "For performance reasons, only equality formulas may be negated in preconditions.",
+		       __FILE__,
+		       __LINE__ );
+    }
+
+    const Term * l_pFirst = GetTerm( l_Literal, 0 );
+    const Term * l_pSecond = GetTerm( l_Literal, 1 );
+    if( l_pFirst->GetType() == TT_CONSTANT || l_pSecond->GetType() == TT_CONSTANT )
+    {
+      bool l_bFirstConst = l_pFirst->GetType() == TT_CONSTANT;
+      l_Frame.m_iType = UF_NEG_CONSTANT;
+      l_Frame.m_iFirstSlot = l_Literal.m_aArgs[l_bFirstConst ? 1 : 0];
+      l_Frame.m_iId = l_bFirstConst ? l_pFirst->GetId() : l_pSecond->GetId();
+      l_Frame.m_pFirstVar = l_bFirstConst ? l_pSecond : l_pFirst;
+    }
+    else if( l_pFirst == l_pSecond )
+      return false;
+    else
+    {
+      l_Frame.m_iType = UF_NEG_PAIRS;
+      l_Frame.m_iFirstSlot = l_Literal.m_aArgs[0];
+      l_Frame.m_iSecondSlot = l_Literal.m_aArgs[1];
+      l_Frame.m_pFirstVar = l_pFirst;
+      l_Frame.m_pSecondVar = l_pSecond;
+    }
+    l_Frame.m_vConstants = m_pState->GetConstants();
+  }
+
+  m_vFrames.push_back( UnifyFrame() );
+  std::swap( m_vFrames.back(), l_Frame );
+  m_vFrames.back().m_vLiterals.swap( l_vNew );
+  return false;
+}
+
+/**
+ *  Try the next alternative of a step, undoing the previous one.
+ *  \param p_Frame INOUT The step.
+ *  \return Whether or not there was another alternative, which is now bound.
+ */
+bool InstantiationCursor::Step( UnifyFrame & p_Frame )
+{
+  m_Slots.Rollback( p_Frame.m_iCheckpoint );
+  switch( p_Frame.m_iType )
+  {
+  case UF_PREDICATE:
+    return StepPredicate( p_Frame );
+  case UF_EQUALITY:
+    if( p_Frame.m_bStarted )
+      return false;
+    p_Frame.m_bStarted = true;
+    m_Slots.Bind( p_Frame.m_iFirstSlot, p_Frame.m_iId );
+    return true;
+  case UF_NEG_CONSTANT:
+    return StepNegConstant( p_Frame );
+  case UF_NEG_PAIRS:
+    return StepNegPairs( p_Frame );
+  }
+  return false;
+}
+
+/**
+ *  Try to unify a predicate with the next candidate atom.
+ *  \param p_Frame INOUT The step.
+ *  \return Whether or not a candidate unified.
+ */
+bool InstantiationCursor::StepPredicate( UnifyFrame & p_Frame )
+{
+  if( p_Frame.m_bStarted && IsDone( p_Frame ) )
+    return false;
+  p_Frame.m_bStarted = true;
+
+  const UnifyLiteral & l_Literal = m_Plan.GetCLiteral( p_Frame.m_vLiterals[0] );
+  while( p_Frame.m_iFirst < p_Frame.m_iNumCandidates )
+  {
+    const GroundAtom & l_Atom = p_Frame.m_pRow->m_vAtoms[p_Frame.m_pList == NULL ? p_Frame.m_iFirst : (*p_Frame.m_pList)[p_Frame.m_iFirst]];
+    p_Frame.m_iFirst++;
+
+    bool l_bBad = false;
+    for( unsigned int l_iParam = 0; l_iParam < l_Atom.GetValence() && !l_bBad; l_iParam++ )
+    {
+      unsigned int l_iAtomParam = l_Atom.GetArgId( l_iParam );
+      unsigned int l_iConjParam = GetArg( l_Literal, l_iParam );
+      if( l_iConjParam != TERM_NO_ID )
+      {
+	if( l_iConjParam != l_iAtomParam )
+	  l_bBad = true;
+      }
+      else
+      {
+	const TermP & l_pVar = m_Plan.GetCVar( l_Literal.m_aArgs[l_iParam] );
+	const TermP & l_pAtomParam = l_Atom.GetCParam( l_iParam );
+	if( ( l_pVar->HasTyping() && !l_pAtomParam->HasTyping() )
+	    || ( !l_pVar->HasTyping() && l_pAtomParam->HasTyping() ) )
+	  throw Exception( E_NOT_IMPLEMENTED,
+			   "Either all terms must be typed, or none.",
+			   __FILE__,
+			   __LINE__ );
+	if( l_pVar->HasTyping() && CompareNoCase( l_pVar->GetTyping(), l_pAtomParam->GetTyping() ) != 0 )
+	  l_bBad = true;
+	else
+	  m_Slots.Bind( l_Literal.m_aArgs[l_iParam], l_iAtomParam );
+      }
+    }
+
+    if( !l_bBad )
+      return true;
+    m_Slots.Rollback( p_Frame.m_iCheckpoint );
+    if( IsDone( p_Frame ) )
+      return false;
+  }
+  return false;
+}
+
+/**
+ *  Try to bind the variable of a negated equality to the next properly typed
+ *   constant that differs from its constant side.
+ *  \param p_Frame INOUT The step.
+ *  \return Whether or not there was such a constant.
+ */
+bool InstantiationCursor::StepNegConstant( UnifyFrame & p_Frame )
+{
+  if( p_Frame.m_bStarted && IsDone( p_Frame ) )
+    return false;
+  p_Frame.m_bStarted = true;
+
+  while( p_Frame.m_iFirst < p_Frame.m_vConstants.size() )
+  {
+    const TermConstantP & l_pConst = p_Frame.m_vConstants[p_Frame.m_iFirst++];
+    if( l_pConst->GetId() != p_Frame.m_iId &&
+	( !p_Frame.m_pFirstVar->HasTyping() ||
+	  CompareNoCase( p_Frame.m_pFirstVar->GetTyping(),
+			 l_pConst->GetTyping() ) == 0 ) )
+    {
+      m_Slots.Bind( p_Frame.m_iFirstSlot, l_pConst->GetId() );
+      return true;
+    }
+    if( IsDone( p_Frame ) )
+      return false;
+  }
+  return false;
+}
+
+/**
+ *  Try to bind both variables of a negated equality to the next pair of
+ *   properly typed different constants.
+ *  \param p_Frame INOUT The step.
+ *  \return Whether or not there was such a pair.
+ */
+bool InstantiationCursor::StepNegPairs( UnifyFrame & p_Frame )
+{
+  if( p_Frame.m_bStarted && IsDone( p_Frame ) )
+    return false;
+  p_Frame.m_bStarted = true;
+
+  const std::vector< TermConstantP > & l_vConstants = p_Frame.m_vConstants;
+  while( p_Frame.m_iFirst < l_vConstants.size() )
+  {
+    if( !p_Frame.m_pFirstVar->HasTyping() ||
+	CompareNoCase( p_Frame.m_pFirstVar->GetTyping(),
+		       l_vConstants[p_Frame.m_iFirst]->GetTyping() ) == 0 )
+    {
+      while( p_Frame.m_iSecond < l_vConstants.size() )
+      {
+	unsigned int j = p_Frame.m_iSecond++;
+	if( p_Frame.m_iFirst != j && ( !p_Frame.m_pSecondVar->HasTyping() ||
+				       CompareNoCase( p_Frame.m_pSecondVar->GetTyping(),
+						      l_vConstants[j]->GetTyping() ) == 0 ) )
+	{
+	  m_Slots.Bind( p_Frame.m_iFirstSlot, l_vConstants[p_Frame.m_iFirst]->GetId() );
+	  m_Slots.Bind( p_Frame.m_iSecondSlot, l_vConstants[j]->GetId() );
+	  return true;
+	}
+	if( IsDone( p_Frame ) )
+	  return false;
+      }
+    }
+    if( IsDone( p_Frame ) )
+      return false;
+    p_Frame.m_iFirst++;
+    p_Frame.m_iSecond = 0;
+  }
+  return false;
+}
+
+/**
+ *  Compute the binding of the projected variables under the current
+ *   bindings of the slots.
+ *  \return Whether or not every projected variable with a slot is bound.
+ */
+bool InstantiationCursor::MakeKey()
+{
+  bool l_bBound = true;
+  for( unsigned int i = 0; i < m_vKey.size(); i++ )
+  {
+    if( m_vProjectSlots[i] == TERM_NO_ID )
+      m_vKey[i] = m_vProjectIds[i];
+    else
+    {
+      m_vKey[i] = m_Slots.GetId( m_vProjectSlots[i] );
+      if( m_vKey[i] == TERM_NO_ID )
+	l_bBound = false;
+    }
+  }
+  return l_bBound;
+}
+
+/**
+ *  Compute the binding of the projected variables in a Substitution.
+ *  \param p_Sub IN The Substitution.
+ */
+void InstantiationCursor::MakeKey( const Substitution & p_Sub )
+{
+  for( unsigned int i = 0; i < m_vKey.size(); i++ )
+  {
+    SubMap::const_iterator l_iIter = p_Sub.FindIndexByVar( m_vProjectVars[i] );
+    m_vKey[i] = ( l_iIter == p_Sub.End() ) ? TERM_NO_ID : l_iIter->second->GetId();
+  }
+}
+
+/**
+ *  Abandon the plan and match the uncompiled preconditions instead.
+ *  Up to the point at which the plan failed, it found exactly what the
+ *   uncompiled match lists first, so those are skipped.  With a projection,
+ *   some of those may have been skipped without being found, so instead every
+ *   result is checked against the bindings already yielded.
+ */
+void InstantiationCursor::FallBack()
+{
+  m_pFallBack = m_pState->GetInstantiations( m_Plan.GetCPreconditions(), m_pSub, m_vRelVars );
+  m_iNextFallBack = m_iNumFound < m_pFallBack->size() ? m_iNumFound : m_pFallBack->size();
+  if( m_bProject )
+    m_iNextFallBack = 0;
+  for( unsigned int i = 0; i < m_iNextFallBack; i++ )
+    delete m_pFallBack->at( i );
+  m_vFrames.clear();
+}
+
+size_t InstantiationCursor::GetMemSizeMin() const
+{
+  size_t l_iSize = sizeof( InstantiationCursor ) + m_Slots.GetMemSizeMin() - sizeof( SlotSubstitution ) + m_vKeys.capacity() * sizeof( UnifyKey ) + m_vRoot.capacity() * sizeof( unsigned int ) + m_vFrames.capacity() * sizeof( UnifyFrame );
+  for( unsigned int i = 0; i < m_vFrames.size(); i++ )
+    l_iSize += m_vFrames[i].m_vLiterals.capacity() * sizeof( unsigned int ) + m_vFrames[i].m_vConstants.capacity() * sizeof( TermConstantP );
+  if( m_pFallBack != NULL )
+    l_iSize += m_pFallBack->capacity() * sizeof( Substitution * );
+  l_iSize += m_vProjectVars.capacity() * sizeof( TermVariableP ) + ( m_vProjectSlots.capacity() + m_vProjectIds.capacity() + m_vKey.capacity() ) * sizeof( unsigned int );
+  l_iSize += m_sSeen.bucket_count() * sizeof( void * ) + m_sSeen.size() * ( sizeof( std::vector< unsigned int > ) + sizeof( void * ) + m_vKey.size() * sizeof( unsigned int ) );
+  return l_iSize;
+}
+
+size_t InstantiationCursor::GetMemSizeMax() const
+{
+  size_t l_iSize = GetMemSizeMin();
+  if( m_pFallBack != NULL )
+  {
+    for( unsigned int i = m_iNextFallBack; i < m_pFallBack->size(); i++ )
+      l_iSize += m_pFallBack->at( i )->GetMemSizeMax();
+  }
+  return l_iSize;
+}
+
+/**
+ *  Hash a tuple of Term ids.
+ *  \param x IN The tuple to hash.
+ *  \return A hash value for x.
+ */
+size_t HashIdTuple::operator() ( const std::vector< unsigned int > & x ) const
+{
+  size_t l_iHash = 0;
+  for( unsigned int i = 0; i < x.size(); i++ )
+    l_iHash = ( l_iHash << 5 ) - l_iHash + x[i];
+  return l_iHash;
+}
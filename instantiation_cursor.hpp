@@ -0,0 +1,113 @@
+#ifndef INSTANTIATION_CURSOR_HPP__
+#define INSTANTIATION_CURSOR_HPP__
+
+#include <tr1/unordered_set>
+
+struct HashIdTuple
+{
+  size_t operator() ( const std::vector< unsigned int > & x ) const;
+};
+
+typedef std::tr1::unordered_set< std::vector< unsigned int >, HashIdTuple > IdTupleSet;
+
+struct UnifyKey
+{
+  unsigned int m_iRank;
+  unsigned int m_iFirst;
+  unsigned int m_iSecond;
+};
+
+enum UnifyFrameType
+{
+  UF_PREDICATE,
+  UF_EQUALITY,
+  UF_NEG_CONSTANT,
+  UF_NEG_PAIRS,
+};
+
+struct UnifyFrame
+{
+  UnifyFrameType m_iType;
+  std::vector< unsigned int > m_vLiterals;
+  unsigned int m_iCheckpoint;
+  unsigned int m_iNumResults;
+  bool m_bStarted;
+  const AtomRow * m_pRow;
+  const std::vector< unsigned int > * m_pList;
+  unsigned int m_iNumCandidates;
+  unsigned int m_iFirst;
+  unsigned int m_iSecond;
+  unsigned int m_iFirstSlot;
+  unsigned int m_iSecondSlot;
+  unsigned int m_iId;
+  const Term * m_pFirstVar;
+  const Term * m_pSecondVar;
+  std::vector< TermConstantP > m_vConstants;
+};
+
+class InstantiationCursor
+{
+public:
+  InstantiationCursor( const State * p_pState,
+		       const UnifyPlan & p_Plan,
+		       const Substitution * p_pSub,
+		       const std::set< TermVariableP > & p_vRelVars );
+  virtual ~InstantiationCursor();
+
+  void Project( const std::vector< TermVariableP > & p_vVars );
+
+  Substitution * Next();
+
+  unsigned int GetNumYielded() const;
+
+  size_t GetMemSizeMin() const;
+  size_t GetMemSizeMax() const;
+
+private:
+  InstantiationCursor( const InstantiationCursor & p_Other );
+  InstantiationCursor & operator=( const InstantiationCursor & p_Other );
+
+  unsigned int GetArg( const UnifyLiteral & p_Literal,
+		       unsigned int p_iIndex ) const;
+  const Term * GetTerm( const UnifyLiteral & p_Literal,
+			unsigned int p_iIndex ) const;
+  bool IsGround( const UnifyLiteral & p_Literal ) const;
+  bool IsDone( const UnifyFrame & p_Frame ) const;
+
+  bool Holds( const UnifyLiteral & p_Literal ) const;
+  unsigned int Count( const UnifyLiteral & p_Literal ) const;
+
+  bool EnterLevel( const std::vector< unsigned int > & p_vLiterals );
+  bool Step( UnifyFrame & p_Frame );
+  bool StepPredicate( UnifyFrame & p_Frame );
+  bool StepNegConstant( UnifyFrame & p_Frame );
+  bool StepNegPairs( UnifyFrame & p_Frame );
+
+  bool MakeKey();
+  void MakeKey( const Substitution & p_Sub );
+
+  void FallBack();
+
+  const State * m_pState;
+  const UnifyPlan & m_Plan;
+  const Substitution * m_pSub;
+  const std::set< TermVariableP > & m_vRelVars;
+  SlotSubstitution m_Slots;
+  std::vector< UnifyKey > m_vKeys;
+  std::vector< unsigned int > m_vRoot;
+  std::vector< UnifyFrame > m_vFrames;
+  unsigned int m_iNumFound;
+  unsigned int m_iNumYielded;
+  bool m_bStarted;
+  std::vector< Substitution * > * m_pFallBack;
+  unsigned int m_iNextFallBack;
+  bool m_bProject;
+  bool m_bPrune;
+  std::vector< TermVariableP > m_vProjectVars;
+  std::vector< unsigned int > m_vProjectSlots;
+  std::vector< unsigned int > m_vProjectIds;
+  std::vector< unsigned int > m_vKey;
+  IdTupleSet m_sSeen;
+};
+
+#endif//INSTANTIATION_CURSOR_HPP__
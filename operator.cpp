@@ -19,6 +19,9 @@
 #include "formula_pred.hpp"
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+#include "compiled_domain.hpp"
 #include "operator.hpp"
 
 /** \file operator.hpp
@@ -42,6 +45,11 @@
  *  \todo This should not really be required to be a conjunction.
  */
 
+/** \var Operator::m_pPlan
+ *  A smart pointer to the preconditions of this Operator, compiled for
+ *   matching against a State.
+ */
+
 /** \var Operator::m_pEffects
  *  A smart pointer to the effects of this Operator.
  *  \todo This should not really be required to be a conjunction.
@@ -163,6 +171,7 @@ Operator * Operator::FromPddl( std::stringstream & p_sInput,
 			 __LINE__ );
       l_bHasPreconditions = true;
       l_pRet->m_pPreconditions = FormulaConjP( new FormulaConj( p_sInput, l_TypeTable, p_vAllowablePredicates ) );
+      l_pRet->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pRet->m_pPreconditions ) );
     }
     else if( CompareNoCase( l_sFeatureName, ":effect" ) == 0 )
     {
@@ -254,6 +263,7 @@ Operator * Operator::FromShop( std::stringstream & p_sInput )
   EatWhitespace( p_sInput );
 
   l_pRet->m_pPreconditions = FormulaConjP( new FormulaConj( p_sInput, TypeTable(), std::vector< FormulaPred >() ) );
+  l_pRet->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pRet->m_pPreconditions ) );
 
   EatWhitespace( p_sInput );
 
@@ -293,6 +303,27 @@ Operator * Operator::FromShop( std::stringstream & p_sInput )
   return l_pRet;
 }
 
+/**
+ *  Get a pointer to a new Operator from its compiled representation, as
+ *   written by Operator::ToCompiled().
+ *  \param p_Reader INOUT The reader of a compiled domain, which will be
+ *   advanced beyond the Operator.
+ *  \return A pointer to a new Operator.  The caller is responsible for
+ *   deallocating it.
+ */
+Operator * Operator::FromCompiled( CompiledDomainReader & p_Reader )
+{
+  Operator * l_pRet = new Operator();
+
+  l_pRet->m_pHead = p_Reader.ReadPred();
+  l_pRet->m_iCost = (int)p_Reader.ReadWord();
+  l_pRet->m_pPreconditions = p_Reader.ReadConj();
+  l_pRet->m_pPlan = std::tr1::shared_ptr< UnifyPlan >( new UnifyPlan( l_pRet->m_pPreconditions ) );
+  l_pRet->m_pEffects = p_Reader.ReadConj();
+
+  return l_pRet;
+}
+
 /**
  *  Construct a default Operator.
  *  This exists only for convenience.
@@ -308,6 +339,7 @@ Operator::Operator()
  */
 Operator::Operator( const Operator & p_Other )
   : m_pPreconditions( p_Other.m_pPreconditions ),
+    m_pPlan( p_Other.m_pPlan ),
     m_pEffects( p_Other.m_pEffects ),
     m_pHead( p_Other.m_pHead ),
     m_iCost( p_Other.m_iCost )
@@ -339,6 +371,17 @@ FormulaConjP Operator::GetCPreconditions() const
   return m_pPreconditions;
 }
 
+/**
+ *  Retrieve the preconditions of this Operator, compiled for matching against
+ *   a State.
+ *  \return A pointer to the compiled preconditions, which has the same
+ *   lifetime as this Operator.
+ */
+const UnifyPlan * Operator::GetCPlan() const
+{
+  return m_pPlan.get();
+}
+
 /**
  *  Retrieve the number of parameters in the head of this Operator.
  *  \return The number of parameters in the head of this Operator.
@@ -492,6 +535,20 @@ std::string Operator::ToStr( bool p_bIsHtn, int p_iIndent ) const
   return l_sRet;
 }
 
+/**
+ *  Write the compiled representation of this Operator.
+ *  Its UnifyPlan is not written, since it refers to process-local indices;
+ *   Operator::FromCompiled() builds it again.
+ *  \param p_Writer INOUT The writer of a compiled domain.
+ */
+void Operator::ToCompiled( CompiledDomainWriter & p_Writer ) const
+{
+  p_Writer.WritePred( *m_pHead );
+  p_Writer.WriteWord( (uint32_t)m_iCost );
+  p_Writer.WriteFormula( m_pPreconditions );
+  p_Writer.WriteFormula( m_pEffects );
+}
+
 /**
  *  Determine whether or not this is equivalent to another Operator, meaning 
  *   that one can be converted to the other by a Substitution.
@@ -1,6 +1,10 @@
 #ifndef OPERATOR_HPP__
 #define OPERATOR_HPP__
 
+class UnifyPlan;
+class CompiledDomainReader;
+class CompiledDomainWriter;
+
 class Operator
 {
 public:
@@ -8,6 +12,7 @@ public:
 			      const std::set< std::string, StrLessNoCase > & p_sTypes, 
 			      const std::vector< FormulaPred > & p_vAllowablePredicates );
   static Operator * FromShop( std::stringstream & p_sInput );
+  static Operator * FromCompiled( CompiledDomainReader & p_Reader );
 
   Operator( const Operator & p_Other );
 
@@ -17,6 +22,8 @@ public:
 
   FormulaConjP GetCPreconditions() const;
 
+  const UnifyPlan * GetCPlan() const;
+
   unsigned int GetNumParams() const;
 
   TermP GetCParam( unsigned int p_iIndex ) const;
@@ -25,6 +32,8 @@ public:
 
   std::string ToStr( bool p_bIsHtn = false, int p_iIndent = 0 ) const;
 
+  void ToCompiled( CompiledDomainWriter & p_Writer ) const;
+
   bool Equivalent( const Operator * p_pOther ) const;
 
   FormulaPredP GetCHead() const;
@@ -38,6 +47,7 @@ private:
   Operator();
 
   FormulaConjP m_pPreconditions;
+  std::tr1::shared_ptr< UnifyPlan > m_pPlan;
   FormulaConjP m_pEffects;
   FormulaPredP m_pHead;
 
@@ -20,6 +20,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "htn_task_head.hpp"
 #include "htn_task_descr.hpp"
@@ -62,6 +64,7 @@
 
 /** \var PartialHtnMethod::m_pDomain
  *  A smart pointer to the domain from which subtasks of this method may come.
+ *  It is only read, so many partial methods may share it.
  */
 
 /** \var PartialHtnMethod::m_pTaskDescr
@@ -156,7 +159,8 @@ extern TermTable g_TermTable;
 /**
  *  Create a PartialHtnMethod with no subtasks.
  *  \param p_pDomain IN A smart pointer to the domain from which subtasks will
- *   come.
+ *   come.  It is never changed, so it may be shared with other partial
+ *   methods.
  *  \param p_pTaskDescr IN A smart pointer to a task description for this 
  *   method.
  *  \param p_pTaskSubs IN A substitution from the variables in the task
@@ -164,7 +168,7 @@ extern TermTable g_TermTable;
  *  \param p_iFinalStateIndex IN The index of the state in the problem where
  *   the effects of the annotated task were satisfied.
  */
-PartialHtnMethod::PartialHtnMethod( const std::tr1::shared_ptr< HtnDomain > & p_pDomain,
+PartialHtnMethod::PartialHtnMethod( const std::tr1::shared_ptr< const HtnDomain > & p_pDomain,
 				    const std::tr1::shared_ptr< HtnTaskDescr > & p_pTaskDescr,
 				    const Substitution * p_pTaskSubs,
 				    unsigned int p_iFinalStateIndex )
@@ -177,9 +181,9 @@ PartialHtnMethod::PartialHtnMethod( const std::tr1::shared_ptr< HtnDomain > & p_
   {
     TermVariableP l_pVar;
     if( l_iIter->first->HasTyping() )
-      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId(), l_iIter->first->GetTyping() ) );
+      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId(), l_iIter->first->GetTyping() ) );
     else
-      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId() ) );
+      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId() ) );
     m_TaskSubs.AddPair( l_iIter->first, l_pVar );
     m_MasterSubs.AddPair( l_pVar, l_iIter->second );
   }
@@ -434,9 +438,9 @@ void PartialHtnMethod::CreateNewVars( const Substitution * p_pRealSub,
       {
         TermVariableP l_pVar;
 	if( l_iIter->first->HasTyping() )
-	  l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId(), l_iIter->first->GetTyping() ) );
+	  l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId(), l_iIter->first->GetTyping() ) );
 	else
-	  l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId() ) );
+	  l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId() ) );
 	p_NewSub.AddPair( l_iIter->first, l_pVar );
 	m_MasterSubs.AddPair( l_pVar, l_iIter->second );
       }
@@ -455,9 +459,9 @@ void PartialHtnMethod::CreateNewVars( const Substitution * p_pRealSub,
     {
       TermVariableP l_pVar;
       if( l_iIter->first->HasTyping() )
-	l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId(), l_iIter->first->GetTyping() ) );
+	l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId(), l_iIter->first->GetTyping() ) );
       else
-	l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId() ) );
+	l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId() ) );
       p_NewSub.AddPair( l_iIter->first, l_pVar );
       m_MasterSubs.AddPair( l_pVar, l_iIter->second );
     }
@@ -1457,9 +1461,9 @@ void PartialHtnMethod::GetNewTaskVars()
   {
     TermVariableP l_pVar;
     if( l_vOldVars[i]->HasTyping() )
-      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId(), l_vOldVars[i]->GetTyping() ) );
+      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId(), l_vOldVars[i]->GetTyping() ) );
     else
-      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( MakeVarId() ) );
+      l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.LookupTemp( MakeVarId() ) );
     m_TaskSubs.ReplaceTerm( l_vOldVars[i], l_pVar );
     m_MasterSubs.ReplaceTerm( l_vOldVars[i], l_pVar );
     l_ReplaceSubs.AddPair( l_vOldVars[i], l_pVar );
@@ -4,7 +4,7 @@
 class PartialHtnMethod
 {
 public:
-  PartialHtnMethod( const std::tr1::shared_ptr< HtnDomain > & p_pDomain, 
+  PartialHtnMethod( const std::tr1::shared_ptr< const HtnDomain > & p_pDomain, 
 		    const std::tr1::shared_ptr< HtnTaskDescr > & p_pTaskDescr,
 		    const Substitution * p_pTaskSubs,
 		    unsigned int p_iFinalStateIndex );
@@ -98,7 +98,7 @@ private:
   bool DoesMethodConflict( unsigned int p_iBeforeStateNum,
 			   unsigned int p_iAfterStateNum ) const;
 
-  std::tr1::shared_ptr< HtnDomain > m_pDomain;
+  std::tr1::shared_ptr< const HtnDomain > m_pDomain;
   std::tr1::shared_ptr< HtnTaskDescr > m_pTaskDescr;
   std::vector< FormulaP > m_vRemainingAddList;
   std::vector< FormulaP > m_vRemainingPrecs;
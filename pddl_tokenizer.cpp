@@ -0,0 +1,439 @@
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <cctype>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exception.hpp"
+#include "pddl_tokenizer.hpp"
+
+/** \file pddl_tokenizer.hpp
+ *  Declaration of the MappedFile and PddlTokenizer classes.
+ */
+
+/** \file pddl_tokenizer.cpp
+ *  Definition of the MappedFile and PddlTokenizer classes.
+ */
+
+/** \class MappedFile
+ *  The read-only contents of a file, mapped into memory.
+ *  If the file cannot be mapped (for example, because it is a pipe or is
+ *   empty), it is read into a buffer with large reads instead.
+ */
+
+/** \var MappedFile::m_pData
+ *  A pointer to the first byte of the file, which has the same lifetime as
+ *   this MappedFile.
+ */
+
+/** \var MappedFile::m_iSize
+ *  The number of bytes in the file.
+ */
+
+/** \var MappedFile::m_bMapped
+ *  Whether m_pData points into a mapping that must be released, rather than
+ *   into m_sBuffer.
+ */
+
+/** \var MappedFile::m_sBuffer
+ *  The contents of the file, if it could not be mapped.
+ */
+
+/**
+ *  Map a file into memory.
+ *  \param p_sFileName IN The path to the file.
+ */
+MappedFile::MappedFile( const std::string & p_sFileName ) throw ( StreamFailException )
+  : m_pData( NULL ),
+    m_iSize( 0 ),
+    m_bMapped( false )
+{
+  int l_iFile = open( p_sFileName.c_str(), O_RDONLY );
+  if( l_iFile < 0 )
+    throw StreamFailException( "Reading file " + p_sFileName + " failed.",
+			       __FILE__,
+			       __LINE__ );
+
+  struct stat l_Stat;
+  if( fstat( l_iFile, &l_Stat ) == 0 && S_ISREG( l_Stat.st_mode ) && l_Stat.st_size > 0 )
+  {
+    void * l_pMap = mmap( NULL, l_Stat.st_size, PROT_READ, MAP_PRIVATE, l_iFile, 0 );
+    if( l_pMap != MAP_FAILED )
+    {
+      m_pData = (const char *)l_pMap;
+      m_iSize = l_Stat.st_size;
+      m_bMapped = true;
+    }
+  }
+
+  if( !m_bMapped )
+  {
+    char l_aBuffer[65536];
+    ssize_t l_iRead;
+    while( ( l_iRead = read( l_iFile, l_aBuffer, sizeof( l_aBuffer ) ) ) > 0 )
+      m_sBuffer.append( l_aBuffer, l_iRead );
+    if( l_iRead < 0 )
+    {
+      close( l_iFile );
+      throw StreamFailException( "Reading file " + p_sFileName + " failed.",
+				 __FILE__,
+				 __LINE__ );
+    }
+    m_pData = m_sBuffer.data();
+    m_iSize = m_sBuffer.size();
+  }
+
+  close( l_iFile );
+}
+
+/**
+ *  Destruct a MappedFile, releasing its mapping.
+ */
+MappedFile::~MappedFile()
+{
+  if( m_bMapped )
+    munmap( (void *)m_pData, m_iSize );
+}
+
+/**
+ *  Retrieve a pointer to the contents of the file.
+ *  \return A pointer to the first byte of the file, which is not terminated
+ *   and has the same lifetime as this MappedFile.
+ */
+const char * MappedFile::GetData() const
+{
+  return m_pData;
+}
+
+/**
+ *  Retrieve the size of the file.
+ *  \return The number of bytes in the file.
+ */
+size_t MappedFile::GetSize() const
+{
+  return m_iSize;
+}
+
+/** \struct PddlToken
+ *  One token of a PDDL text: a parenthesis, or a name delimited by
+ *   whitespace and parentheses.
+ *  A token does not own its text; it points into the buffer of the
+ *   PddlTokenizer that produced it.
+ */
+
+/** \var PddlToken::m_iType
+ *  Whether this is an opening or closing parenthesis, a name, or the end of
+ *   the text.
+ */
+
+/** \var PddlToken::m_pText
+ *  A pointer to the first character of this token in the buffer.
+ */
+
+/** \var PddlToken::m_iLength
+ *  The number of characters in this token.
+ */
+
+/** \var PddlToken::m_iOffset
+ *  The byte offset of this token from the start of the buffer.
+ */
+
+/**
+ *  Retrieve a copy of the text of this token.
+ *  \return A copy of the text of this token.
+ */
+std::string PddlToken::ToStr() const
+{
+  return std::string( m_pText, m_iLength );
+}
+
+/**
+ *  Determine whether this token is a given string, ignoring case.
+ *  \param p_sString IN The string to compare against.  "(" and ")" match
+ *   parentheses.
+ *  \return Whether this token is p_sString.
+ */
+bool PddlToken::Is( const std::string & p_sString ) const
+{
+  if( m_iType == PT_END || p_sString.size() != m_iLength )
+    return false;
+  for( unsigned int i = 0; i < m_iLength; i++ )
+  {
+    if( tolower( m_pText[i] ) != tolower( p_sString[i] ) )
+      return false;
+  }
+  return true;
+}
+
+/** \class PddlTokenizer
+ *  A tokenizer that reads PDDL directly from a buffer without copying it.
+ *  It accepts the same syntax as EatWhitespace(), EatString(), ReadString(),
+ *   and ReadParenthetical(): names are delimited by whitespace and
+ *   parentheses, and a semicolon outside a name starts a comment that runs
+ *   to the end of the line.
+ *  Errors report the byte offset at which they occurred.
+ */
+
+/** \var PddlTokenizer::m_pData
+ *  A pointer to the buffer, which is not owned by this tokenizer.
+ */
+
+/** \var PddlTokenizer::m_iSize
+ *  The number of bytes in the buffer.
+ */
+
+/** \var PddlTokenizer::m_iPos
+ *  The offset of the first byte that has not yet been scanned.
+ */
+
+/** \var PddlTokenizer::m_bPeeked
+ *  Whether m_Next holds a token that has been scanned but not consumed.
+ */
+
+/** \var PddlTokenizer::m_Next
+ *  The next token, if m_bPeeked.
+ */
+
+/**
+ *  Construct a PddlTokenizer over a buffer.
+ *  A final EOF character, as appended by ReadFile(), is ignored.
+ *  \param p_pData IN A pointer to the buffer, which must outlive this.
+ *  \param p_iSize IN The number of bytes in the buffer.
+ */
+PddlTokenizer::PddlTokenizer( const char * p_pData, size_t p_iSize )
+  : m_pData( p_pData ),
+    m_iSize( p_iSize ),
+    m_iPos( 0 ),
+    m_bPeeked( false )
+{
+  if( m_iSize > 0 && m_pData[m_iSize - 1] == (char)EOF )
+    m_iSize--;
+}
+
+/**
+ *  Construct a PddlTokenizer over the contents of a string.
+ *  A final EOF character, as appended by ReadFile(), is ignored.
+ *  \param p_sInput IN The string, which must outlive this and must not be
+ *   modified while it is in use.
+ */
+PddlTokenizer::PddlTokenizer( const std::string & p_sInput )
+  : m_pData( p_sInput.data() ),
+    m_iSize( p_sInput.size() ),
+    m_iPos( 0 ),
+    m_bPeeked( false )
+{
+  if( m_iSize > 0 && m_pData[m_iSize - 1] == (char)EOF )
+    m_iSize--;
+}
+
+/**
+ *  Destruct a PddlTokenizer.
+ */
+PddlTokenizer::~PddlTokenizer()
+{
+}
+
+/**
+ *  Scan the next token into m_Next, skipping whitespace and comments.
+ */
+void PddlTokenizer::Scan()
+{
+  while( m_iPos < m_iSize )
+  {
+    char l_cTemp = m_pData[m_iPos];
+    if( l_cTemp == ' ' || l_cTemp == '\n' || l_cTemp == '\r' || l_cTemp == '\t' )
+      m_iPos++;
+    else if( l_cTemp == ';' )
+    {
+      while( m_iPos < m_iSize && m_pData[m_iPos] != '\n' )
+	m_iPos++;
+    }
+    else
+      break;
+  }
+
+  m_Next.m_pText = m_pData + m_iPos;
+  m_Next.m_iOffset = m_iPos;
+  m_Next.m_iLength = 0;
+
+  if( m_iPos >= m_iSize )
+    m_Next.m_iType = PT_END;
+  else if( m_pData[m_iPos] == '(' )
+  {
+    m_Next.m_iType = PT_OPEN;
+    m_Next.m_iLength = 1;
+  }
+  else if( m_pData[m_iPos] == ')' )
+  {
+    m_Next.m_iType = PT_CLOSE;
+    m_Next.m_iLength = 1;
+  }
+  else
+  {
+    m_Next.m_iType = PT_ATOM;
+    size_t l_iEnd = m_iPos;
+    while( l_iEnd < m_iSize )
+    {
+      char l_cTemp = m_pData[l_iEnd];
+      if( l_cTemp == '(' || l_cTemp == ')' || l_cTemp == ' ' ||
+	  l_cTemp == '\n' || l_cTemp == '\t' || l_cTemp == '\r' )
+	break;
+      l_iEnd++;
+    }
+    m_Next.m_iLength = l_iEnd - m_iPos;
+  }
+
+  m_iPos += m_Next.m_iLength;
+  m_bPeeked = true;
+}
+
+/**
+ *  Retrieve the next token without consuming it.
+ *  \return A reference to the next token, which is valid until this
+ *   tokenizer is next advanced.
+ */
+const PddlToken & PddlTokenizer::Peek()
+{
+  if( !m_bPeeked )
+    Scan();
+  return m_Next;
+}
+
+/**
+ *  Consume the next token.
+ *  \return The token that was consumed.
+ */
+PddlToken PddlTokenizer::Next()
+{
+  if( !m_bPeeked )
+    Scan();
+  m_bPeeked = false;
+  return m_Next;
+}
+
+/**
+ *  Determine whether the next token is an opening parenthesis.
+ *  \return Whether the next token is an opening parenthesis.
+ */
+bool PddlTokenizer::PeekOpen()
+{
+  return Peek().m_iType == PT_OPEN;
+}
+
+/**
+ *  Determine whether the next token is a closing parenthesis.
+ *  \return Whether the next token is a closing parenthesis.
+ */
+bool PddlTokenizer::PeekClose()
+{
+  return Peek().m_iType == PT_CLOSE;
+}
+
+/**
+ *  Describe a token for an error message.
+ *  \param p_Token IN The token to describe.
+ *  \return A description of the token and its offset.
+ */
+std::string PddlTokenizer::Describe( const PddlToken & p_Token ) const
+{
+  std::stringstream l_sMessage;
+  if( p_Token.m_iType == PT_END )
+    l_sMessage << "end of file";
+  else
+    l_sMessage << "\"" << p_Token.ToStr() << "\"";
+  l_sMessage << " at byte " << p_Token.m_iOffset;
+  return l_sMessage.str();
+}
+
+/**
+ *  Consume a given token, ignoring case.
+ *  \param p_sString IN The expected token.  This may be "(" or ")".
+ */
+void PddlTokenizer::Eat( const std::string & p_sString ) throw ( MissingStringException )
+{
+  PddlToken l_Token = Next();
+  if( !l_Token.Is( p_sString ) )
+    throw MissingStringException( "Unexpected " + Describe( l_Token ) + ", expecting \"" + p_sString + "\".",
+				  __FILE__,
+				  __LINE__,
+				  p_sString );
+}
+
+/**
+ *  Consume a name and retrieve a copy of it.
+ *  \return A copy of the name.
+ */
+std::string PddlTokenizer::ReadAtom() throw ( MissingStringException )
+{
+  PddlToken l_Token = Next();
+  if( l_Token.m_iType != PT_ATOM )
+    throw MissingStringException( "Unexpected " + Describe( l_Token ) + ", expecting a name.",
+				  __FILE__,
+				  __LINE__,
+				  "" );
+  return l_Token.ToStr();
+}
+
+/**
+ *  Consume a parenthetical phrase and retrieve it in the normalized form
+ *   produced by ReadParenthetical( std::stringstream & ), so that it can be
+ *   handed to the parsers that still read from a stream.
+ *  \return A string containing the phrase.
+ */
+std::string PddlTokenizer::ReadParenthetical() throw ( MissingStringException )
+{
+  Eat( "(" );
+  std::string l_sRet = "( ";
+  int l_iDepth = 1;
+
+  while( l_iDepth > 0 )
+  {
+    PddlToken l_Token = Next();
+    switch( l_Token.m_iType )
+    {
+    case PT_OPEN:
+      l_iDepth++;
+      l_sRet += "(";
+      break;
+    case PT_CLOSE:
+      l_iDepth--;
+      l_sRet += ")";
+      break;
+    case PT_ATOM:
+      l_sRet.append( l_Token.m_pText, l_Token.m_iLength );
+      l_sRet += " ";
+      break;
+    case PT_END:
+      throw MissingStringException( "Unexpected " + Describe( l_Token ) + ", expecting \")\".",
+				    __FILE__,
+				    __LINE__,
+				    ")" );
+    }
+  }
+
+  return l_sRet;
+}
+
+/**
+ *  Retrieve the offset of the next unconsumed token, or of the whitespace
+ *   before it.
+ *  \return A byte offset into the buffer.
+ */
+size_t PddlTokenizer::GetOffset() const
+{
+  return m_bPeeked ? m_Next.m_iOffset : m_iPos;
+}
+
+/**
+ *  Move this tokenizer to an offset returned by GetOffset().
+ *  \param p_iOffset IN A byte offset into the buffer.
+ */
+void PddlTokenizer::SetOffset( size_t p_iOffset )
+{
+  m_iPos = p_iOffset;
+  m_bPeeked = false;
+}
@@ -0,0 +1,76 @@
+#ifndef PDDL_TOKENIZER_HPP__
+#define PDDL_TOKENIZER_HPP__
+
+class MappedFile
+{
+public:
+  MappedFile( const std::string & p_sFileName ) throw ( StreamFailException );
+  virtual ~MappedFile();
+
+  const char * GetData() const;
+  size_t GetSize() const;
+
+private:
+  MappedFile( const MappedFile & p_Other );
+  MappedFile & operator=( const MappedFile & p_Other );
+
+  const char * m_pData;
+  size_t m_iSize;
+  bool m_bMapped;
+  std::string m_sBuffer;
+};
+
+enum PddlTokenType
+{
+  PT_OPEN,
+  PT_CLOSE,
+  PT_ATOM,
+  PT_END,
+};
+
+struct PddlToken
+{
+  PddlTokenType m_iType;
+  const char * m_pText;
+  unsigned int m_iLength;
+  size_t m_iOffset;
+
+  std::string ToStr() const;
+  bool Is( const std::string & p_sString ) const;
+};
+
+class PddlTokenizer
+{
+public:
+  PddlTokenizer( const char * p_pData, size_t p_iSize );
+  PddlTokenizer( const std::string & p_sInput );
+  virtual ~PddlTokenizer();
+
+  const PddlToken & Peek();
+  PddlToken Next();
+
+  bool PeekOpen();
+  bool PeekClose();
+
+  void Eat( const std::string & p_sString ) throw ( MissingStringException );
+  std::string ReadAtom() throw ( MissingStringException );
+  std::string ReadParenthetical() throw ( MissingStringException );
+
+  size_t GetOffset() const;
+  void SetOffset( size_t p_iOffset );
+
+private:
+  PddlTokenizer( const PddlTokenizer & p_Other );
+  PddlTokenizer & operator=( const PddlTokenizer & p_Other );
+
+  void Scan();
+  std::string Describe( const PddlToken & p_Token ) const;
+
+  const char * m_pData;
+  size_t m_iSize;
+  size_t m_iPos;
+  bool m_bPeeked;
+  PddlToken m_Next;
+};
+
+#endif//PDDL_TOKENIZER_HPP__
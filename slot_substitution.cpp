@@ -0,0 +1,142 @@
+#include <vector>
+#include <string>
+#include <set>
+#include <tr1/memory>
+#include <tr1/unordered_map>
+#include <pthread.h>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_variable.hpp"
+#include "term_constant.hpp"
+#include "term_table.hpp"
+#include "substitution.hpp"
+#include "slot_substitution.hpp"
+
+/** \file slot_substitution.hpp
+ *  Declaration of the SlotSubstitution class.
+ */
+
+/** \file slot_substitution.cpp
+ *  Definition of the SlotSubstitution class.
+ */
+
+/** \class SlotSubstitution
+ *  A substitution from a fixed, densely numbered list of variables into
+ *   constants, as used while unifying a UnifyPlan with a State.
+ *  The bindings are a flat array of constant ids indexed by slot.  Rather
+ *   than copying the substitution before each tentative binding, a caller
+ *   takes a Checkpoint() and later does a Rollback() to it, which unbinds
+ *   exactly the slots bound in between.
+ *  Only the result of a successful match is turned back into a Substitution.
+ */
+
+/** \var SlotSubstitution::m_vVars
+ *  The variable in each slot.  This is owned by whoever numbered the
+ *   variables, and must outlive this.
+ */
+
+/** \var SlotSubstitution::m_vIds
+ *  The id of the constant bound to each slot, or TERM_NO_ID.
+ */
+
+/** \var SlotSubstitution::m_vWatched
+ *  Whether or not each slot is watched.
+ *  Callers watch the variables for which they want every possible binding,
+ *   so that they may stop at the first result once all of those are bound.
+ */
+
+/** \var SlotSubstitution::m_iNumUnboundWatched
+ *  The number of watched variables that have not been bound since this was
+ *   loaded.
+ */
+
+/** \var SlotSubstitution::m_vTrail
+ *  The slots bound since this was loaded, in order.
+ */
+
+extern TermTable g_TermTable;
+
+/**
+ *  Construct a SlotSubstitution in which every slot is unbound.
+ *  \param p_vVars IN The variable in each slot, which must outlive this.
+ */
+SlotSubstitution::SlotSubstitution( const std::vector< TermVariableP > & p_vVars )
+  : m_vVars( p_vVars ),
+    m_vIds( p_vVars.size(), TERM_NO_ID ),
+    m_vWatched( p_vVars.size(), false ),
+    m_iNumUnboundWatched( 0 )
+{
+}
+
+/**
+ *  Destruct a SlotSubstitution.
+ */
+SlotSubstitution::~SlotSubstitution()
+{
+}
+
+/**
+ *  Bind each slot whose variable is bound in a Substitution.
+ *  These bindings are not on the trail, and so are never rolled back and are
+ *   not repeated by ToSubstitution().
+ *  \param p_Sub IN The Substitution.
+ *  \return Whether or not every such variable was bound to a constant.  If
+ *   not, this cannot represent the Substitution.
+ */
+bool SlotSubstitution::Load( const Substitution & p_Sub )
+{
+  bool l_bOk = true;
+  for( unsigned int i = 0; i < m_vVars.size(); i++ )
+  {
+    SubMap::const_iterator l_iBound = p_Sub.FindIndexByVar( m_vVars[i] );
+    if( l_iBound != p_Sub.End() )
+    {
+      if( l_iBound->second->GetType() != TT_CONSTANT )
+	l_bOk = false;
+      m_vIds[i] = l_iBound->second->GetId();
+    }
+  }
+  return l_bOk;
+}
+
+/**
+ *  Watch the slots of some variables.
+ *  Every member of the set counts as unbound until its slot is bound, so a
+ *   variable that has no slot here is never counted as bound.
+ *  \param p_vVars IN The variables to watch.
+ */
+void SlotSubstitution::Watch( const std::set< TermVariableP > & p_vVars )
+{
+  m_iNumUnboundWatched = p_vVars.size();
+  for( unsigned int i = 0; i < m_vVars.size(); i++ )
+    m_vWatched[i] = ( p_vVars.find( m_vVars[i] ) != p_vVars.end() );
+}
+
+/**
+ *  Create a Substitution that extends another with the bindings made since
+ *   this was loaded.
+ *  \param p_Base IN The Substitution to extend, which is normally the one
+ *   that was loaded.
+ *  \return A new Substitution, which the caller must deallocate.
+ */
+Substitution * SlotSubstitution::ToSubstitution( const Substitution & p_Base ) const
+{
+  Substitution * l_pNew = new Substitution( p_Base );
+  for( unsigned int i = 0; i < m_vTrail.size(); i++ )
+    l_pNew->AddPair( m_vVars[m_vTrail[i]],
+		     g_TermTable.LookupId( m_vIds[m_vTrail[i]] ) );
+  return l_pNew;
+}
+
+size_t SlotSubstitution::GetMemSizeMin() const
+{
+  return sizeof( SlotSubstitution ) + m_vIds.capacity() * sizeof( unsigned int ) + m_vWatched.capacity() / 8 + m_vTrail.capacity() * sizeof( unsigned int );
+}
+
+size_t SlotSubstitution::GetMemSizeMax() const
+{
+  return GetMemSizeMin();
+}
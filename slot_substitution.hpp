@@ -0,0 +1,88 @@
+#ifndef SLOT_SUBSTITUTION_HPP__
+#define SLOT_SUBSTITUTION_HPP__
+
+class SlotSubstitution
+{
+public:
+  SlotSubstitution( const std::vector< TermVariableP > & p_vVars );
+  virtual ~SlotSubstitution();
+
+  bool Load( const Substitution & p_Sub );
+
+  void Watch( const std::set< TermVariableP > & p_vVars );
+
+  /**
+   *  Retrieve the id of the constant bound to a slot.
+   *  \param p_iSlot IN The index of the slot.
+   *  \return The id of the constant, or TERM_NO_ID if the slot is unbound.
+   */
+  unsigned int GetId( unsigned int p_iSlot ) const
+  {
+    return m_vIds[p_iSlot];
+  }
+
+  /**
+   *  Bind an unbound slot to a constant.
+   *  \param p_iSlot IN The index of the slot.
+   *  \param p_iId IN The id of the constant.
+   */
+  void Bind( unsigned int p_iSlot,
+	     unsigned int p_iId )
+  {
+    m_vIds[p_iSlot] = p_iId;
+    m_vTrail.push_back( p_iSlot );
+    if( m_vWatched[p_iSlot] )
+      m_iNumUnboundWatched--;
+  }
+
+  /**
+   *  Retrieve a checkpoint to which the bindings may later be rolled back.
+   *  \return The number of slots bound since this was loaded.
+   */
+  unsigned int Checkpoint() const
+  {
+    return m_vTrail.size();
+  }
+
+  /**
+   *  Unbind every slot bound since a checkpoint.
+   *  \param p_iCheckpoint IN A value returned by Checkpoint().
+   */
+  void Rollback( unsigned int p_iCheckpoint )
+  {
+    while( m_vTrail.size() > p_iCheckpoint )
+    {
+      unsigned int l_iSlot = m_vTrail.back();
+      m_vTrail.pop_back();
+      m_vIds[l_iSlot] = TERM_NO_ID;
+      if( m_vWatched[l_iSlot] )
+	m_iNumUnboundWatched++;
+    }
+  }
+
+  /**
+   *  Retrieve the number of watched slots that are still unbound.
+   *  \return The number of watched slots that are still unbound.
+   */
+  unsigned int GetNumUnboundWatched() const
+  {
+    return m_iNumUnboundWatched;
+  }
+
+  Substitution * ToSubstitution( const Substitution & p_Base ) const;
+
+  size_t GetMemSizeMin() const;
+  size_t GetMemSizeMax() const;
+
+private:
+  SlotSubstitution( const SlotSubstitution & p_Other );
+  SlotSubstitution & operator=( const SlotSubstitution & p_Other );
+
+  const std::vector< TermVariableP > & m_vVars;
+  std::vector< unsigned int > m_vIds;
+  std::vector< bool > m_vWatched;
+  unsigned int m_iNumUnboundWatched;
+  std::vector< unsigned int > m_vTrail;
+};
+
+#endif//SLOT_SUBSTITUTION_HPP__
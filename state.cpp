@@ -6,6 +6,8 @@
 #include <iostream>
 #include <algorithm>
 #include <tr1/memory>
+#include <tr1/unordered_map>
+#include <tr1/unordered_set>
 
 #include "exception.hpp"
 #include "funcs.hpp"
@@ -13,15 +15,20 @@
 #include "term_string.hpp"
 #include "term_variable.hpp"
 #include "term_constant.hpp"
+#include "term_table.hpp"
 #include "type_table.hpp"
 #include "substitution.hpp"
 #include "formula.hpp"
 #include "formula_pred.hpp"
+#include "ground_atom.hpp"
 #include "formula_equ.hpp"
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
+#include "unify_plan.hpp"
+#include "slot_substitution.hpp"
 #include "operator.hpp"
 #include "state.hpp"
+#include "instantiation_cursor.hpp"
 
 /** \file state.hpp
  *  Declaration of State class.
@@ -37,15 +44,70 @@
  */
 
 /** \var State::m_vAtoms
- *  A doubly-indexed list of smart pointers to all predicates that hold in 
- *   this State.
- *  Technically, this is a vector of vectors of smart pointers to predicates.
- *   Each of the internal vectors contains smart pointers to predicates with 
- *   the same predicate symbol.
+ *  A doubly-indexed list of all atoms that hold in this State.
+ *  Technically, this is a vector of smart pointers to AtomRows, each of
+ *   which contains the atoms with the same predicate symbol.
  *  This is done to make looking up whether or not a given predicate holds in 
  *   this State faster.
- *  \todo The lookup could potentially be even faster if we used hashtables
- *   instead of vectors.
+ *  The rows are shared between a State and the States copied from it, and
+ *   are only copied when one of them changes a row (see
+ *   State::GetMutableRow()).  Thus a successor State costs only as much as
+ *   the rows that its effects touch.
+ *  The rows are kept ordered by State::SortAtoms().  The order of the atoms
+ *   within a row depends only on the order in which atoms were added and
+ *   removed (see AtomRow::Remove()), so the order in which instantiations
+ *   are found does not depend on the hashtables.
+ */
+
+/** \var State::m_mRows
+ *  A hashtable from relation (predicate symbol) indices to the row of
+ *   State::m_vAtoms that holds the atoms with that relation.
+ *  This must be rebuilt whenever the rows are re-ordered.
+ */
+
+/** \class AtomRow
+ *  The atoms of a State that share a predicate symbol.
+ *  An AtomRow may be shared by several States, and so must not be modified
+ *   unless the State modifying it holds the only reference to it.
+ */
+
+/** \var AtomRow::m_iRelation
+ *  The index of the relation (predicate symbol) shared by the atoms of this
+ *   row in the global StringTable.
+ */
+
+/** \var AtomRow::m_vAtoms
+ *  The atoms in this row, in the order they were added, except that the last
+ *   atom takes the place of any that is removed.
+ */
+
+/** \var AtomRow::m_vSlots
+ *  An open-addressed hashtable of the atoms in AtomRow::m_vAtoms, each stored
+ *   as one more than its index there, with zero for an empty slot.
+ *  This makes determining whether or not an atom holds in a State O(1).  The
+ *   number of slots is a power of two and at least twice the number of atoms.
+ *  Since it is a plain vector of integers, copying a row to modify it costs
+ *   no allocation beyond the vector itself.
+ */
+
+/** \var AtomRow::m_mArgs
+ *  A hashtable from an argument position and the id of a constant to the
+ *   indices in AtomRow::m_vAtoms of the atoms that have that constant in that
+ *   position.
+ *  Each list is in increasing order, so it may be enumerated in place of the
+ *   row.
+ */
+
+/** \class AtomArgKey
+ *  A key into AtomRow::m_mArgs.
+ */
+
+/** \class HashAtomArgKey
+ *  A functor to hash AtomArgKeys.
+ */
+
+/** \class EqualAtomArgKey
+ *  A functor to determine whether or not two AtomArgKeys are equal.
  */
 
 /** \var State::m_vConstants
@@ -54,30 +116,185 @@
  *   the overhead in computing it many times.
  */
 
+/** \def ATOM_ROW_MIN_SLOTS
+ *  The smallest number of slots in the hashtable of an AtomRow.
+ */
+#define ATOM_ROW_MIN_SLOTS 8
+
+/**
+ *  The one and only TermTable, defined in term_table.cpp.
+ */
+extern TermTable g_TermTable;
+
 /** \var State::m_iStateNum
  *  The index of this State in a plan.
  *  \todo Is this really necessary?
  */
 
+/** \var State::m_iHash
+ *  The sum of the mixed hashes of the atoms of this State, which is kept up
+ *   to date as atoms are added and removed.
+ */
+
+/** \var State::m_iCheckHash
+ *  The sum of the check hashes (see CheckHashAtom()) of the atoms of this
+ *   State, which is kept up to date along with State::m_iHash.
+ */
+
 /**
- *  A functor to order a vector of vectors of predicates from smallest vector
- *   to largest vector.
- *  Order among two vectors of the same size is meaningless, but we define it
+ *  A functor to order a vector of rows of predicates from smallest row to
+ *   largest row.
+ *  Order among two rows of the same size is meaningless, but we define it
  *   so that equality testing becomes easier.
  */
 struct AtomsCompare
 {
-  bool operator()( const std::vector< FormulaPredP > & p_Vec1,
-		   const std::vector< FormulaPredP > & p_Vec2 ) const
+  bool operator()( const AtomRowP & p_pRow1,
+		   const AtomRowP & p_pRow2 ) const
   {
-    if( p_Vec1.size() < p_Vec2.size() )
+    if( p_pRow1->m_vAtoms.size() < p_pRow2->m_vAtoms.size() )
       return true;
-    if( p_Vec1.size() > p_Vec2.size() )
+    if( p_pRow1->m_vAtoms.size() > p_pRow2->m_vAtoms.size() )
       return false;
-    return p_Vec1[0]->GetRelationIndex() < p_Vec2[0]->GetRelationIndex();
+    return p_pRow1->m_iRelation < p_pRow2->m_iRelation;
   }
 } g_AtomsComparer;
 
+/**
+ *  Find an atom in this row.
+ *  \param p_Atom IN The atom to find.
+ *  \return The index of the atom in AtomRow::m_vAtoms, or -1 if it is not in
+ *   this row.
+ */
+int AtomRow::Find( const GroundAtom & p_Atom ) const
+{
+  if( m_vSlots.empty() )
+    return -1;
+  unsigned int l_iMask = m_vSlots.size() - 1;
+  for( unsigned int i = p_Atom.Hash() & l_iMask; m_vSlots[i] != 0; i = ( i + 1 ) & l_iMask )
+  {
+    if( m_vAtoms[m_vSlots[i] - 1].Equal( p_Atom ) )
+      return m_vSlots[i] - 1;
+  }
+  return -1;
+}
+
+/**
+ *  Add an atom to the end of this row.
+ *  The caller is responsible for making sure that it is not already here.
+ *  \param p_Atom IN The atom to add.
+ */
+void AtomRow::Add( const GroundAtom & p_Atom )
+{
+  unsigned int l_iIndex = m_vAtoms.size();
+  m_vAtoms.push_back( p_Atom );
+
+  if( 2 * m_vAtoms.size() > m_vSlots.size() )
+    Rehash();
+  else
+  {
+    unsigned int l_iMask = m_vSlots.size() - 1;
+    unsigned int i = p_Atom.Hash() & l_iMask;
+    while( m_vSlots[i] != 0 )
+      i = ( i + 1 ) & l_iMask;
+    m_vSlots[i] = l_iIndex + 1;
+  }
+
+  AtomArgKey l_Key;
+  for( unsigned int i = 0; i < p_Atom.GetValence(); i++ )
+  {
+    l_Key.m_iPosition = i;
+    l_Key.m_iTermId = p_Atom.GetArgId( i );
+    m_mArgs[l_Key].push_back( l_iIndex );
+  }
+}
+
+/**
+ *  Remove an atom from this row.
+ *  The last atom of the row moves into its place, so only the slot and the
+ *   argument lists of that atom need to change.  The slot of the removed atom
+ *   is emptied by shifting back the atoms that probed past it, which leaves
+ *   the hashtable as if the atom had never been added.
+ *  \param p_iIndex IN The index of the atom in AtomRow::m_vAtoms.
+ */
+void AtomRow::Remove( unsigned int p_iIndex )
+{
+  unsigned int l_iLast = m_vAtoms.size() - 1;
+  unsigned int l_iMask = m_vSlots.size() - 1;
+
+  unsigned int l_iHole = m_vAtoms[p_iIndex].Hash() & l_iMask;
+  while( m_vSlots[l_iHole] != p_iIndex + 1 )
+    l_iHole = ( l_iHole + 1 ) & l_iMask;
+  for( unsigned int j = ( l_iHole + 1 ) & l_iMask; m_vSlots[j] != 0; j = ( j + 1 ) & l_iMask )
+  {
+    // An atom may fill the hole unless its home slot lies after the hole,
+    //  cyclically, and no later than where it is now.
+    unsigned int l_iHome = m_vAtoms[m_vSlots[j] - 1].Hash() & l_iMask;
+    if( ( ( j - l_iHome ) & l_iMask ) >= ( ( j - l_iHole ) & l_iMask ) )
+    {
+      m_vSlots[l_iHole] = m_vSlots[j];
+      l_iHole = j;
+    }
+  }
+  m_vSlots[l_iHole] = 0;
+
+  AtomArgKey l_Key;
+  const GroundAtom & l_Atom = m_vAtoms[p_iIndex];
+  for( unsigned int i = 0; i < l_Atom.GetValence(); i++ )
+  {
+    l_Key.m_iPosition = i;
+    l_Key.m_iTermId = l_Atom.GetArgId( i );
+    AtomArgMap::iterator l_iList = m_mArgs.find( l_Key );
+    std::vector< unsigned int > & l_vList = l_iList->second;
+    l_vList.erase( std::lower_bound( l_vList.begin(), l_vList.end(), p_iIndex ) );
+    if( l_vList.empty() )
+      m_mArgs.erase( l_iList );
+  }
+
+  if( p_iIndex != l_iLast )
+  {
+    const GroundAtom & l_Moved = m_vAtoms[l_iLast];
+    unsigned int j = l_Moved.Hash() & l_iMask;
+    while( m_vSlots[j] != l_iLast + 1 )
+      j = ( j + 1 ) & l_iMask;
+    m_vSlots[j] = p_iIndex + 1;
+
+    // The last atom has the greatest index, so it ends each of its lists.
+    for( unsigned int i = 0; i < l_Moved.GetValence(); i++ )
+    {
+      l_Key.m_iPosition = i;
+      l_Key.m_iTermId = l_Moved.GetArgId( i );
+      std::vector< unsigned int > & l_vList = m_mArgs[l_Key];
+      l_vList.pop_back();
+      l_vList.insert( std::lower_bound( l_vList.begin(), l_vList.end(), p_iIndex ), p_iIndex );
+    }
+
+    m_vAtoms[p_iIndex] = l_Moved;
+  }
+  m_vAtoms.pop_back();
+}
+
+/**
+ *  Rebuild the hashtable of this row from scratch, with a number of slots
+ *   suited to the number of atoms.
+ */
+void AtomRow::Rehash()
+{
+  unsigned int l_iNumSlots = ATOM_ROW_MIN_SLOTS;
+  while( l_iNumSlots < 4 * m_vAtoms.size() )
+    l_iNumSlots *= 2;
+  m_vSlots.assign( l_iNumSlots, 0 );
+
+  unsigned int l_iMask = l_iNumSlots - 1;
+  for( unsigned int j = 0; j < m_vAtoms.size(); j++ )
+  {
+    unsigned int i = m_vAtoms[j].Hash() & l_iMask;
+    while( m_vSlots[i] != 0 )
+      i = ( i + 1 ) & l_iMask;
+    m_vSlots[i] = j + 1;
+  }
+}
+
 
 /**
  *  Construct a State from a stream containing its textual representation.
@@ -97,6 +314,8 @@ State::State( std::stringstream & p_sStream,
 	      const TypeTable & p_TypeTable,
 	      const std::vector< FormulaPred > & p_vAllowablePredicates )
 {
+  m_iHash = 0;
+  m_iCheckHash = 0;
   ConstructorInternal( p_sStream, p_TypeTable, p_vAllowablePredicates );
   m_iStateNum = p_iStateNum;
 }
@@ -118,24 +337,41 @@ State::State( std::string p_sString,
 	      const TypeTable & p_TypeTable,
 	      const std::vector< FormulaPred > & p_vAllowablePredicates )
 {
+  m_iHash = 0;
+  m_iCheckHash = 0;
   std::stringstream l_Stream( p_sString );
   ConstructorInternal( l_Stream, p_TypeTable, p_vAllowablePredicates );
   m_iStateNum = p_iStateNum;
 }
 
+/**
+ *  Construct a State that contains a given list of atoms.
+ *  \param p_vAtoms IN The atoms that should hold in the State.  Any that
+ *   appear more than once are only added once.
+ *  \param p_iStateNum IN The number of this State.
+ */
+State::State( const std::vector< GroundAtom > & p_vAtoms,
+	      unsigned int p_iStateNum )
+{
+  m_iHash = 0;
+  m_iCheckHash = 0;
+  for( unsigned int i = 0; i < p_vAtoms.size(); i++ )
+    AddAtom( p_vAtoms[i] );
+  SortAtoms();
+  m_iStateNum = p_iStateNum;
+}
+
 /**
  *  Construct a State as a copy of an existing State.
  *  \param p_Other IN The State to copy.
  */
 State::State( const State & p_Other )
+  : m_vAtoms( p_Other.m_vAtoms ),
+    m_mRows( p_Other.m_mRows )
 {
-  for( unsigned int i = 0; i < p_Other.m_vAtoms.size(); i++ )
-  {
-    m_vAtoms.push_back( std::vector< FormulaPredP >() );
-    for( unsigned int j = 0; j < p_Other.m_vAtoms[i].size(); j++ )
-      m_vAtoms[i].push_back( p_Other.m_vAtoms[i][j] );
-  }
   m_iStateNum = p_Other.m_iStateNum;
+  m_iHash = p_Other.m_iHash;
+  m_iCheckHash = p_Other.m_iCheckHash;
 }
 
 /**
@@ -180,13 +416,13 @@ void State::ConstructorInternal( std::stringstream & p_Stream,
 
   while( p_Stream.peek() != ')' )
   {
-    FormulaPredP l_pNewAtom( new FormulaPred( p_Stream, p_TypeTable, p_vAllowablePredicates ) );
+    FormulaPred l_NewAtom( p_Stream, p_TypeTable, p_vAllowablePredicates );
 
-    if( !l_pNewAtom->IsGround() )
+    if( !l_NewAtom.IsGround() )
     {
       std::string l_sMessage;
       l_sMessage = "\"";
-      l_sMessage += l_pNewAtom->ToStr();
+      l_sMessage += l_NewAtom.ToStr();
       l_sMessage += "\" is a member of a state, but not an atom.";
       throw Exception( E_STATE_NOT_ATOM,
 		       l_sMessage,
@@ -194,35 +430,209 @@ void State::ConstructorInternal( std::stringstream & p_Stream,
 		       __LINE__ );
     }
 
-    bool l_bFound = false;
-    for( unsigned int i = 0; i < m_vAtoms.size() && !l_bFound; i++ )
-    {
-      if( PredRelationsAreEqual( *m_vAtoms[i][0], *l_pNewAtom ) )
-      {
-	l_bFound = true;
-	bool l_bFound2 = false;
-	for( unsigned int j = 0; j < m_vAtoms[i].size() && !l_bFound2; j++ )
-	{
-	  if( *m_vAtoms[i][j] == *l_pNewAtom )
-	    l_bFound2 = true;
-	}
-	if( !l_bFound2 )
-	  m_vAtoms[i].push_back( l_pNewAtom );
-      }
-    }
-    if( !l_bFound )
-    {
-      std::vector< FormulaPredP > l_vNew;
-      l_vNew.push_back( l_pNewAtom );
-      m_vAtoms.push_back( l_vNew );
-    }
+    AddAtom( GroundAtom( l_NewAtom ) );
 
     EatWhitespace( p_Stream );
   }
 
   EatString( p_Stream, ")" );
 
+  SortAtoms();
+}
+
+/**
+ *  Compute a hash of an atom that is independent of GroundAtom::Hash().
+ *  It mixes each field into a 64-bit chain rather than multiplying them into
+ *   a word, so that two atoms whose ordinary hashes collide will almost
+ *   never collide here as well.
+ *  \param p_Atom IN The atom to hash.
+ *  \return A second hash of the atom.
+ */
+uint64_t CheckHashAtom( const GroundAtom & p_Atom )
+{
+  uint64_t l_iHash = MixHash( ( (uint64_t)p_Atom.GetRelationIndex() << 32 ) | p_Atom.GetValence() );
+  for( unsigned int i = 0; i < p_Atom.GetValence(); i++ )
+    l_iHash = MixHash( l_iHash ^ p_Atom.GetArgId( i ) );
+  return l_iHash;
+}
+
+/**
+ *  Add an atom to this State, if it does not already hold.
+ *  The caller is responsible for calling State::SortAtoms() afterward.
+ *  \param p_Atom IN The atom to add.
+ */
+void State::AddAtom( const GroundAtom & p_Atom )
+{
+  AtomRow * l_pRow;
+  AtomRowMap::const_iterator l_iRow = m_mRows.find( p_Atom.GetRelationIndex() );
+  if( l_iRow != m_mRows.end() )
+  {
+    if( m_vAtoms[l_iRow->second]->Find( p_Atom ) >= 0 )
+      return;
+    l_pRow = GetMutableRow( l_iRow->second );
+  }
+  else
+  {
+    m_mRows[p_Atom.GetRelationIndex()] = m_vAtoms.size();
+    m_vAtoms.push_back( AtomRowP( new AtomRow() ) );
+    l_pRow = m_vAtoms.back().get();
+    l_pRow->m_iRelation = p_Atom.GetRelationIndex();
+  }
+
+  l_pRow->Add( p_Atom );
+  m_iHash += MixHash( p_Atom.Hash() );
+  m_iCheckHash += CheckHashAtom( p_Atom );
+}
+
+/**
+ *  Remove an atom from this State, if it holds.
+ *  The caller is responsible for calling State::SortAtoms() afterward.
+ *  \param p_Atom IN The atom to remove.
+ */
+void State::RemoveAtom( const GroundAtom & p_Atom )
+{
+  AtomRowMap::const_iterator l_iRowIndex = m_mRows.find( p_Atom.GetRelationIndex() );
+  if( l_iRowIndex == m_mRows.end() )
+    return;
+  unsigned int l_iRow = l_iRowIndex->second;
+  int l_iIndex = m_vAtoms[l_iRow]->Find( p_Atom );
+  if( l_iIndex < 0 )
+    return;
+  m_iHash -= MixHash( p_Atom.Hash() );
+  m_iCheckHash -= CheckHashAtom( p_Atom );
+
+  if( m_vAtoms[l_iRow]->m_vAtoms.size() == 1 )
+  {
+    // The whole row goes away, so there is no need to copy it first.
+    m_mRows.erase( p_Atom.GetRelationIndex() );
+    m_vAtoms.erase( m_vAtoms.begin() + l_iRow );
+    for( AtomRowMap::iterator i = m_mRows.begin(); i != m_mRows.end(); i++ )
+    {
+      if( i->second > l_iRow )
+	i->second--;
+    }
+    return;
+  }
+
+  GetMutableRow( l_iRow )->Remove( l_iIndex );
+}
+
+/**
+ *  Retrieve a row of this State that may be modified.
+ *  If the row is shared with any other State, this State first gets its own
+ *   copy of it.
+ *  \param p_iRow IN The index of the row in State::m_vAtoms.
+ *  \return A pointer to a row that only this State refers to.
+ */
+AtomRow * State::GetMutableRow( unsigned int p_iRow )
+{
+  if( !m_vAtoms[p_iRow].unique() )
+    m_vAtoms[p_iRow] = AtomRowP( new AtomRow( *m_vAtoms[p_iRow] ) );
+  return m_vAtoms[p_iRow].get();
+}
+
+/**
+ *  Put the rows of State::m_vAtoms into their canonical order and rebuild the
+ *   index of them in State::m_mRows.
+ */
+void State::SortAtoms()
+{
   std::sort( m_vAtoms.begin(), m_vAtoms.end(), g_AtomsComparer );
+  m_mRows.clear();
+  for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
+    m_mRows[m_vAtoms[i]->m_iRelation] = i;
+}
+
+/**
+ *  Retrieve the row of atoms in this State that have a given relation.
+ *  \param p_iRelation IN The index of a relation (predicate symbol) in the
+ *   global StringTable.
+ *  \return A pointer to the row of atoms with that relation, or NULL if no
+ *   atom in this State has it.
+ */
+const AtomRow * State::FindRow( unsigned int p_iRelation ) const
+{
+  AtomRowMap::const_iterator l_iRow = m_mRows.find( p_iRelation );
+  if( l_iRow == m_mRows.end() )
+    return NULL;
+  return m_vAtoms[l_iRow->second].get();
+}
+
+/**
+ *  Retrieve the shortest list of atoms in this State that contains every atom
+ *   that might unify with a predicate.
+ *  This is the list for whichever constant parameter of the predicate is
+ *   least common in that position, or the whole row if the predicate has no
+ *   constant parameters.  The list is in the same relative order as the row.
+ *  \param p_Pred IN The predicate that atoms must be able to unify with.
+ *  \param p_pList OUT A pointer to the indices in the row of the candidate 
+ *   atoms, or NULL if every atom in the row is a candidate.
+ *  \return A pointer to the row of atoms with the predicate's relation, or
+ *   NULL if there are no candidates.
+ */
+const AtomRow * State::FindCandidates( const FormulaPred & p_Pred,
+				       const std::vector< unsigned int > *& p_pList ) const
+{
+  p_pList = NULL;
+  const AtomRow * l_pRow = FindRow( p_Pred.GetRelationIndex() );
+  if( l_pRow == NULL )
+    return NULL;
+
+  AtomArgKey l_Key;
+  for( unsigned int i = 0; i < p_Pred.GetValence(); i++ )
+  {
+    TermP l_pParam = p_Pred.GetCParam( i );
+    if( l_pParam->GetType() != TT_CONSTANT )
+      continue;
+    l_Key.m_iPosition = i;
+    l_Key.m_iTermId = l_pParam->GetId();
+    AtomArgMap::const_iterator l_iList = l_pRow->m_mArgs.find( l_Key );
+    if( l_iList == l_pRow->m_mArgs.end() )
+      return NULL;
+    if( l_iList->second.size() < ( p_pList == NULL ? l_pRow->m_vAtoms.size() : p_pList->size() ) )
+      p_pList = &l_iList->second;
+  }
+  return l_pRow;
+}
+
+/**
+ *  Retrieve the shortest list of atoms in this State that contains every atom
+ *   that might unify with a predicate given by the ids of its parameters.
+ *  This is the same as the other FindCandidates(), but for a predicate that
+ *   has not been built as a FormulaPred.
+ *  \param p_iRelation IN The index of the predicate's relation.
+ *  \param p_iValence IN The number of parameters of the predicate.
+ *  \param p_aArgIds IN The id of each constant parameter of the predicate, or
+ *   TERM_NO_ID for each parameter that is not yet bound.
+ *  \param p_pList OUT A pointer to the indices in the row of the candidate 
+ *   atoms, or NULL if every atom in the row is a candidate.
+ *  \return A pointer to the row of atoms with the predicate's relation, or
+ *   NULL if there are no candidates.
+ */
+const AtomRow * State::FindCandidates( unsigned int p_iRelation,
+				       unsigned int p_iValence,
+				       const unsigned int * p_aArgIds,
+				       const std::vector< unsigned int > *& p_pList ) const
+{
+  p_pList = NULL;
+  const AtomRow * l_pRow = FindRow( p_iRelation );
+  if( l_pRow == NULL )
+    return NULL;
+
+  AtomArgKey l_Key;
+  for( unsigned int i = 0; i < p_iValence; i++ )
+  {
+    if( p_aArgIds[i] == TERM_NO_ID )
+      continue;
+    l_Key.m_iPosition = i;
+    l_Key.m_iTermId = p_aArgIds[i];
+    AtomArgMap::const_iterator l_iList = l_pRow->m_mArgs.find( l_Key );
+    if( l_iList == l_pRow->m_mArgs.end() )
+      return NULL;
+    if( l_iList->second.size() < ( p_pList == NULL ? l_pRow->m_vAtoms.size() : p_pList->size() ) )
+      p_pList = &l_iList->second;
+  }
+  return l_pRow;
 }
 
 /**
@@ -233,7 +643,7 @@ unsigned int State::GetNumAtoms() const
 {
   unsigned int l_iNumAtoms = 0;
   for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
-    l_iNumAtoms += m_vAtoms[i].size();
+    l_iNumAtoms += m_vAtoms[i]->m_vAtoms.size();
   return l_iNumAtoms;
 }
 
@@ -271,8 +681,8 @@ void CopyVectorsAndDelete( std::vector< Substitution * > * p_pDst,
  *   instantiated.
  *  \param p_pSub IN The partial Substitution of which this will find 
  *   extensions.
- *  \param p_pAtom IN A smart pointer to a predicate that is in this State and
- *   has the same predicate symbol and arity as the current formula.
+ *  \param p_Atom IN An atom that is in this State and has the same predicate
+ *   symbol and arity as the current formula.
  *  \param p_vRelVars IN A list of variables of which we actually care about
  *   all possible substitutions.
  *  \param p_vRet OUT A list of Substitutions that make all formulas in the
@@ -280,7 +690,7 @@ void CopyVectorsAndDelete( std::vector< Substitution * > * p_pDst,
  */
 void State::GetInstantiationsDoublePredicate( const FormulaPVec & p_pPrecs,
 					      const Substitution * p_pSub,
-					      const FormulaPredP & p_pAtom,
+					      const GroundAtom & p_Atom,
 					      const std::set< TermVariableP > & p_vRelVars,
 					      std::vector< Substitution * > & p_vRet ) const
 {
@@ -288,13 +698,13 @@ void State::GetInstantiationsDoublePredicate( const FormulaPVec & p_pPrecs,
   Substitution l_NewSubs( *p_pSub );
   std::set< TermVariableP > l_vNewRelVars( p_vRelVars );
   bool l_bBad = false;
-  for( unsigned int l_iParam = 0; l_iParam < p_pAtom->GetValence() && !l_bBad; l_iParam++ )
+  for( unsigned int l_iParam = 0; l_iParam < p_Atom.GetValence() && !l_bBad; l_iParam++ )
   {
-    TermP l_pAtomParam = p_pAtom->GetCParam( l_iParam );
+    unsigned int l_iAtomParam = p_Atom.GetArgId( l_iParam );
     TermP l_pConjParam = p_pCurConj->GetCParam( l_iParam );
     if( l_pConjParam->GetType() == TT_CONSTANT )
     {
-      if( !( *l_pConjParam == *l_pAtomParam ) )
+      if( l_pConjParam->GetId() != l_iAtomParam )
 	l_bBad = true;
     }
     else
@@ -302,11 +712,12 @@ void State::GetInstantiationsDoublePredicate( const FormulaPVec & p_pPrecs,
       SubMap::const_iterator l_iConjSubsIndex = l_NewSubs.FindIndexByVar( std::tr1::dynamic_pointer_cast< TermVariable >( l_pConjParam ) );
       if( l_iConjSubsIndex != l_NewSubs.End() )
       {
-	if( !( *l_pAtomParam == *l_iConjSubsIndex->second ) )
+	if( l_iConjSubsIndex->second->GetId() != l_iAtomParam )
 	  l_bBad = true;
       }
       else
       {
+	const TermP & l_pAtomParam = p_Atom.GetCParam( l_iParam );
 	if( ( l_pConjParam->HasTyping() && !l_pAtomParam->HasTyping() )
 	    || ( !l_pConjParam->HasTyping() && l_pAtomParam->HasTyping() ) )
 	  throw Exception( E_NOT_IMPLEMENTED,
@@ -350,21 +761,19 @@ std::vector< Substitution * > *
 {
   FormulaPredP p_pCurConj = std::tr1::dynamic_pointer_cast< FormulaPred >( p_pPrecs[0] );
   std::vector<Substitution *> * l_pRet = new std::vector<Substitution *>;
-  for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
+  const std::vector< unsigned int > * l_pList;
+  const AtomRow * l_pRow = FindCandidates( *p_pCurConj, l_pList );
+  if( l_pRow == NULL )
+    return l_pRet;
+
+  unsigned int l_iNumCandidates = l_pList == NULL ? l_pRow->m_vAtoms.size() : l_pList->size();
+  for( unsigned int j = 0; j < l_iNumCandidates; j++ )
   {
-    if( PredRelationsAreEqual( *m_vAtoms[i][0], *p_pCurConj ) )
-    {
-      for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
-      {
-	GetInstantiationsDoublePredicate( p_pPrecs,
-					  p_pSub,
-					  m_vAtoms[i][j],
-					  p_vRelVars,
-					  *l_pRet );
-	if( l_pRet->size() > 0 && p_vRelVars.size() == 0 )
-	  break;
-      }
-    }
+    GetInstantiationsDoublePredicate( p_pPrecs,
+				      p_pSub,
+				      l_pRow->m_vAtoms[l_pList == NULL ? j : (*l_pList)[j]],
+				      p_vRelVars,
+				      *l_pRet );
     if( l_pRet->size() > 0 && p_vRelVars.size() == 0 )
       break;
   }
@@ -588,6 +997,17 @@ std::vector< Substitution * > *
  */
 struct FormulaPMostSpecified
 {
+  /**
+   *  Construct a functor that orders formulas by their instances in a State.
+   *  Each call to GetInstantiations makes its own, so that different threads
+   *   may search different States at the same time.
+   *  \param p_pState IN The State in which to count instances.
+   */
+  FormulaPMostSpecified( const State * p_pState )
+    : m_pState( p_pState )
+  {
+  }
+
   /**
    *  Determine if the first formula is more specified than the second.
    *  What this means is that the first should have fewer possible
@@ -618,44 +1038,7 @@ struct FormulaPMostSpecified
       const FormulaPredP & p_pPred1 = std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm1 );
       const FormulaPredP & p_pPred2 = std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm2 );
 
-      unsigned int l_iNumInstances1 = 0;
-      unsigned int l_iNumInstances2 = 0;
-      for( unsigned int i = 0; i < m_pAtoms->size(); i++ )
-      {
-	if( p_pPred1->GetRelationIndex() == m_pAtoms->at(i)[0]->GetRelationIndex() )
-	{
-	  for( unsigned int j = 0; j < m_pAtoms->at(i).size(); j++ )
-	  {
-	    bool l_bReject = false;
-	    for( unsigned int k = 0; k < p_pPred1->GetValence() && !l_bReject; k++ )
-	    {
-	      if( p_pPred1->GetCParam( k )->GetType() == TT_CONSTANT &&
-		  !p_pPred1->GetCParam( k )->Equal( *m_pAtoms->at(i)[j]->GetCParam( k ) ) )
-		l_bReject = true;
-	    }
-	    if( !l_bReject )
-	      l_iNumInstances1++;
-	  }
-	}
-
-	if( p_pPred2->GetRelationIndex() == m_pAtoms->at(i)[0]->GetRelationIndex() )
-	{
-	  for( unsigned int j = 0; j < m_pAtoms->at(i).size(); j++ )
-	  {
-	    bool l_bReject = false;
-	    for( unsigned int k = 0; k < p_pPred2->GetValence() && !l_bReject; k++ )
-	    {
-	      if( p_pPred2->GetCParam( k )->GetType() == TT_CONSTANT &&
-		  !p_pPred2->GetCParam( k )->Equal( *m_pAtoms->at(i)[j]->GetCParam( k ) ) )
-		l_bReject = true;
-	    }
-	    if( !l_bReject )
-	      l_iNumInstances2++;
-	  }
-	}
-      }
-
-      return ( l_iNumInstances1 < l_iNumInstances2 );
+      return ( CountInstances( p_pPred1 ) < CountInstances( p_pPred2 ) );
 
     }
 
@@ -674,8 +1057,42 @@ struct FormulaPMostSpecified
       return true;
     return false;
   }
-  const std::vector< std::vector< FormulaPredP > > * m_pAtoms;
-} asdf;
+
+  /**
+   *  Count the atoms in the State that agree with a predicate on all of its
+   *   constant parameters.
+   *  \param p_pPred IN The predicate whose possible instances to count.
+   *  \return The number of atoms with which p_pPred might unify.
+   */
+  unsigned int CountInstances( const FormulaPredP & p_pPred ) const
+  {
+    unsigned int l_iNumInstances = 0;
+    const std::vector< unsigned int > * l_pList;
+    const AtomRow * l_pRow = m_pState->FindCandidates( *p_pPred, l_pList );
+    if( l_pRow == NULL )
+      return 0;
+    unsigned int l_iNumCandidates = l_pList == NULL ? l_pRow->m_vAtoms.size() : l_pList->size();
+    for( unsigned int j = 0; j < l_iNumCandidates; j++ )
+    {
+      const GroundAtom & l_Atom = l_pRow->m_vAtoms[l_pList == NULL ? j : (*l_pList)[j]];
+      bool l_bReject = false;
+      for( unsigned int k = 0; k < p_pPred->GetValence() && !l_bReject; k++ )
+      {
+	if( p_pPred->GetCParam( k )->GetType() == TT_CONSTANT &&
+	    p_pPred->GetCParam( k )->GetId() != l_Atom.GetArgId( k ) )
+	  l_bReject = true;
+      }
+      if( !l_bReject )
+	l_iNumInstances++;
+    }
+    return l_iNumInstances;
+  }
+
+  /**
+   *  The State in which to count instances.
+   */
+  const State * m_pState;
+};
 
 /**
  *  Retrieve a list of Substitutions that make a vector of formulas hold in 
@@ -721,8 +1138,7 @@ std::vector<Substitution *> * State::GetInstantiations( const FormulaPVec & p_pP
     return l_pRet;
   }
 
-  asdf.m_pAtoms = &m_vAtoms;
-  std::sort< FormulaPVecI, FormulaPMostSpecified >( l_vNew.begin(), l_vNew.end(), asdf );
+  std::sort< FormulaPVecI, FormulaPMostSpecified >( l_vNew.begin(), l_vNew.end(), FormulaPMostSpecified( this ) );
 
   switch( l_vNew[0]->GetType() )
   {
@@ -790,7 +1206,7 @@ std::vector<Substitution *> * State::GetInstantiations( const Operator * p_pOp,
       l_vRelVars.insert( std::tr1::dynamic_pointer_cast< TermVariable >( p_pOp->GetCHead()->GetCParam( i ) ) );
     }
   }
-  return GetInstantiations( p_pOp->GetCHead(), p_pOp->GetCPreconditions(), p_pSub, l_vRelVars );
+  return GetInstantiations( p_pOp->GetCHead(), p_pOp->GetCPreconditions(), p_pSub, l_vRelVars, p_pOp->GetCPlan() );
 }
 
 /**
@@ -805,13 +1221,16 @@ std::vector<Substitution *> * State::GetInstantiations( const Operator * p_pOp,
  *   extensions.
  *  \param p_vRelVars IN A list of variables for which we actually want every
  *   posible replacement.
+ *  \param p_pPlan IN A pointer to the preconditions compiled into a
+ *   UnifyPlan, or NULL if they have not been.
  *  \return A list of Substitutions that make the head and preconditions ground
  *   and applicable to this State.
  */
 std::vector<Substitution *> * State::GetInstantiations( const FormulaPredP & p_pHead,
 							const FormulaConjP & p_pPrecs,
 							const Substitution * p_pSub,
-							const std::set< TermVariableP > & p_vRelVars ) const
+							const std::set< TermVariableP > & p_vRelVars,
+							const UnifyPlan * p_pPlan ) const
 {
   std::vector< Substitution * > * l_pRet = new std::vector< Substitution * >;
   std::vector< TermConstantP > l_vConsts = GetConstants();
@@ -875,7 +1294,7 @@ std::vector<Substitution *> * State::GetInstantiations( const FormulaPredP & p_p
 	   i != l_pOldSubs->End();
 	   i++ )
 	l_vNewRelVars.erase( (*i).first );
-      std::vector< Substitution * > * l_pTemp = GetInstantiations( p_pPrecs, l_pOldSubs, l_vNewRelVars );
+      std::vector< Substitution * > * l_pTemp = p_pPlan == NULL ? GetInstantiations( p_pPrecs, l_pOldSubs, l_vNewRelVars ) : GetInstantiations( *p_pPlan, l_pOldSubs, l_vNewRelVars );
       delete l_pOldSubs;
       for( unsigned int i = 0; i < l_pTemp->size(); i++ )
 	l_pRet->push_back( l_pTemp->at( i ) );
@@ -886,6 +1305,34 @@ std::vector<Substitution *> * State::GetInstantiations( const FormulaPredP & p_p
   return l_pRet;
 }
 
+/**
+ *  Retrieve a list of Substitutions that make compiled preconditions hold in
+ *   this State.
+ *  This gives exactly the same list as calling GetInstantiations() with the
+ *   conjunction from which the plan was compiled, but without building a
+ *   Formula or Substitution for each partial match.  A caller that may not
+ *   need them all should use an InstantiationCursor directly.
+ *  \param p_Plan IN The compiled preconditions.
+ *  \param p_pSub IN The partial Substitution of which this will find 
+ *   extensions.
+ *  \param p_vRelVars IN A list of those variables for which we actually want
+ *   all possible replacements.
+ *  \return A list of Substitutions that make the preconditions ground and
+ *   satisfied in this State.
+ */
+std::vector<Substitution *> * State::GetInstantiations( const UnifyPlan & p_Plan,
+							const Substitution * p_pSub,
+							const std::set< TermVariableP > & p_vRelVars ) const
+{
+  InstantiationCursor l_Cursor( this, p_Plan, p_pSub, p_vRelVars );
+  std::vector< Substitution * > * l_pRet = new std::vector< Substitution * >;
+  Substitution * l_pNext;
+  while( ( l_pNext = l_Cursor.Next() ) != NULL )
+    l_pRet->push_back( l_pNext );
+  return l_pRet;
+}
+
+
 /**
  *  Determine whether or not a given Formula holds in this State.
  *  \param p_pForm IN A smart pointer to the Formula that might hold.
@@ -899,21 +1346,11 @@ bool State::IsConsistent( const FormulaP & p_pForm ) const
   switch( p_pForm->GetType() )
   {
   case FT_PRED:
-    // A predicate holds if it appears in the list of atoms.
+    // A predicate holds if it appears in the set of atoms.
   {
-    for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
-    {
-      if( PredRelationsAreEqual( *m_vAtoms[i][0], *std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm ) ) )
-      {
-	for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
-	{
-	  if( *m_vAtoms[i][j] == *std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm ) )
-	    return true;
-	}
-	return false;
-      }
-    }
-    return false;
+    GroundAtom l_Atom( *static_cast< const FormulaPred * >( p_pForm.get() ) );
+    const AtomRow * l_pRow = FindRow( l_Atom.GetRelationIndex() );
+    return l_pRow != NULL && l_pRow->Find( l_Atom ) >= 0;
   }
   case FT_EQU:
     // An equality holds if the two parameters are equal.
@@ -981,25 +1418,24 @@ bool State::CouldBeConsistent( const FormulaP & p_pForm ) const
       return IsConsistent( p_pForm );
     else
     {
-      for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
+      FormulaPredP l_pPred = std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm );
+      const std::vector< unsigned int > * l_pList;
+      const AtomRow * l_pRow = FindCandidates( *l_pPred, l_pList );
+      if( l_pRow == NULL )
+	return false;
+      unsigned int l_iNumCandidates = l_pList == NULL ? l_pRow->m_vAtoms.size() : l_pList->size();
+      for( unsigned int j = 0; j < l_iNumCandidates; j++ )
       {
-	if( PredRelationsAreEqual( *m_vAtoms[i][0], *std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm ) ) )
+	const GroundAtom & l_Atom = l_pRow->m_vAtoms[l_pList == NULL ? j : (*l_pList)[j]];
+	bool l_bOk = true;
+	for( unsigned int k = 0; k < l_pPred->GetValence() && l_bOk; k++ )
 	{
-	  for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
-	  {
-	    bool l_bOk = true;
-	    for( unsigned int k = 0; k < std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm )->GetValence() && l_bOk; k++ )
-	    {
-	      if( std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm )->GetCParam( k )->GetType() == TT_CONSTANT &&
-		  m_vAtoms[i][j]->GetCParam( k )->GetType() == TT_CONSTANT &&
-		  !std::tr1::dynamic_pointer_cast< FormulaPred >( p_pForm )->GetCParam( k )->Equal( *m_vAtoms[i][j]->GetCParam( k ) ) )
-		l_bOk = false;
-	    }
-	    if( l_bOk )
-	      return true;
-	  }
-	  return false;
+	  if( l_pPred->GetCParam( k )->GetType() == TT_CONSTANT &&
+	      l_pPred->GetCParam( k )->GetId() != l_Atom.GetArgId( k ) )
+	    l_bOk = false;
 	}
+	if( l_bOk )
+	  return true;
       }
       return false;
     }
@@ -1082,7 +1518,7 @@ State * State::NextState( const Operator * p_pOp, const Substitution * p_pSub )
   FormulaP l_pEffNoVars( p_pOp->GetCEffects()->AfterSubstitution( *p_pSub, 0 ) );
 
   l_pNext->ApplyEffects( l_pEffNoVars );
-  std::sort( l_pNext->m_vAtoms.begin(), l_pNext->m_vAtoms.end(), g_AtomsComparer );
+  l_pNext->SortAtoms();
 
   return l_pNext;
 }
@@ -1104,31 +1540,8 @@ void State::ApplyEffects( const FormulaP & p_pEff )
   switch( p_pEff->GetType() )
   {
   case FT_PRED:
-    {
-      bool l_bFoundRow = false;
-      for( unsigned int i = 0; i < m_vAtoms.size() && !l_bFoundRow; i++ )
-      {
-	if( PredRelationsAreEqual( *m_vAtoms[i][0], *std::tr1::dynamic_pointer_cast< FormulaPred >( p_pEff ) ) )
-	{
-	  l_bFoundRow = true;
-	  bool l_bFoundCol = false;
-	  for( unsigned int j = 0; j < m_vAtoms[i].size() && !l_bFoundCol; j++ )
-	  {
-	    if( *m_vAtoms[i][j] == *p_pEff )
-	      l_bFoundCol = true;
-	  }
-	  if( !l_bFoundCol )
-	    m_vAtoms[i].push_back( std::tr1::dynamic_pointer_cast< FormulaPred >( p_pEff ) );
-	}
-      }
-      if( !l_bFoundRow )
-      {
-	std::vector< FormulaPredP > l_vNew;
-	l_vNew.push_back( std::tr1::dynamic_pointer_cast< FormulaPred >( p_pEff ) );
-	m_vAtoms.push_back( l_vNew );
-      }
-      break;
-    }
+    AddAtom( GroundAtom( *static_cast< const FormulaPred * >( p_pEff.get() ) ) );
+    break;
   case FT_NEG:
     {
       if( std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pEff )->GetCNegForm()->GetType() != FT_PRED )
@@ -1137,26 +1550,7 @@ void State::ApplyEffects( const FormulaP & p_pEff )
 			 __FILE__,
 			 __LINE__ );
 
-      bool l_bFoundRow = false;
-      for( unsigned int i = 0; i < m_vAtoms.size() && !l_bFoundRow; i++ )
-      {
-	if( PredRelationsAreEqual( *m_vAtoms[i][0], 
-				   *std::tr1::dynamic_pointer_cast< FormulaPred >( std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pEff )->GetCNegForm() ) ) )
-	{
-	  l_bFoundRow = true;
-	  bool l_bFoundCol = false;
-	  for( unsigned int j = 0; j < m_vAtoms[i].size() && !l_bFoundCol; j++ )
-	  {
-	    if( *m_vAtoms[i][j] == *std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pEff )->GetCNegForm() )
-	    {
-	      l_bFoundCol = true;
-	      m_vAtoms[i].erase( m_vAtoms[i].begin() + j );
-	    }
-	  }
-	  if( m_vAtoms[i].empty() )
-	    m_vAtoms.erase( m_vAtoms.begin() + i );
-	}
-      }
+      RemoveAtom( GroundAtom( *static_cast< const FormulaPred * >( std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pEff )->GetCNegForm().get() ) ) );
       break;
     }
   case FT_CONJ:
@@ -1202,17 +1596,17 @@ bool State::Equal( const State & p_Other ) const
     return false;
   for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
   {
-    if( m_vAtoms[i].size() != p_Other.m_vAtoms[i].size() )
+    const AtomRow * l_pRow = m_vAtoms[i].get();
+    const AtomRow * l_pOtherRow = p_Other.FindRow( l_pRow->m_iRelation );
+    if( l_pOtherRow == NULL )
       return false;
-    for( unsigned int k = 0; k < m_vAtoms[i].size(); k++ )
+    if( l_pRow == l_pOtherRow )
+      continue;
+    if( l_pRow->m_vAtoms.size() != l_pOtherRow->m_vAtoms.size() )
+      return false;
+    for( unsigned int j = 0; j < l_pRow->m_vAtoms.size(); j++ )
     {
-      bool l_bFoundCol = false;
-      for( unsigned int l = 0; l < p_Other.m_vAtoms[i].size() && !l_bFoundCol; l++ )
-      {
-	if( *m_vAtoms[i][k] == *p_Other.m_vAtoms[i][l] )
-	  l_bFoundCol = true;
-      }
-      if( !l_bFoundCol )
+      if( l_pOtherRow->Find( l_pRow->m_vAtoms[j] ) < 0 )
 	return false;
     }
   }
@@ -1222,6 +1616,28 @@ bool State::Equal( const State & p_Other ) const
   return true;
 }
 
+/**
+ *  Retrieve a hash of the atoms of this State, which does not depend on the
+ *   order in which they were added.
+ *  Equal states have equal hashes, and the hash takes no time to compute.
+ *  \return A hash of the atoms of this State.
+ */
+uint64_t State::GetHash() const
+{
+  return m_iHash;
+}
+
+/**
+ *  Retrieve a second hash of the atoms of this State, which is computed
+ *   independently of State::GetHash() and also does not depend on order.
+ *  It confirms that two states with the same hash are in fact the same.
+ *  \return A second hash of the atoms of this State.
+ */
+uint64_t State::GetCheckHash() const
+{
+  return m_iCheckHash;
+}
+
 /**
  *  Retrieve a list of constants that appear in the atoms of this State.
  *  This will only be calculated the first time it is called, unless the state
@@ -1232,21 +1648,19 @@ std::vector< TermConstantP > State::GetConstants() const
 {
   if( m_vConstants.size() == 0 )
   {
+    std::vector< bool > l_vFound( g_TermTable.GetNumIds(), false );
     for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
     {
-      for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
+      for( unsigned int j = 0; j < m_vAtoms[i]->m_vAtoms.size(); j++ )
       {
-	std::vector< TermConstantP > l_vTemp = m_vAtoms[i][j]->GetConstants();
-	for( unsigned int k = 0; k < l_vTemp.size(); k++ )
+	const GroundAtom & l_Atom = m_vAtoms[i]->m_vAtoms[j];
+	for( unsigned int k = 0; k < l_Atom.GetValence(); k++ )
 	{
-	  bool l_bFound = false;
-	  for( unsigned int l = 0; l < m_vConstants.size() && !l_bFound; l++ )
+	  if( !l_vFound[l_Atom.GetArgId( k )] )
 	  {
-	    if( *m_vConstants[l] == *l_vTemp[k] )
-	      l_bFound = true;
+	    l_vFound[l_Atom.GetArgId( k )] = true;
+	    m_vConstants.push_back( std::tr1::dynamic_pointer_cast< TermConstant >( l_Atom.GetCParam( k ) ) );
 	  }
-	  if( !l_bFound )
-	    m_vConstants.push_back( l_vTemp[k] );
 	}
       }
     }
@@ -1254,6 +1668,19 @@ std::vector< TermConstantP > State::GetConstants() const
   return m_vConstants;
 }
 
+/**
+ *  Retrieve a list of the atoms that hold in this State.
+ *  They are in the same order as in State::ToStr().
+ *  \return A list of the atoms that hold in this State.
+ */
+std::vector< GroundAtom > State::GetAtoms() const
+{
+  std::vector< GroundAtom > l_vRet;
+  for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
+    l_vRet.insert( l_vRet.end(), m_vAtoms[i]->m_vAtoms.begin(), m_vAtoms[i]->m_vAtoms.end() );
+  return l_vRet;
+}
+
 /**
  *  Retrieve a string containing a textual representation of this State.
  *  \return A string containing a textual representation of this State.
@@ -1264,9 +1691,9 @@ std::string State::ToStr() const
 
   for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
   {
-    for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
+    for( unsigned int j = 0; j < m_vAtoms[i]->m_vAtoms.size(); j++ )
     {
-      l_sRet += m_vAtoms[i][j]->ToStr();
+      l_sRet += m_vAtoms[i]->m_vAtoms[j].ToStr();
       l_sRet += " ";
     }
   }
@@ -1285,9 +1712,9 @@ std::string State::ToPddl() const
 
   for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
   {
-    for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
+    for( unsigned int j = 0; j < m_vAtoms[i]->m_vAtoms.size(); j++ )
     {
-      l_sRet += "    " + m_vAtoms[i][j]->ToStr() + "\n";
+      l_sRet += "    " + m_vAtoms[i]->m_vAtoms[j].ToStr() + "\n";
     }
   }
 
@@ -1308,21 +1735,42 @@ bool operator==( const State & p_First, const State & p_Second )
 
 size_t State::GetMemSizeMin() const
 {
-  size_t l_iSize = sizeof( State ) + m_vAtoms.capacity() * sizeof( std::vector< FormulaPredP > ) + m_vConstants.capacity() * sizeof( TermConstantP );
+  size_t l_iSize = sizeof( State ) + m_vAtoms.capacity() * sizeof( AtomRowP ) + m_vConstants.capacity() * sizeof( TermConstantP ) + m_mRows.bucket_count() * sizeof( void * ) + m_mRows.size() * ( 2 * sizeof( unsigned int ) + sizeof( void * ) );
   for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
   {
-    l_iSize += m_vAtoms[i].capacity() * sizeof( FormulaPredP );
+    const AtomRow * l_pRow = m_vAtoms[i].get();
+    l_iSize += sizeof( AtomRow ) + l_pRow->m_vAtoms.capacity() * sizeof( GroundAtom ) + l_pRow->m_vSlots.capacity() * sizeof( unsigned int ) + l_pRow->m_mArgs.bucket_count() * sizeof( void * );
+    for( AtomArgMap::const_iterator j = l_pRow->m_mArgs.begin(); j != l_pRow->m_mArgs.end(); j++ )
+      l_iSize += sizeof( AtomArgKey ) + sizeof( std::vector< unsigned int > ) + sizeof( void * ) + j->second.capacity() * sizeof( unsigned int );
   }
   return l_iSize;
 }
 
 size_t State::GetMemSizeMax() const
 {
-  size_t l_iSize = GetMemSizeMin();
-  for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
-  {
-    for( unsigned int j = 0; j < m_vAtoms[i].size(); j++ )
-      l_iSize += m_vAtoms[i][j]->GetMemSizeMax();
-  }
-  return l_iSize;
+  return GetMemSizeMin();
+}
+
+/**
+ *  Hash an AtomArgKey.
+ *  \param x IN The AtomArgKey to hash.
+ *  \return A hash value for x.
+ */
+size_t HashAtomArgKey::operator() ( const AtomArgKey & x ) const
+{
+  size_t l_iHash = x.m_iTermId;
+  l_iHash = ( l_iHash << 3 ) + x.m_iPosition;
+  return l_iHash;
+}
+
+/**
+ *  Determine whether or not two AtomArgKeys are equal.
+ *  \param x IN The first AtomArgKey.
+ *  \param y IN The second AtomArgKey.
+ *  \return Whether or not x and y are equal.
+ */
+bool EqualAtomArgKey::operator() ( const AtomArgKey & x, const AtomArgKey & y ) const
+{
+  return x.m_iPosition == y.m_iPosition &&
+    x.m_iTermId == y.m_iTermId;
 }
@@ -1,6 +1,44 @@
 #ifndef STATE_HPP__
 #define STATE_HPP__
 
+#include <stdint.h>
+#include <tr1/unordered_map>
+
+typedef std::tr1::unordered_map< unsigned int, unsigned int > AtomRowMap;
+
+struct AtomArgKey
+{
+  unsigned int m_iPosition;
+  unsigned int m_iTermId;
+};
+
+struct HashAtomArgKey
+{
+  size_t operator() ( const AtomArgKey & x ) const;
+};
+
+struct EqualAtomArgKey
+{
+  bool operator() ( const AtomArgKey & x, const AtomArgKey & y ) const;
+};
+
+typedef std::tr1::unordered_map< AtomArgKey, std::vector< unsigned int >, HashAtomArgKey, EqualAtomArgKey > AtomArgMap;
+
+struct AtomRow
+{
+  int Find( const GroundAtom & p_Atom ) const;
+  void Add( const GroundAtom & p_Atom );
+  void Remove( unsigned int p_iIndex );
+  void Rehash();
+
+  unsigned int m_iRelation;
+  std::vector< GroundAtom > m_vAtoms;
+  std::vector< unsigned int > m_vSlots;
+  AtomArgMap m_mArgs;
+};
+
+typedef std::tr1::shared_ptr< AtomRow > AtomRowP;
+
 class State
 {
 public:
@@ -15,6 +53,9 @@ public:
 	 const TypeTable & p_TypeTable,
 	 const std::vector< FormulaPred > & p_vAllowablePredicates );
 
+  State( const std::vector< GroundAtom > & p_vAtoms,
+	 unsigned int p_iStateNum );
+
   State( const State & p_Other );
 
   virtual ~State();
@@ -25,8 +66,13 @@ public:
 
   bool Equal( const State & p_Other ) const;
 
+  uint64_t GetHash() const;
+  uint64_t GetCheckHash() const;
+
   std::vector< TermConstantP > GetConstants() const;
 
+  std::vector< GroundAtom > GetAtoms() const;
+
   std::string ToStr() const;
   std::string ToPddl() const;
 
@@ -38,13 +84,18 @@ public:
 						   const Substitution * p_pSub,
 						   const std::set< TermVariableP > & p_vRelVars ) const;
 
+  std::vector<Substitution *> * GetInstantiations( const UnifyPlan & p_Plan,
+						   const Substitution * p_pSub,
+						   const std::set< TermVariableP > & p_vRelVars ) const;
+
   std::vector<Substitution *> * GetInstantiations( const Operator * p_pOp,
 						   const Substitution * p_pSub ) const;
 
   std::vector<Substitution *> * GetInstantiations( const FormulaPredP & p_pHead,
 						   const FormulaConjP & p_pPrecs,
 						   const Substitution * p_pSub,
-						   const std::set< TermVariableP > & p_vRelVars ) const;
+						   const std::set< TermVariableP > & p_vRelVars,
+						   const UnifyPlan * p_pPlan = NULL ) const;
 
   bool IsConsistent( const FormulaP & p_pForm ) const;
 
@@ -58,6 +109,21 @@ public:
 private:
   void ApplyEffects( const FormulaP & p_pEff );
 
+  void AddAtom( const GroundAtom & p_Atom );
+  void RemoveAtom( const GroundAtom & p_Atom );
+
+  void SortAtoms();
+
+  AtomRow * GetMutableRow( unsigned int p_iRow );
+
+  const AtomRow * FindRow( unsigned int p_iRelation ) const;
+  const AtomRow * FindCandidates( const FormulaPred & p_Pred,
+				  const std::vector< unsigned int > *& p_pList ) const;
+  const AtomRow * FindCandidates( unsigned int p_iRelation,
+				  unsigned int p_iValence,
+				  const unsigned int * p_aArgIds,
+				  const std::vector< unsigned int > *& p_pList ) const;
+
   void ConstructorInternal( std::stringstream & p_Stream, 
 			    const TypeTable & p_TypeTable,
 			    const std::vector< FormulaPred > & p_vAllowablePredicates );
@@ -79,16 +145,23 @@ private:
 
   void GetInstantiationsDoublePredicate( const FormulaPVec & p_pPrecs,
 					 const Substitution * p_pSub,
-					 const FormulaPredP & p_pAtom,
+					 const GroundAtom & p_Atom,
 					 const std::set< TermVariableP > & p_vRelVars,
 					 std::vector< Substitution * > & p_vRet ) const;
 
+  std::vector< AtomRowP > m_vAtoms;
 
-  std::vector< std::vector< FormulaPredP > > m_vAtoms;
+  AtomRowMap m_mRows;
 
   mutable std::vector< TermConstantP > m_vConstants;
 
   int m_iStateNum;
+
+  uint64_t m_iHash;
+  uint64_t m_iCheckHash;
+
+  friend struct FormulaPMostSpecified;
+  friend class InstantiationCursor;
 };
 
 bool operator==( const State & p_First, const State & p_Second );
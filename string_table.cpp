@@ -1,6 +1,7 @@
 #include <string>
 #include <vector>
 #include <tr1/unordered_map>
+#include <pthread.h>
 
 #include "exception.hpp"
 #include "funcs.hpp"
@@ -17,19 +18,56 @@
 /** \class StringTable
  *  A hash table of strings to integers.
  *  Using this, string comparisons can be O(1).
+ *  Any number of threads may look up strings at once.  Looking up an integer
+ *   never waits, and looking up a string only waits for a thread inserting a
+ *   new string into the same shard.
  */
 
-/** \var StringTable::m_mIntLookup
- *  A hashmap from strings to integers.
+/** \class StringShard
+ *  One of the independently locked parts of a StringTable.
+ */
+
+/** \var StringShard::m_Lock
+ *  A lock that must be held for reading to search m_mIntLookup, and for
+ *   writing to insert into it.
+ */
+
+/** \var StringShard::m_mIntLookup
+ *  A hashmap from strings to integers, for those strings whose hash selects
+ *   this shard.
  *  This is so looking up based on a string is amortized O(1).
- *  The integers are the indexes of the strings in StringTable::m_vStrLookup.
+ *  The integers are indexes into StringTable::m_apStrChunks.
+ */
+
+/** \var StringTable::m_aShards
+ *  The hashmaps from strings to integers, split by the hash of the string so
+ *   that threads looking up different strings rarely wait on the same lock.
  */
 
-/** \var StringTable::m_vStrLookup
- *  A vector of strings.
+/** \var StringTable::m_apStrChunks
+ *  The strings, indexed by their integers.
  *  This is so looking up based on an integer is O(1).
- *  Indexes in this vector match the integers in StringTable::m_mIntLookup.
+ *  Chunk i holds 2^(STR_TABLE_CHUNK_BITS + i) strings and is only allocated
+ *   when needed.  Once stored, a string never moves, so that it may be read
+ *   without a lock while other threads are adding to the table.
+ */
+
+/** \var StringTable::m_iNumStrs
+ *  The number of strings that have been stored in m_apStrChunks.
+ *  This is only written while holding m_InsertMutex, and only after the
+ *   string with the new highest index is in place.
+ */
+
+/** \var StringTable::m_InsertMutex
+ *  A lock that must be held while assigning a new integer.
+ *  This keeps the integers dense and in the order that strings were first
+ *   inserted, which is the same as in a single-threaded program.
+ */
+
+/**
+ *  The one and only string hasher, defined in funcs.cpp.
  */
+extern HashStr g_StrHasher;
 
 /**
  *  The single global StringTable that should be used in a running instance of
@@ -37,39 +75,119 @@
  */
 StringTable g_StrTable;
 
+/**
+ *  Construct an empty StringTable.
+ */
+StringTable::StringTable()
+{
+  for( unsigned int i = 0; i < STR_TABLE_SHARDS; i++ )
+    pthread_rwlock_init( &m_aShards[i].m_Lock, NULL );
+  for( unsigned int i = 0; i < STR_TABLE_MAX_CHUNKS; i++ )
+    m_apStrChunks[i] = NULL;
+  m_iNumStrs = 0;
+  pthread_mutex_init( &m_InsertMutex, NULL );
+}
+
+/**
+ *  Destructor.
+ */
+StringTable::~StringTable()
+{
+  for( unsigned int i = 0; i < STR_TABLE_SHARDS; i++ )
+    pthread_rwlock_destroy( &m_aShards[i].m_Lock );
+  for( unsigned int i = 0; i < STR_TABLE_MAX_CHUNKS; i++ )
+    delete [] m_apStrChunks[i];
+  pthread_mutex_destroy( &m_InsertMutex );
+}
+
+/**
+ *  Find the storage for the string with a given integer.
+ *  Chunk i begins at index 2^STR_TABLE_CHUNK_BITS * ( 2^i - 1 ).
+ *  \param p_iKey IN The integer of a string.
+ *  \return A reference to where that string is or will be stored.
+ */
+std::string & StringTable::StrAt( unsigned int p_iKey ) const
+{
+  unsigned int l_iBlock = ( p_iKey >> STR_TABLE_CHUNK_BITS ) + 1;
+  unsigned int l_iChunk = 0;
+  while( l_iBlock >> ( l_iChunk + 1 ) )
+    l_iChunk++;
+  unsigned int l_iOffset = p_iKey - ( ( ( 1 << l_iChunk ) - 1 ) << STR_TABLE_CHUNK_BITS );
+  return m_apStrChunks[l_iChunk][l_iOffset];
+}
+
 /**
  *  Lookup a string in the hash table, returning an auto-incremented ID.
  *  Inserts the string into the table if it does not currently exist there.
+ *  This is safe to call from multiple threads at once.
  *  \param l_sKey IN The string to lookup and possibly add.
  *  \return The ID associated with the input string in the table.
  */
 unsigned int StringTable::Lookup( std::string l_sKey )
 {
-  std::tr1::unordered_map< std::string, unsigned int, HashStr, StrEquNoCase >::iterator l_Iter = m_mIntLookup.find( l_sKey );
-  if( l_Iter == m_mIntLookup.end() )
+  StringShard & l_Shard = m_aShards[g_StrHasher( l_sKey ) % STR_TABLE_SHARDS];
+
+  pthread_rwlock_rdlock( &l_Shard.m_Lock );
+  std::tr1::unordered_map< std::string, unsigned int, HashStr, StrEquNoCase >::iterator l_Iter = l_Shard.m_mIntLookup.find( l_sKey );
+  if( l_Iter != l_Shard.m_mIntLookup.end() )
   {
-    std::string l_sUpper;
-    for( unsigned int i = 0; i < l_sKey.size(); i++ )
-      l_sUpper += toupper( l_sKey[i] );
-    m_vStrLookup.push_back( l_sUpper );
-    unsigned int l_iNewInt = m_vStrLookup.size() - 1;
-    m_mIntLookup[l_sUpper] = l_iNewInt;
-    return l_iNewInt;
+    unsigned int l_iRet = (*l_Iter).second;
+    pthread_rwlock_unlock( &l_Shard.m_Lock );
+    return l_iRet;
   }
-  else
-    return (*l_Iter).second;
+  pthread_rwlock_unlock( &l_Shard.m_Lock );
+
+  std::string l_sUpper;
+  for( unsigned int i = 0; i < l_sKey.size(); i++ )
+    l_sUpper += toupper( l_sKey[i] );
+
+  pthread_rwlock_wrlock( &l_Shard.m_Lock );
+  l_Iter = l_Shard.m_mIntLookup.find( l_sKey );
+  if( l_Iter != l_Shard.m_mIntLookup.end() )
+  {
+    unsigned int l_iRet = (*l_Iter).second;
+    pthread_rwlock_unlock( &l_Shard.m_Lock );
+    return l_iRet;
+  }
+
+  pthread_mutex_lock( &m_InsertMutex );
+  unsigned int l_iNewInt = m_iNumStrs;
+  unsigned int l_iChunk = 0;
+  while( ( ( l_iNewInt >> STR_TABLE_CHUNK_BITS ) + 1 ) >> ( l_iChunk + 1 ) )
+    l_iChunk++;
+  if( l_iChunk >= STR_TABLE_MAX_CHUNKS )
+  {
+    pthread_mutex_unlock( &m_InsertMutex );
+    pthread_rwlock_unlock( &l_Shard.m_Lock );
+    throw Exception( E_INDEX_OUT_OF_BOUNDS,
+		     "The string table is full.",
+		     __FILE__,
+		     __LINE__ );
+  }
+  if( m_apStrChunks[l_iChunk] == NULL )
+    m_apStrChunks[l_iChunk] = new std::string[1 << ( STR_TABLE_CHUNK_BITS + l_iChunk )];
+  StrAt( l_iNewInt ) = l_sUpper;
+  __sync_synchronize();
+  m_iNumStrs = l_iNewInt + 1;
+  pthread_mutex_unlock( &m_InsertMutex );
+
+  l_Shard.m_mIntLookup[l_sUpper] = l_iNewInt;
+  pthread_rwlock_unlock( &l_Shard.m_Lock );
+  return l_iNewInt;
 }
 
 /**
  *  Lookup an integer in the vector, returning the associated string.
  *  Throws E_INDEX_OUT_OF_BOUNDS if the integer is not in the table.
+ *  This takes no lock, so it does not slow down threads that are adding to
+ *   the table.
  *  \param l_iKey IN The integer to lookup.
  *  \return The string associated with the input integer.
  */
 std::string StringTable::Lookup( unsigned int l_iKey )
 {
-  if( l_iKey < m_vStrLookup.size() )
-    return m_vStrLookup[ l_iKey ];
+  if( l_iKey < m_iNumStrs )
+    return StrAt( l_iKey );
   else
     throw Exception( E_INDEX_OUT_OF_BOUNDS,
 		     "Bounds error.",
@@ -79,9 +197,18 @@ std::string StringTable::Lookup( unsigned int l_iKey )
 
 size_t StringTable::GetMemSizeMin() const
 {
-  size_t l_iSize = sizeof( StringTable ) + m_vStrLookup.capacity() * sizeof( std::string ) + m_mIntLookup.size() * (sizeof( std::string ) + sizeof( unsigned int ));
-  for( unsigned int i = 0; i < m_vStrLookup.size(); i++ )
-    l_iSize += 2 * m_vStrLookup[i].capacity();
+  size_t l_iSize = sizeof( StringTable );
+  for( unsigned int i = 0; i < STR_TABLE_SHARDS; i++ )
+  {
+    pthread_rwlock_rdlock( &m_aShards[i].m_Lock );
+    l_iSize += m_aShards[i].m_mIntLookup.size() * (sizeof( std::string ) + sizeof( unsigned int ));
+    pthread_rwlock_unlock( &m_aShards[i].m_Lock );
+  }
+  for( unsigned int i = 0; i < STR_TABLE_MAX_CHUNKS && m_apStrChunks[i] != NULL; i++ )
+    l_iSize += ( 1 << ( STR_TABLE_CHUNK_BITS + i ) ) * sizeof( std::string );
+  unsigned int l_iNumStrs = m_iNumStrs;
+  for( unsigned int i = 0; i < l_iNumStrs; i++ )
+    l_iSize += 2 * StrAt( i ).capacity();
   return l_iSize;
 }
 
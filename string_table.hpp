@@ -2,20 +2,30 @@
 #define STRING_TABLE_HPP__
 
 #include <tr1/unordered_map>
+#include <pthread.h>
 
-/* \todo When there are a large number of unique strings that should exist for
- *  only a small amount of time, this can waste a ton of space.  For example,
- *  HTN-Maker creates a large number of temporary variable names, which never
- *  expire.  In one run that was giving me problems, I found that 6,220,384
- *  strings were stored, at a total cost of over 395MB.  I cannot think of any
- *  way to garbage collect, because we do not know when the string is no longer
- *  used.  Perhaps, because we have the TermTable, this data structure is
- *  completely unnecessary.  More testing will be required.
+#define STR_TABLE_SHARDS 16
+#define STR_TABLE_CHUNK_BITS 8
+#define STR_TABLE_MAX_CHUNKS 24
+
+/* Automatically named variables (MakeVarId and friends) are not stored here,
+ *  but as temporary Terms in the TermTable, which are reclaimed once nothing
+ *  refers to them.  This table only holds relation and type names, of which
+ *  there are few.
  */
 
+struct StringShard
+{
+  mutable pthread_rwlock_t m_Lock;
+  std::tr1::unordered_map< std::string, unsigned int, HashStr, StrEquNoCase > m_mIntLookup;
+};
+
 class StringTable
 {
 public:
+  StringTable();
+  virtual ~StringTable();
+
   unsigned int Lookup( std::string l_sKey );
   std::string Lookup( unsigned int l_iKey );
 
@@ -23,8 +33,15 @@ public:
   size_t GetMemSizeMax() const;
 
 private:
-  std::vector< std::string > m_vStrLookup;
-  std::tr1::unordered_map< std::string, unsigned int, HashStr, StrEquNoCase > m_mIntLookup;
+  StringTable( const StringTable & p_Other );
+  StringTable & operator=( const StringTable & p_Other );
+
+  std::string & StrAt( unsigned int p_iKey ) const;
+
+  StringShard m_aShards[STR_TABLE_SHARDS];
+  std::string * m_apStrChunks[STR_TABLE_MAX_CHUNKS];
+  volatile unsigned int m_iNumStrs;
+  pthread_mutex_t m_InsertMutex;
 };
 
 #endif//STRING_TABLE_HPP__
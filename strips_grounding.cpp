@@ -0,0 +1,651 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <tr1/memory>
+#include <tr1/unordered_map>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_variable.hpp"
+#include "term_constant.hpp"
+#include "type_table.hpp"
+#include "substitution.hpp"
+#include "formula.hpp"
+#include "formula_pred.hpp"
+#include "formula_equ.hpp"
+#include "formula_neg.hpp"
+#include "formula_conj.hpp"
+#include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+#include "state.hpp"
+#include "strips_domain.hpp"
+#include "strips_problem.hpp"
+#include "strips_grounding.hpp"
+
+/** \file strips_grounding.hpp
+ *  Declaration of the StripsGrounding class.
+ */
+
+/** \file strips_grounding.cpp
+ *  Definition of the StripsGrounding class.
+ */
+
+/** \def GROUNDING_WORD_BITS
+ *  The number of atoms represented by each word of an AtomBits.
+ */
+
+/** \class StripsGrounding
+ *  A StripsProblem compiled into ground actions over a fixed set of atoms, so
+ *   that a State may be represented as a dense bitset (AtomBits) with one bit
+ *   per atom.
+ *  The atoms and actions are those reachable from the initial state when
+ *   delete effects and negated preconditions are ignored, which includes
+ *   every action that could ever be applied.  Checking whether an action is
+ *   applicable is then a word-wise AND and compare, and applying it is a
+ *   word-wise AND-NOT and OR, with no Substitution or Formula involved.
+ *  An operator parameter that does not appear in the positive preconditions
+ *   may be bound to any object of the problem of the right type, whereas
+ *   State only binds it to a constant in the current State.
+ */
+
+/** \var StripsGrounding::m_pProblem
+ *  A smart pointer to the problem that was grounded.
+ */
+
+/** \var StripsGrounding::m_vAtoms
+ *  Every atom that was reached while grounding, indexed by its bit.
+ */
+
+/** \var StripsGrounding::m_mAtomIndices
+ *  A hashtable from each atom in StripsGrounding::m_vAtoms to its bit.
+ */
+
+/** \var StripsGrounding::m_vOperIndices
+ *  The index in the domain of the operator of each ground action.
+ */
+
+/** \var StripsGrounding::m_vSubstitutions
+ *  The Substitution that grounds the operator of each ground action.
+ *  These are owned by this StripsGrounding.
+ */
+
+/** \var StripsGrounding::m_vOperActions
+ *  For each operator in the domain, the indices of its ground actions in
+ *   the order they were found.
+ */
+
+/** \var StripsGrounding::m_mActionIndices
+ *  A map from the index of an operator followed by the ids of the constants
+ *   bound to its parameters, to the index of that ground action.
+ */
+
+/** \var StripsGrounding::m_iNumWords
+ *  The number of words in each AtomBits.
+ */
+
+/** \var StripsGrounding::m_vMasks
+ *  Four bitsets for each ground action, one after another: the atoms that
+ *   must hold for it to be applicable, the atoms that must not, the atoms
+ *   that it adds and the atoms that it deletes.
+ *  Keeping them in one array means that checking an action touches a single
+ *   contiguous block of memory.
+ */
+
+/** \var StripsGrounding::m_vInitState
+ *  The initial state of the problem.
+ */
+
+/** \var StripsGrounding::m_vGoalPos
+ *  The atoms that must hold in a goal state.
+ */
+
+/** \var StripsGrounding::m_vGoalNeg
+ *  The atoms that must not hold in a goal state.
+ */
+
+/** \var StripsGrounding::m_bGoalsReachable
+ *  False if the goals require an atom that can never hold, or an equality
+ *   that is false.
+ */
+
+/**
+ *  Ground a problem.
+ *  This repeatedly finds every instance of every operator that is applicable
+ *   in the State containing every atom reached so far, ignoring negated
+ *   predicates in the preconditions, then adds the atoms that those
+ *   instances add.  It stops when a pass finds no new instances.
+ *  \param p_pProblem IN A smart pointer to the problem to ground.
+ */
+StripsGrounding::StripsGrounding( const std::tr1::shared_ptr< StripsProblem > & p_pProblem )
+  : m_pProblem( p_pProblem ),
+    m_iNumWords( 0 ),
+    m_bGoalsReachable( true )
+{
+  std::tr1::shared_ptr< StripsDomain > l_pDomain = m_pProblem->GetCDomain();
+  m_vOperActions.resize( l_pDomain->GetNumOpers() );
+
+  std::vector< TermConstantP > l_vConsts = m_pProblem->GetCInitState()->GetConstants();
+  for( TypeTable::const_iterator i = m_pProblem->GetObjectTypes().begin();
+       i != m_pProblem->GetObjectTypes().end();
+       i++ )
+  {
+    TermConstantP l_pConst = std::tr1::dynamic_pointer_cast< TermConstant >( ReadTerm( i->first, m_pProblem->GetObjectTypes() ) );
+    bool l_bFound = false;
+    for( unsigned int j = 0; j < l_vConsts.size() && !l_bFound; j++ )
+      l_bFound = ( l_vConsts[j]->GetId() == l_pConst->GetId() );
+    if( !l_bFound )
+      l_vConsts.push_back( l_pConst );
+  }
+
+  std::vector< FormulaConjP > l_vRelaxedPrecs;
+  std::vector< std::set< TermVariableP > > l_vRelVars( l_pDomain->GetNumOpers() );
+  std::vector< std::vector< TermVariableP > > l_vFreeVars( l_pDomain->GetNumOpers() );
+  for( unsigned int i = 0; i < l_pDomain->GetNumOpers(); i++ )
+  {
+    const Operator * l_pOp = l_pDomain->GetCOper( i );
+    FormulaPVec l_vPrecs;
+    std::vector< TermVariableP > l_vPrecVars;
+    for( FormulaPVecCI j = l_pOp->GetCPreconditions()->GetBeginConj();
+	 j != l_pOp->GetCPreconditions()->GetEndConj();
+	 j++ )
+    {
+      if( ( *j )->GetType() != FT_NEG ||
+	  std::tr1::dynamic_pointer_cast< FormulaNeg >( *j )->GetCNegForm()->GetType() != FT_PRED )
+	l_vPrecs.push_back( *j );
+      if( ( *j )->GetType() != FT_NEG )
+      {
+	std::vector< TermVariableP > l_vVars = ( *j )->GetVariables();
+	l_vPrecVars.insert( l_vPrecVars.end(), l_vVars.begin(), l_vVars.end() );
+      }
+    }
+    l_vRelaxedPrecs.push_back( FormulaConjP( new FormulaConj( l_vPrecs ) ) );
+
+    // Parameters that no positive precondition binds are enumerated over
+    //  every object, and the rest are found by unification.
+    for( unsigned int j = 0; j < l_pOp->GetCHead()->GetValence(); j++ )
+    {
+      if( l_pOp->GetCHead()->GetCParam( j )->GetType() != TT_VARIABLE )
+	continue;
+      TermVariableP l_pVar = std::tr1::dynamic_pointer_cast< TermVariable >( l_pOp->GetCHead()->GetCParam( j ) );
+      bool l_bInPrecs = false;
+      for( unsigned int k = 0; k < l_vPrecVars.size() && !l_bInPrecs; k++ )
+	l_bInPrecs = ( *l_vPrecVars[k] == *l_pVar );
+      if( l_bInPrecs )
+	l_vRelVars[i].insert( l_pVar );
+      else if( std::find( l_vFreeVars[i].begin(), l_vFreeVars[i].end(), l_pVar ) == l_vFreeVars[i].end() )
+	l_vFreeVars[i].push_back( l_pVar );
+    }
+  }
+
+  std::vector< GroundAtom > l_vReached = m_pProblem->GetCInitState()->GetAtoms();
+  std::vector< bool > l_vIsReached;
+  for( unsigned int i = 0; i < l_vReached.size(); i++ )
+  {
+    unsigned int l_iIndex = GetAtomIndex( l_vReached[i] );
+    l_vIsReached.resize( m_vAtoms.size(), false );
+    l_vIsReached[l_iIndex] = true;
+  }
+
+  std::vector< std::vector< unsigned int > > l_vAtomLists;
+  unsigned int l_iOldNumActions;
+  do
+  {
+    l_iOldNumActions = m_vOperIndices.size();
+    State l_Relaxed( l_vReached, 0 );
+
+    for( unsigned int i = 0; i < l_pDomain->GetNumOpers(); i++ )
+    {
+      std::vector< Substitution * > l_vParts( 1, new Substitution() );
+      for( unsigned int j = 0; j < l_vFreeVars[i].size(); j++ )
+      {
+	std::vector< Substitution * > l_vNewParts;
+	for( unsigned int k = 0; k < l_vParts.size(); k++ )
+	{
+	  for( unsigned int l = 0; l < l_vConsts.size(); l++ )
+	  {
+	    if( l_vFreeVars[i][j]->HasTyping() &&
+		( !l_vConsts[l]->HasTyping() ||
+		  CompareNoCase( l_vFreeVars[i][j]->GetTyping(), l_vConsts[l]->GetTyping() ) != 0 ) )
+	      continue;
+	    Substitution * l_pNewSub = new Substitution( *l_vParts[k] );
+	    l_pNewSub->AddPair( l_vFreeVars[i][j], l_vConsts[l] );
+	    l_vNewParts.push_back( l_pNewSub );
+	  }
+	  delete l_vParts[k];
+	}
+	l_vParts = l_vNewParts;
+      }
+
+      for( unsigned int j = 0; j < l_vParts.size(); j++ )
+      {
+	std::vector< Substitution * > * l_pSubs = l_Relaxed.GetInstantiations( l_vRelaxedPrecs[i],
+									     l_vParts[j],
+									     l_vRelVars[i] );
+	for( unsigned int k = 0; k < l_pSubs->size(); k++ )
+	{
+	  if( !AddAction( i, l_pSubs->at( k ), l_vAtomLists ) )
+	    delete l_pSubs->at( k );
+	}
+	delete l_pSubs;
+	delete l_vParts[j];
+      }
+    }
+
+    l_vIsReached.resize( m_vAtoms.size(), false );
+    for( unsigned int i = l_iOldNumActions; i < m_vOperIndices.size(); i++ )
+    {
+      const std::vector< unsigned int > & l_vAdds = l_vAtomLists[4 * i + 2];
+      for( unsigned int j = 0; j < l_vAdds.size(); j++ )
+      {
+	if( !l_vIsReached[l_vAdds[j]] )
+	{
+	  l_vIsReached[l_vAdds[j]] = true;
+	  l_vReached.push_back( m_vAtoms[l_vAdds[j]] );
+	}
+      }
+    }
+  } while( m_vOperIndices.size() > l_iOldNumActions );
+
+  m_iNumWords = m_vAtoms.size() / GROUNDING_WORD_BITS + 1;
+  m_vMasks.assign( 4 * m_iNumWords * m_vOperIndices.size(), 0 );
+  for( unsigned int i = 0; i < l_vAtomLists.size(); i++ )
+    SetBits( l_vAtomLists[i], &m_vMasks[i * m_iNumWords] );
+
+  std::vector< unsigned int > l_vInit;
+  std::vector< GroundAtom > l_vInitAtoms = m_pProblem->GetCInitState()->GetAtoms();
+  for( unsigned int i = 0; i < l_vInitAtoms.size(); i++ )
+    l_vInit.push_back( m_mAtomIndices[l_vInitAtoms[i]] );
+  m_vInitState.assign( m_iNumWords, 0 );
+  SetBits( l_vInit, &m_vInitState[0] );
+
+  m_vGoalPos.assign( m_iNumWords, 0 );
+  m_vGoalNeg.assign( m_iNumWords, 0 );
+  AddGoal( m_pProblem->GetCGoals() );
+}
+
+/**
+ *  Destruct a StripsGrounding.
+ */
+StripsGrounding::~StripsGrounding()
+{
+  for( unsigned int i = 0; i < m_vSubstitutions.size(); i++ )
+    delete m_vSubstitutions[i];
+}
+
+/**
+ *  Retrieve the index of an atom, giving it the next index if it has none.
+ *  \param p_Atom IN The atom.
+ *  \return The index of that atom's bit.
+ */
+unsigned int StripsGrounding::GetAtomIndex( const GroundAtom & p_Atom )
+{
+  std::tr1::unordered_map< GroundAtom, unsigned int, HashGroundAtom, EqualGroundAtom >::iterator l_iFound = m_mAtomIndices.find( p_Atom );
+  if( l_iFound != m_mAtomIndices.end() )
+    return l_iFound->second;
+  m_mAtomIndices[p_Atom] = m_vAtoms.size();
+  m_vAtoms.push_back( p_Atom );
+  return m_vAtoms.size() - 1;
+}
+
+/**
+ *  Construct the key in StripsGrounding::m_mActionIndices for an instance of
+ *   an operator.
+ *  \param p_iOperIndex IN The index of the operator in the domain.
+ *  \param p_pSub IN The Substitution that grounds it.
+ *  \return The index of the operator followed by the ids of the constants
+ *   bound to its parameters.
+ */
+std::vector< unsigned int > StripsGrounding::MakeActionKey( unsigned int p_iOperIndex,
+							    const Substitution * p_pSub ) const
+{
+  const Operator * l_pOp = m_pProblem->GetCDomain()->GetCOper( p_iOperIndex );
+  std::vector< unsigned int > l_vKey;
+  l_vKey.push_back( p_iOperIndex );
+  for( unsigned int i = 0; i < l_pOp->GetNumParams(); i++ )
+    l_vKey.push_back( l_pOp->GetCParam( i )->AfterSubstitution( *p_pSub, 0 )->GetId() );
+  return l_vKey;
+}
+
+/**
+ *  Record a ground action, unless it has already been found.
+ *  \param p_iOperIndex IN The index of the operator in the domain.
+ *  \param p_pSub IN A pointer to a Substitution that grounds the operator.
+ *   If this returns true, this StripsGrounding takes ownership of it.
+ *  \param p_vAtomLists INOUT The atom indices of the four masks of each
+ *   action, to which those of the new action are appended.
+ *  \return Whether or not a new action was recorded.
+ */
+bool StripsGrounding::AddAction( unsigned int p_iOperIndex,
+				 Substitution * p_pSub,
+				 std::vector< std::vector< unsigned int > > & p_vAtomLists )
+{
+  std::vector< unsigned int > l_vKey = MakeActionKey( p_iOperIndex, p_pSub );
+  if( m_mActionIndices.find( l_vKey ) != m_mActionIndices.end() )
+    return false;
+
+  const Operator * l_pOp = m_pProblem->GetCDomain()->GetCOper( p_iOperIndex );
+  FormulaConjP l_pPrecs = std::tr1::dynamic_pointer_cast< FormulaConj >( l_pOp->GetCPreconditions()->AfterSubstitution( *p_pSub, 0 ) );
+  FormulaConjP l_pEffs = std::tr1::dynamic_pointer_cast< FormulaConj >( l_pOp->GetCEffects()->AfterSubstitution( *p_pSub, 0 ) );
+  if( !l_pPrecs->IsGround() || !l_pEffs->IsGround() )
+    throw Exception( E_NOT_IMPLEMENTED,
+		     "Grounding requires every variable of operator " + l_pOp->GetName() + " to be one of its parameters.",
+		     __FILE__,
+		     __LINE__ );
+
+  std::vector< unsigned int > l_vPre, l_vPreNeg, l_vAdd, l_vDel;
+  for( FormulaPVecCI i = l_pPrecs->GetBeginConj(); i != l_pPrecs->GetEndConj(); i++ )
+  {
+    switch( ( *i )->GetType() )
+    {
+    case FT_PRED:
+      l_vPre.push_back( GetAtomIndex( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( *i ) ) ) );
+      break;
+    case FT_EQU:
+    {
+      FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( *i );
+      if( !l_pEqu->GetCFirst()->Equal( *l_pEqu->GetCSecond() ) )
+	return false;
+      break;
+    }
+    case FT_NEG:
+    {
+      FormulaP l_pNegForm = std::tr1::dynamic_pointer_cast< FormulaNeg >( *i )->GetCNegForm();
+      if( l_pNegForm->GetType() == FT_PRED )
+	l_vPreNeg.push_back( GetAtomIndex( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( l_pNegForm ) ) ) );
+      else if( l_pNegForm->GetType() == FT_EQU )
+      {
+	FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( l_pNegForm );
+	if( l_pEqu->GetCFirst()->Equal( *l_pEqu->GetCSecond() ) )
+	  return false;
+      }
+      else
+	throw Exception( E_NEG_NOT_PRED,
+			 "For now, only predicates and equalities may be negated.",
+			 __FILE__,
+			 __LINE__ );
+      break;
+    }
+    default:
+      throw Exception( E_FORMULA_TYPE_UNKNOWN,
+		       "Unknown formula type.",
+		       __FILE__,
+		       __LINE__ );
+    }
+  }
+
+  for( FormulaPVecCI i = l_pEffs->GetBeginConj(); i != l_pEffs->GetEndConj(); i++ )
+  {
+    if( ( *i )->GetType() == FT_PRED )
+      l_vAdd.push_back( GetAtomIndex( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( *i ) ) ) );
+    else if( ( *i )->GetType() == FT_NEG &&
+	     std::tr1::dynamic_pointer_cast< FormulaNeg >( *i )->GetCNegForm()->GetType() == FT_PRED )
+      l_vDel.push_back( GetAtomIndex( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( std::tr1::dynamic_pointer_cast< FormulaNeg >( *i )->GetCNegForm() ) ) ) );
+    else
+      throw Exception( E_NEG_NOT_PRED,
+		       "For now, only predicates may be negated.",
+		       __FILE__,
+		       __LINE__ );
+  }
+
+  m_mActionIndices[l_vKey] = m_vOperIndices.size();
+  m_vOperActions[p_iOperIndex].push_back( m_vOperIndices.size() );
+  m_vOperIndices.push_back( p_iOperIndex );
+  m_vSubstitutions.push_back( p_pSub );
+  p_vAtomLists.push_back( l_vPre );
+  p_vAtomLists.push_back( l_vPreNeg );
+  p_vAtomLists.push_back( l_vAdd );
+  p_vAtomLists.push_back( l_vDel );
+  return true;
+}
+
+/**
+ *  Set the bits for a list of atoms.
+ *  \param p_vAtomIndices IN The indices of the atoms.
+ *  \param p_pBits OUT The first of StripsGrounding::m_iNumWords words in which
+ *   to set them.
+ */
+void StripsGrounding::SetBits( const std::vector< unsigned int > & p_vAtomIndices,
+			       unsigned long * p_pBits ) const
+{
+  for( unsigned int i = 0; i < p_vAtomIndices.size(); i++ )
+    p_pBits[p_vAtomIndices[i] / GROUNDING_WORD_BITS] |= 1UL << ( p_vAtomIndices[i] % GROUNDING_WORD_BITS );
+}
+
+/**
+ *  Add the requirements of a goal formula to StripsGrounding::m_vGoalPos and
+ *   StripsGrounding::m_vGoalNeg.
+ *  \param p_pGoal IN A smart pointer to a ground goal formula.
+ */
+void StripsGrounding::AddGoal( const FormulaP & p_pGoal )
+{
+  if( !p_pGoal->IsGround() )
+    throw Exception( E_NOT_IMPLEMENTED,
+		     "Grounding requires the goals to be ground.",
+		     __FILE__,
+		     __LINE__ );
+
+  switch( p_pGoal->GetType() )
+  {
+  case FT_PRED:
+  {
+    std::tr1::unordered_map< GroundAtom, unsigned int, HashGroundAtom, EqualGroundAtom >::const_iterator l_iFound = m_mAtomIndices.find( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( p_pGoal ) ) );
+    if( l_iFound == m_mAtomIndices.end() )
+      m_bGoalsReachable = false;
+    else
+      m_vGoalPos[l_iFound->second / GROUNDING_WORD_BITS] |= 1UL << ( l_iFound->second % GROUNDING_WORD_BITS );
+    break;
+  }
+  case FT_EQU:
+  {
+    FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( p_pGoal );
+    if( !l_pEqu->GetCFirst()->Equal( *l_pEqu->GetCSecond() ) )
+      m_bGoalsReachable = false;
+    break;
+  }
+  case FT_NEG:
+  {
+    FormulaP l_pNegForm = std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pGoal )->GetCNegForm();
+    if( l_pNegForm->GetType() == FT_PRED )
+    {
+      std::tr1::unordered_map< GroundAtom, unsigned int, HashGroundAtom, EqualGroundAtom >::const_iterator l_iFound = m_mAtomIndices.find( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( l_pNegForm ) ) );
+      if( l_iFound != m_mAtomIndices.end() )
+	m_vGoalNeg[l_iFound->second / GROUNDING_WORD_BITS] |= 1UL << ( l_iFound->second % GROUNDING_WORD_BITS );
+    }
+    else if( l_pNegForm->GetType() == FT_EQU )
+    {
+      FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( l_pNegForm );
+      if( l_pEqu->GetCFirst()->Equal( *l_pEqu->GetCSecond() ) )
+	m_bGoalsReachable = false;
+    }
+    else
+      throw Exception( E_NEG_NOT_PRED,
+		       "For now, only predicates and equalities may be negated.",
+		       __FILE__,
+		       __LINE__ );
+    break;
+  }
+  case FT_CONJ:
+  {
+    FormulaConjP l_pConj = std::tr1::dynamic_pointer_cast< FormulaConj >( p_pGoal );
+    for( FormulaPVecCI i = l_pConj->GetBeginConj(); i != l_pConj->GetEndConj(); i++ )
+      AddGoal( *i );
+    break;
+  }
+  default:
+    throw Exception( E_FORMULA_TYPE_UNKNOWN,
+		     "Unknown formula type.",
+		     __FILE__,
+		     __LINE__ );
+  }
+}
+
+/**
+ *  Retrieve the number of atoms that were reached while grounding.
+ *  \return The number of atoms that were reached while grounding.
+ */
+unsigned int StripsGrounding::GetNumAtoms() const
+{
+  return m_vAtoms.size();
+}
+
+/**
+ *  Retrieve the number of words in each AtomBits.
+ *  \return The number of words in each AtomBits.
+ */
+unsigned int StripsGrounding::GetNumWords() const
+{
+  return m_iNumWords;
+}
+
+/**
+ *  Retrieve the number of ground actions.
+ *  \return The number of ground actions.
+ */
+unsigned int StripsGrounding::GetNumActions() const
+{
+  return m_vOperIndices.size();
+}
+
+/**
+ *  Retrieve the initial state of the problem.
+ *  \return The initial state of the problem.
+ */
+const AtomBits & StripsGrounding::GetInitState() const
+{
+  return m_vInitState;
+}
+
+/**
+ *  Determine whether or not a ground action is applicable in a state.
+ *  \param p_iAction IN The index of the ground action.
+ *  \param p_vState IN The state.
+ *  \return Whether or not the action is applicable in the state.
+ */
+bool StripsGrounding::IsApplicable( unsigned int p_iAction,
+				    const AtomBits & p_vState ) const
+{
+  const unsigned long * l_pPre = &m_vMasks[4 * m_iNumWords * p_iAction];
+  const unsigned long * l_pPreNeg = l_pPre + m_iNumWords;
+  unsigned long l_iFailed = 0;
+  for( unsigned int i = 0; i < m_iNumWords; i++ )
+    l_iFailed |= ( l_pPre[i] & ~p_vState[i] ) | ( l_pPreNeg[i] & p_vState[i] );
+  return l_iFailed == 0;
+}
+
+/**
+ *  Apply a ground action to a state.
+ *  As with State::NextState(), the deleted atoms are removed before the added
+ *   atoms are added.  The action is assumed to be applicable.
+ *  \param p_iAction IN The index of the ground action.
+ *  \param p_vState IN The state before the action.
+ *  \param p_vNext OUT The state after the action.  This may be the same
+ *   object as p_vState.
+ */
+void StripsGrounding::Apply( unsigned int p_iAction,
+			     const AtomBits & p_vState,
+			     AtomBits & p_vNext ) const
+{
+  const unsigned long * l_pAdd = &m_vMasks[4 * m_iNumWords * p_iAction + 2 * m_iNumWords];
+  const unsigned long * l_pDel = l_pAdd + m_iNumWords;
+  p_vNext.resize( m_iNumWords );
+  for( unsigned int i = 0; i < m_iNumWords; i++ )
+    p_vNext[i] = ( p_vState[i] & ~l_pDel[i] ) | l_pAdd[i];
+}
+
+/**
+ *  Find every ground action that is applicable in a state.
+ *  They are listed in order of their operators in the domain, and then in the
+ *   order in which they were found while grounding.
+ *  \param p_vState IN The state.
+ *  \param p_vActions OUT A list to which the indices of the applicable
+ *   actions are appended.
+ */
+void StripsGrounding::GetApplicable( const AtomBits & p_vState,
+				     std::vector< unsigned int > & p_vActions ) const
+{
+  for( unsigned int i = 0; i < m_vOperActions.size(); i++ )
+  {
+    for( unsigned int j = 0; j < m_vOperActions[i].size(); j++ )
+    {
+      if( IsApplicable( m_vOperActions[i][j], p_vState ) )
+	p_vActions.push_back( m_vOperActions[i][j] );
+    }
+  }
+}
+
+/**
+ *  Determine whether or not a state satisfies the goals of the problem.
+ *  \param p_vState IN The state.
+ *  \return Whether or not the state satisfies the goals.
+ */
+bool StripsGrounding::SatisfiesGoals( const AtomBits & p_vState ) const
+{
+  unsigned long l_iFailed = 0;
+  for( unsigned int i = 0; i < m_iNumWords; i++ )
+    l_iFailed |= ( m_vGoalPos[i] & ~p_vState[i] ) | ( m_vGoalNeg[i] & p_vState[i] );
+  return m_bGoalsReachable && l_iFailed == 0;
+}
+
+/**
+ *  Find the ground action for an instance of an operator.
+ *  \param p_iOperIndex IN The index of the operator in the domain.
+ *  \param p_pSub IN A Substitution that grounds the operator.
+ *  \return The index of the ground action, or -1 if that instance was not
+ *   reachable, in which case it is never applicable.
+ */
+int StripsGrounding::FindAction( unsigned int p_iOperIndex,
+				 const Substitution * p_pSub ) const
+{
+  std::map< std::vector< unsigned int >, unsigned int >::const_iterator l_iFound = m_mActionIndices.find( MakeActionKey( p_iOperIndex, p_pSub ) );
+  if( l_iFound == m_mActionIndices.end() )
+    return -1;
+  return l_iFound->second;
+}
+
+/**
+ *  Retrieve the index in the domain of the operator of a ground action.
+ *  \param p_iAction IN The index of the ground action.
+ *  \return The index of its operator in the domain.
+ */
+unsigned int StripsGrounding::GetOperIndex( unsigned int p_iAction ) const
+{
+  return m_vOperIndices[p_iAction];
+}
+
+/**
+ *  Retrieve the Substitution that grounds the operator of a ground action.
+ *  \param p_iAction IN The index of the ground action.
+ *  \return A pointer to the Substitution, which has the same lifetime as this
+ *   StripsGrounding.
+ */
+const Substitution * StripsGrounding::GetCSubstitution( unsigned int p_iAction ) const
+{
+  return m_vSubstitutions[p_iAction];
+}
+
+/**
+ *  Retrieve a string containing a textual representation of a state.
+ *  \param p_vState IN The state.
+ *  \return A string containing a textual representation of the state, in the
+ *   same format as State::ToStr().
+ */
+std::string StripsGrounding::StateToStr( const AtomBits & p_vState ) const
+{
+  std::string l_sRet = "( ";
+  for( unsigned int i = 0; i < m_vAtoms.size(); i++ )
+  {
+    if( p_vState[i / GROUNDING_WORD_BITS] & ( 1UL << ( i % GROUNDING_WORD_BITS ) ) )
+    {
+      l_sRet += m_vAtoms[i].ToStr();
+      l_sRet += " ";
+    }
+  }
+  l_sRet += ")";
+  return l_sRet;
+}
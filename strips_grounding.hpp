@@ -0,0 +1,61 @@
+#ifndef STRIPS_GROUNDING_HPP__
+#define STRIPS_GROUNDING_HPP__
+
+#include <map>
+#include <tr1/unordered_map>
+
+#define GROUNDING_WORD_BITS ( 8 * sizeof( unsigned long ) )
+
+typedef std::vector< unsigned long > AtomBits;
+
+class StripsGrounding
+{
+public:
+  StripsGrounding( const std::tr1::shared_ptr< StripsProblem > & p_pProblem );
+  virtual ~StripsGrounding();
+
+  unsigned int GetNumAtoms() const;
+  unsigned int GetNumWords() const;
+  unsigned int GetNumActions() const;
+
+  const AtomBits & GetInitState() const;
+
+  bool IsApplicable( unsigned int p_iAction, const AtomBits & p_vState ) const;
+  void Apply( unsigned int p_iAction, const AtomBits & p_vState, AtomBits & p_vNext ) const;
+  void GetApplicable( const AtomBits & p_vState, std::vector< unsigned int > & p_vActions ) const;
+  bool SatisfiesGoals( const AtomBits & p_vState ) const;
+
+  int FindAction( unsigned int p_iOperIndex, const Substitution * p_pSub ) const;
+  unsigned int GetOperIndex( unsigned int p_iAction ) const;
+  const Substitution * GetCSubstitution( unsigned int p_iAction ) const;
+
+  std::string StateToStr( const AtomBits & p_vState ) const;
+
+private:
+  StripsGrounding( const StripsGrounding & p_Other );
+  StripsGrounding & operator=( const StripsGrounding & p_Other );
+
+  unsigned int GetAtomIndex( const GroundAtom & p_Atom );
+  std::vector< unsigned int > MakeActionKey( unsigned int p_iOperIndex, const Substitution * p_pSub ) const;
+  bool AddAction( unsigned int p_iOperIndex,
+		  Substitution * p_pSub,
+		  std::vector< std::vector< unsigned int > > & p_vAtomLists );
+  void SetBits( const std::vector< unsigned int > & p_vAtomIndices, unsigned long * p_pBits ) const;
+  void AddGoal( const FormulaP & p_pGoal );
+
+  std::tr1::shared_ptr< StripsProblem > m_pProblem;
+  std::vector< GroundAtom > m_vAtoms;
+  std::tr1::unordered_map< GroundAtom, unsigned int, HashGroundAtom, EqualGroundAtom > m_mAtomIndices;
+  std::vector< unsigned int > m_vOperIndices;
+  std::vector< Substitution * > m_vSubstitutions;
+  std::vector< std::vector< unsigned int > > m_vOperActions;
+  std::map< std::vector< unsigned int >, unsigned int > m_mActionIndices;
+  unsigned int m_iNumWords;
+  std::vector< unsigned long > m_vMasks;
+  AtomBits m_vInitState;
+  AtomBits m_vGoalPos;
+  AtomBits m_vGoalNeg;
+  bool m_bGoalsReachable;
+};
+
+#endif//STRIPS_GROUNDING_HPP__
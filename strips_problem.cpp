@@ -7,6 +7,7 @@
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_variable.hpp"
@@ -19,6 +20,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_domain.hpp"
 #include "strips_problem.hpp"
@@ -80,30 +83,21 @@ StripsProblem::StripsProblem( std::string p_sProblem,
   m_pInitState = NULL;
   m_iRequirements = PDDL_REQ_STRIPS;
 
-  std::stringstream l_sStream( p_sProblem );
+  PddlTokenizer l_Tokens( p_sProblem );
 
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "(" );
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "define" );
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "(" );
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "problem" );
-  EatWhitespace( l_sStream );
+  l_Tokens.Eat( "(" );
+  l_Tokens.Eat( "define" );
+  l_Tokens.Eat( "(" );
+  l_Tokens.Eat( "problem" );
 
-  m_sName = ReadString( l_sStream );
+  m_sName = l_Tokens.ReadAtom();
 
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, ")" );
+  l_Tokens.Eat( ")" );
 
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "(" );
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, ":domain" );
-  EatWhitespace( l_sStream );
+  l_Tokens.Eat( "(" );
+  l_Tokens.Eat( ":domain" );
   
-  std::string l_sDomainName = ReadString( l_sStream );
+  std::string l_sDomainName = l_Tokens.ReadAtom();
 
   if( CompareNoCase( l_sDomainName, m_pDomain->GetName() ) != 0 )
     throw Exception( E_DOMAIN_MATCH,
@@ -111,25 +105,18 @@ StripsProblem::StripsProblem( std::string p_sProblem,
 		     __FILE__,
 		     __LINE__ );
     
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, ")" );
-  EatWhitespace( l_sStream );
+  l_Tokens.Eat( ")" );
 
   bool l_bHasRequirements = false,
     l_bHasObjects = false,
     l_bHasInit = false,
     l_bHasGoal = false;
 
-  while( l_sStream.peek() == '(' )
+  while( l_Tokens.PeekOpen() )
   {
-    std::string l_sFeature = ReadParenthetical( l_sStream );
-    EatWhitespace( l_sStream );
-
-    std::stringstream l_sFeatureStream( l_sFeature );
-    EatString( l_sFeatureStream, "(" );
-    EatWhitespace( l_sFeatureStream );
-    std::string l_sFeatureName = ReadString( l_sFeatureStream );
-    EatWhitespace( l_sFeatureStream );
+    size_t l_iFeatureStart = l_Tokens.GetOffset();
+    l_Tokens.Eat( "(" );
+    std::string l_sFeatureName = l_Tokens.ReadAtom();
 
     if( CompareNoCase( l_sFeatureName, ":requirements" ) == 0 )
     {
@@ -154,7 +141,8 @@ StripsProblem::StripsProblem( std::string p_sProblem,
 			 __FILE__,
 			 __LINE__ );
       l_bHasRequirements = true;
-      m_iRequirements = ParseRequirements( l_sFeature, false );
+      l_Tokens.SetOffset( l_iFeatureStart );
+      m_iRequirements = ParseRequirements( l_Tokens.ReadParenthetical(), false );
     }
     else if( CompareNoCase( l_sFeatureName, ":objects" ) == 0 )
     {
@@ -175,17 +163,14 @@ StripsProblem::StripsProblem( std::string p_sProblem,
 			 __LINE__ );
       l_bHasObjects = true;
 
-      while( l_sFeatureStream.peek() != ')' )
+      while( !l_Tokens.PeekClose() )
       {
-	std::string l_sNewObj = ReadString( l_sFeatureStream );
-	EatWhitespace( l_sFeatureStream );
+	std::string l_sNewObj = l_Tokens.ReadAtom();
 	std::string l_sTyping = "";
 	if( m_pDomain->GetRequirements() & PDDL_REQ_TYPING )
 	{
-	  EatString( l_sFeatureStream, "-" );
-	  EatWhitespace( l_sFeatureStream );
-	  l_sTyping = ReadString( l_sFeatureStream );
-	  EatWhitespace( l_sFeatureStream );
+	  l_Tokens.Eat( "-" );
+	  l_sTyping = l_Tokens.ReadAtom();
 	}
 
 	if( m_ObjectTypes.find( l_sNewObj ) == m_ObjectTypes.end() )
@@ -212,6 +197,7 @@ StripsProblem::StripsProblem( std::string p_sProblem,
 			   __FILE__,
 			   __LINE__ );
       }
+      l_Tokens.Eat( ")" );
     }
     else if( CompareNoCase( l_sFeatureName, ":init" ) == 0 )
     {
@@ -227,13 +213,13 @@ StripsProblem::StripsProblem( std::string p_sProblem,
 			 __LINE__ );
       l_bHasInit = true;
       std::string l_sInitState = "( ";
-      while( l_sFeatureStream.peek() == '(' )
+      while( l_Tokens.PeekOpen() )
       {
-	l_sInitState += ReadParenthetical( l_sFeatureStream );
+	l_sInitState += l_Tokens.ReadParenthetical();
 	l_sInitState += " ";
-	EatWhitespace( l_sFeatureStream );
       }
       l_sInitState += ")";
+      l_Tokens.Eat( ")" );
 
       m_pInitState = new State( l_sInitState, 0, ( m_ObjectTypes.size() > 0 ? m_ObjectTypes : p_pDomain->GetConstantTypes() ), p_pDomain->GetAllowablePredicates() );
     }
@@ -245,7 +231,8 @@ StripsProblem::StripsProblem( std::string p_sProblem,
 			 __FILE__,
 			 __LINE__ );
       l_bHasGoal = true;
-      std::stringstream l_sGoalStream( ReadParenthetical( l_sFeatureStream ) );
+      std::stringstream l_sGoalStream( l_Tokens.ReadParenthetical() );
+      l_Tokens.Eat( ")" );
       m_pGoals = FormulaP( NewFormula( l_sGoalStream, ( m_ObjectTypes.size() > 0 ? m_ObjectTypes : p_pDomain->GetConstantTypes() ), p_pDomain->GetAllowablePredicates() ) );
     }
     else if( CompareNoCase( l_sFeatureName, ":constraints" ) == 0 )
@@ -275,7 +262,7 @@ StripsProblem::StripsProblem( std::string p_sProblem,
     }
   }
 
-  EatString( l_sStream, ")" );
+  l_Tokens.Eat( ")" );
 
   if( !l_bHasInit )
     throw Exception( E_NOT_IMPLEMENTED,
@@ -7,6 +7,7 @@
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
 #include "term_variable.hpp"
@@ -21,6 +22,8 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_domain.hpp"
 #include "strips_problem.hpp"
@@ -82,40 +85,31 @@ StripsSolution::StripsSolution( const std::tr1::shared_ptr< StripsProblem > & p_
 				std::string p_sInput )
   : m_pProblem( p_pProblem )
 {
-  std::stringstream l_sStream( p_sInput );
+  PddlTokenizer l_Tokens( p_sInput );
 
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "(" );
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, "defplan" );
-  EatWhitespace( l_sStream );
-  EatString( l_sStream, m_pProblem->GetCDomain()->GetName() );
-  EatWhitespace( l_sStream );
-  ReadString( l_sStream );
-  //  EatString( l_sStream, m_pProblem->GetName() );
-  EatWhitespace( l_sStream );
+  l_Tokens.Eat( "(" );
+  l_Tokens.Eat( "defplan" );
+  l_Tokens.Eat( m_pProblem->GetCDomain()->GetName() );
+  l_Tokens.ReadAtom();
+  //  l_Tokens.Eat( m_pProblem->GetName() );
 
-  while( l_sStream.peek() == '(' )
+  while( l_Tokens.PeekOpen() )
   {
-    EatString( l_sStream, "(" );
-    EatWhitespace( l_sStream );
-    std::string l_sOpName = ReadString( l_sStream );
+    l_Tokens.Eat( "(" );
+    std::string l_sOpName = l_Tokens.ReadAtom();
     unsigned int l_iOpIndex = m_pProblem->GetCDomain()->GetOperIndexByName( l_sOpName );
     Substitution * l_pNewSubs = new Substitution();
     for( unsigned int i = 0; i < m_pProblem->GetCDomain()->GetCOper( l_iOpIndex )->GetNumParams(); i++ )
     {
-      EatWhitespace( l_sStream );
-      std::string l_sParam = ReadString( l_sStream );
+      std::string l_sParam = l_Tokens.ReadAtom();
 
       l_pNewSubs->AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( m_pProblem->GetCDomain()->GetCOper( l_iOpIndex )->GetCParam( i ) ), ReadTerm( l_sParam, m_pProblem->GetObjectTypes() ) );
     }
-    EatWhitespace( l_sStream );
-    EatString( l_sStream, ")" );
-    EatWhitespace( l_sStream );
+    l_Tokens.Eat( ")" );
     ApplyOperator( l_iOpIndex, l_pNewSubs );
   }
 
-  EatString( l_sStream, ")" );
+  l_Tokens.Eat( ")" );
 }
 
 /**
@@ -245,6 +239,24 @@ const Operator * StripsSolution::GetCOperator( unsigned int p_iIndex ) const
   }
 }
 
+/**
+ *  Retrieve the index in the domain of one of the Operators in this plan.
+ *  \param p_iIndex IN The 0-based index of the desired Operator.
+ *  \return The index of the requested Operator in the domain.
+ */
+unsigned int StripsSolution::GetOperIndex( unsigned int p_iIndex ) const
+{
+  if( p_iIndex < m_vOperatorIndices.size() )
+    return m_vOperatorIndices[ p_iIndex ];
+  else
+  {
+    throw Exception( E_INDEX_OUT_OF_BOUNDS,
+		     "Bounds error.",
+		     __FILE__,
+		     __LINE__ );
+  }
+}
+
 /**
  *  Retrieve a pointer to the Substitution associated with one of the Operators
  *   in this plan.
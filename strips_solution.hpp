@@ -27,6 +27,8 @@ public:
 
   const Operator * GetCOperator( unsigned int p_iIndex ) const;
 
+  unsigned int GetOperIndex( unsigned int p_iIndex ) const;
+
   const Substitution * GetCSubstitution( unsigned int p_iIndex ) const;
 
   bool ContainsState( const State & p_State ) const;
@@ -28,6 +28,10 @@
  *   second B with C and so on, but cycles should not be allowed.
  */
 
+/** \def TERM_NO_ID
+ *  The value of Term::GetId() for a Term that is not a numbered constant.
+ */
+
 /** \enum TermType
  *  The basic type of a Term.
  *  This does not specify an exact class, because both TermVariable and
@@ -51,6 +55,23 @@
  *  This is a pure virtual class.
  */
 
+/** \var Term::m_pThis
+ *  A weak pointer to this Term, set by the TermTable that owns it.
+ */
+
+/** \var Term::m_iId
+ *  The index of this Term among the constants in the global TermTable, set
+ *   by the TermTable when it stores a constant.
+ */
+
+/**
+ *  Construct a Term that has not yet been numbered.
+ */
+Term::Term()
+  : m_iId( TERM_NO_ID )
+{
+}
+
 /** Does nothing, but exists for derived classes.
  */
 Term::~Term()
@@ -4,6 +4,7 @@
 class Substitution;
 
 #define MAX_SUBS_DEPTH 10
+#define TERM_NO_ID 0xFFFFFFFF
 
 enum TermType
 {
@@ -18,6 +19,7 @@ typedef std::tr1::shared_ptr< Term > TermP;
 class Term
 {
 public:
+  Term();
   virtual ~Term();
 
   /**
@@ -87,6 +89,16 @@ public:
 		     __LINE__ );
   }
 
+  /**
+   *  Get the index of this Term among the constants in the global TermTable.
+   *  Only constants are numbered; any other Term returns TERM_NO_ID.
+   *  \return The index of this Term, or TERM_NO_ID.
+   */
+  unsigned int GetId() const
+  {
+    return m_iId;
+  }
+
   virtual size_t GetMemSizeMin() const = 0;
   virtual size_t GetMemSizeMax() const = 0;
 
@@ -95,6 +107,7 @@ protected:
 
 private:
   std::tr1::weak_ptr< Term > m_pThis;
+  unsigned int m_iId;
 
   friend class TermTable;
 };
@@ -1,6 +1,7 @@
 #include <string>
 #include <vector>
 #include <tr1/memory>
+#include <pthread.h>
 
 #include "exception.hpp"
 #include "funcs.hpp"
@@ -31,25 +32,260 @@
  *   savings would be even more significant.
  *  There should only be a single instance of this for each program, otherwise
  *   the comparisons mentioned above will not work.
+ *  Terms created by LookupTemp are held only weakly, so that the automatically
+ *   named variables created while learning do not accumulate.  Constants are
+ *   always held, and are numbered densely in the order they are created, so
+ *   that a State may refer to them by a 32-bit id (see GroundAtom).
+ *  Any number of threads may look up Terms at once.  A lookup only waits for
+ *   a thread inserting a new Term into the same shard.
  */
 
-/** \var TermTable::m_mTermLookup
- *  A hash table from strings to Terms.
+/** \class TermShard
+ *  One of the independently locked parts of a TermTable.
+ */
+
+/** \var TermShard::m_Lock
+ *  A lock that must be held for reading to search m_mTermLookup, and for
+ *   writing to insert into it.
+ */
+
+/** \var TermShard::m_mTermLookup
+ *  A hash table from strings to Terms, for those strings whose hash selects
+ *   this shard.
+ */
+
+/** \var TermShard::m_mTempLookup
+ *  A hash table from strings to temporary Terms, for those strings whose hash
+ *   selects this shard.
+ *  These are held weakly, so that each is deallocated as soon as nothing 
+ *   outside the table refers to it.  Entries for deallocated Terms are
+ *   removed by TermTable::SweepTemps.
+ */
+
+/** \var TermShard::m_iTempSweepSize
+ *  The size that m_mTempLookup must reach before it is next swept.
+ */
+
+/** \var TermTable::m_aShards
+ *  The hash tables from strings to Terms, split by the hash of the string so
+ *   that threads looking up different Terms rarely wait on the same lock.
  *  This is the heart of TermTable.
  */
 
+/** \var TermTable::m_apIdChunks
+ *  The constants, indexed by their ids.
+ *  Chunk i holds 2^(TERM_TABLE_CHUNK_BITS + i) Terms and is only allocated
+ *   when needed.  Once stored, a Term never moves, so that it may be read
+ *   without a lock while other threads are adding to the table.
+ */
+
+/** \var TermTable::m_iNumIds
+ *  The number of constants that have been stored in m_apIdChunks.
+ *  This is only written while holding m_IdMutex, and only after the constant
+ *   with the new highest id is in place.
+ */
+
+/** \var TermTable::m_IdMutex
+ *  A lock that must be held while assigning a new id.
+ */
+
+/**
+ *  The one and only string hasher, defined in funcs.cpp.
+ */
+extern HashStr g_StrHasher;
+
 /**
  *  The one and only instance of TermTable that should ever exist.
  */
 TermTable g_TermTable;
 
+/**
+ *  Construct an empty TermTable.
+ */
+TermTable::TermTable()
+{
+  for( unsigned int i = 0; i < TERM_TABLE_SHARDS; i++ )
+  {
+    pthread_rwlock_init( &m_aShards[i].m_Lock, NULL );
+    m_aShards[i].m_iTempSweepSize = TERM_TABLE_MIN_SWEEP;
+  }
+  for( unsigned int i = 0; i < TERM_TABLE_MAX_CHUNKS; i++ )
+    m_apIdChunks[i] = NULL;
+  m_iNumIds = 0;
+  pthread_mutex_init( &m_IdMutex, NULL );
+}
+
 /**
  *  Destructor.
- *  Removes all of the elements in the hash table, because they are dynamically
- *   allocated.
+ *  The Terms themselves are deallocated with the hash tables, once nothing
+ *   else refers to them.
  */
 TermTable::~TermTable()
 {
+  for( unsigned int i = 0; i < TERM_TABLE_SHARDS; i++ )
+    pthread_rwlock_destroy( &m_aShards[i].m_Lock );
+  for( unsigned int i = 0; i < TERM_TABLE_MAX_CHUNKS; i++ )
+    delete [] m_apIdChunks[i];
+  pthread_mutex_destroy( &m_IdMutex );
+}
+
+/**
+ *  Retrieve the shard in which a Term with a given name belongs.
+ *  \param p_sKey IN The name of a Term.
+ *  \return A reference to the shard for that name.
+ */
+TermShard & TermTable::GetShard( const std::string & p_sKey )
+{
+  return m_aShards[g_StrHasher( p_sKey ) % TERM_TABLE_SHARDS];
+}
+
+/**
+ *  Find an existing Term in a shard.
+ *  \param p_Shard IN The shard for p_sKey.
+ *  \param p_sKey IN The name of a Term.
+ *  \return A pointer to the Term with that name, or NULL if there is none.
+ *   A temporary Term that has been deallocated does not count.
+ */
+TermP TermTable::Find( TermShard & p_Shard,
+		       const std::string & p_sKey )
+{
+  TermP l_pRet;
+  pthread_rwlock_rdlock( &p_Shard.m_Lock );
+  std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase >::iterator l_Iter = p_Shard.m_mTermLookup.find( p_sKey );
+  if( l_Iter != p_Shard.m_mTermLookup.end() )
+    l_pRet = (*l_Iter).second;
+  else
+  {
+    std::tr1::unordered_map< std::string, std::tr1::weak_ptr< Term >, HashStr, StrEquNoCase >::iterator l_TempIter = p_Shard.m_mTempLookup.find( p_sKey );
+    if( l_TempIter != p_Shard.m_mTempLookup.end() )
+      l_pRet = (*l_TempIter).second.lock();
+  }
+  pthread_rwlock_unlock( &p_Shard.m_Lock );
+  return l_pRet;
+}
+
+/**
+ *  Insert a new Term into a shard, unless another thread has already 
+ *   inserted one with the same name.
+ *  \param p_Shard IN The shard for p_sKey.
+ *  \param p_sKey IN The name of the new Term.
+ *  \param p_pNew IN The new Term.
+ *  \param p_bTemporary IN Whether the table should hold the new Term only as
+ *   long as something else does.  This is ignored for constants, which are
+ *   always held so that their ids remain valid.
+ *  \return A pointer to whichever Term is in the table with that name.
+ */
+TermP TermTable::Insert( TermShard & p_Shard,
+			 const std::string & p_sKey,
+			 const TermP & p_pNew,
+			 bool p_bTemporary )
+{
+  TermP l_pRet;
+  pthread_rwlock_wrlock( &p_Shard.m_Lock );
+
+  std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase >::iterator l_Iter = p_Shard.m_mTermLookup.find( p_sKey );
+  std::tr1::unordered_map< std::string, std::tr1::weak_ptr< Term >, HashStr, StrEquNoCase >::iterator l_TempIter = p_Shard.m_mTempLookup.find( p_sKey );
+  if( l_Iter != p_Shard.m_mTermLookup.end() )
+    l_pRet = (*l_Iter).second;
+  else if( l_TempIter != p_Shard.m_mTempLookup.end() )
+    l_pRet = (*l_TempIter).second.lock();
+
+  if( !l_pRet )
+  {
+    l_pRet = p_pNew;
+    if( p_bTemporary && p_pNew->GetType() != TT_CONSTANT )
+    {
+      if( l_TempIter != p_Shard.m_mTempLookup.end() )
+	(*l_TempIter).second = p_pNew;
+      else
+	p_Shard.m_mTempLookup.insert( std::make_pair( p_sKey, std::tr1::weak_ptr< Term >( p_pNew ) ) );
+      if( p_Shard.m_mTempLookup.size() >= p_Shard.m_iTempSweepSize )
+	SweepTemps( p_Shard );
+    }
+    else
+    {
+      if( l_TempIter != p_Shard.m_mTempLookup.end() )
+	p_Shard.m_mTempLookup.erase( l_TempIter );
+      p_Shard.m_mTermLookup.insert( std::make_pair( p_sKey, p_pNew ) );
+      if( p_pNew->GetType() == TT_CONSTANT )
+	AssignId( p_pNew );
+    }
+  }
+
+  pthread_rwlock_unlock( &p_Shard.m_Lock );
+  return l_pRet;
+}
+
+/**
+ *  Give a new constant the next id, and store it so that it may be found by
+ *   that id.
+ *  The caller must hold the lock for the constant's shard for writing, so
+ *   that no other thread can see the constant before its id is set.
+ *  \param p_pNew IN The new constant.
+ */
+void TermTable::AssignId( const TermP & p_pNew )
+{
+  pthread_mutex_lock( &m_IdMutex );
+  unsigned int l_iNewId = m_iNumIds;
+  unsigned int l_iChunk = 0;
+  while( ( ( l_iNewId >> TERM_TABLE_CHUNK_BITS ) + 1 ) >> ( l_iChunk + 1 ) )
+    l_iChunk++;
+  if( l_iChunk >= TERM_TABLE_MAX_CHUNKS )
+  {
+    pthread_mutex_unlock( &m_IdMutex );
+    throw Exception( E_INDEX_OUT_OF_BOUNDS,
+		     "The term table is full.",
+		     __FILE__,
+		     __LINE__ );
+  }
+  if( m_apIdChunks[l_iChunk] == NULL )
+    m_apIdChunks[l_iChunk] = new TermP[1 << ( TERM_TABLE_CHUNK_BITS + l_iChunk )];
+  TermAt( l_iNewId ) = p_pNew;
+  p_pNew->m_iId = l_iNewId;
+  __sync_synchronize();
+  m_iNumIds = l_iNewId + 1;
+  pthread_mutex_unlock( &m_IdMutex );
+}
+
+/**
+ *  Find the storage for the constant with a given id.
+ *  Chunk i begins at index 2^TERM_TABLE_CHUNK_BITS * ( 2^i - 1 ).
+ *  \param p_iId IN The id of a constant.
+ *  \return A reference to where that constant is or will be stored.
+ */
+TermP & TermTable::TermAt( unsigned int p_iId ) const
+{
+  unsigned int l_iBlock = ( p_iId >> TERM_TABLE_CHUNK_BITS ) + 1;
+  unsigned int l_iChunk = 0;
+  while( l_iBlock >> ( l_iChunk + 1 ) )
+    l_iChunk++;
+  unsigned int l_iOffset = p_iId - ( ( ( 1 << l_iChunk ) - 1 ) << TERM_TABLE_CHUNK_BITS );
+  return m_apIdChunks[l_iChunk][l_iOffset];
+}
+
+/**
+ *  Remove the entries for deallocated temporary Terms from a shard.
+ *  The next sweep happens once the number of entries has doubled, so the
+ *   cost is amortized O(1) per temporary Term and the number of entries is
+ *   at most about twice the number of live temporary Terms.
+ *  The caller must hold the shard's lock for writing.
+ *  \param p_Shard INOUT The shard to sweep.
+ */
+void TermTable::SweepTemps( TermShard & p_Shard )
+{
+  std::tr1::unordered_map< std::string, std::tr1::weak_ptr< Term >, HashStr, StrEquNoCase >::iterator l_Iter = p_Shard.m_mTempLookup.begin();
+  while( l_Iter != p_Shard.m_mTempLookup.end() )
+  {
+    if( (*l_Iter).second.expired() )
+      p_Shard.m_mTempLookup.erase( l_Iter++ );
+    else
+      l_Iter++;
+  }
+  p_Shard.m_mTempLookup.rehash( 0 );
+
+  p_Shard.m_iTempSweepSize = 2 * p_Shard.m_mTempLookup.size();
+  if( p_Shard.m_iTempSweepSize < TERM_TABLE_MIN_SWEEP )
+    p_Shard.m_iTempSweepSize = TERM_TABLE_MIN_SWEEP;
 }
 
 /**
@@ -67,22 +303,7 @@ TermTable::~TermTable()
  */
 TermP TermTable::Lookup( std::string l_sKey )
 {
-  std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase >::iterator l_Iter = m_mTermLookup.find( l_sKey );
-  if( l_Iter == m_mTermLookup.end() )
-  {
-    std::string l_sUpper;
-    //    for( int i = 0; i < l_sKey.size(); i++ )
-    //      l_sUpper += toupper( l_sKey[i] );
-    l_sUpper = l_sKey;
-
-    TermP l_pNew( NewTerm( l_sUpper ) );
-    l_pNew->m_pThis = l_pNew;
-
-    m_mTermLookup[l_sUpper] = l_pNew;
-    return l_pNew;
-  }
-  else
-    return (*l_Iter).second;
+  return DoLookup( l_sKey, false );
 }
 
 /**
@@ -100,29 +321,132 @@ TermP TermTable::Lookup( std::string l_sKey )
 TermP TermTable::Lookup( std::string l_sKey, 
 			 std::string l_sTyping )
 {
-  std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase >::iterator l_Iter = m_mTermLookup.find( l_sKey );
-  if( l_Iter == m_mTermLookup.end() )
+  return DoLookup( l_sKey, l_sTyping, false );
+}
+
+/**
+ *  Lookup a pointer to the Term associated with a given string, creating a
+ *   temporary one if it does not exist.
+ *  Unlike with Lookup, the table does not keep a new Term alive; it is 
+ *   deallocated with the last pointer to it held elsewhere.  This is meant
+ *   for automatically named variables, which would otherwise accumulate 
+ *   without bound.
+ *  A new constant is kept alive regardless, as if by Lookup.
+ *  \param l_sKey IN The name of a Term to find or create a pointer to.
+ *  \return A const pointer to a Term related to the input string.  It is
+ *   guaranteed to be the same as any other pointer returned for that string
+ *   while any of them exist.
+ */
+TermP TermTable::LookupTemp( std::string l_sKey )
+{
+  return DoLookup( l_sKey, true );
+}
+
+/**
+ *  Lookup a pointer to the Term associated with a given name and type,
+ *   creating a temporary one if it does not exist.
+ *  As with LookupTemp, the table does not keep a new Term alive.
+ *  \param l_sKey IN The name of a Term to find or create a pointer to.
+ *  \param l_sTyping IN The type associated wih the Term to find or create.
+ *  \return A const pointer to a Term related to the input string.  It is
+ *   guaranteed to be the same as any other pointer returned for that string
+ *   while any of them exist.
+ */
+TermP TermTable::LookupTemp( std::string l_sKey, 
+			     std::string l_sTyping )
+{
+  return DoLookup( l_sKey, l_sTyping, true );
+}
+
+/**
+ *  Retrieve the constant with a given id.
+ *  Throws E_INDEX_OUT_OF_BOUNDS if no constant has that id.
+ *  This takes no lock, so it does not slow down threads that are adding to
+ *   the table.
+ *  \param p_iId IN The id of a constant, as returned by Term::GetId().
+ *  \return A smart pointer to the constant with that id.
+ */
+const TermP & TermTable::LookupId( unsigned int p_iId ) const
+{
+  if( p_iId < m_iNumIds )
+    return TermAt( p_iId );
+  else
+    throw Exception( E_INDEX_OUT_OF_BOUNDS,
+		     "Bounds error.",
+		     __FILE__,
+		     __LINE__ );
+}
+
+/**
+ *  Retrieve the number of constants that have ids.
+ *  \return One more than the highest id of any constant.
+ */
+unsigned int TermTable::GetNumIds() const
+{
+  return m_iNumIds;
+}
+
+/**
+ *  Find or create the Term with a given name.
+ *  \param l_sKey IN The name of a Term to find or create a pointer to.
+ *  \param p_bTemporary IN Whether a new Term should be temporary.
+ *  \return A pointer to the Term with that name.
+ */
+TermP TermTable::DoLookup( std::string l_sKey,
+			   bool p_bTemporary )
+{
+  TermShard & l_Shard = GetShard( l_sKey );
+  TermP l_pFound = Find( l_Shard, l_sKey );
+  if( !l_pFound )
   {
     std::string l_sUpper;
     //    for( int i = 0; i < l_sKey.size(); i++ )
     //      l_sUpper += toupper( l_sKey[i] );
     l_sUpper = l_sKey;
 
-    TermP l_pNew( NewTerm( l_sUpper, l_sTyping ) );
+    TermP l_pNew( NewTerm( l_sUpper ) );
     l_pNew->m_pThis = l_pNew;
 
-    m_mTermLookup[l_sUpper] = l_pNew;
-    return l_pNew;
+    return Insert( l_Shard, l_sUpper, l_pNew, p_bTemporary );
   }
   else
+    return l_pFound;
+}
+
+/**
+ *  Find or create the Term with a given name and type.
+ *  \param l_sKey IN The name of a Term to find or create a pointer to.
+ *  \param l_sTyping IN The type associated wih the Term to find or create.
+ *  \param p_bTemporary IN Whether a new Term should be temporary.
+ *  \return A pointer to the Term with that name.
+ */
+TermP TermTable::DoLookup( std::string l_sKey, 
+			   std::string l_sTyping,
+			   bool p_bTemporary )
+{
+  TermShard & l_Shard = GetShard( l_sKey );
+  TermP l_pFound = Find( l_Shard, l_sKey );
+  if( !l_pFound )
   {
-    if( CompareNoCase( (*l_Iter).second->GetTyping(), l_sTyping ) != 0 )
-      throw Exception( E_NOT_IMPLEMENTED,
-		       "Term " + l_sKey + " was already declared with type " + (*l_Iter).second->GetTyping() + ", but is now being used with type " + l_sTyping + ".",
-		       __FILE__,
-		       __LINE__ );
-    return (*l_Iter).second;
+    std::string l_sUpper;
+    //    for( int i = 0; i < l_sKey.size(); i++ )
+    //      l_sUpper += toupper( l_sKey[i] );
+    l_sUpper = l_sKey;
+
+    TermP l_pNew( NewTerm( l_sUpper, l_sTyping ) );
+    l_pNew->m_pThis = l_pNew;
+
+    l_pFound = Insert( l_Shard, l_sUpper, l_pNew, p_bTemporary );
+    if( l_pFound == l_pNew )
+      return l_pFound;
   }
+
+  if( CompareNoCase( l_pFound->GetTyping(), l_sTyping ) != 0 )
+    throw Exception( E_NOT_IMPLEMENTED,
+		     "Term " + l_sKey + " was already declared with type " + l_pFound->GetTyping() + ", but is now being used with type " + l_sTyping + ".",
+		     __FILE__,
+		     __LINE__ );
+  return l_pFound;
 }
 
 /**
@@ -192,9 +516,24 @@ Term * TermTable::NewTerm( std::string p_sName, std::string p_sTyping ) throw (
 
 size_t TermTable::GetMemSizeMin() const
 {
-  size_t l_iSize = sizeof( TermTable ) + m_mTermLookup.bucket_count() * ( sizeof( std::string ) + sizeof( TermP ) );
-  for( std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase >::const_iterator i = m_mTermLookup.begin(); i != m_mTermLookup.end(); i++ )
-    l_iSize += (*i).first.capacity() + (*i).second->GetMemSizeMax();
+  size_t l_iSize = sizeof( TermTable );
+  for( unsigned int j = 0; j < TERM_TABLE_SHARDS; j++ )
+  {
+    const TermShard & l_Shard = m_aShards[j];
+    pthread_rwlock_rdlock( &l_Shard.m_Lock );
+    l_iSize += l_Shard.m_mTermLookup.bucket_count() * ( sizeof( std::string ) + sizeof( TermP ) );
+    for( std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase >::const_iterator i = l_Shard.m_mTermLookup.begin(); i != l_Shard.m_mTermLookup.end(); i++ )
+      l_iSize += (*i).first.capacity() + (*i).second->GetMemSizeMax();
+    l_iSize += l_Shard.m_mTempLookup.bucket_count() * ( sizeof( std::string ) + sizeof( std::tr1::weak_ptr< Term > ) );
+    for( std::tr1::unordered_map< std::string, std::tr1::weak_ptr< Term >, HashStr, StrEquNoCase >::const_iterator i = l_Shard.m_mTempLookup.begin(); i != l_Shard.m_mTempLookup.end(); i++ )
+    {
+      TermP l_pTerm = (*i).second.lock();
+      l_iSize += (*i).first.capacity() + ( l_pTerm ? l_pTerm->GetMemSizeMax() : 0 );
+    }
+    pthread_rwlock_unlock( &l_Shard.m_Lock );
+  }
+  for( unsigned int i = 0; i < TERM_TABLE_MAX_CHUNKS && m_apIdChunks[i] != NULL; i++ )
+    l_iSize += ( 1 << ( TERM_TABLE_CHUNK_BITS + i ) ) * sizeof( TermP );
   return l_iSize;
 }
 
@@ -2,13 +2,32 @@
 #define TERM_TABLE_HPP__
 
 #include <tr1/unordered_map>
+#include <pthread.h>
+
+#define TERM_TABLE_SHARDS 16
+#define TERM_TABLE_MIN_SWEEP 256
+#define TERM_TABLE_CHUNK_BITS 8
+#define TERM_TABLE_MAX_CHUNKS 24
+
+struct TermShard
+{
+  mutable pthread_rwlock_t m_Lock;
+  std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase > m_mTermLookup;
+  std::tr1::unordered_map< std::string, std::tr1::weak_ptr< Term >, HashStr, StrEquNoCase > m_mTempLookup;
+  unsigned int m_iTempSweepSize;
+};
 
 class TermTable
 {
 public:
+  TermTable();
   virtual ~TermTable();
   TermP Lookup( std::string l_sKey );
   TermP Lookup( std::string l_sKey, std::string l_sTyping );
+  TermP LookupTemp( std::string l_sKey );
+  TermP LookupTemp( std::string l_sKey, std::string l_sTyping );
+  const TermP & LookupId( unsigned int p_iId ) const;
+  unsigned int GetNumIds() const;
   size_t GetMemSizeMin() const;
   size_t GetMemSizeMax() const;
 private:
@@ -17,7 +36,23 @@ private:
 
   static Term * NewTerm( std::string p_sName, std::string p_sTyping ) throw ( MissingStringException );
 
-  std::tr1::unordered_map< std::string, TermP, HashStr, StrEquNoCase > m_mTermLookup;
+  TermTable( const TermTable & p_Other );
+  TermTable & operator=( const TermTable & p_Other );
+
+  TermShard & GetShard( const std::string & p_sKey );
+  TermP Find( TermShard & p_Shard, const std::string & p_sKey );
+  TermP Insert( TermShard & p_Shard, const std::string & p_sKey, const TermP & p_pNew, bool p_bTemporary );
+  void SweepTemps( TermShard & p_Shard );
+  void AssignId( const TermP & p_pNew );
+  TermP & TermAt( unsigned int p_iId ) const;
+
+  TermP DoLookup( std::string l_sKey, bool p_bTemporary );
+  TermP DoLookup( std::string l_sKey, std::string l_sTyping, bool p_bTemporary );
+
+  TermShard m_aShards[TERM_TABLE_SHARDS];
+  TermP * m_apIdChunks[TERM_TABLE_MAX_CHUNKS];
+  volatile unsigned int m_iNumIds;
+  pthread_mutex_t m_IdMutex;
 };
 
 #endif//TERM_TABLE_HPP__
@@ -5,10 +5,17 @@
 #include <fstream>
 #include <iostream>
 #include <set>
+#include <algorithm>
 #include <tr1/memory>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "exception.hpp"
 #include "funcs.hpp"
+#include "pddl_tokenizer.hpp"
 #include "string_table.hpp"
 #include "term.hpp"
 #include "term_string.hpp"
@@ -23,13 +30,20 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+#include "slot_substitution.hpp"
 #include "state.hpp"
+#include "instantiation_cursor.hpp"
 #include "strips_domain.hpp"
 #include "strips_problem.hpp"
 #include "strips_solution.hpp"
+#include "strips_grounding.hpp"
 #include "htn_task_head.hpp"
 #include "htn_task_descr.hpp"
 #include "htn_method.hpp"
+#include "compiled_domain.hpp"
+#include "failure_cache.hpp"
 #include "htn_domain.hpp"
 #include "htn_task_list.hpp"
 #include "annotated_plan.hpp"
@@ -59,6 +73,19 @@ void TestTermCreation()
   TermP l_pVar1 = g_TermTable.Lookup( "?t1" );
   assert( l_pVar1->GetType() == TT_VARIABLE );
   assert( CompareNoCase( l_pVar1->ToStr(), "?T1" ) == 0 );
+
+  TermP l_pTemp1 = g_TermTable.LookupTemp( "?temp_test" );
+  assert( l_pTemp1->GetType() == TT_VARIABLE );
+  assert( g_TermTable.Lookup( "?temp_test" ) == l_pTemp1 );
+  assert( g_TermTable.LookupTemp( "?temp_test" ) == l_pTemp1 );
+  std::tr1::weak_ptr< Term > l_pTempWeak( l_pTemp1 );
+  l_pTemp1.reset();
+  assert( l_pTempWeak.expired() );
+  for( unsigned int i = 0; i < 1000; i++ )
+    g_TermTable.LookupTemp( MakeVarId() );
+  TermP l_pTemp2 = g_TermTable.LookupTemp( "?temp_test", "truck" );
+  assert( l_pTemp2->HasTyping() );
+  assert( CompareNoCase( l_pTemp2->GetTyping(), "truck" ) == 0 );
 }
 
 //FormulaPLess myFormulaPLess;
@@ -537,6 +564,63 @@ void TestStateCreation()
   assert( *l_pInitState == *l_pOtherState );
   assert( l_pInitState->GetStateNum() == 0 );
 
+  FormulaPred l_Pred1( "(at p0 l10)", TypeTable(), g_NoPredicates );
+  FormulaPred l_Pred2( "(at p0 l20)", TypeTable(), g_NoPredicates );
+  GroundAtom l_Atom1( l_Pred1 );
+  GroundAtom l_Atom2( l_Pred2 );
+  assert( l_Atom1 == GroundAtom( l_Pred1 ) );
+  assert( l_Atom1.Hash() == GroundAtom( l_Pred1 ).Hash() );
+  assert( !( l_Atom1 == l_Atom2 ) );
+  assert( l_Atom1.GetRelationIndex() == l_Pred1.GetRelationIndex() );
+  assert( l_Atom1.GetValence() == 2 );
+  assert( l_Atom1.GetArgId( 0 ) == l_Atom2.GetArgId( 0 ) );
+  assert( l_Atom1.GetCParam( 1 ) == l_Pred1.GetCParam( 1 ) );
+  assert( g_TermTable.LookupId( l_Atom2.GetArgId( 1 ) ) == l_Pred2.GetCParam( 1 ) );
+  assert( l_Atom1.ToStr() == l_Pred1.ToStr() );
+
+  bool l_bThrown = false;
+  try
+  {
+    GroundAtom l_Bad( FormulaPred( "(at ?p l10)", TypeTable(), g_NoPredicates ) );
+  }
+  catch( Exception & e )
+  {
+    l_bThrown = true;
+  }
+  assert( l_bThrown );
+
+  // Atoms wider than GROUND_ATOM_MAX_ARGS keep the rest of their parameters
+  //  elsewhere, but behave the same.
+  FormulaPred l_Wide1( "(route a0 c0 c1 c2 l00 l10 l20 p0)", TypeTable(), g_NoPredicates );
+  FormulaPred l_Wide2( "(route a0 c0 c1 c2 l00 l10 l20 p1)", TypeTable(), g_NoPredicates );
+  GroundAtom l_WideAtom1( l_Wide1 );
+  assert( l_WideAtom1 == GroundAtom( l_Wide1 ) );
+  assert( l_WideAtom1.Hash() == GroundAtom( l_Wide1 ).Hash() );
+  assert( !( l_WideAtom1 == GroundAtom( l_Wide2 ) ) );
+  assert( l_WideAtom1.GetValence() == 8 );
+  assert( l_WideAtom1.GetCParam( 7 ) == l_Wide1.GetCParam( 7 ) );
+  assert( l_WideAtom1.ToStr() == l_Wide1.ToStr() );
+
+  State * l_pWideState = new State( "( (route a0 c0 c1 c2 l00 l10 l20 p0) (AIRPLANE a0) )", 0, TypeTable(), std::vector< FormulaPred >() );
+  assert( l_pWideState->IsConsistent( FormulaP( new FormulaPred( l_Wide1 ) ) ) );
+  assert( !l_pWideState->IsConsistent( FormulaP( new FormulaPred( l_Wide2 ) ) ) );
+
+  std::stringstream l_sOpStream( "(:action !REROUTE :parameters (?a ?p) :precondition (and (AIRPLANE ?a) (route ?a c0 c1 c2 l00 l10 l20 ?p)) :effect (and (not (route ?a c0 c1 c2 l00 l10 l20 ?p)) (route ?a c0 c1 c2 l00 l10 l20 p1)))" );
+  Operator * l_pOp = Operator::FromPddl( l_sOpStream, std::set< std::string, StrLessNoCase >(), std::vector< FormulaPred >() );
+  Substitution l_Subs;
+  std::vector< Substitution * > * l_pSubs = l_pWideState->GetInstantiations( l_pOp, &l_Subs );
+  assert( l_pSubs->size() == 1 );
+  State * l_pRerouted = l_pWideState->NextState( l_pOp, (*l_pSubs)[0] );
+  assert( l_pRerouted->GetNumAtoms() == 2 );
+  assert( !l_pRerouted->IsConsistent( FormulaP( new FormulaPred( l_Wide1 ) ) ) );
+  assert( l_pRerouted->IsConsistent( FormulaP( new FormulaPred( l_Wide2 ) ) ) );
+  delete l_pRerouted;
+  for( unsigned int i = 0; i < l_pSubs->size(); i++ )
+    delete (*l_pSubs)[i];
+  delete l_pSubs;
+  delete l_pOp;
+  delete l_pWideState;
+
   delete l_pOtherState;
   delete l_pInitState;
 }
@@ -656,6 +740,100 @@ void TestStateGetInstantiations()
     delete (*l_pSubs)[i];
   delete l_pSubs;
 
+  // Bound arguments restrict which atoms are tried.
+  TermVariableP l_pVarX( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( "?X" ) ) );
+  std::set< TermVariableP > l_vRelVars;
+  l_vRelVars.insert( l_pVarX );
+  FormulaConjP l_pAtL10( new FormulaConj( "(and (at ?x l10))", TypeTable(), g_NoPredicates ) );
+  FormulaConjP l_pAtL21( new FormulaConj( "(and (at ?x l21))", TypeTable(), g_NoPredicates ) );
+  FormulaConjP l_pTruckAtL10( new FormulaConj( "(and (at ?x l10) (TRUCK ?x))", TypeTable(), g_NoPredicates ) );
+
+  l_pSubs = l_pInitState->GetInstantiations( l_pAtL10, &l_Subs, l_vRelVars );
+  assert( l_pSubs->size() == 2 );
+  for( unsigned int i = 0; i < l_pSubs->size(); i++ )
+    delete (*l_pSubs)[i];
+  delete l_pSubs;
+
+  l_pSubs = l_pInitState->GetInstantiations( l_pAtL21, &l_Subs, l_vRelVars );
+  assert( l_pSubs->size() == 0 );
+  delete l_pSubs;
+
+  l_pSubs = l_pInitState->GetInstantiations( l_pTruckAtL10, &l_Subs, l_vRelVars );
+  assert( l_pSubs->size() == 1 );
+  assert( CompareNoCase( l_pSubs->at( 0 )->FindIndexByVar( l_pVarX )->second->ToStr(), "T1" ) == 0 );
+  for( unsigned int i = 0; i < l_pSubs->size(); i++ )
+    delete (*l_pSubs)[i];
+  delete l_pSubs;
+
+  // A compiled plan must give the same Substitutions in the same order.
+  FormulaConjP l_pMixed( new FormulaConj( "(and (at ?x ?y) (in-city ?y ?c) (not (= ?x ?z)) (TRUCK ?z) (= ?c c2))", TypeTable(), g_NoPredicates ) );
+  UnifyPlan l_Plan( l_pMixed );
+  assert( l_Plan.IsCompiled() );
+  assert( l_Plan.GetNumLiterals() == 5 );
+  assert( l_Plan.GetNumVars() == 4 );
+  std::vector<Substitution *> * l_pLegacy = l_pInitState->GetInstantiations( l_pMixed, &l_Subs, l_vRelVars );
+  l_pSubs = l_pInitState->GetInstantiations( l_Plan, &l_Subs, l_vRelVars );
+  assert( l_pSubs->size() > 0 );
+  assert( l_pSubs->size() == l_pLegacy->size() );
+  for( unsigned int i = 0; i < l_pSubs->size(); i++ )
+  {
+    assert( l_pSubs->at( i )->Equal( *l_pLegacy->at( i ) ) );
+    delete (*l_pSubs)[i];
+    delete (*l_pLegacy)[i];
+  }
+  delete l_pSubs;
+  delete l_pLegacy;
+
+  // A cursor yields the same Substitutions one at a time, and may be
+  //  abandoned early.
+  l_pLegacy = l_pInitState->GetInstantiations( l_pMixed, &l_Subs, l_vRelVars );
+  InstantiationCursor * l_pCursor = new InstantiationCursor( l_pInitState, l_Plan, &l_Subs, l_vRelVars );
+  for( unsigned int i = 0; i < l_pLegacy->size(); i++ )
+  {
+    Substitution * l_pNext = l_pCursor->Next();
+    assert( l_pNext != NULL );
+    assert( l_pNext->Equal( *l_pLegacy->at( i ) ) );
+    assert( l_pCursor->GetNumYielded() == i + 1 );
+    delete l_pNext;
+  }
+  assert( l_pCursor->Next() == NULL );
+  delete l_pCursor;
+  l_pCursor = new InstantiationCursor( l_pInitState, l_Plan, &l_Subs, l_vRelVars );
+  Substitution * l_pFirst = l_pCursor->Next();
+  assert( l_pFirst->Equal( *l_pLegacy->at( 0 ) ) );
+  delete l_pFirst;
+  delete l_pCursor;
+
+  // A projected cursor yields the first Substitution for each binding of the
+  //  projected variables, whether or not they are relevant.
+  const char * l_aProjections[] = { "?X", "?Y", "?C" };
+  for( unsigned int l_iProj = 0; l_iProj < 3; l_iProj++ )
+  {
+    std::vector< TermVariableP > l_vProject;
+    l_vProject.push_back( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( l_aProjections[l_iProj] ) ) );
+    std::set< TermP > l_vSeen;
+    l_pCursor = new InstantiationCursor( l_pInitState, l_Plan, &l_Subs, l_vRelVars );
+    l_pCursor->Project( l_vProject );
+    for( unsigned int i = 0; i < l_pLegacy->size(); i++ )
+    {
+      TermP l_pBinding = l_pLegacy->at( i )->FindIndexByVar( l_vProject[0] )->second;
+      if( !l_vSeen.insert( l_pBinding ).second )
+	continue;
+      Substitution * l_pNext = l_pCursor->Next();
+      assert( l_pNext != NULL );
+      assert( l_pNext->Equal( *l_pLegacy->at( i ) ) );
+      delete l_pNext;
+    }
+    assert( l_pCursor->Next() == NULL );
+    assert( l_pCursor->GetNumYielded() == l_vSeen.size() );
+    assert( l_iProj != 2 || l_vSeen.size() == 1 );
+    delete l_pCursor;
+  }
+
+  for( unsigned int i = 0; i < l_pLegacy->size(); i++ )
+    delete (*l_pLegacy)[i];
+  delete l_pLegacy;
+
   delete l_pOp;
   delete l_pInitState;
 }
@@ -697,6 +875,88 @@ void TestNextState()
   assert( !l_pOption3->IsConsistent( l_pForm1 ) );
   assert( l_pOption3->IsConsistent( l_pForm2 ) );
 
+  assert( !( *l_pOption1 == *l_pOption2 ) );
+  assert( !( *l_pOption2 == *l_pOption3 ) );
+  assert( !( *l_pOption3 == *l_pOption1 ) );
+
+  // The successors share rows with the original, which must not change.
+  assert( l_pInitState->IsConsistent( l_pForm0 ) );
+  assert( !l_pInitState->IsConsistent( l_pForm1 ) );
+  assert( !l_pInitState->IsConsistent( l_pForm2 ) );
+
+  State * l_pOption1Copy = new State( *l_pOption1 );
+  assert( *l_pOption1Copy == *l_pOption1 );
+  assert( l_pOption1Copy->IsConsistent( l_pForm0 ) );
+  assert( !l_pOption1Copy->IsConsistent( l_pForm1 ) );
+  delete l_pOption1Copy;
+
+  // Removing atoms from a large row, in no particular order, must keep its
+  //  hashtable and argument lists consistent with its atoms.
+  std::string l_sEdges = "( ";
+  for( unsigned int i = 0; i < 8; i++ )
+  {
+    for( unsigned int j = 0; j < 8; j++ )
+    {
+      char l_cArray[32];
+      sprintf( l_cArray, "(EDGE n%d n%d) ", i, j );
+      l_sEdges += l_cArray;
+    }
+  }
+  l_sEdges += ")";
+  std::stringstream l_sCutStream( "(:action !CUT :parameters (?x ?y) :precondition (and (EDGE ?x ?y)) :effect (and (not (EDGE ?x ?y))))" );
+  Operator * l_pCut = Operator::FromPddl( l_sCutStream, std::set< std::string, StrLessNoCase >(), std::vector< FormulaPred >() );
+  std::stringstream l_sCutN3Stream( "(:action !CUT-N3 :parameters (?y) :precondition (and (EDGE n3 ?y)) :effect (and (not (EDGE n3 ?y))))" );
+  Operator * l_pCutN3 = Operator::FromPddl( l_sCutN3Stream, std::set< std::string, StrLessNoCase >(), std::vector< FormulaPred >() );
+  State * l_pEdges = new State( l_sEdges, 0, TypeTable(), std::vector< FormulaPred >() );
+  std::vector<Substitution *> * l_pCutSubs = l_pEdges->GetInstantiations( l_pCut, &l_Subs );
+  assert( l_pCutSubs->size() == 64 );
+
+  for( unsigned int m = 0; m < 64; m++ )
+  {
+    unsigned int k = ( m * 37 ) % 64;
+    if( k % 3 == 0 )
+      continue;
+    State * l_pNext = l_pEdges->NextState( l_pCut, (*l_pCutSubs)[k] );
+    delete l_pEdges;
+    l_pEdges = l_pNext;
+  }
+
+  std::vector< GroundAtom > l_vLeft;
+  for( unsigned int k = 0; k < 64; k++ )
+  {
+    FormulaP l_pEdge( l_pCut->GetCPreconditions()->AfterSubstitution( *(*l_pCutSubs)[k], 0 ) );
+    assert( l_pEdges->IsConsistent( l_pEdge ) == ( k % 3 == 0 ) );
+    if( k % 3 == 0 )
+      l_vLeft.push_back( GroundAtom( *std::tr1::dynamic_pointer_cast< FormulaPred >( *std::tr1::dynamic_pointer_cast< FormulaConj >( l_pEdge )->GetBeginConj() ) ) );
+  }
+  State l_Left( l_vLeft, 0 );
+  assert( l_Left == *l_pEdges );
+  assert( l_Left.GetHash() == l_pEdges->GetHash() );
+  assert( l_Left.GetCheckHash() == l_pEdges->GetCheckHash() );
+
+  std::vector<Substitution *> * l_pLeftSubs = l_pEdges->GetInstantiations( l_pCut, &l_Subs );
+  assert( l_pLeftSubs->size() == l_vLeft.size() );
+  for( unsigned int i = 0; i < l_pLeftSubs->size(); i++ )
+    delete (*l_pLeftSubs)[i];
+  delete l_pLeftSubs;
+  l_pLeftSubs = l_pEdges->GetInstantiations( l_pCutN3, &l_Subs );
+  std::vector<Substitution *> * l_pRebuiltSubs = l_Left.GetInstantiations( l_pCutN3, &l_Subs );
+  assert( l_pLeftSubs->size() == l_pRebuiltSubs->size() && !l_pLeftSubs->empty() );
+  for( unsigned int i = 0; i < l_pLeftSubs->size(); i++ )
+  {
+    delete (*l_pLeftSubs)[i];
+    delete (*l_pRebuiltSubs)[i];
+  }
+  delete l_pLeftSubs;
+  delete l_pRebuiltSubs;
+
+  for( unsigned int i = 0; i < l_pCutSubs->size(); i++ )
+    delete (*l_pCutSubs)[i];
+  delete l_pCutSubs;
+  delete l_pEdges;
+  delete l_pCutN3;
+  delete l_pCut;
+
   delete l_pOption3;
   delete l_pOption2;
   delete l_pOption1;
@@ -914,6 +1174,11 @@ void TestHtnTaskDescr()
   assert( CompareNoCase( l_pTask1->GetCHead()->GetCParam( 2 )->ToStr(), "?DST" ) == 0 );
   //  assert( CompareNoCase( l_pTask1->GetCPreconditions()->ToStr(), "( and ( TRUCK ?TRUCK ) ( LOCATION ?SRC ) ( LOCATION ?DST ) ( CITY ?CITY ) ( IN-CITY ?SRC ?CITY ) ( IN-CITY ?DST ?CITY ) ( AT ?TRUCK ?SRC ) )" ) == 0 );
   //  assert( CompareNoCase( l_pTask1->GetCEffects()->ToStr(), "( and ( not ( AT ?TRUCK ?SRC ) ) ( AT ?TRUCK ?DST ) )" ) == 0 );
+
+  HtnTaskDescr l_Task2( l_pTask1->ToPddl(), std::set< std::string, StrLessNoCase >(), std::vector< FormulaPred >() );
+  assert( l_Task2.ToPddl() == l_pTask1->ToPddl() );
+  assert( l_Task2.GetCHead()->GetNumParams() == 3 );
+  assert( l_Task2.GetCEffects()->Equal( *l_pTask1->GetCEffects() ) );
 }
 
 void TestHtnTaskList()
@@ -1025,6 +1290,37 @@ void TestHtnMethod()
   assert( l_pMethod9->Subsumes( l_pMethod8 ) );
   assert( l_pMethod9->Subsumes( l_pMethod9 ) );
 
+  // MightSubsume() never rejects a pair that Subsumes() accepts.
+  HtnMethod * l_apMethods[] = { l_pMethod1, l_pMethod2, l_pMethod3, l_pMethod4, l_pMethod5, l_pMethod6, l_pMethod7, l_pMethod8, l_pMethod9 };
+  for( unsigned int i = 0; i < 9; i++ )
+  {
+    for( unsigned int j = 0; j < 9; j++ )
+    {
+      assert( !l_apMethods[i]->Subsumes( l_apMethods[j] ) || l_apMethods[i]->MightSubsume( l_apMethods[j] ) );
+      assert( ( l_apMethods[i]->GetShape() == l_apMethods[j]->GetShape() ) == ( ( i < 5 ) == ( j < 5 ) && ( i == 3 ) == ( j == 3 ) ) );
+    }
+  }
+  assert( !l_pMethod3->MightSubsume( l_pMethod1 ) );
+  assert( l_pMethod1->MightSubsume( l_pMethod3 ) );
+  assert( !l_pMethod6->MightSubsume( l_pMethod7 ) );
+
+  // Alpha-equivalent methods share a canonical form, whatever the order of
+  //  their preconditions.
+  std::stringstream l_sMethod10Stream( "( :method ( method1 ?x ?y ) ( ( D ?w ) ( C ?z ) ( b ?y ) ( A ?x ) ) ( ( !OPER1 ?x ?y ) ) )" );
+  HtnMethod * l_pMethod10 = HtnMethod::FromShop( l_sMethod10Stream );
+  assert( l_pMethod1->GetCanonicalForm() == l_pMethod2->GetCanonicalForm() );
+  assert( l_pMethod1->GetFingerprint() == l_pMethod2->GetFingerprint() );
+  assert( l_pMethod1->GetCanonicalForm() != l_pMethod3->GetCanonicalForm() );
+  assert( l_pMethod1->GetFingerprint() != l_pMethod3->GetFingerprint() );
+  assert( l_pMethod4->GetCanonicalForm() != l_pMethod5->GetCanonicalForm() );
+  assert( l_pMethod6->GetCanonicalForm() == l_pMethod10->GetCanonicalForm() );
+  assert( l_pMethod6->GetFingerprint() == l_pMethod10->GetFingerprint() );
+  assert( l_pMethod6->GetCanonicalForm() != l_pMethod8->GetCanonicalForm() );
+  assert( l_pMethod6->GetCanonicalForm() != l_pMethod9->GetCanonicalForm() );
+  assert( l_pMethod6->Subsumes( l_pMethod10 ) && l_pMethod10->Subsumes( l_pMethod6 ) );
+  HtnMethod l_Method10Copy( *l_pMethod10 );
+  assert( l_Method10Copy.GetFingerprint() == l_pMethod10->GetFingerprint() );
+
   std::string l_FlyStrings[7];
   l_FlyStrings[0] = 
     "( :method ( DELIVER-PKG ?a_390 ?a_391 ) \n"
@@ -1328,6 +1624,7 @@ void TestHtnMethod()
 
 
   for( unsigned int i = 0; i < 7; i++ ) delete l_FlyMethods[i];
+  delete l_pMethod10;
   delete l_pMethod9;
   delete l_pMethod8;
   delete l_pMethod7;
@@ -1497,6 +1794,26 @@ void TestAnnotatedPlan()
   assert( l_pPlan->GetMethodBeforeState( 1 ) == 2 );
   assert( l_pPlan->GetMethodAfterState( 1 ) == 5 );
 
+  // Saved method instantiations come back with the same states, costs, and
+  //  ground preconditions, but variables of their own.
+  long l_iReqs = PDDL_REQ_STRIPS | PDDL_REQ_HTN;
+  std::stringstream l_sSaved( l_pPlan->MethodInstsToPddl( l_iReqs ) );
+  AnnotatedPlan * l_pResumed = new AnnotatedPlan( l_pProblem,
+						  ReadFile( "tests/test-sol.pddl" ) );
+  l_pResumed->MethodInstsFromPddl( l_sSaved, std::set< std::string, StrLessNoCase >(), g_NoPredicates, l_iReqs );
+  assert( l_pResumed->GetNumMethods() == 2 );
+  for( unsigned int i = 0; i < 2; i++ )
+  {
+    assert( l_pResumed->GetMethodBeforeState( i ) == l_pPlan->GetMethodBeforeState( i ) );
+    assert( l_pResumed->GetMethodAfterState( i ) == l_pPlan->GetMethodAfterState( i ) );
+    assert( l_pResumed->GetMethodCost( i ) == l_pPlan->GetMethodCost( i ) );
+    assert( l_pResumed->GetCMethod( i )->GetCanonicalForm() == l_pPlan->GetCMethod( i )->GetCanonicalForm() );
+    assert( l_pResumed->GetCMethod( i )->GetCPreconditions()->AfterSubstitution( *l_pResumed->GetCMethodSub( i ), 0 )->Equal( *l_pPlan->GetCMethod( i )->GetCPreconditions()->AfterSubstitution( *l_pPlan->GetCMethodSub( i ), 0 ) ) );
+    assert( l_pResumed->GetCMethodEffects( i )->AfterSubstitution( *l_pResumed->GetCMethodSub( i ), 0 )->Equal( *l_pPlan->GetCMethodEffects( i )->AfterSubstitution( *l_pPlan->GetCMethodSub( i ), 0 ) ) );
+    assert( !l_pResumed->GetCMethod( i )->GetCHead()->GetCParam( 0 )->Equal( *l_pPlan->GetCMethod( i )->GetCHead()->GetCParam( 0 ) ) );
+  }
+  delete l_pResumed;
+
   delete l_pSubs2;
   delete l_pMethod2;
   delete l_pSubs1;
@@ -1516,6 +1833,32 @@ void TestHtnDomain()
   assert( l_pHtnDomain->GetNumMethods() == l_pOtherDom->GetNumMethods() + 1 );
   assert( l_pOtherDom->GetDomainName() == "logistics" );
 
+  // The task index lists every method for a task, in order, and stays up to
+  //  date as methods are removed.
+  HtnDomain * l_apDoms[] = { l_pHtnDomain, l_pOtherDom };
+  for( unsigned int d = 0; d < 2; d++ )
+  {
+    for( unsigned int i = 0; i < l_apDoms[d]->GetNumMethods(); i++ )
+    {
+      const std::vector< unsigned int > & l_vForTask = l_apDoms[d]->GetMethodsForTask( l_apDoms[d]->GetCMethod( i )->GetCHead()->GetName() );
+      unsigned int l_iNumFound = 0;
+      for( unsigned int j = 0; j < l_vForTask.size(); j++ )
+      {
+	assert( CompareNoCase( l_apDoms[d]->GetCMethod( l_vForTask[j] )->GetCHead()->GetName(), l_apDoms[d]->GetCMethod( i )->GetCHead()->GetName() ) == 0 );
+	assert( j == 0 || l_vForTask[j - 1] < l_vForTask[j] );
+	if( l_vForTask[j] == i )
+	  l_iNumFound++;
+      }
+      assert( l_iNumFound == 1 );
+    }
+    for( unsigned int i = 0; i < l_apDoms[d]->GetNumOperators(); i++ )
+    {
+      int l_iOper = l_apDoms[d]->GetOperatorForTask( g_StrTable.Lookup( l_apDoms[d]->GetCOperator( i )->GetName() ) );
+      assert( l_iOper >= 0 && l_iOper <= (int)i );
+    }
+  }
+  assert( l_pHtnDomain->GetMethodsForTask( "no-such-task" ).empty() );
+
   delete l_pOtherDom;
   delete l_pHtnDomain;
 }
@@ -1573,6 +1916,15 @@ void TestHtnSolution()
   l_pSubs1->AddPair( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( "?auto_285" ) ),
 			 g_TermTable.Lookup( "l10" ) );
 
+  l_pSol2->EnableUndo();
+  unsigned int l_iMark = l_pSol2->GetUndoMark();
+  l_pSol2->ApplyMethod( 4, l_pSubs1 );
+  assert( l_pSol2->GetUndoMark() == l_iMark + 1 );
+  l_pSol2->UndoTo( l_iMark );
+  assert( l_pSol2->GetUndoMark() == l_iMark );
+  assert( l_pSol2->GetDecompTree().empty() );
+  assert( l_pSol2->GetCTopTask() == l_pSol1->GetCTopTask() );
+
   l_pSol1->ApplyMethod( 4, l_pSubs1 );
 
   delete l_pSubs1;
@@ -1580,11 +1932,53 @@ void TestHtnSolution()
   delete l_pSol1;
 }
 
+struct InternResults
+{
+  std::vector< unsigned int > m_vStrs;
+  std::vector< TermP > m_vTerms;
+};
+
+void * InternConcurrently( void * p_pResults )
+{
+  InternResults * l_pResults = (InternResults *)p_pResults;
+  for( unsigned int i = 0; i < 1000; i++ )
+  {
+    char l_cArray[32];
+    sprintf( l_cArray, "concurrent_%d", i );
+    l_pResults->m_vStrs.push_back( g_StrTable.Lookup( std::string( l_cArray ) ) );
+    l_pResults->m_vTerms.push_back( g_TermTable.Lookup( std::string( l_cArray ) ) );
+  }
+  return NULL;
+}
+
 void TestStringTable()
 {
   unsigned int l_iStr2 = g_StrTable.Lookup( "tiger" );
   assert( g_StrTable.Lookup( "TIGER" ) == l_iStr2 );
   assert( g_StrTable.Lookup( l_iStr2 ) == "TIGER" );
+
+  pthread_t l_aThreads[4];
+  InternResults l_aResults[4];
+  for( unsigned int i = 0; i < 4; i++ )
+  {
+    // The thread must be started even when assertions are compiled out.
+    int l_iRet = pthread_create( &l_aThreads[i], NULL, InternConcurrently, &l_aResults[i] );
+    assert( l_iRet == 0 );
+  }
+  for( unsigned int i = 0; i < 4; i++ )
+    pthread_join( l_aThreads[i], NULL );
+  for( unsigned int j = 0; j < 1000; j++ )
+  {
+    char l_cArray[32];
+    sprintf( l_cArray, "CONCURRENT_%d", j );
+    assert( g_StrTable.Lookup( l_aResults[0].m_vStrs[j] ) == l_cArray );
+    assert( CompareNoCase( l_aResults[0].m_vTerms[j]->ToStr(), l_cArray ) == 0 );
+    for( unsigned int i = 1; i < 4; i++ )
+    {
+      assert( l_aResults[i].m_vStrs[j] == l_aResults[0].m_vStrs[j] );
+      assert( l_aResults[i].m_vTerms[j] == l_aResults[0].m_vTerms[j] );
+    }
+  }
 }
 
 void TestSubtasksAreLinked()
@@ -1698,3 +2092,372 @@ void TestTyping()
 
   delete l_pState;
 }
+
+void TestGrounding()
+{
+  std::tr1::shared_ptr< StripsDomain > l_pDomain( new StripsDomain(
+      "( define ( domain grounding )\n"
+      "  ( :requirements :strips :typing :equality )\n"
+      "  ( :types loc )\n"
+      "  ( :predicates\n"
+      "    ( at ?l - loc )\n"
+      "    ( visited ?l - loc )\n"
+      "    ( blocked ?l - loc )\n"
+      "  )\n"
+      "  ( :action !move\n"
+      "    :parameters ( ?from - loc ?to - loc )\n"
+      "    :precondition ( and ( at ?from ) ( not ( = ?from ?to ) ) ( not ( blocked ?to ) ) )\n"
+      "    :effect ( and ( not ( at ?from ) ) ( at ?to ) ( visited ?to ) )\n"
+      "  )\n"
+      ")\n" ) );
+  std::tr1::shared_ptr< StripsProblem > l_pProblem( new StripsProblem(
+      "( define ( problem grounding-1 )\n"
+      "  ( :domain grounding )\n"
+      "  ( :requirements :strips :typing :equality )\n"
+      "  ( :objects l1 - loc l2 - loc l3 - loc )\n"
+      "  ( :init ( at l1 ) ( blocked l3 ) )\n"
+      "  ( :goal ( and ( visited l2 ) ( at l1 ) ) )\n"
+      ")\n",
+      l_pDomain ) );
+
+  StripsGrounding l_Grounding( l_pProblem );
+
+  // ?to is bound to objects that appear in no atom of the initial state, and
+  //  ( blocked ?to ) is ignored while grounding, though every ( blocked ?l )
+  //  it names still gets a bit.
+  assert( l_Grounding.GetNumAtoms() == 9 );
+  assert( l_Grounding.GetNumActions() == 6 );
+  assert( l_Grounding.GetNumWords() == 1 );
+  assert( !l_Grounding.SatisfiesGoals( l_Grounding.GetInitState() ) );
+
+  std::vector< unsigned int > l_vApplicable;
+  l_Grounding.GetApplicable( l_Grounding.GetInitState(), l_vApplicable );
+  assert( l_vApplicable.size() == 1 );
+  assert( l_Grounding.GetOperIndex( l_vApplicable[0] ) == 0 );
+  assert( l_Grounding.FindAction( 0, l_Grounding.GetCSubstitution( l_vApplicable[0] ) ) == (int)l_vApplicable[0] );
+
+  const State * l_pState = l_pProblem->GetCInitState();
+  State * l_pOwned = NULL;
+  AtomBits l_vState = l_Grounding.GetInitState();
+  for( unsigned int l_iStep = 0; l_iStep < 2; l_iStep++ )
+  {
+    l_vApplicable.clear();
+    l_Grounding.GetApplicable( l_vState, l_vApplicable );
+    assert( l_vApplicable.size() == 1 );
+    unsigned int l_iAction = l_vApplicable[0];
+
+    // The bitset state must agree with the lifted one.
+    State * l_pNext = l_pState->NextState( l_pDomain->GetCOper( l_Grounding.GetOperIndex( l_iAction ) ),
+					   l_Grounding.GetCSubstitution( l_iAction ) );
+    l_Grounding.Apply( l_iAction, l_vState, l_vState );
+    std::string l_sBits = l_Grounding.StateToStr( l_vState );
+    std::vector< GroundAtom > l_vAtoms = l_pNext->GetAtoms();
+    unsigned int l_iNumBits = 0;
+    for( unsigned int i = 0; i < l_Grounding.GetNumAtoms(); i++ )
+      if( l_vState[i / GROUNDING_WORD_BITS] & ( 1UL << ( i % GROUNDING_WORD_BITS ) ) )
+	l_iNumBits++;
+    assert( l_iNumBits == l_vAtoms.size() );
+    for( unsigned int i = 0; i < l_vAtoms.size(); i++ )
+      assert( l_sBits.find( l_vAtoms[i].ToStr() ) != std::string::npos );
+    assert( l_Grounding.SatisfiesGoals( l_vState ) == l_pNext->IsConsistent( l_pProblem->GetCGoals() ) );
+
+    delete l_pOwned;
+    l_pOwned = l_pNext;
+    l_pState = l_pNext;
+  }
+  assert( l_Grounding.SatisfiesGoals( l_vState ) );
+  delete l_pOwned;
+}
+
+void TestSlotSubstitution()
+{
+  std::vector< TermVariableP > l_vVars;
+  l_vVars.push_back( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( "?s1" ) ) );
+  l_vVars.push_back( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( "?s2" ) ) );
+  l_vVars.push_back( std::tr1::dynamic_pointer_cast< TermVariable >( g_TermTable.Lookup( "?s3" ) ) );
+  TermP l_pConst1 = g_TermTable.Lookup( "asdf" );
+  TermP l_pConst2 = g_TermTable.Lookup( "qwer" );
+
+  // Loaded bindings are not part of the result.
+  Substitution l_Base;
+  l_Base.AddPair( l_vVars[0], l_pConst1 );
+  SlotSubstitution l_Slots( l_vVars );
+  assert( l_Slots.Load( l_Base ) );
+  assert( l_Slots.GetId( 0 ) == l_pConst1->GetId() );
+  assert( l_Slots.GetId( 1 ) == TERM_NO_ID );
+
+  std::set< TermVariableP > l_vWatched;
+  l_vWatched.insert( l_vVars[1] );
+  l_vWatched.insert( l_vVars[2] );
+  l_Slots.Watch( l_vWatched );
+  assert( l_Slots.GetNumUnboundWatched() == 2 );
+
+  unsigned int l_iCheckpoint = l_Slots.Checkpoint();
+  l_Slots.Bind( 1, l_pConst2->GetId() );
+  l_Slots.Bind( 2, l_pConst1->GetId() );
+  assert( l_Slots.GetNumUnboundWatched() == 0 );
+  Substitution * l_pResult = l_Slots.ToSubstitution( l_Base );
+  assert( l_pResult->GetNumPairs() == 3 );
+  assert( l_pResult->FindIndexByVar( l_vVars[1] )->second == l_pConst2 );
+  delete l_pResult;
+
+  // Rolling back unbinds exactly what was bound since the checkpoint.
+  l_Slots.Rollback( l_iCheckpoint );
+  assert( l_Slots.GetId( 0 ) == l_pConst1->GetId() );
+  assert( l_Slots.GetId( 1 ) == TERM_NO_ID );
+  assert( l_Slots.GetId( 2 ) == TERM_NO_ID );
+  assert( l_Slots.GetNumUnboundWatched() == 2 );
+  l_pResult = l_Slots.ToSubstitution( l_Base );
+  assert( l_pResult->Equal( l_Base ) );
+  delete l_pResult;
+
+  // A binding to a variable cannot be loaded.
+  Substitution l_ToVar;
+  l_ToVar.AddPair( l_vVars[2], l_vVars[1] );
+  SlotSubstitution l_Other( l_vVars );
+  assert( !l_Other.Load( l_ToVar ) );
+}
+
+void TestPddlTokenizer()
+{
+  std::string l_sInput = "( define ; a comment (\n\t(Domain d-1)(:types a b))";
+  l_sInput += (char)EOF;
+
+  PddlTokenizer l_Tokens( l_sInput );
+  assert( l_Tokens.PeekOpen() );
+  l_Tokens.Eat( "(" );
+  PddlToken l_Token = l_Tokens.Next();
+  assert( l_Token.m_iType == PT_ATOM );
+  assert( l_Token.ToStr() == "define" );
+  assert( l_Token.m_iOffset == 2 );
+
+  // Names are matched without regard to case.
+  size_t l_iStart = l_Tokens.GetOffset();
+  l_Tokens.Eat( "(" );
+  l_Tokens.Eat( "domain" );
+  assert( l_Tokens.ReadAtom() == "d-1" );
+  l_Tokens.Eat( ")" );
+
+  // A mismatch is reported, along with its offset.
+  bool l_bThrown = false;
+  try
+  {
+    l_Tokens.Eat( ")" );
+  }
+  catch( MissingStringException & e )
+  {
+    l_bThrown = true;
+    assert( e.GetMessage().find( "at byte 36" ) != std::string::npos );
+  }
+  assert( l_bThrown );
+
+  // The parenthetical matches the one read from a stream.
+  l_Tokens.SetOffset( l_iStart );
+  std::string l_sPhrase = l_Tokens.ReadParenthetical();
+  std::stringstream l_sStream( l_sInput.substr( l_iStart ) );
+  assert( l_sPhrase == ReadParenthetical( l_sStream ) );
+  assert( l_Tokens.ReadParenthetical() == "( :types a b )" );
+  l_Tokens.Eat( ")" );
+
+  // The EOF character appended by ReadFile() is not a token.
+  assert( l_Tokens.Next().m_iType == PT_END );
+  assert( l_Tokens.Next().m_iType == PT_END );
+
+  // A mapped file holds the same bytes that ReadFile() returns.
+  char l_sFileName[] = "/tmp/htn_tokenizer_XXXXXX";
+  int l_iFile = mkstemp( l_sFileName );
+  assert( l_iFile >= 0 );
+  close( l_iFile );
+  std::ofstream l_Out( l_sFileName );
+  l_Out << l_sInput.substr( 0, l_sInput.size() - 1 );
+  l_Out.close();
+  {
+    MappedFile l_File( l_sFileName );
+    assert( std::string( l_File.GetData(), l_File.GetSize() ) + (char)EOF == ReadFile( l_sFileName ) );
+  }
+  unlink( l_sFileName );
+}
+
+void TestCompiledDomain()
+{
+  std::string l_sInput = "( define ( domain compiled ) "
+    "( :requirements :strips :typing :equality :htn :method-ids ) "
+    "( :types place truck ) "
+    "( :constants depot - place ) "
+    "( :predicates ( at ?t - truck ?p - place ) ( busy ?t - truck ) ) "
+    "( :action !drive :parameters ( ?t - truck ?a - place ?b - place ) "
+    ":precondition ( and ( at ?t ?a ) ( not ( = ?a ?b ) ) ) "
+    ":effect ( and ( not ( at ?t ?a ) ) ( at ?t ?b ) ) ) "
+    "( :method go-home :id ( m1 ) :parameters ( ?t - truck ?a - place ?b - place ) "
+    ":precondition ( and ( at ?t ?a ) ( not ( busy ?t ) ) ) "
+    ":subtasks ( ( !drive ?t ?a ?b ) ) ) "
+    "( :method go-home :id ( m2 ) :parameters ( ?t - truck ) "
+    ":precondition ( and ( busy ?t ) ) "
+    ":subtasks ( ) ) )";
+
+  PddlTokenizer l_Tokens( l_sInput );
+  std::tr1::shared_ptr< HtnDomain > l_pDomain( HtnDomain::FromPddl( l_Tokens ) );
+  l_pDomain->UpdateMethodQValue( 1, 3.5 );
+  std::string l_sCompiled = l_pDomain->ToCompiled();
+  assert( IsCompiledDomain( l_sCompiled.data(), l_sCompiled.size() ) );
+  assert( !IsCompiledDomain( l_sInput.data(), l_sInput.size() ) );
+
+  // The loaded domain is the same as the original, down to its relations.
+  std::tr1::shared_ptr< HtnDomain > l_pLoaded( HtnDomain::FromCompiled( l_sCompiled.data(), l_sCompiled.size() ) );
+  assert( l_pLoaded->Equivalent( l_pDomain.get() ) );
+  assert( l_pLoaded->ToPddl() == l_pDomain->ToPddl() );
+  assert( l_pLoaded->GetCMethod( 1 )->GetId() == "m2" );
+  assert( l_pLoaded->GetCMethod( 1 )->GetQValue() == l_pDomain->GetCMethod( 1 )->GetQValue() );
+  assert( l_pLoaded->GetCMethod( 1 )->GetQCount() == 1 );
+  assert( l_pLoaded->GetMethodsForTask( "go-home" ).size() == 2 );
+  assert( l_pLoaded->GetCOperator( 0 )->GetCHead()->GetRelationIndex() == l_pDomain->GetCOperator( 0 )->GetCHead()->GetRelationIndex() );
+  assert( l_pLoaded->GetCMethod( 0 )->GetCSubtask( 0 )->GetCParam( 2 ) == l_pDomain->GetCMethod( 0 )->GetCSubtask( 0 )->GetCParam( 2 ) );
+
+  // A truncated file is rejected rather than misread.
+  bool l_bThrown = false;
+  try
+  {
+    delete HtnDomain::FromCompiled( l_sCompiled.data(), l_sCompiled.size() - 4 );
+  }
+  catch( UnexpectedStringException & e )
+  {
+    l_bThrown = true;
+  }
+  assert( l_bThrown );
+
+  // Even when it ends inside the padding that follows a string.
+  size_t l_iPos = sizeof( COMPILED_DOMAIN_MAGIC ) + 2 * sizeof( uint32_t );
+  uint32_t l_iNumStrings;
+  memcpy( &l_iNumStrings, l_sCompiled.data() + l_iPos, sizeof( uint32_t ) );
+  l_iPos += sizeof( uint32_t );
+  size_t l_iCut = 0;
+  for( uint32_t i = 0; i < l_iNumStrings && l_iCut == 0; i++ )
+  {
+    uint32_t l_iLength;
+    memcpy( &l_iLength, l_sCompiled.data() + l_iPos, sizeof( uint32_t ) );
+    l_iPos += sizeof( uint32_t );
+    if( l_iLength % 4 != 0 )
+      l_iCut = l_iPos + l_iLength;
+    l_iPos += ( ( l_iLength + 3 ) / 4 ) * 4;
+  }
+  assert( l_iCut != 0 );
+  l_bThrown = false;
+  try
+  {
+    delete HtnDomain::FromCompiled( l_sCompiled.data(), l_iCut );
+  }
+  catch( UnexpectedStringException & e )
+  {
+    l_bThrown = true;
+    assert( e.GetMessage().find( "truncated" ) != std::string::npos );
+  }
+  assert( l_bThrown );
+
+  // So is one written in another version of the format.
+  std::string l_sOther = l_sCompiled;
+  l_sOther[sizeof( COMPILED_DOMAIN_MAGIC )]++;
+  l_bThrown = false;
+  try
+  {
+    delete HtnDomain::FromCompiled( l_sOther.data(), l_sOther.size() );
+  }
+  catch( UnexpectedStringException & e )
+  {
+    l_bThrown = true;
+    assert( e.GetMessage().find( "version" ) != std::string::npos );
+  }
+  assert( l_bThrown );
+}
+
+void TestFailureCache()
+{
+  State * l_pInitState = new State( g_sInitStateStr, 0, TypeTable(), std::vector< FormulaPred >() );
+  std::stringstream l_sOpStream( "(:action !FLY-AIRPLANE :parameters (?airplane ?loc-from ?loc-to) :precondition (and (AIRPLANE ?airplane) (AIRPORT ?loc-from) (AIRPORT ?loc-to) (at ?airplane ?loc-from)) :effect (and (not (at ?airplane ?loc-from)) (at ?airplane ?loc-to)))" );
+  Operator * l_pOp = Operator::FromPddl( l_sOpStream, std::set< std::string, StrLessNoCase >(), std::vector< FormulaPred >() );
+
+  Substitution l_Subs;
+  std::vector<Substitution *> * l_pSubs = l_pInitState->GetInstantiations( l_pOp, &l_Subs );
+  State * l_pOption1 = l_pInitState->NextState( l_pOp, (*l_pSubs)[0] );
+  State * l_pOption2 = l_pInitState->NextState( l_pOp, (*l_pSubs)[1] );
+
+  // The hash of a state does not depend on how it was reached.
+  std::vector< GroundAtom > l_vAtoms = l_pOption2->GetAtoms();
+  std::reverse( l_vAtoms.begin(), l_vAtoms.end() );
+  State l_Rebuilt( l_vAtoms, 0 );
+  assert( l_Rebuilt == *l_pOption2 );
+  assert( l_Rebuilt.GetHash() == l_pOption2->GetHash() );
+  assert( l_Rebuilt.GetCheckHash() == l_pOption2->GetCheckHash() );
+  assert( State( *l_pOption1 ).GetHash() == l_pOption1->GetHash() );
+  assert( l_pOption1->GetHash() != l_pOption2->GetHash() );
+  assert( l_pOption1->GetCheckHash() != l_pOption2->GetCheckHash() );
+
+  // Flying back undoes the change to the hash.
+  std::vector<Substitution *> * l_pBackSubs = l_pOption2->GetInstantiations( l_pOp, &l_Subs );
+  unsigned int l_iNumBack = 0;
+  for( unsigned int i = 0; i < l_pBackSubs->size(); i++ )
+  {
+    State * l_pBack = l_pOption2->NextState( l_pOp, (*l_pBackSubs)[i] );
+    if( *l_pBack == *l_pInitState )
+    {
+      assert( l_pBack->GetHash() == l_pInitState->GetHash() );
+      assert( l_pBack->GetCheckHash() == l_pInitState->GetCheckHash() );
+      l_iNumBack++;
+    }
+    delete l_pBack;
+    delete (*l_pBackSubs)[i];
+  }
+  delete l_pBackSubs;
+  assert( l_iNumBack == 1 );
+
+  FailureCache l_Lru( 2, FE_LRU );
+  l_Lru.AddFailure( 1, 101, 5 );
+  l_Lru.AddFailure( 2, 102, 5 );
+  assert( l_Lru.IsFailure( 1, 101, 5 ) );
+  assert( l_Lru.IsFailure( 1, 101, 7 ) );
+  // A search that starts shallower has more room, so it might succeed.
+  assert( !l_Lru.IsFailure( 1, 101, 4 ) );
+  assert( !l_Lru.IsFailure( 3, 103, 5 ) );
+  assert( l_Lru.GetNumHits() == 2 && l_Lru.GetNumMisses() == 2 );
+
+  // 1 was used more recently than 2, so 2 goes.
+  l_Lru.AddFailure( 3, 103, 5 );
+  assert( l_Lru.GetSize() == 2 && l_Lru.GetNumEvictions() == 1 );
+  assert( l_Lru.IsFailure( 1, 101, 5 ) );
+  assert( !l_Lru.IsFailure( 2, 102, 5 ) );
+  assert( l_Lru.IsFailure( 3, 103, 5 ) );
+
+  // A shallower failure replaces a deeper one.
+  l_Lru.AddFailure( 3, 103, 2 );
+  assert( l_Lru.GetSize() == 2 );
+  assert( l_Lru.IsFailure( 3, 103, 2 ) );
+
+  // Another node with the same key is not taken for the one that failed.
+  assert( !l_Lru.IsFailure( 3, 999, 5 ) );
+  assert( l_Lru.GetNumCollisions() == 1 );
+  l_Lru.AddFailure( 3, 999, 5 );
+  assert( l_Lru.GetNumCollisions() == 2 && l_Lru.GetSize() == 2 );
+  assert( !l_Lru.IsFailure( 3, 103, 5 ) );
+  assert( l_Lru.IsFailure( 3, 999, 5 ) );
+
+  // With FIFO, being found does not save an entry from eviction.
+  FailureCache l_Fifo( 2, FE_FIFO );
+  l_Fifo.AddFailure( 1, 101, 5 );
+  l_Fifo.AddFailure( 2, 102, 5 );
+  assert( l_Fifo.IsFailure( 1, 101, 5 ) );
+  l_Fifo.AddFailure( 3, 103, 5 );
+  assert( !l_Fifo.IsFailure( 1, 101, 5 ) );
+  assert( l_Fifo.IsFailure( 2, 102, 5 ) );
+
+  FailureCache l_None( 0, FE_LRU );
+  l_None.AddFailure( 1, 101, 5 );
+  assert( l_None.GetSize() == 0 );
+  assert( !l_None.IsFailure( 1, 101, 5 ) );
+
+  delete l_pOption2;
+  delete l_pOption1;
+  for( unsigned int i = 0; i < l_pSubs->size(); i++ )
+    delete (*l_pSubs)[i];
+  delete l_pSubs;
+  delete l_pOp;
+  delete l_pInitState;
+}
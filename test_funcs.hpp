@@ -26,5 +26,10 @@ void TestHtnSolution();
 void TestStringTable();
 void TestSubtasksAreLinked();
 void TestTyping();
+void TestGrounding();
+void TestSlotSubstitution();
+void TestPddlTokenizer();
+void TestCompiledDomain();
+void TestFailureCache();
 
 #endif//TEST_FUNCS_HPP__
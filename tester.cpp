@@ -23,10 +23,14 @@
 #include "formula_neg.hpp"
 #include "formula_conj.hpp"
 #include "operator.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+#include "slot_substitution.hpp"
 #include "state.hpp"
 #include "strips_domain.hpp"
 #include "strips_problem.hpp"
 #include "strips_solution.hpp"
+#include "strips_grounding.hpp"
 #include "htn_task_head.hpp"
 #include "htn_task_descr.hpp"
 #include "htn_method.hpp"
@@ -72,6 +76,11 @@ int main( int argc, char * argv[] )
     std::cout << "\n\t23\tString Table";
     std::cout << "\n\t24\tSubtasksAreLinked";
     std::cout << "\n\t25\tTyping";
+    std::cout << "\n\t26\tGrounding";
+    std::cout << "\n\t27\tSlot Substitution";
+    std::cout << "\n\t28\tPddl Tokenizer";
+    std::cout << "\n\t29\tCompiled Domain";
+    std::cout << "\n\t30\tFailure Cache";
     std::cout << "\n\n";
     return 0;
   }
@@ -158,6 +167,21 @@ int main( int argc, char * argv[] )
     case 25:
       TestTyping();
       break;
+    case 26:
+      TestGrounding();
+      break;
+    case 27:
+      TestSlotSubstitution();
+      break;
+    case 28:
+      TestPddlTokenizer();
+      break;
+    case 29:
+      TestCompiledDomain();
+      break;
+    case 30:
+      TestFailureCache();
+      break;
     default:
       std::cout << "\n\t Test " << argv[i] << " unknown.";
       break;
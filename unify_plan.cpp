@@ -0,0 +1,224 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <set>
+#include <tr1/memory>
+
+#include "exception.hpp"
+#include "funcs.hpp"
+#include "term.hpp"
+#include "term_string.hpp"
+#include "term_variable.hpp"
+#include "term_constant.hpp"
+#include "type_table.hpp"
+#include "substitution.hpp"
+#include "formula.hpp"
+#include "formula_pred.hpp"
+#include "formula_equ.hpp"
+#include "formula_neg.hpp"
+#include "formula_conj.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
+
+/** \file unify_plan.hpp
+ *  Declaration of the UnifyPlan class.
+ */
+
+/** \file unify_plan.cpp
+ *  Definition of the UnifyPlan class.
+ */
+
+/** \class UnifyLiteral
+ *  One conjunct of a precondition, as compiled into a UnifyPlan.
+ *  Each parameter is either the id of a constant in the global TermTable or
+ *   the index of a variable slot in the plan.
+ */
+
+/** \var UnifyLiteral::m_iType
+ *  The type of the conjunct: FT_PRED, FT_EQU, or FT_NEG.
+ */
+
+/** \var UnifyLiteral::m_iNegType
+ *  If this is a negation, the type of the negated formula: FT_PRED or FT_EQU.
+ */
+
+/** \var UnifyLiteral::m_iRelation
+ *  If this is a predicate or a negated predicate, the index of its relation in
+ *   the global StringTable.
+ */
+
+/** \var UnifyLiteral::m_iValence
+ *  The number of parameters, which is 2 for an equality.
+ */
+
+/** \var UnifyLiteral::m_aArgs
+ *  For each parameter, the id of the constant or the index of the slot.
+ */
+
+/** \var UnifyLiteral::m_aIsVar
+ *  For each parameter, whether it is a variable slot rather than a constant.
+ */
+
+/** \class UnifyPlan
+ *  The preconditions of an Operator or HtnMethod, compiled once so that
+ *   State::GetInstantiations() can match them against the atoms of a State
+ *   without building a new Formula at every step.
+ *  The variables of the preconditions are numbered densely, so that a partial
+ *   binding is simply an array of constant ids indexed by slot.
+ *  The order in which the literals are matched is still chosen at each step
+ *   from the number of atoms that could match them, exactly as
+ *   State::GetInstantiations() does for an uncompiled conjunction, so that
+ *   the two produce the same Substitutions in the same order.
+ */
+
+/** \var UnifyPlan::m_pPrecs
+ *  A smart pointer to the conjunction that was compiled.
+ */
+
+/** \var UnifyPlan::m_bCompiled
+ *  Whether or not every conjunct could be compiled.
+ *  If not, State::GetInstantiations() falls back to matching m_pPrecs
+ *   directly.
+ */
+
+/** \var UnifyPlan::m_vLiterals
+ *  The compiled conjuncts, in the same order as in the conjunction.
+ */
+
+/** \var UnifyPlan::m_vVars
+ *  The variable in each slot, in order of first appearance.
+ */
+
+/**
+ *  Compile a conjunction of preconditions.
+ *  \param p_pPrecs IN A smart pointer to the conjunction.
+ */
+UnifyPlan::UnifyPlan( const FormulaConjP & p_pPrecs )
+  : m_pPrecs( p_pPrecs ),
+    m_bCompiled( true )
+{
+  for( FormulaPVecCI i = m_pPrecs->GetBeginConj();
+       i != m_pPrecs->GetEndConj() && m_bCompiled;
+       i++ )
+  {
+    UnifyLiteral l_Literal;
+    m_bCompiled = CompileLiteral( *i, l_Literal );
+    m_vLiterals.push_back( l_Literal );
+  }
+
+  if( !m_bCompiled )
+  {
+    m_vLiterals.clear();
+    m_vVars.clear();
+  }
+}
+
+/**
+ *  Destruct a UnifyPlan.
+ */
+UnifyPlan::~UnifyPlan()
+{
+}
+
+/**
+ *  Compile one conjunct.
+ *  \param p_pForm IN A smart pointer to the conjunct.
+ *  \param p_Literal OUT The compiled literal.
+ *  \return Whether or not the conjunct could be compiled.  Only predicates
+ *   with at most GROUND_ATOM_MAX_ARGS parameters, equalities, and negations
+ *   of those can be.
+ */
+bool UnifyPlan::CompileLiteral( const FormulaP & p_pForm,
+				UnifyLiteral & p_Literal )
+{
+  p_Literal.m_iType = p_pForm->GetType();
+  p_Literal.m_iNegType = p_Literal.m_iType;
+  p_Literal.m_iRelation = 0;
+  p_Literal.m_iValence = 0;
+
+  FormulaP l_pForm = p_pForm;
+  if( p_Literal.m_iType == FT_NEG )
+  {
+    l_pForm = std::tr1::dynamic_pointer_cast< FormulaNeg >( p_pForm )->GetCNegForm();
+    p_Literal.m_iNegType = l_pForm->GetType();
+  }
+
+  std::vector< TermP > l_vParams;
+  switch( l_pForm->GetType() )
+  {
+  case FT_PRED:
+  {
+    FormulaPredP l_pPred = std::tr1::dynamic_pointer_cast< FormulaPred >( l_pForm );
+    if( l_pPred->GetValence() > GROUND_ATOM_MAX_ARGS )
+      return false;
+    p_Literal.m_iRelation = l_pPred->GetRelationIndex();
+    for( unsigned int i = 0; i < l_pPred->GetValence(); i++ )
+      l_vParams.push_back( l_pPred->GetCParam( i ) );
+    break;
+  }
+  case FT_EQU:
+  {
+    FormulaEquP l_pEqu = std::tr1::dynamic_pointer_cast< FormulaEqu >( l_pForm );
+    l_vParams.push_back( l_pEqu->GetCFirst() );
+    l_vParams.push_back( l_pEqu->GetCSecond() );
+    break;
+  }
+  default:
+    return false;
+  }
+
+  p_Literal.m_iValence = l_vParams.size();
+  for( unsigned int i = 0; i < l_vParams.size(); i++ )
+  {
+    p_Literal.m_aIsVar[i] = ( l_vParams[i]->GetType() == TT_VARIABLE );
+    if( p_Literal.m_aIsVar[i] )
+      p_Literal.m_aArgs[i] = GetSlot( std::tr1::dynamic_pointer_cast< TermVariable >( l_vParams[i] ) );
+    else
+      p_Literal.m_aArgs[i] = l_vParams[i]->GetId();
+  }
+  return true;
+}
+
+/**
+ *  Retrieve the slot of a variable, giving it the next slot if it has none.
+ *  \param p_pVar IN A smart pointer to the variable.
+ *  \return The index of its slot.
+ */
+unsigned int UnifyPlan::GetSlot( const TermVariableP & p_pVar )
+{
+  for( unsigned int i = 0; i < m_vVars.size(); i++ )
+  {
+    if( m_vVars[i] == p_pVar )
+      return i;
+  }
+  m_vVars.push_back( p_pVar );
+  return m_vVars.size() - 1;
+}
+
+/**
+ *  Retrieve a smart pointer to the conjunction that was compiled.
+ *  \return A smart pointer to the conjunction that was compiled.
+ */
+FormulaConjP UnifyPlan::GetCPreconditions() const
+{
+  return m_pPrecs;
+}
+
+/**
+ *  Determine whether or not every conjunct could be compiled.
+ *  \return Whether or not every conjunct could be compiled.
+ */
+bool UnifyPlan::IsCompiled() const
+{
+  return m_bCompiled;
+}
+
+size_t UnifyPlan::GetMemSizeMin() const
+{
+  return sizeof( UnifyPlan ) + m_vLiterals.capacity() * sizeof( UnifyLiteral ) + m_vVars.capacity() * sizeof( TermVariableP );
+}
+
+size_t UnifyPlan::GetMemSizeMax() const
+{
+  return GetMemSizeMin();
+}
@@ -0,0 +1,90 @@
+#ifndef UNIFY_PLAN_HPP__
+#define UNIFY_PLAN_HPP__
+
+struct UnifyLiteral
+{
+  FormulaType m_iType;
+  FormulaType m_iNegType;
+  unsigned int m_iRelation;
+  unsigned int m_iValence;
+  unsigned int m_aArgs[GROUND_ATOM_MAX_ARGS];
+  bool m_aIsVar[GROUND_ATOM_MAX_ARGS];
+};
+
+class UnifyPlan
+{
+public:
+  UnifyPlan( const FormulaConjP & p_pPrecs );
+  virtual ~UnifyPlan();
+
+  FormulaConjP GetCPreconditions() const;
+
+  bool IsCompiled() const;
+
+  /**
+   *  Retrieve the number of literals in this plan.
+   *  \return The number of literals in this plan.
+   */
+  unsigned int GetNumLiterals() const
+  {
+    return m_vLiterals.size();
+  }
+
+  /**
+   *  Retrieve one of the literals in this plan.
+   *  \param p_iIndex IN The index of the literal, which is also the index of
+   *   its conjunct in the preconditions.
+   *  \return A reference to the literal, which has the same lifetime as this
+   *   plan.
+   */
+  const UnifyLiteral & GetCLiteral( unsigned int p_iIndex ) const
+  {
+    return m_vLiterals[p_iIndex];
+  }
+
+  /**
+   *  Retrieve the number of variable slots in this plan.
+   *  \return The number of distinct variables in the preconditions.
+   */
+  unsigned int GetNumVars() const
+  {
+    return m_vVars.size();
+  }
+
+  /**
+   *  Retrieve the variable in one slot of this plan.
+   *  \param p_iSlot IN The index of the slot.
+   *  \return A smart pointer to the variable in that slot.
+   */
+  const TermVariableP & GetCVar( unsigned int p_iSlot ) const
+  {
+    return m_vVars[p_iSlot];
+  }
+
+  /**
+   *  Retrieve the variables of this plan.
+   *  \return The variable in each slot, with the same lifetime as this plan.
+   */
+  const std::vector< TermVariableP > & GetCVars() const
+  {
+    return m_vVars;
+  }
+
+  size_t GetMemSizeMin() const;
+  size_t GetMemSizeMax() const;
+
+private:
+  UnifyPlan( const UnifyPlan & p_Other );
+  UnifyPlan & operator=( const UnifyPlan & p_Other );
+
+  bool CompileLiteral( const FormulaP & p_pForm,
+		       UnifyLiteral & p_Literal );
+  unsigned int GetSlot( const TermVariableP & p_pVar );
+
+  FormulaConjP m_pPrecs;
+  bool m_bCompiled;
+  std::vector< UnifyLiteral > m_vLiterals;
+  std::vector< TermVariableP > m_vVars;
+};
+
+#endif//UNIFY_PLAN_HPP__
@@ -23,21 +23,158 @@
 #include "formula_conj.hpp"
 #include "operator.hpp"
 #include "strips_domain.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_problem.hpp"
 #include "strips_solution.hpp"
+#include "strips_grounding.hpp"
 
 
+void PrintGroundedAction( const StripsGrounding & p_Grounding,
+			  std::tr1::shared_ptr< StripsDomain > p_pDomain,
+			  unsigned int p_iAction )
+{
+  const Operator * l_pOp = p_pDomain->GetCOper( p_Grounding.GetOperIndex( p_iAction ) );
+  std::cout << "( " << l_pOp->GetName();
+  for( unsigned int j = 0; j < l_pOp->GetNumParams(); j++ )
+    std::cout << " " << l_pOp->GetCParam( j )->AfterSubstitution( *p_Grounding.GetCSubstitution( p_iAction ), 0 )->ToStr();
+}
+
+int GroundedSearch( std::tr1::shared_ptr< StripsProblem > p_pProblem,
+		    int p_iLogLevel )
+{
+  StripsGrounding l_Grounding( p_pProblem );
+  std::tr1::shared_ptr< StripsDomain > l_pDomain = p_pProblem->GetCDomain();
+
+  // Every node ever queued, with the node it extends and the action that
+  //  extends it.  The queue is the nodes from l_iCursor on.
+  std::vector< AtomBits > l_vStates;
+  std::vector< int > l_vParents;
+  std::vector< unsigned int > l_vActions;
+  std::vector< unsigned int > l_vDepths;
+  l_vStates.push_back( l_Grounding.GetInitState() );
+  l_vParents.push_back( -1 );
+  l_vActions.push_back( 0 );
+  l_vDepths.push_back( 0 );
+
+  unsigned int l_iCurDepth = 0;
+  unsigned int l_iCount = 0;
+  std::vector< unsigned int > l_vApplicable;
+  AtomBits l_vNext;
+
+  for( unsigned int l_iCursor = 0; l_iCursor < l_vStates.size(); l_iCursor++ )
+  {
+    if( l_vDepths[l_iCursor] > l_iCurDepth && p_iLogLevel >= 1 )
+    {
+      std::cout << "\nProcessed "
+		<< "all extensions of "
+		<< l_iCount
+		<< " "
+		<< l_iCurDepth
+		<< "-length plans without success ...";
+      std::cout.flush();
+      assert( l_vDepths[l_iCursor] == l_iCurDepth + 1 );
+      l_iCurDepth++;
+      l_iCount = 0;
+    }
+
+    l_iCount++;
+
+    l_vApplicable.clear();
+    l_Grounding.GetApplicable( l_vStates[l_iCursor], l_vApplicable );
+
+    for( unsigned int i = 0; i < l_vApplicable.size(); i++ )
+    {
+      l_Grounding.Apply( l_vApplicable[i], l_vStates[l_iCursor], l_vNext );
+
+      bool l_bIsRepeat = false;
+      for( int j = l_iCursor; j >= 0 && !l_bIsRepeat; j = l_vParents[j] )
+	l_bIsRepeat = ( l_vNext == l_vStates[j] );
+
+      bool l_bIsGoal = l_Grounding.SatisfiesGoals( l_vNext );
+      std::vector< unsigned int > l_vPlan;
+      if( l_bIsGoal || p_iLogLevel >= 2 )
+      {
+	l_vPlan.push_back( l_vApplicable[i] );
+	for( int j = l_iCursor; l_vParents[j] >= 0; j = l_vParents[j] )
+	  l_vPlan.insert( l_vPlan.begin(), l_vActions[j] );
+      }
+
+      if( p_iLogLevel >= 2 )
+      {
+	std::cout << "\n\n*************************************\n";
+	std::cout << "Extending the following partial plan:\n\n";
+	std::cout << "Initial State:\n";
+	std::cout << l_Grounding.StateToStr( l_Grounding.GetInitState() );
+
+	AtomBits l_vState = l_Grounding.GetInitState();
+	for( unsigned int k = 0; k + 1 < l_vPlan.size(); k++ )
+	{
+	  std::cout << "\nAction " << k << ":\t";
+	  PrintGroundedAction( l_Grounding, l_pDomain, l_vPlan[k] );
+	  std::cout << " )\n";
+
+	  l_Grounding.Apply( l_vPlan[k], l_vState, l_vState );
+	  std::cout << "\nState " << k << "\n";
+	  std::cout << l_Grounding.StateToStr( l_vState );
+	  std::cout << "\n";
+	}
+
+	std::cout << "\nNew Action:\t";
+	PrintGroundedAction( l_Grounding, l_pDomain, l_vApplicable[i] );
+	std::cout << " )\n";
+
+	std::cout << "\nResulting State:\n";
+	std::cout << l_Grounding.StateToStr( l_vNext );
+	std::cout << "\n";
+
+	if( l_bIsRepeat )
+	{
+	  std::cout << "\nThis branch loops and thus will be terminated.\n";
+	}
+      }
+
+      if( l_bIsGoal )
+      {
+	std::cout << "\nPlan found!\n\n";
+
+	for( unsigned int j = 0; j < l_vPlan.size(); j++ )
+	{
+	  std::cout << "\t";
+	  PrintGroundedAction( l_Grounding, l_pDomain, l_vPlan[j] );
+	  std::cout << " )\n";
+	}
+	return 0;
+      }
+
+      if( !l_bIsRepeat )
+      {
+	l_vStates.push_back( l_vNext );
+	l_vParents.push_back( l_iCursor );
+	l_vActions.push_back( l_vApplicable[i] );
+	l_vDepths.push_back( l_vDepths[l_iCursor] + 1 );
+      }
+    }
+  }
+
+  std::cout << "\nNo plans found.\n";
+
+  return 0;
+}
+
 int main( int argc, char * argv[] )
 {
-  if( argc != 4 || atoi( argv[3] ) < 0 || atoi( argv[3] ) > 2  )
+  if( argc < 4 || argc > 5 || atoi( argv[3] ) < 0 || atoi( argv[3] ) > 2 ||
+      ( argc == 5 && std::string( argv[4] ) != "-g" ) )
   {
     std::cerr << "\nUsage: \n";
-    std::cerr << "vanilla_ice <domain-file> <problem-file> <log-level>\n";
+    std::cerr << "vanilla_ice <domain-file> <problem-file> <log-level> [-g]\n";
     std::cerr << "Valid log levels:\n";
     std::cerr << "\t0 Only print plan\n";
     std::cerr << "\t1 Print number of nodes at each depth\n";
     std::cerr << "\t2 Print each state and action\n";
+    std::cerr << "-g grounds the problem first and searches over bitset states\n";
     return 1;
   }
 
@@ -75,6 +212,8 @@ int main( int argc, char * argv[] )
     return 0;
   }
 
+  if( argc == 5 )
+    return GroundedSearch( l_pProblem, l_iLogLevel );
 
   std::vector< StripsSolution * > l_vQueue;
   l_vQueue.push_back( new StripsSolution( l_pProblem ) );
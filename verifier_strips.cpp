@@ -23,17 +23,22 @@
 #include "formula_conj.hpp"
 #include "operator.hpp"
 #include "strips_domain.hpp"
+#include "ground_atom.hpp"
+#include "unify_plan.hpp"
 #include "state.hpp"
 #include "strips_problem.hpp"
 #include "strips_solution.hpp"
+#include "strips_grounding.hpp"
 
 
 int main( int argc, char * argv[] )
 {
-  if( argc != 4 || atoi( argv[3] ) < 0 || atoi( argv[3] ) > 2  )
+  if( argc < 4 || argc > 5 || atoi( argv[3] ) < 0 || atoi( argv[3] ) > 2 ||
+      ( argc == 5 && std::string( argv[4] ) != "-g" ) )
   {
     std::cerr << "\nUsage: \n";
-    std::cerr << "verifier_strips <domain-file> <problem-file> <solution-file>\n";
+    std::cerr << "verifier_strips <domain-file> <problem-file> <solution-file> [-g]\n";
+    std::cerr << "-g grounds the problem first and checks over bitset states\n";
     return 1;
   }
 
@@ -74,6 +79,35 @@ int main( int argc, char * argv[] )
       throw e;
     }
 
+    if( argc == 5 )
+    {
+      StripsGrounding l_Grounding( l_pProblem );
+      AtomBits l_vCurState = l_Grounding.GetInitState();
+      for( unsigned int i = 0; i < l_pSolution->GetPlanLength(); i++ )
+      {
+	int l_iAction = l_Grounding.FindAction( l_pSolution->GetOperIndex( i ),
+						l_pSolution->GetCSubstitution( i ) );
+	if( l_iAction < 0 || !l_Grounding.IsApplicable( l_iAction, l_vCurState ) )
+	{
+	  std::cout << "FAILURE: Invalid action #" << i << ".\n";
+	  delete l_pSolution;
+	  exit( 2 );
+	}
+	l_Grounding.Apply( l_iAction, l_vCurState, l_vCurState );
+      }
+
+      if( !l_Grounding.SatisfiesGoals( l_vCurState ) )
+      {
+	std::cout << "FAILURE: Does not achieve goals.\n";
+	delete l_pSolution;
+	exit( 3 );
+      }
+
+      std::cout << "SUCCESS\n";
+      delete l_pSolution;
+      return 0;
+    }
+
     State * l_pCurState = new State( *l_pProblem->GetCInitState() );
     for( unsigned int i = 0; i < l_pSolution->GetPlanLength(); i++ )
     {